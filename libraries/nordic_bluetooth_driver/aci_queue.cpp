@@ -27,15 +27,26 @@
 #include "aci_queue.h"
 #include "ble_assert.h"
 
-void aci_queue_init(aci_queue_t *aci_q)
+/* The producer publishes a packet by storing tail after filling its slot, and
+   the consumer frees a slot by storing head after copying it out. Release
+   stores and acquire loads keep the slot accesses on the right side of the
+   index updates. On AVR these are plain byte loads and stores. */
+#define load_index(p_index)           __atomic_load_n((p_index), __ATOMIC_ACQUIRE)
+#define store_index(p_index, value)   __atomic_store_n((p_index), (value), __ATOMIC_RELEASE)
+
+void aci_queue_init(aci_queue_t *aci_q, hal_aci_data_t *p_slots, uint8_t size)
 {
   uint8_t loop;
 
   ble_assert(NULL != aci_q);
+  ble_assert(NULL != p_slots);
+  ble_assert((0 != size) && (0 == (size & (size - 1))) && (size <= 128));
 
+  aci_q->aci_data = p_slots;
+  aci_q->mask = size - 1;
   aci_q->head = 0;
   aci_q->tail = 0;
-  for(loop=0; loop<ACI_QUEUE_SIZE; loop++)
+  for(loop=0; loop<size; loop++)
   {
     aci_q->aci_data[loop].buffer[0] = 0x00;
     aci_q->aci_data[loop].buffer[1] = 0x00;
@@ -47,145 +58,134 @@ bool aci_queue_dequeue(aci_queue_t *aci_q, hal_aci_data_t *p_data)
   ble_assert(NULL != aci_q);
   ble_assert(NULL != p_data);
 
-  if (aci_queue_is_empty(aci_q))
+  const hal_aci_data_t *p_front = aci_queue_front(aci_q);
+
+  if (NULL == p_front)
   {
     return false;
   }
 
-  memcpy((uint8_t *)p_data, (uint8_t *)&(aci_q->aci_data[aci_q->head % ACI_QUEUE_SIZE]), sizeof(hal_aci_data_t));
-  ++aci_q->head;
+  memcpy((uint8_t *)p_data, (uint8_t *)p_front, sizeof(hal_aci_data_t));
 
-  return true;
+  return aci_queue_consume(aci_q);
 }
 
-bool aci_queue_dequeue_from_isr(aci_queue_t *aci_q, hal_aci_data_t *p_data)
+bool aci_queue_enqueue(aci_queue_t *aci_q, hal_aci_data_t *p_data)
 {
   ble_assert(NULL != aci_q);
   ble_assert(NULL != p_data);
 
-  if (aci_queue_is_empty_from_isr(aci_q))
+  hal_aci_data_t *p_slot = aci_queue_back(aci_q);
+
+  /* a corrupt length from the radio must not overrun the slot */
+  const uint8_t length = (p_data->buffer[0] > HAL_ACI_MAX_LENGTH) ? HAL_ACI_MAX_LENGTH : p_data->buffer[0];
+
+  if (NULL == p_slot)
   {
     return false;
   }
 
-  memcpy((uint8_t *)p_data, (uint8_t *)&(aci_q->aci_data[aci_q->head % ACI_QUEUE_SIZE]), sizeof(hal_aci_data_t));
-  ++aci_q->head;
+  p_slot->status_byte = 0;
+  memcpy((uint8_t *)&(p_slot->buffer[0]), (uint8_t *)&p_data->buffer[0], length + 1);
+  p_slot->buffer[0] = length;
 
-  return true;
+  return aci_queue_commit(aci_q);
 }
 
-bool aci_queue_enqueue(aci_queue_t *aci_q, hal_aci_data_t *p_data)
+bool aci_queue_is_empty(aci_queue_t *aci_q)
 {
-  const uint8_t length = p_data->buffer[0];
-
   ble_assert(NULL != aci_q);
-  ble_assert(NULL != p_data);
 
-  if (aci_queue_is_full(aci_q))
-  {
-    return false;
-  }
+  return load_index(&aci_q->head) == load_index(&aci_q->tail);
+}
 
-  aci_q->aci_data[aci_q->tail % ACI_QUEUE_SIZE].status_byte = 0;
-  memcpy((uint8_t *)&(aci_q->aci_data[aci_q->tail % ACI_QUEUE_SIZE].buffer[0]), (uint8_t *)&p_data->buffer[0], length + 1);
-  ++aci_q->tail;
+bool aci_queue_is_full(aci_queue_t *aci_q)
+{
+  ble_assert(NULL != aci_q);
 
-  return true;
+  return aci_queue_count(aci_q) > aci_q->mask;
 }
 
-bool aci_queue_enqueue_from_isr(aci_queue_t *aci_q, hal_aci_data_t *p_data)
+uint8_t aci_queue_count(aci_queue_t *aci_q)
 {
-  const uint8_t length = p_data->buffer[0];
+  ble_assert(NULL != aci_q);
+
+  return (uint8_t)(load_index(&aci_q->tail) - load_index(&aci_q->head));
+}
 
+bool aci_queue_peek(aci_queue_t *aci_q, hal_aci_data_t *p_data)
+{
   ble_assert(NULL != aci_q);
   ble_assert(NULL != p_data);
 
-  if (aci_queue_is_full_from_isr(aci_q))
+  const hal_aci_data_t *p_front = aci_queue_front(aci_q);
+
+  if (NULL == p_front)
   {
     return false;
   }
 
-  aci_q->aci_data[aci_q->tail % ACI_QUEUE_SIZE].status_byte = 0;
-  memcpy((uint8_t *)&(aci_q->aci_data[aci_q->tail % ACI_QUEUE_SIZE].buffer[0]), (uint8_t *)&p_data->buffer[0], length + 1);
-  ++aci_q->tail;
+  memcpy((uint8_t *)p_data, (uint8_t *)p_front, sizeof(hal_aci_data_t));
 
   return true;
 }
 
-bool aci_queue_is_empty(aci_queue_t *aci_q)
+hal_aci_data_t *aci_queue_front(aci_queue_t *aci_q)
 {
-  bool state = false;
-
   ble_assert(NULL != aci_q);
 
-  //Critical section
-  noInterrupts();
-  if (aci_q->head == aci_q->tail)
+  const uint8_t head = aci_q->head;
+
+  if (head == load_index(&aci_q->tail))
   {
-    state = true;
+    return NULL;
   }
-  interrupts();
 
-  return state;
+  return &aci_q->aci_data[head & aci_q->mask];
 }
 
-bool aci_queue_is_empty_from_isr(aci_queue_t *aci_q)
+bool aci_queue_consume(aci_queue_t *aci_q)
 {
   ble_assert(NULL != aci_q);
 
-  return aci_q->head == aci_q->tail;
-}
-
-bool aci_queue_is_full(aci_queue_t *aci_q)
-{
-  bool state;
-
-  ble_assert(NULL != aci_q);
+  const uint8_t head = aci_q->head;
 
-  //This should be done in a critical section
-  noInterrupts();
-  
-  state = (aci_q->tail == aci_q->head + ACI_QUEUE_SIZE);
+  if (head == load_index(&aci_q->tail))
+  {
+    return false;
+  }
 
-  interrupts();
-  //end
+  store_index(&aci_q->head, (uint8_t)(head + 1));
 
-  return state;
+  return true;
 }
 
-bool aci_queue_is_full_from_isr(aci_queue_t *aci_q)
+hal_aci_data_t *aci_queue_back(aci_queue_t *aci_q)
 {
   ble_assert(NULL != aci_q);
 
-  return (aci_q->tail == aci_q->head + ACI_QUEUE_SIZE);
-}
-
-bool aci_queue_peek(aci_queue_t *aci_q, hal_aci_data_t *p_data)
-{
-  ble_assert(NULL != aci_q);
-  ble_assert(NULL != p_data);
+  const uint8_t tail = aci_q->tail;
 
-  if (aci_queue_is_empty(aci_q))
+  if ((uint8_t)(tail - load_index(&aci_q->head)) > aci_q->mask)
   {
-    return false;
+    return NULL;
   }
 
-  memcpy((uint8_t *)p_data, (uint8_t *)&(aci_q->aci_data[aci_q->head % ACI_QUEUE_SIZE]), sizeof(hal_aci_data_t));
-
-  return true;
+  return &aci_q->aci_data[tail & aci_q->mask];
 }
 
-bool aci_queue_peek_from_isr(aci_queue_t *aci_q, hal_aci_data_t *p_data)
+bool aci_queue_commit(aci_queue_t *aci_q)
 {
   ble_assert(NULL != aci_q);
-  ble_assert(NULL != p_data);
 
-  if (aci_queue_is_empty_from_isr(aci_q))
+  const uint8_t tail = aci_q->tail;
+
+  if ((uint8_t)(tail - load_index(&aci_q->head)) > aci_q->mask)
   {
     return false;
   }
 
-  memcpy((uint8_t *)p_data, (uint8_t *)&(aci_q->aci_data[aci_q->head % ACI_QUEUE_SIZE]), sizeof(hal_aci_data_t));
+  store_index(&aci_q->tail, (uint8_t)(tail + 1));
 
   return true;
 }
\ No newline at end of file
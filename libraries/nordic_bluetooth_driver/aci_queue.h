@@ -38,8 +38,31 @@
 /***********************************************************************    */
 /* The ACI_QUEUE_SIZE determines the memory usage of the system.            */
 /* Successfully tested to a ACI_QUEUE_SIZE of 4 (interrupt) and 4 (polling) */
+/* It must be a power of two, no larger than 128.                           */
 /***********************************************************************    */
+#ifndef ACI_QUEUE_SIZE
 #define ACI_QUEUE_SIZE  4
+#endif
+
+/* The command (TX) and event (RX) queues default to ACI_QUEUE_SIZE and may */
+/* be sized apart, at 33 bytes of RAM per slot. A deeper event queue lets   */
+/* bursts of received data wait while the main loop is busy, rather than    */
+/* holding off the nRF8001. Same rules as ACI_QUEUE_SIZE.                   */
+#ifndef ACI_TX_QUEUE_SIZE
+#define ACI_TX_QUEUE_SIZE  ACI_QUEUE_SIZE
+#endif
+
+#ifndef ACI_RX_QUEUE_SIZE
+#define ACI_RX_QUEUE_SIZE  ACI_QUEUE_SIZE
+#endif
+
+#if (ACI_TX_QUEUE_SIZE & (ACI_TX_QUEUE_SIZE - 1)) || (ACI_TX_QUEUE_SIZE > 128)
+#error "ACI_TX_QUEUE_SIZE must be a power of two, no larger than 128"
+#endif
+
+#if (ACI_RX_QUEUE_SIZE & (ACI_RX_QUEUE_SIZE - 1)) || (ACI_RX_QUEUE_SIZE > 128)
+#error "ACI_RX_QUEUE_SIZE must be a power of two, no larger than 128"
+#endif
 
 /** Data type for queue of data packets to send/receive from radio.
  *
@@ -47,30 +70,63 @@
  *  at the tail and taken (dequeued) from the head. The head variable is the
  *  index of the next packet to dequeue while the tail variable is the index of
  *  where the next packet should be queued.
+ *
+ *  Each queue has a single producer and a single consumer: the RDYN interrupt
+ *  and the main loop, or the main loop alone when polling. Only the consumer
+ *  writes head and only the producer writes tail. Both are single bytes, read
+ *  and written atomically, so no function needs a critical section and all of
+ *  them may be called from the interrupt. The indices run freely and are
+ *  masked into the array; their difference is the number of packets queued.
  */
 
 typedef struct {
-	hal_aci_data_t           aci_data[ACI_QUEUE_SIZE];
+	hal_aci_data_t           *aci_data;   /**< Slots, a power of two of them */
+	uint8_t                  mask;        /**< Number of slots less one */
 	uint8_t                  head;
 	uint8_t                  tail;
 } aci_queue_t;
 
-void aci_queue_init(aci_queue_t *aci_q);
+/** @brief Empties a queue and gives it its slots
+ *  @details Must not be called while the other side may be using the queue.
+ *  @param p_slots Array of size slots.
+ *  @param size Number of slots, a power of two no larger than 128.
+ */
+void aci_queue_init(aci_queue_t *aci_q, hal_aci_data_t *p_slots, uint8_t size);
 
+/** @brief Takes the packet at the head of a queue. Consumer only. */
 bool aci_queue_dequeue(aci_queue_t *aci_q, hal_aci_data_t *p_data);
-bool aci_queue_dequeue_from_isr(aci_queue_t *aci_q, hal_aci_data_t *p_data);
 
+/** @brief Adds a packet at the tail of a queue. Producer only. */
 bool aci_queue_enqueue(aci_queue_t *aci_q, hal_aci_data_t *p_data);
-bool aci_queue_enqueue_from_isr(aci_queue_t *aci_q, hal_aci_data_t *p_data);
 
 bool aci_queue_is_empty(aci_queue_t *aci_q);
-bool aci_queue_is_empty_from_isr(aci_queue_t *aci_q);
 
 bool aci_queue_is_full(aci_queue_t *aci_q);
-bool aci_queue_is_full_from_isr(aci_queue_t *aci_q);
 
+/** @brief Returns the number of packets in a queue */
+uint8_t aci_queue_count(aci_queue_t *aci_q);
+
+/** @brief Copies the packet at the head of a queue without taking it. Consumer only. */
 bool aci_queue_peek(aci_queue_t *aci_q, hal_aci_data_t *p_data);
-bool aci_queue_peek_from_isr(aci_queue_t *aci_q, hal_aci_data_t *p_data);
+
+/** @brief Points at the packet at the head of a queue, in place. Consumer only.
+ *  @details The packet stays valid, and may be modified, until aci_queue_consume()
+ *  is called. Its slot counts as used until then.
+ *  @return Pointer to the packet, or NULL if the queue is empty.
+ */
+hal_aci_data_t *aci_queue_front(aci_queue_t *aci_q);
+
+/** @brief Takes the packet at the head of a queue without copying it. Consumer only. */
+bool aci_queue_consume(aci_queue_t *aci_q);
+
+/** @brief Points at the free slot at the tail of a queue, to fill in place. Producer only.
+ *  @details The packet is not queued until aci_queue_commit() is called.
+ *  @return Pointer to the slot, or NULL if the queue is full.
+ */
+hal_aci_data_t *aci_queue_back(aci_queue_t *aci_q);
+
+/** @brief Queues the packet filled in the slot from aci_queue_back(). Producer only. */
+bool aci_queue_commit(aci_queue_t *aci_q);
 
 #endif /* ACI_QUEUE_H__ */
 /** @} */
\ No newline at end of file
@@ -81,19 +81,32 @@ static bool aci_setup_fill(aci_state_t *aci_stat, uint8_t *num_cmd_offset)
   return ret_val;
 }
 
+uint16_t aci_setup_crc(aci_state_t *aci_stat)
+{
+  const hal_aci_data_t *p_last = &(aci_stat->aci_setup_info.setup_msgs[aci_stat->aci_setup_info.num_setup_msgs - 1]);
+  uint8_t length;
+  uint16_t crc;
+
+  //The CRC is in the last two bytes of the last Setup message, most significant first
+  #if defined (__AVR__)
+    length = pgm_read_byte_near(&(p_last->buffer[0]));
+    crc = (pgm_read_byte_near(&(p_last->buffer[length - 1])) << 8) | pgm_read_byte_near(&(p_last->buffer[length]));
+  #elif defined(__PIC32MX__)
+    length = p_last->buffer[0];
+    crc = (p_last->buffer[length - 1] << 8) | p_last->buffer[length];
+  #endif
+
+  return crc;
+}
+
 uint8_t do_aci_setup(aci_state_t *aci_stat)
 {
   uint8_t setup_offset         = 0;
-  uint32_t i                   = 0x0000;
+  uint32_t last_response       = 0;
+  hal_aci_evt_t *aci_data      = NULL;
   aci_evt_t * aci_evt          = NULL;
   aci_status_code_t cmd_status = ACI_STATUS_ERROR_CRC_MISMATCH;
   
-  /*
-  We are using the same buffer since we are copying the contents of the buffer 
-  when queuing and immediately processing the buffer when receiving
-  */
-  hal_aci_evt_t  *aci_data = (hal_aci_evt_t *)&msg_to_send;
-  
   /* Messages in the outgoing queue must be handled before the Setup routine can run.
    * If it is non-empty we return. The user should then process the messages before calling
    * do_aci_setup() again.
@@ -107,25 +120,31 @@ uint8_t do_aci_setup(aci_state_t *aci_stat)
    * so that the user can handle them. At this point we don't care what the event is,
    * as any event is an error.
    */
-  if (lib_aci_event_peek(aci_data))
+  if (NULL != lib_aci_event_front(aci_stat))
   {
     return SETUP_FAIL_EVENT_QUEUE_NOT_EMPTY;
   }
   
   /* Fill the ACI command queue with as many Setup messages as it will hold. */
   aci_setup_fill(aci_stat, &setup_offset);
+  last_response = millis();
   
   while (cmd_status != ACI_STATUS_TRANSACTION_COMPLETE)
   {
-    /* This counter is used to ensure that this function does not loop forever. When the device
-     * returns a valid response, we reset the counter.
+    /* Responses are handled in place in the event queue, without copying them out */
+    aci_data = lib_aci_event_front(aci_stat);
+
+    /* This timeout ensures that this function does not loop forever. When the device
+     * returns a valid response, we restart it.
      */
-    if (i++ > 0xFFFFE)
+    if (NULL == aci_data)
     {
-      return SETUP_FAIL_TIMEOUT;	
+      if (millis() - last_response > SETUP_RESPONSE_TIMEOUT_MS)
+      {
+        return SETUP_FAIL_TIMEOUT;
+      }
     }
-    
-    if (lib_aci_event_peek(aci_data))
+    else
     {
       aci_evt = &(aci_data->evt);
       
@@ -139,11 +158,13 @@ uint8_t do_aci_setup(aci_state_t *aci_stat)
       switch (cmd_status)
       {
         case ACI_STATUS_TRANSACTION_CONTINUE:
-          //As the device is responding, reset guard counter
-          i = 0;
+          //As the device is responding, restart the timeout
+          last_response = millis();
           
           /* As the device has processed the Setup messages we put in the command queue earlier,
-           * we can proceed to fill the queue with new messages
+           * we can proceed to fill the queue with new messages. This is done before the
+           * response is released, so the transfer bringing the next response can carry
+           * the next message.
            */
           aci_setup_fill(aci_stat, &setup_offset);
           break;
@@ -161,7 +182,7 @@ uint8_t do_aci_setup(aci_state_t *aci_stat)
        * or ACI_STATUS_TRANSACTION_COMPLETE. We don't need the event itself, so we simply
        * remove it from the queue.
        */
-       lib_aci_event_get (aci_stat, aci_data);
+       lib_aci_event_consume();
     }
   }
   
@@ -30,6 +30,9 @@
 #define SETUP_FAIL_NOT_SETUP_EVENT           4
 #define SETUP_FAIL_NOT_COMMAND_RESPONSE      5
 
+/* Longest wait for a response to a Setup message before do_aci_setup() gives up, in ms */
+#define SETUP_RESPONSE_TIMEOUT_MS            250
+
 /** @brief Setup the nRF8001 device
  *  @details
  *  Performs ACI Setup by transmitting the setup messages generated by nRFgo Studio to the
@@ -41,4 +44,12 @@
  */
 uint8_t do_aci_setup(aci_state_t *aci_stat);
 
+/** @brief Get the CRC of the setup
+ *  @details
+ *  Returns the CRC nRFgo Studio puts at the end of the setup messages. It identifies
+ *  the setup, so it can be stored to tell whether the nRF8001 was given this setup before.
+ *  @returns The CRC of the setup messages in aci_stat
+ */
+uint16_t aci_setup_crc(aci_state_t *aci_stat);
+
 #endif
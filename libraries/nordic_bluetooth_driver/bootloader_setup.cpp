@@ -81,21 +81,21 @@ bool bootloader_data_store (aci_state_t *state, uint16_t conn_timeout,
   uint8_t valid_app = 1;
   uint8_t valid_ble = 1;
   uint8_t *p = (uint8_t *) &(state->aci_pins);
-  uint8_t timeout_h = (uint8_t) conn_timeout >> 8;
-  uint8_t timeout_l = (uint8_t) conn_timeout >> 0;
-  uint8_t interval_h = (uint8_t) adv_interval >> 8;
-  uint8_t interval_l = (uint8_t) adv_interval >> 0;
+  uint8_t timeout_h = (uint8_t) (conn_timeout >> 8);
+  uint8_t timeout_l = (uint8_t) (conn_timeout >> 0);
+  uint8_t interval_h = (uint8_t) (adv_interval >> 8);
+  uint8_t interval_l = (uint8_t) (adv_interval >> 0);
   uint16_t crc_local;
 
   /* Length of the data to be stored, excluding CRC */
-  uint8_t len = 2 + sizeof(aci_pins_t) + 1 + sizeof(pipes) + 4;
+  uint8_t len = 2 + sizeof(aci_pins_t) + 1 + n_pipes + 4;
 
   /* Compute CRC16 for our data */
   crc_local = crc_16_ccitt(0xFFFF, &valid_app, 1);
   crc_local = crc_16_ccitt(crc_local, &valid_ble, 1);
   crc_local = crc_16_ccitt(crc_local, p, sizeof(aci_pins_t));
   crc_local = crc_16_ccitt(crc_local, &(state->data_credit_total), 1);
-  crc_local = crc_16_ccitt(crc_local, pipes, sizeof(pipes));
+  crc_local = crc_16_ccitt(crc_local, pipes, n_pipes);
   crc_local = crc_16_ccitt(crc_local, &timeout_l, 1);
   crc_local = crc_16_ccitt(crc_local, &timeout_h, 1);
   crc_local = crc_16_ccitt(crc_local, &interval_l, 1);
@@ -125,7 +125,7 @@ bool bootloader_data_store (aci_state_t *state, uint16_t conn_timeout,
 
     EEPROM.write(addr++, state->data_credit_total);
 
-    for (uint8_t i = 0; i < sizeof(pipes); i++)
+    for (uint8_t i = 0; i < n_pipes; i++)
     {
       EEPROM.write(addr++, pipes[i]);
     }
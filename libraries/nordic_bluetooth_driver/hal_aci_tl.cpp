@@ -51,17 +51,134 @@ static void m_aci_pins_set(aci_pins_t *a_pins_ptr);
 static inline void m_aci_reqn_disable (void);
 static inline void m_aci_reqn_enable (void);
 static void m_aci_q_flush(void);
-static bool m_aci_spi_transfer(hal_aci_data_t * data_to_send, hal_aci_data_t * received_data);
+static void m_aci_rx_hold_off(void);
+static void m_aci_rx_release(void);
+static void m_aci_high_water(uint8_t *p_high_water, aci_queue_t *aci_q);
+static bool m_aci_spi_transfer(const hal_aci_data_t * data_to_send, hal_aci_data_t * received_data);
 
 static uint8_t        spi_readwrite(uint8_t aci_byte);
+static void           spi_readwrite_block(uint8_t *p_buffer, uint8_t length);
 
 static bool           aci_debug_print = false;
 
 aci_queue_t    aci_tx_q;
 aci_queue_t    aci_rx_q;
 
+static hal_aci_data_t     aci_tx_slots[ACI_TX_QUEUE_SIZE];
+static hal_aci_data_t     aci_rx_slots[ACI_RX_QUEUE_SIZE];
+
+/* Set when the event queue filled and the nRF8001 is being held off: the RDYN
+   interrupt is detached, or no longer polled, until an event is consumed */
+static volatile bool      rx_held_off = false;
+
+/* Set by hal_aci_tl_events_hold() while no events are to be taken at all */
+static bool               rx_stopped = false;
+
+static hal_aci_tl_stats_t aci_stats;
+
 static aci_pins_t	 *a_pins_local_ptr;
 
+#if HAL_ACI_TRACE
+/*
+  The trace ring buffer. trace_written counts the records since the last export,
+  the newest is at (trace_written - 1) modulo the size. Records are written from
+  the main thread and from the interrupt, with interrupts disabled.
+*/
+static hal_aci_tl_trace_record_t trace_records[HAL_ACI_TRACE_RECORDS];
+static uint16_t           trace_written = 0;
+static bool               trace_wrapped = false;  // trace_written wrapped, more were lost than it tells
+static uint16_t           trace_epoch = 0;        // epoch of the newest record
+static bool               trace_epoch_valid = false;
+static uint16_t           trace_first_epoch = 0;  // epoch of the oldest record held, once the ring is full
+static uint16_t           trace_missed = 0;       // records missed while exporting
+static volatile bool      trace_exporting = false;
+
+#if defined(TCNT0) && defined(TOV0)
+/* Timer 0 runs the Arduino clock, overflowing every 256 ticks of 64 CPU cycles, and
+   the core counts its overflows. Read directly, as interrupts are already disabled,
+   it saves the call of micros() and its scaling to microseconds. */
+extern volatile unsigned long timer0_overflow_count;
+
+#define TRACE_TICK_US (64 / clockCyclesPerMicrosecond())
+
+static inline uint32_t m_aci_trace_ticks(void)
+{
+  uint8_t  count = TCNT0;
+  uint32_t overflows = timer0_overflow_count;
+
+  if ((TIFR0 & _BV(TOV0)) && (count < 255))
+  {
+    overflows++;
+  }
+
+  return (overflows << 8) | count;
+}
+#else
+#define TRACE_TICK_US 4
+
+static inline uint32_t m_aci_trace_ticks(void)
+{
+  return micros() / TRACE_TICK_US;
+}
+#endif
+
+#if defined(SREG)
+#define TRACE_LOCK()   uint8_t trace_sreg = SREG; cli()
+#define TRACE_UNLOCK() SREG = trace_sreg
+#else
+/* The host tools run the interrupt in turn with the main thread */
+#define TRACE_LOCK()
+#define TRACE_UNLOCK()
+#endif
+
+/* Puts a record in the ring buffer, keeping the epoch of the oldest when it is overwritten */
+static void m_aci_trace_put(uint8_t type, uint8_t argument, uint16_t time)
+{
+  hal_aci_tl_trace_record_t *p_record = &trace_records[trace_written & (HAL_ACI_TRACE_RECORDS - 1)];
+
+  if ((trace_wrapped || trace_written >= HAL_ACI_TRACE_RECORDS) && (HAL_ACI_TRACE_EPOCH == p_record->type))
+  {
+    trace_first_epoch = p_record->time;
+  }
+
+  p_record->type = type;
+  p_record->argument = argument;
+  p_record->time = time;
+
+  if (0 == ++trace_written)
+  {
+    trace_wrapped = true;
+  }
+}
+
+static void m_aci_trace(uint8_t type, uint8_t argument)
+{
+  TRACE_LOCK();
+
+  if (trace_exporting)
+  {
+    trace_missed++;
+  }
+  else
+  {
+    const uint32_t ticks = m_aci_trace_ticks();
+    const uint16_t epoch = (uint16_t)(ticks >> 16);
+
+    if (!trace_epoch_valid || (epoch != trace_epoch))
+    {
+      m_aci_trace_put(HAL_ACI_TRACE_EPOCH, 0, epoch);
+      trace_epoch = epoch;
+      trace_epoch_valid = true;
+    }
+    m_aci_trace_put(type, argument, (uint16_t)ticks);
+  }
+
+  TRACE_UNLOCK();
+}
+#else
+#define m_aci_trace(type, argument)
+#endif
+
 void m_aci_data_print(hal_aci_data_t *p_data)
 {
   const uint8_t length = p_data->buffer[0];
@@ -81,58 +198,136 @@ void m_aci_data_print(hal_aci_data_t *p_data)
 */
 static void m_aci_isr(void)
 {
-  hal_aci_data_t data_to_send;
-  hal_aci_data_t received_data;
-
-  // Receive from queue
-  if (!aci_queue_dequeue_from_isr(&aci_tx_q, &data_to_send))
+  // The event is received straight into the free slot of the event queue
+  hal_aci_data_t *p_received = aci_queue_back(&aci_rx_q);
+  // The command is sent from its slot in the command queue, NULL if there is none
+  hal_aci_data_t *p_to_send;
+
+  // No room to store incoming messages. The nRF8001 keeps RDYN low and its event
+  // until the interrupt is attached again.
+  if (NULL == p_received)
   {
-    /* queue was empty, nothing to send */
-    data_to_send.status_byte = 0;
-    data_to_send.buffer[0] = 0;
+    m_aci_rx_hold_off();
+    return;
   }
 
+  p_to_send = aci_queue_front(&aci_tx_q);
+
   // Receive and/or transmit data
-  m_aci_spi_transfer(&data_to_send, &received_data);
+  m_aci_spi_transfer(p_to_send, p_received);
+
+  if (NULL != p_to_send)
+  {
+    aci_queue_consume(&aci_tx_q);
+  }
 
-  if (!aci_queue_is_full_from_isr(&aci_rx_q) && !aci_queue_is_empty_from_isr(&aci_tx_q))
+  if (!aci_queue_is_full(&aci_rx_q) && !aci_queue_is_empty(&aci_tx_q))
   {
     m_aci_reqn_enable();
   }
 
   // Check if we received data
-  if (received_data.buffer[0] > 0)
+  if (p_received->buffer[0] > 0)
   {
-    if (!aci_queue_enqueue_from_isr(&aci_rx_q, &received_data))
+    if (!aci_queue_commit(&aci_rx_q))
     {
       /* Receive Buffer full.
-         Should never happen.
-         Spin in a while loop.
+         Cannot happen as the queue was checked for room above.
+         Count it rather than hang.
       */
-      while(1);
+      aci_stats.rx_dropped++;
     }
+    m_aci_high_water(&aci_stats.rx_high_water, &aci_rx_q);
 
     // Disable ready line interrupt until we have room to store incoming messages
-    if (aci_queue_is_full_from_isr(&aci_rx_q))
+    if (aci_queue_is_full(&aci_rx_q))
     {
-      detachInterrupt(a_pins_local_ptr->interrupt_number);
+      m_aci_rx_hold_off();
     }
   }
 
   return;
 }
 
+/*
+  Holds the nRF8001 off while the event queue is full. Called from the interrupt,
+  or from the main loop when polling.
+*/
+static void m_aci_rx_hold_off(void)
+{
+  if (a_pins_local_ptr->interface_is_interrupt)
+  {
+    detachInterrupt(a_pins_local_ptr->interrupt_number);
+  }
+
+  if (!rx_held_off)
+  {
+    aci_stats.rx_full++;
+    m_aci_trace(HAL_ACI_TRACE_HOLD_OFF, 0);
+  }
+
+  rx_held_off = true;
+}
+
+/*
+  Lets the nRF8001 send again once an event has been consumed. rx_held_off is set
+  after the interrupt detaches, so a hold off which races with the consume is seen
+  here or on the next consume, and the interrupt is never left detached.
+*/
+static void m_aci_rx_release(void)
+{
+  if (!rx_held_off || rx_stopped)
+  {
+    return;
+  }
+
+  rx_held_off = false;
+
+  if (LOW == digitalRead(a_pins_local_ptr->rdyn_pin))
+  {
+    /* The nRF8001 had an event waiting */
+    aci_stats.rx_stalls++;
+    m_aci_trace(HAL_ACI_TRACE_RELEASE, 1);
+  }
+  else
+  {
+    m_aci_trace(HAL_ACI_TRACE_RELEASE, 0);
+  }
+
+  if (a_pins_local_ptr->interface_is_interrupt)
+  {
+    /* Enable RDY line interrupt again */
+    attachInterrupt(a_pins_local_ptr->interrupt_number, m_aci_isr, LOW);
+  }
+}
+
+static void m_aci_high_water(uint8_t *p_high_water, aci_queue_t *aci_q)
+{
+  const uint8_t count = aci_queue_count(aci_q);
+
+  if (count > *p_high_water)
+  {
+    *p_high_water = count;
+  }
+}
+
 /*
   Checks the RDYN line and runs the SPI transfer if required.
 */
 static void m_aci_event_check(void)
 {
-  hal_aci_data_t data_to_send;
-  hal_aci_data_t received_data;
+  hal_aci_data_t *p_received = aci_queue_back(&aci_rx_q);
+  hal_aci_data_t *p_to_send;
+
+  if (rx_stopped)
+  {
+    return;
+  }
 
   // No room to store incoming messages
-  if (aci_queue_is_full(&aci_rx_q))
+  if (NULL == p_received)
   {
+    m_aci_rx_hold_off();
     return;
   }
 
@@ -147,16 +342,15 @@ static void m_aci_event_check(void)
     return;
   }
 
-  // Receive from queue
-  if (!aci_queue_dequeue(&aci_tx_q, &data_to_send))
-  {
-    /* queue was empty, nothing to send */
-    data_to_send.status_byte = 0;
-    data_to_send.buffer[0] = 0;
-  }
+  p_to_send = aci_queue_front(&aci_tx_q);
 
   // Receive and/or transmit data
-  m_aci_spi_transfer(&data_to_send, &received_data);
+  m_aci_spi_transfer(p_to_send, p_received);
+
+  if (NULL != p_to_send)
+  {
+    aci_queue_consume(&aci_tx_q);
+  }
 
   /* If there are messages to transmit, and we can store the reply, we request a new transfer */
   if (!aci_queue_is_full(&aci_rx_q) && !aci_queue_is_empty(&aci_tx_q))
@@ -165,16 +359,17 @@ static void m_aci_event_check(void)
   }
 
   // Check if we received data
-  if (received_data.buffer[0] > 0)
+  if (p_received->buffer[0] > 0)
   {
-    if (!aci_queue_enqueue(&aci_rx_q, &received_data))
+    if (!aci_queue_commit(&aci_rx_q))
     {
       /* Receive Buffer full.
-         Should never happen.
-         Spin in a while loop.
+         Cannot happen as the queue was checked for room above.
+         Count it rather than hang.
       */
-      while(1);
+      aci_stats.rx_dropped++;
     }
+    m_aci_high_water(&aci_stats.rx_high_water, &aci_rx_q);
   }
 
   return;
@@ -204,52 +399,62 @@ static void m_aci_q_flush(void)
 {
   noInterrupts();
   /* re-initialize aci cmd queue and aci event queue to flush them*/
-  aci_queue_init(&aci_tx_q);
-  aci_queue_init(&aci_rx_q);
+  aci_queue_init(&aci_tx_q, aci_tx_slots, ACI_TX_QUEUE_SIZE);
+  aci_queue_init(&aci_rx_q, aci_rx_slots, ACI_RX_QUEUE_SIZE);
   interrupts();
+  m_aci_trace(HAL_ACI_TRACE_FLUSH, 0);
+
+  /* the event queue has room again */
+  m_aci_rx_release();
 }
 
-static bool m_aci_spi_transfer(hal_aci_data_t * data_to_send, hal_aci_data_t * received_data)
+/*
+  Runs one SPI transfer. data_to_send is NULL when there is no command to send.
+  received_data may be a slot in the event queue, its length is at most HAL_ACI_MAX_LENGTH.
+*/
+static bool m_aci_spi_transfer(const hal_aci_data_t * data_to_send, hal_aci_data_t * received_data)
 {
-  uint8_t byte_cnt;
-  uint8_t byte_sent_cnt;
+  uint8_t length_to_send = 0;
+  uint8_t rest_to_send = 0;
   uint8_t max_bytes;
 
+  if (NULL != data_to_send)
+  {
+    length_to_send = (data_to_send->buffer[0] > HAL_ACI_MAX_LENGTH) ? HAL_ACI_MAX_LENGTH : data_to_send->buffer[0];
+    rest_to_send = (length_to_send > 1) ? (length_to_send - 1) : 0;
+  }
+
+  m_aci_trace(HAL_ACI_TRACE_TRANSFER, (0 == length_to_send) ? 0 : data_to_send->buffer[1]);
+
   SPI.beginTransaction(SPISettings(2000000, LSBFIRST, SPI_MODE0));
   m_aci_reqn_enable();
 
   // Send length, receive header
-  byte_sent_cnt = 0;
-  received_data->status_byte = spi_readwrite(data_to_send->buffer[byte_sent_cnt++]);
+  received_data->status_byte = spi_readwrite(length_to_send);
   // Send first byte, receive length from slave
-  received_data->buffer[0] = spi_readwrite(data_to_send->buffer[byte_sent_cnt++]);
-  if (0 == data_to_send->buffer[0])
+  received_data->buffer[0] = spi_readwrite((0 == length_to_send) ? 0 : data_to_send->buffer[1]);
+  if (received_data->buffer[0] > HAL_ACI_MAX_LENGTH)
   {
-    max_bytes = received_data->buffer[0];
-  }
-  else
-  {
-    // Set the maximum to the biggest size. One command byte is already sent
-    max_bytes = (received_data->buffer[0] > (data_to_send->buffer[0] - 1))
-                                          ? received_data->buffer[0]
-                                          : (data_to_send->buffer[0] - 1);
+    received_data->buffer[0] = HAL_ACI_MAX_LENGTH;
   }
 
-  if (max_bytes > HAL_ACI_MAX_LENGTH)
-  {
-    max_bytes = HAL_ACI_MAX_LENGTH;
-  }
+  // Clock the longer of the event and the rest of the command, and no more.
+  max_bytes = (received_data->buffer[0] > rest_to_send) ? received_data->buffer[0] : rest_to_send;
 
-  // Transmit/receive the rest of the packet
-  for (byte_cnt = 0; byte_cnt < max_bytes; byte_cnt++)
+  // The rest of the command is exchanged for the rest of the event in place, in one
+  // block. The bytes clocked past the end of the command are ignored by the nRF8001.
+  if (0 != rest_to_send)
   {
-    received_data->buffer[byte_cnt+1] =  spi_readwrite(data_to_send->buffer[byte_sent_cnt++]);
+    memcpy(&received_data->buffer[1], &data_to_send->buffer[2], rest_to_send);
   }
+  spi_readwrite_block(&received_data->buffer[1], max_bytes);
 
   // RDYN should follow the REQN line in approx 100ns
   m_aci_reqn_disable();
   SPI.endTransaction();
 
+  m_aci_trace(HAL_ACI_TRACE_EVENT, (0 == received_data->buffer[0]) ? 0 : received_data->buffer[1]);
+
   return (max_bytes > 0);
 }
 
@@ -297,18 +502,23 @@ bool hal_aci_tl_event_peek(hal_aci_data_t *p_aci_data)
   return false;
 }
 
-bool hal_aci_tl_event_get(hal_aci_data_t *p_aci_data)
+hal_aci_data_t *hal_aci_tl_event_front(void)
 {
-  bool was_full;
-
-  if (!a_pins_local_ptr->interface_is_interrupt && !aci_queue_is_full(&aci_rx_q))
+  if (!a_pins_local_ptr->interface_is_interrupt)
   {
     m_aci_event_check();
   }
 
-  was_full = aci_queue_is_full(&aci_rx_q);
+  return aci_queue_front(&aci_rx_q);
+}
 
-  if (aci_queue_dequeue(&aci_rx_q, p_aci_data))
+bool hal_aci_tl_event_consume(void)
+{
+  hal_aci_data_t *p_aci_data;
+
+  p_aci_data = aci_queue_front(&aci_rx_q);
+
+  if (NULL != p_aci_data)
   {
     if (aci_debug_print)
     {
@@ -316,11 +526,9 @@ bool hal_aci_tl_event_get(hal_aci_data_t *p_aci_data)
       m_aci_data_print(p_aci_data);
     }
 
-    if (was_full && a_pins_local_ptr->interface_is_interrupt)
-	  {
-      /* Enable RDY line interrupt again */
-      attachInterrupt(a_pins_local_ptr->interrupt_number, m_aci_isr, LOW);
-    }
+    m_aci_trace(HAL_ACI_TRACE_CONSUME, p_aci_data->buffer[1]);
+    aci_queue_consume(&aci_rx_q);
+    m_aci_rx_release();
 
     /* Attempt to pull REQN LOW since we've made room for new messages */
     if (!aci_queue_is_full(&aci_rx_q) && !aci_queue_is_empty(&aci_tx_q))
@@ -334,7 +542,22 @@ bool hal_aci_tl_event_get(hal_aci_data_t *p_aci_data)
   return false;
 }
 
-void hal_aci_tl_init(aci_pins_t *a_pins, bool debug)
+bool hal_aci_tl_event_get(hal_aci_data_t *p_aci_data)
+{
+  const hal_aci_data_t *p_front = hal_aci_tl_event_front();
+
+  if (NULL == p_front)
+  {
+    return false;
+  }
+
+  memcpy((uint8_t *)p_aci_data, (uint8_t *)p_front, sizeof(hal_aci_data_t));
+
+  return hal_aci_tl_event_consume();
+}
+
+/* Shared by hal_aci_tl_init() and hal_aci_tl_resume(), which skips the pin reset */
+static void m_aci_init(aci_pins_t *a_pins, bool debug, bool reset)
 {
   aci_debug_print = debug;
 
@@ -361,8 +584,12 @@ void hal_aci_tl_init(aci_pins_t *a_pins, bool debug)
   SPI.setDataMode(SPI_MODE0);
 
   /* Initialize the ACI Command queue. This must be called after the delay above. */
-  aci_queue_init(&aci_tx_q);
-  aci_queue_init(&aci_rx_q);
+  aci_queue_init(&aci_tx_q, aci_tx_slots, ACI_TX_QUEUE_SIZE);
+  aci_queue_init(&aci_rx_q, aci_rx_slots, ACI_RX_QUEUE_SIZE);
+  rx_held_off = false;
+  rx_stopped = false;
+  m_aci_trace(HAL_ACI_TRACE_FLUSH, 0);
+  hal_aci_tl_stats_clear();
 
   //Configure the IO lines
   pinMode(a_pins->rdyn_pin,		INPUT_PULLUP);
@@ -373,7 +600,10 @@ void hal_aci_tl_init(aci_pins_t *a_pins, bool debug)
     pinMode(a_pins->active_pin,	INPUT);
   }
   /* Pin reset the nRF8001, required when the nRF8001 setup is being changed */
-  hal_aci_tl_pin_reset();
+  if (reset)
+  {
+    hal_aci_tl_pin_reset();
+  }
 
   /* Set the nRF8001 to a known state as required by the datasheet*/
   digitalWrite(a_pins->miso_pin, 0);
@@ -381,7 +611,10 @@ void hal_aci_tl_init(aci_pins_t *a_pins, bool debug)
   digitalWrite(a_pins->reqn_pin, 1);
   digitalWrite(a_pins->sck_pin,  0);
 
-  delay(30); //Wait for the nRF8001 to get hold of its lines - the lines float for a few ms after the reset
+  if (reset)
+  {
+    delay(30); //Wait for the nRF8001 to get hold of its lines - the lines float for a few ms after the reset
+  }
 
   /* Attach the interrupt to the RDYN line as requested by the caller */
   if (a_pins->interface_is_interrupt)
@@ -391,6 +624,16 @@ void hal_aci_tl_init(aci_pins_t *a_pins, bool debug)
   }
 }
 
+void hal_aci_tl_init(aci_pins_t *a_pins, bool debug)
+{
+  m_aci_init(a_pins, debug, true);
+}
+
+void hal_aci_tl_resume(aci_pins_t *a_pins, bool debug)
+{
+  m_aci_init(a_pins, debug, false);
+}
+
 bool hal_aci_tl_send(hal_aci_data_t *p_aci_cmd)
 {
   const uint8_t length = p_aci_cmd->buffer[0];
@@ -402,8 +645,15 @@ bool hal_aci_tl_send(hal_aci_data_t *p_aci_cmd)
   }
 
   ret_val = aci_queue_enqueue(&aci_tx_q, p_aci_cmd);
-  if (ret_val)
+  if (!ret_val)
+  {
+    aci_stats.tx_full++;
+  }
+  else
   {
+    m_aci_trace(HAL_ACI_TRACE_COMMAND, p_aci_cmd->buffer[1]);
+    m_aci_high_water(&aci_stats.tx_high_water, &aci_tx_q);
+
     if(!aci_queue_is_full(&aci_rx_q))
     {
       // Lower the REQN only when successfully enqueued
@@ -434,6 +684,22 @@ static uint8_t spi_readwrite(const uint8_t aci_byte)
 #endif
 }
 
+static void spi_readwrite_block(uint8_t *p_buffer, const uint8_t length)
+{
+	//Board dependent defines
+#if defined (__AVR__)
+    //The block transfer loads each byte while the one before is shifted out
+    SPI.transfer(p_buffer, length);
+#elif defined(__PIC32MX__)
+    //For ChipKit each byte has to be reversed
+    uint8_t i;
+    for (i = 0; i < length; i++)
+    {
+      p_buffer[i] = spi_readwrite(p_buffer[i]);
+    }
+#endif
+}
+
 bool hal_aci_tl_rx_q_empty (void)
 {
   return aci_queue_is_empty(&aci_rx_q);
@@ -454,7 +720,110 @@ bool hal_aci_tl_tx_q_full (void)
   return aci_queue_is_full(&aci_tx_q);
 }
 
+void hal_aci_tl_events_hold(bool hold)
+{
+  if (hold)
+  {
+    rx_stopped = true;
+    if (a_pins_local_ptr->interface_is_interrupt)
+    {
+      detachInterrupt(a_pins_local_ptr->interrupt_number);
+    }
+    return;
+  }
+
+  if (!rx_stopped)
+  {
+    return;
+  }
+  rx_stopped = false;
+
+  /* A queue still full stays held off until an event is consumed */
+  if (rx_held_off)
+  {
+    if (!aci_queue_is_full(&aci_rx_q))
+    {
+      m_aci_rx_release();
+    }
+  }
+  else if (a_pins_local_ptr->interface_is_interrupt)
+  {
+    attachInterrupt(a_pins_local_ptr->interrupt_number, m_aci_isr, LOW);
+  }
+}
+
 void hal_aci_tl_q_flush (void)
 {
   m_aci_q_flush();
 }
+
+void hal_aci_tl_stats_get(hal_aci_tl_stats_t *p_stats)
+{
+  /* the interrupt updates the event queue counters */
+  noInterrupts();
+  *p_stats = aci_stats;
+  interrupts();
+}
+
+void hal_aci_tl_stats_clear(void)
+{
+  noInterrupts();
+  memset(&aci_stats, 0, sizeof(aci_stats));
+  interrupts();
+}
+
+#if HAL_ACI_TRACE
+void hal_aci_tl_trace_mark(uint8_t id)
+{
+  m_aci_trace(HAL_ACI_TRACE_MARK, id);
+}
+
+void hal_aci_tl_trace_export(hal_aci_tl_trace_write_t p_write)
+{
+  hal_aci_tl_trace_header_t header;
+  uint16_t written;
+  uint16_t records;
+  uint16_t first;
+  uint16_t to_end;
+  uint32_t lost;
+
+  /* Stop recording, the records stay where they are while they are written */
+  noInterrupts();
+  trace_exporting = true;
+  written = trace_written;
+  records = (!trace_wrapped && (written < HAL_ACI_TRACE_RECORDS)) ? written : HAL_ACI_TRACE_RECORDS;
+  lost = trace_wrapped ? 0xFFFF : ((uint32_t)written - records + trace_missed);
+  trace_missed = 0;
+  /* The first record after an export is an epoch */
+  header.epoch = (0 == written) ? 0 : ((records == written) ? trace_records[0].time : trace_first_epoch);
+  interrupts();
+
+  header.magic = HAL_ACI_TRACE_MAGIC;
+  header.version = HAL_ACI_TRACE_VERSION;
+  header.tick_us = TRACE_TICK_US;
+  header.records = records;
+  header.lost = (lost > 0xFFFF) ? 0xFFFF : (uint16_t)lost;
+  p_write((const uint8_t *)&header, sizeof(header));
+
+  /* Oldest first, from the slot the next record would take once the ring is full */
+  first = (written - records) & (HAL_ACI_TRACE_RECORDS - 1);
+  to_end = HAL_ACI_TRACE_RECORDS - first;
+  if (to_end > records)
+  {
+    to_end = records;
+  }
+  p_write((const uint8_t *)&trace_records[first], to_end * sizeof(hal_aci_tl_trace_record_t));
+  if (to_end < records)
+  {
+    p_write((const uint8_t *)&trace_records[0], (records - to_end) * sizeof(hal_aci_tl_trace_record_t));
+  }
+
+  /* Records missed meanwhile are counted in the next export */
+  noInterrupts();
+  trace_written = 0;
+  trace_wrapped = false;
+  trace_epoch_valid = false;
+  trace_exporting = false;
+  interrupts();
+}
+#endif
@@ -93,6 +93,15 @@ typedef struct aci_pins_t
  */
 void hal_aci_tl_init(aci_pins_t *a_pins, bool debug);
 
+/** @brief ACI Transport Layer initialization without the pin reset.
+ *  @details
+ *  As hal_aci_tl_init(), but leaves the nRF8001 running, with its setup and any
+ *  event it is waiting to send, as after a reset of the MCU alone.
+ *  @param a_pins Pins on the MCU used to connect to the nRF8001
+ *  @param bool True if debug printing should be enabled on the Serial.
+ */
+void hal_aci_tl_resume(aci_pins_t *a_pins, bool debug);
+
 /** @brief Sends an ACI command to the radio.
  *  @details
  *  This function sends an ACI command to the radio. This queue up the message to send and 
@@ -127,6 +136,23 @@ bool hal_aci_tl_event_get(hal_aci_data_t *p_aci_data);
  */
 bool hal_aci_tl_event_peek(hal_aci_data_t *p_aci_data);
 
+/** @brief Point at the ACI event at the head of the event queue, in place
+ *  @details
+ *  Call this function from the main context. Unlike hal_aci_tl_event_get() the event is not
+ *  copied; it stays valid, and may be modified, until hal_aci_tl_event_consume() is called.
+ *  This is called by lib_aci_event_front
+ *  @return Pointer to the event, or NULL if there is none.
+ */
+hal_aci_data_t * hal_aci_tl_event_front(void);
+
+/** @brief Remove the ACI event at the head of the event queue
+ *  @details
+ *  Call this function from the main context once done with the event from hal_aci_tl_event_front().
+ *  This is called by lib_aci_event_consume
+ *  @return True if an event was removed.
+ */
+bool hal_aci_tl_event_consume(void);
+
 /** @brief Enable debug printing of all ACI commands sent and ACI events received
  *  @details
  *  when the enable parameter is true. The debug printing is enabled on the Serial.
@@ -169,11 +195,134 @@ void hal_aci_tl_pin_reset(void);
  */
  bool hal_aci_tl_tx_q_empty(void);
 
+/** @brief Stop or restart taking events from the nRF8001
+ *  @details
+ *  While stopped no SPI transfer is run, so events, and commands, stay where they are:
+ *  the nRF8001 keeps its events with RDYN low, for whoever takes the ACI next, as a
+ *  bootloader does after a reset of the MCU. Events already in the event queue can
+ *  still be read and consumed.
+ *  Call this function in the main thread
+ *  @param hold True to stop, false to take events again
+ */
+void hal_aci_tl_events_hold(bool hold);
+
 /** @brief Flush the ACI command Queue and the ACI Event Queue
  *  @details
  *  Call this function in the main thread
  */
 void hal_aci_tl_q_flush(void);
 
+/** Counters of ACI queue use, for sizing ACI_RX_QUEUE_SIZE and ACI_TX_QUEUE_SIZE */
+typedef struct {
+  uint8_t  rx_high_water;  /**< Most events ever waiting in the event queue */
+  uint8_t  tx_high_water;  /**< Most commands ever waiting in the command queue */
+  uint16_t rx_full;        /**< Times the event queue filled and the nRF8001 was held off */
+  uint16_t rx_stalls;      /**< Times the nRF8001 was found waiting with an event when room was made */
+  uint16_t rx_dropped;     /**< Events lost to a full event queue, should stay 0 */
+  uint16_t tx_full;        /**< Commands refused by hal_aci_tl_send() as the command queue was full */
+} hal_aci_tl_stats_t;
+
+/** @brief Get the ACI queue counters
+ *  @details
+ *  The counters run from hal_aci_tl_init() or the last hal_aci_tl_stats_clear().
+ *  Call this function in the main thread
+ */
+void hal_aci_tl_stats_get(hal_aci_tl_stats_t *p_stats);
+
+/** @brief Clear the ACI queue counters
+ */
+void hal_aci_tl_stats_clear(void);
+
+/************************************************************************/
+/* ACI trace                                                             */
+/************************************************************************/
+
+/* Set HAL_ACI_TRACE to 1 to record the ACI traffic, with timestamps, in a */
+/* ring buffer in RAM of HAL_ACI_TRACE_RECORDS records of 4 bytes, which  */
+/* keeps the newest. With HAL_ACI_TRACE 0 the trace functions compile to  */
+/* nothing. HAL_ACI_TRACE_RECORDS must be a power of two, up to 1024.     */
+#ifndef HAL_ACI_TRACE
+#define HAL_ACI_TRACE 0
+#endif
+
+#ifndef HAL_ACI_TRACE_RECORDS
+#define HAL_ACI_TRACE_RECORDS 64
+#endif
+
+#if (HAL_ACI_TRACE_RECORDS & (HAL_ACI_TRACE_RECORDS - 1)) || (HAL_ACI_TRACE_RECORDS > 1024)
+#error "HAL_ACI_TRACE_RECORDS must be a power of two, no larger than 1024"
+#endif
+
+/** Types of trace record */
+typedef enum
+{
+  HAL_ACI_TRACE_EPOCH    = 0x00, /**< Later records are in a new epoch, the time holds it */
+  HAL_ACI_TRACE_COMMAND  = 0x01, /**< Command queued by hal_aci_tl_send(), the argument is its opcode */
+  HAL_ACI_TRACE_TRANSFER = 0x02, /**< SPI transfer starts, the argument is the opcode sent, 0 for none */
+  HAL_ACI_TRACE_EVENT    = 0x03, /**< SPI transfer ends, the argument is the opcode received, 0 for none */
+  HAL_ACI_TRACE_CONSUME  = 0x04, /**< Event consumed, the argument is its opcode */
+  HAL_ACI_TRACE_HOLD_OFF = 0x05, /**< Event queue full, the nRF8001 is held off */
+  HAL_ACI_TRACE_RELEASE  = 0x06, /**< The nRF8001 may send again, the argument is 1 if it was waiting */
+  HAL_ACI_TRACE_MARK     = 0x07, /**< Mark of the application, the argument is its id */
+  HAL_ACI_TRACE_FLUSH    = 0x08  /**< Command and event queues emptied, at init or by hal_aci_tl_q_flush() */
+} hal_aci_tl_trace_type_t;
+
+/** A trace record. The time is in ticks of hal_aci_tl_trace_header_t::tick_us, the low
+    16 bits of a 32 bit count whose high 16 bits, the epoch, are given by the last
+    HAL_ACI_TRACE_EPOCH record, or the header before the first. */
+typedef struct {
+  uint8_t  type;                /**< One of hal_aci_tl_trace_type_t */
+  uint8_t  argument;            /**< Opcode, or as the type has it */
+  uint16_t time;                /**< Low 16 bits of the time, little endian */
+} _aci_packed_ hal_aci_tl_trace_record_t;
+
+ACI_ASSERT_SIZE(hal_aci_tl_trace_record_t, 4);
+
+#define HAL_ACI_TRACE_MAGIC   0x5441  /**< "AT", first in the header */
+#define HAL_ACI_TRACE_VERSION 1
+
+/** Header of an exported trace, followed by its records, oldest first. Little endian. */
+typedef struct {
+  uint16_t magic;               /**< HAL_ACI_TRACE_MAGIC */
+  uint8_t  version;             /**< HAL_ACI_TRACE_VERSION */
+  uint8_t  tick_us;             /**< Length of a tick of the record times, in us */
+  uint16_t records;             /**< Number of records following */
+  uint16_t lost;                /**< Records overwritten or missed since the last export, 0xFFFF for more */
+  uint16_t epoch;               /**< Epoch of the first record */
+} _aci_packed_ hal_aci_tl_trace_header_t;
+
+ACI_ASSERT_SIZE(hal_aci_tl_trace_header_t, 10);
+
+/** Function the trace is exported with, given the bytes in order */
+typedef void (*hal_aci_tl_trace_write_t)(const uint8_t *p_data, uint16_t length);
+
+#if HAL_ACI_TRACE
+
+/** @brief Add a mark of the application to the trace
+ *  @details
+ *  Marks put the application's own steps, such as delays, on the timeline of the ACI
+ *  traffic. The ids are the application's.
+ *  Call this function in the main thread or an interrupt.
+ *  @param id Id of the mark
+ */
+void hal_aci_tl_trace_mark(uint8_t id);
+
+/** @brief Export the trace and start a new one
+ *  @details
+ *  Writes a hal_aci_tl_trace_header_t and the records held, oldest first, then empties
+ *  the ring buffer. Records made while it runs, from the interrupt, are missed and
+ *  counted as lost in the next export.
+ *  Call this function in the main thread.
+ *  @param p_write Function to write the trace with, as to a serial port
+ */
+void hal_aci_tl_trace_export(hal_aci_tl_trace_write_t p_write);
+
+#else
+
+static inline void hal_aci_tl_trace_mark(uint8_t) {}
+static inline void hal_aci_tl_trace_export(hal_aci_tl_trace_write_t) {}
+
+#endif
+
 #endif // HAL_ACI_TL_H__
 /** @} */
@@ -175,7 +175,8 @@ void lib_aci_board_init(aci_state_t *aci_stat)
 }
 
 
-void lib_aci_init(aci_state_t *aci_stat, bool debug)
+/* Shared by lib_aci_init() and lib_aci_resume(), which skips the pin reset */
+static void m_lib_aci_init(aci_state_t *aci_stat, bool debug, bool reset)
 {
   uint8_t i;
 
@@ -208,11 +209,28 @@ void lib_aci_init(aci_state_t *aci_stat, bool debug)
   p_setup_msgs             = aci_stat->aci_setup_info.setup_msgs;
   
   
-  hal_aci_tl_init(&aci_stat->aci_pins, debug);
+  if (reset)
+  {
+    hal_aci_tl_init(&aci_stat->aci_pins, debug);
+  }
+  else
+  {
+    hal_aci_tl_resume(&aci_stat->aci_pins, debug);
+  }
   
   lib_aci_board_init(aci_stat);
 }
 
+void lib_aci_init(aci_state_t *aci_stat, bool debug)
+{
+  m_lib_aci_init(aci_stat, debug, true);
+}
+
+void lib_aci_resume(aci_state_t *aci_stat, bool debug)
+{
+  m_lib_aci_init(aci_stat, debug, false);
+}
+
 
 uint8_t lib_aci_get_nb_available_credits(aci_state_t *aci_stat)
 {
@@ -560,76 +578,93 @@ bool lib_aci_event_peek(hal_aci_evt_t *p_aci_evt_data)
   return hal_aci_tl_event_peek((hal_aci_data_t *)p_aci_evt_data);
 }
 
+/** Update the state of the ACI with the
+    ACI Events -> Pipe Status, Disconnected, Connected, Bond Status, Pipe Error
+*/
+static void m_aci_state_update(aci_state_t *aci_stat, aci_evt_t *aci_evt)
+{
+  switch(aci_evt->evt_opcode)
+  {
+      case ACI_EVT_PIPE_STATUS:
+          {
+              uint8_t i=0;
+              
+              for (i=0; i < PIPES_ARRAY_SIZE; i++)
+              {
+                aci_stat->pipes_open_bitmap[i]   = aci_evt->params.pipe_status.pipes_open_bitmap[i];
+                aci_stat->pipes_closed_bitmap[i] = aci_evt->params.pipe_status.pipes_closed_bitmap[i];
+              }
+          }
+          break;
+      
+      case ACI_EVT_DISCONNECTED:
+          {
+              uint8_t i=0;
+              
+              for (i=0; i < PIPES_ARRAY_SIZE; i++)
+              {
+                aci_stat->pipes_open_bitmap[i] = 0;
+                aci_stat->pipes_closed_bitmap[i] = 0;
+              }
+              aci_stat->confirmation_pending = false;
+              aci_stat->data_credit_available = aci_stat->data_credit_total;
+              
+          }
+          break;
+          
+      case ACI_EVT_TIMING:            
+              aci_stat->connection_interval = aci_evt->params.timing.conn_rf_interval;
+              aci_stat->slave_latency       = aci_evt->params.timing.conn_slave_rf_latency;
+              aci_stat->supervision_timeout = aci_evt->params.timing.conn_rf_timeout;
+          break;
+
+      case ACI_EVT_CONNECTED:
+              aci_stat->connection_interval = aci_evt->params.connected.conn_rf_interval;
+              aci_stat->slave_latency       = aci_evt->params.connected.conn_slave_rf_latency;
+              aci_stat->supervision_timeout = aci_evt->params.connected.conn_rf_timeout;
+          break;
+
+      default:
+          /* Need default case to avoid compiler warnings about missing enum
+           * values on some platforms.
+           */
+          break;
+
+			
+			
+  }
+}
+
 bool lib_aci_event_get(aci_state_t *aci_stat, hal_aci_evt_t *p_aci_evt_data)
 {
   bool status = false;
   
   status = hal_aci_tl_event_get((hal_aci_data_t *)p_aci_evt_data);
   
-  /**
-  Update the state of the ACI with the 
-  ACI Events -> Pipe Status, Disconnected, Connected, Bond Status, Pipe Error
-  */
   if (true == status)
   {
-    aci_evt_t * aci_evt;
-    
-    aci_evt = &p_aci_evt_data->evt;  
-    
-    switch(aci_evt->evt_opcode)
-    {
-        case ACI_EVT_PIPE_STATUS:
-            {
-                uint8_t i=0;
-                
-                for (i=0; i < PIPES_ARRAY_SIZE; i++)
-                {
-                  aci_stat->pipes_open_bitmap[i]   = aci_evt->params.pipe_status.pipes_open_bitmap[i];
-                  aci_stat->pipes_closed_bitmap[i] = aci_evt->params.pipe_status.pipes_closed_bitmap[i];
-                }
-            }
-            break;
-        
-        case ACI_EVT_DISCONNECTED:
-            {
-                uint8_t i=0;
-                
-                for (i=0; i < PIPES_ARRAY_SIZE; i++)
-                {
-                  aci_stat->pipes_open_bitmap[i] = 0;
-                  aci_stat->pipes_closed_bitmap[i] = 0;
-                }
-                aci_stat->confirmation_pending = false;
-                aci_stat->data_credit_available = aci_stat->data_credit_total;
-                
-            }
-            break;
-            
-        case ACI_EVT_TIMING:            
-                aci_stat->connection_interval = aci_evt->params.timing.conn_rf_interval;
-                aci_stat->slave_latency       = aci_evt->params.timing.conn_slave_rf_latency;
-                aci_stat->supervision_timeout = aci_evt->params.timing.conn_rf_timeout;
-            break;
-
-        case ACI_EVT_CONNECTED:
-                aci_stat->connection_interval = aci_evt->params.connected.conn_rf_interval;
-                aci_stat->slave_latency       = aci_evt->params.connected.conn_slave_rf_latency;
-                aci_stat->supervision_timeout = aci_evt->params.connected.conn_rf_timeout;
-            break;
-
-        default:
-            /* Need default case to avoid compiler warnings about missing enum
-             * values on some platforms.
-             */
-            break;
-
-			
-			
-    }
+    m_aci_state_update(aci_stat, &p_aci_evt_data->evt);
   }
   return status;
 }
 
+hal_aci_evt_t *lib_aci_event_front(aci_state_t *aci_stat)
+{
+  hal_aci_evt_t *p_aci_evt_data = (hal_aci_evt_t *)hal_aci_tl_event_front();
+
+  /* The updates only copy fields of the event, so seeing it twice is harmless */
+  if (NULL != p_aci_evt_data)
+  {
+    m_aci_state_update(aci_stat, &p_aci_evt_data->evt);
+  }
+  return p_aci_evt_data;
+}
+
+bool lib_aci_event_consume(void)
+{
+  return hal_aci_tl_event_consume();
+}
+
 
 bool lib_aci_send_ack(aci_state_t *aci_stat, const uint8_t pipe)
 {
@@ -739,6 +774,11 @@ void lib_aci_pin_reset(void)
     hal_aci_tl_pin_reset();
 }
 
+void lib_aci_events_hold(bool hold)
+{
+  hal_aci_tl_events_hold(hold);
+}
+
 bool lib_aci_event_queue_empty(void)
 {
   return hal_aci_tl_rx_q_empty();
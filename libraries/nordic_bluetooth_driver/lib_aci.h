@@ -135,6 +135,13 @@ void lib_aci_pin_reset(void);
  */
 void lib_aci_init(aci_state_t *aci_stat, bool debug);
 
+/** @brief Initialization function without the pin reset.
+ *  @details As lib_aci_init(), but the nRF8001 is not reset, so one which kept its setup
+ *           while the MCU alone was reset can be used again without running do_aci_setup().
+ *           No ACI Device Started Event follows, unless the nRF8001 has just started by itself.
+ */
+void lib_aci_resume(aci_state_t *aci_stat, bool debug);
+
 
 /** @brief Gets the number of currently available ACI credits.
  *  @return Number of ACI credits.
@@ -521,11 +528,32 @@ bool lib_aci_event_get(aci_state_t *aci_stat, hal_aci_evt_t * aci_evt);
 */
 bool lib_aci_event_peek(hal_aci_evt_t *p_aci_evt_data);
 
+/** @brief Points at the ACI event at the head of the ACI Event Queue, without copying it
+ *  @details The state of the ACI is updated as by lib_aci_event_get(). The event stays in the
+ *  queue, valid and writable in place, until lib_aci_event_consume() is called, and takes up one
+ *  of the queue's ACI_RX_QUEUE_SIZE slots until then.
+ *  @param aci_stat pointer to the state of the ACI.
+ *  @return Pointer to the ACI Event, or NULL if there is none.
+*/
+hal_aci_evt_t *lib_aci_event_front(aci_state_t *aci_stat);
+
+/** @brief Removes the ACI event returned by lib_aci_event_front() from the ACI Event Queue
+ *  @return True if an ACI Event was removed.
+*/
+bool lib_aci_event_consume(void);
+
 /** @brief Flushes the events in the ACI command queues and ACI Event queue
  *
 */
 void lib_aci_flush(void);
 
+/** @brief Stops or restarts taking events from the nRF8001
+ *  @details
+ *  See hal_aci_tl_events_hold(). Used to leave the next events to a bootloader.
+ *  @param hold True to stop, false to take events again
+*/
+void lib_aci_events_hold(bool hold);
+
 /** @brief Return full status of the Event queue
  *  @details
  *
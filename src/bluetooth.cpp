@@ -14,11 +14,14 @@
  */
 
 #include <SPI.h>
+#include <avr/eeprom.h>
 #include <lib_aci.h>
 #include <aci_setup.h>
 #include <services.h>
+#include <bootloader_setup.h>
 
 #include "bluetooth.h"
+#include "dfu_format.h"
 
 /* Code based on both
    https://github.com/NordicSemiconductor/ble-sdk-arduino/tree/master/libraries/BLE/examples/ble_uart_project_template
@@ -35,6 +38,23 @@
 
 #define RDY_INTERRUPT_NUMBER 4 /* corresponds to pin 7, (D7) */
 
+#define VERSION_TIMEOUT 20 /* longest wait for the nRF8001 to report its version, in ms */
+
+/* the tracking state is broadcast on a TX_BROADCAST pipe, which the
+   nRFgo Studio setup in services.h does not have yet */
+#ifdef PIPE_GPS_WATCH_TRACKING_STATE_TX_BROADCAST
+#define BROADCAST_PIPE PIPE_GPS_WATCH_TRACKING_STATE_TX_BROADCAST
+#else
+#define BROADCAST_PIPE 0
+#endif
+
+/* link asked for before a firmware update, for the most image packets
+   a second: 7.5 to 15 ms connection interval, in units of 1.25 ms */
+#define DFU_MIN_INTERVAL 6
+#define DFU_MAX_INTERVAL 12
+#define DFU_HANDOVER_TIMEOUT 500 /* longest wait for the link to settle before the handover, in ms */
+#define DFU_ADVERTISING_TIMEOUT 180 /* bootloader advertising if the link is lost, in s */
+
 /* static setup inormation */
 #ifdef SERVICES_PIPE_TYPE_MAPPING_CONTENT
 static services_pipe_type_mapping_t services_pipe_type_mapping[NUMBER_OF_PIPES] = SERVICES_PIPE_TYPE_MAPPING_CONTENT;
@@ -64,6 +84,49 @@ bluetooth_status_t bluetooth_get_status(bluetooth_t *bluetooth)
     return bluetooth->status;
 }
 
+/*!
+ * @brief Asks the nRF8001 which setup it holds
+ *
+ * Sends Get Device Version and waits for the answer, dropping any
+ * other event. Gives up if the nRF8001 reports it has just started,
+ * or does not answer within VERSION_TIMEOUT.
+ *
+ * @param[in,out]  bluetooth  Pointer to bluetooth struct
+ * @param[out]     setup_id   Setup ID reported by the nRF8001
+ *
+ * @returns    True if the nRF8001 holds a setup, false otherwise
+ *
+ */
+static bool bluetooth_get_setup_id(bluetooth_t *bluetooth, uint32_t *setup_id)
+{
+    uint32_t started = millis();
+
+    lib_aci_device_version();
+
+    while (millis() - started < VERSION_TIMEOUT) {
+        hal_aci_evt_t *aci_data = lib_aci_event_front(&bluetooth->aci_state);
+        if (NULL == aci_data) {
+            continue;
+        }
+
+        aci_evt_t *aci_evt = &aci_data->evt;
+        bool answered = (ACI_EVT_CMD_RSP == aci_evt->evt_opcode
+                         && ACI_CMD_GET_DEVICE_VERSION == aci_evt->params.cmd_rsp.cmd_opcode);
+        bool has_setup = answered
+            && ACI_STATUS_SUCCESS == aci_evt->params.cmd_rsp.cmd_status
+            && aci_evt->params.cmd_rsp.params.get_device_version.setup_status;
+        bool restarted = (ACI_EVT_DEVICE_STARTED == aci_evt->evt_opcode);
+        *setup_id = aci_evt->params.cmd_rsp.params.get_device_version.setup_id;
+        lib_aci_event_consume();
+
+        if (answered || restarted) {
+            return has_setup;
+        }
+    }
+
+    return false;
+}
+
 /*!
  * @brief Performs setup and puts bluetooth to sleep
  *
@@ -71,6 +134,10 @@ bluetooth_status_t bluetooth_get_status(bluetooth_t *bluetooth)
  * and setting values in the bluetooth struct. Puts the device to sleep
  * after initialization.
  *
+ * The nRF8001 keeps its setup while only the AVR is reset. If it still
+ * holds the setup given to it last, as remembered in EEPROM, it is not
+ * reset and the setup is skipped.
+ *
  * @param[in,out]  bluetooth  Pointer to bluetooth struct to initialize
  *
  * @returns    Nothing.
@@ -78,11 +145,16 @@ bluetooth_status_t bluetooth_get_status(bluetooth_t *bluetooth)
  */
 void bluetooth_setup(bluetooth_t *bluetooth)
 {
+    uint32_t started = millis();
 
     bluetooth->setup_required = false;
     bluetooth->timing_change_done = false;
+    bluetooth->connect_pending = false;
+    bluetooth->broadcast_pending = false;
+    bluetooth->dfu_requested = false;
     bluetooth->status = SETUP;
     bluetooth->has_message = false;
+    bluetooth->message = NULL;
 
     /* convenience pointer */
     aci_state_t *aci_state = &bluetooth->aci_state;
@@ -122,16 +194,45 @@ void bluetooth_setup(bluetooth_t *bluetooth)
     aci_state->aci_pins.interface_is_interrupt = true;
     aci_state->aci_pins.interrupt_number       = RDY_INTERRUPT_NUMBER;
 
-    /* send initialization command to bluetooth module */
-    lib_aci_init(aci_state, false);
+    /* the LCD shares the bus, its transactions hold the RDYN interrupt off */
+    SPI.usingInterrupt(RDY_INTERRUPT_NUMBER);
+
+    /* try the nRF8001 as it is if it was given this setup before,
+       it has to be woken up if it was left asleep */
+    uint16_t setup_crc = aci_setup_crc(aci_state);
+    uint32_t setup_id;
+    bluetooth->setup_resumed = false;
+    if (setup_crc == eeprom_read_word((uint16_t*)BLUETOOTH_SETUP_CRC_ADDRESS)) {
+        lib_aci_resume(aci_state, false);
+        lib_aci_wakeup();
+        bluetooth->setup_resumed = bluetooth_get_setup_id(bluetooth, &setup_id)
+            && setup_id == eeprom_read_dword((uint32_t*)BLUETOOTH_SETUP_ID_ADDRESS);
+    }
 
-    /* wait for standby mode before putting device to sleep */
-    /* danger zone, rewrite this to be safer */
-    while (STANDBY != bluetooth_get_status(bluetooth)) {
-        bluetooth_poll(bluetooth);
+    if (bluetooth->setup_resumed) {
+        aci_state->data_credit_total = eeprom_read_byte((uint8_t*)BLUETOOTH_CREDITS_ADDRESS);
+        bluetooth->status = STANDBY;
+    } else {
+        /* send initialization command to bluetooth module */
+        lib_aci_init(aci_state, false);
+
+        /* wait for standby mode before putting device to sleep */
+        /* danger zone, rewrite this to be safer */
+        while (STANDBY != bluetooth_get_status(bluetooth)) {
+            bluetooth_poll(bluetooth);
+        }
+
+        /* remember the setup for the next reset */
+        if (bluetooth_get_setup_id(bluetooth, &setup_id)) {
+            eeprom_update_word((uint16_t*)BLUETOOTH_SETUP_CRC_ADDRESS, setup_crc);
+            eeprom_update_dword((uint32_t*)BLUETOOTH_SETUP_ID_ADDRESS, setup_id);
+            eeprom_update_byte((uint8_t*)BLUETOOTH_CREDITS_ADDRESS, aci_state->data_credit_total);
+        }
     }
 
     bluetooth_sleep(bluetooth);
+
+    bluetooth->setup_time = millis() - started;
 }
 
 /*!
@@ -164,6 +265,128 @@ void bluetooth_advertise(bluetooth_t *bluetooth)
     }
 }
 
+/*!
+ * @brief Begins advertising again from standby without waiting
+ *
+ * Sends the connect command, as bluetooth_advertise does once the
+ * module is awake. The status turns to ADVERTISING on a later
+ * bluetooth_poll. Used to let the phone reconnect after it has
+ * disconnected.
+ *
+ * @param[in,out]  bluetooth  Pointer to bluetooth struct
+ *
+ * @returns    True if the connect command was sent, false if not in
+ *             standby or one is already waiting for its response
+ *
+ */
+bool bluetooth_start_advertising(bluetooth_t *bluetooth)
+{
+    if (STANDBY != bluetooth->status || bluetooth->connect_pending) {
+        return false;
+    }
+
+    /* 0 => no timeout, 0x100 => 0x100 * 0.626 = 160 ms advertising interval */
+    bluetooth->connect_pending = lib_aci_connect(0, 0x100);
+    return bluetooth->connect_pending;
+}
+
+/*!
+ * @brief Sends data to the phone without waiting
+ *
+ * Sends the data over the UART TX pipe if the phone is connected and
+ * has the pipe open, and the nRF8001 has a data credit left. The
+ * credit comes back in a data credit event once the data is sent.
+ *
+ * @param[in,out]  bluetooth  Pointer to bluetooth struct
+ * @param[in]      data       Data to send
+ * @param[in]      length     Length of the data, at most ACI_PIPE_TX_DATA_MAX_LEN
+ *
+ * @returns    True if sent, false if it has to be sent later
+ *
+ */
+bool bluetooth_send(bluetooth_t *bluetooth, const uint8_t *data, uint8_t length)
+{
+    if (CONNECTED != bluetooth->status
+        || 0 == bluetooth->aci_state.data_credit_available
+        || !lib_aci_is_pipe_available(&bluetooth->aci_state, PIPE_UART_OVER_BTLE_UART_TX_TX)) {
+        return false;
+    }
+
+    if (!lib_aci_send_data(PIPE_UART_OVER_BTLE_UART_TX_TX, (uint8_t*)data, length)) {
+        return false;
+    }
+
+    bluetooth->aci_state.data_credit_available--;
+    return true;
+}
+
+/*!
+ * @brief Wakes up bluetooth and begins broadcasting
+ *
+ * Wakes up the Bluetooth module, opens the tracking state broadcast
+ * pipe for advertising and advertises without accepting connections
+ * until put to sleep. The broadcast pipe has to be in the nRFgo
+ * Studio setup, as PIPE_GPS_WATCH_TRACKING_STATE_TX_BROADCAST.
+ *
+ * @param[in,out]  bluetooth  Pointer to bluetooth struct, asleep
+ * @param[in]      interval   Advertising interval, 100 to 10240 ms
+ *
+ * @returns    True if broadcasting, false if the setup has no
+ *             broadcast pipe or the interval is out of range, leaving
+ *             the module asleep, or if the nRF8001 refused, leaving it
+ *             in standby
+ *
+ */
+bool bluetooth_broadcast(bluetooth_t *bluetooth, uint16_t interval)
+{
+    /* advertising intervals are in units of 0.625 ms */
+    uint32_t adv_interval = interval*8UL/5;
+    if (0 == BROADCAST_PIPE || adv_interval < 160 || adv_interval > 16384) {
+        return false;
+    }
+
+    lib_aci_wakeup();
+
+    /* DANGEROUS */
+    while (STANDBY != bluetooth->status) {
+        bluetooth_poll(bluetooth);
+    }
+
+    /* 0 => no timeout */
+    lib_aci_open_adv_pipe(BROADCAST_PIPE);
+    bluetooth->broadcast_pending = lib_aci_broadcast(0, adv_interval);
+
+    /* DANGEROUS */
+    while (bluetooth->broadcast_pending) {
+        bluetooth_poll(bluetooth);
+    }
+
+    return BROADCASTING == bluetooth->status;
+}
+
+/*!
+ * @brief Sets the data broadcast without waiting
+ *
+ * Sends the data as the local data of the broadcast pipe, which the
+ * nRF8001 puts in the advertising packets from then on.
+ *
+ * @param[in,out]  bluetooth  Pointer to bluetooth struct
+ * @param[in]      data       Data to broadcast
+ * @param[in]      length     Length of the data, at most the size of the broadcast pipe
+ *
+ * @returns    True if sent, false if not broadcasting or the command
+ *             queue is full
+ *
+ */
+bool bluetooth_set_broadcast_data(bluetooth_t *bluetooth, const uint8_t *data, uint8_t length)
+{
+    if (BROADCASTING != bluetooth->status) {
+        return false;
+    }
+
+    return lib_aci_set_local_data(&bluetooth->aci_state, BROADCAST_PIPE, (uint8_t*)data, length);
+}
+
 
 /*!
  * @brief Disconnects bluetooth (if necessary) and puts it to sleep
@@ -199,7 +422,9 @@ void bluetooth_sleep(bluetooth_t *bluetooth)
        SPI transaction avoiding this problem.
        Should probably read up on the nordic bluetooth driver and the arduino
        SPI driver to figure this out, but this works for now. */
+    hal_aci_tl_trace_mark(BLUETOOTH_TRACE_SLEEP_DELAY);
     delay(5);
+    hal_aci_tl_trace_mark(BLUETOOTH_TRACE_SLEEP_DONE);
 
     bluetooth->status = SLEEPING;
 }
@@ -222,12 +447,10 @@ bool bluetooth_has_message(bluetooth_t *bluetooth)
 /*!
  * @brief Fetch a message over bluetooth
  *
- * Returns last message recieved from bluetooth.Only a 
- * pointer is returned, so care must be taken to ensure
- * the value is consumed before the next message is read.
- * If bluetooth module receives a new message,and 
- * bluetooth_poll is called, the new message will stomp 
- * the current message. 
+ * Returns last message recieved from bluetooth. The message
+ * is not copied out of the driver's event queue, so it is
+ * only valid until the next call to bluetooth_poll, which
+ * drops it whether it has been read or not.
  *
  * @param[in]  bluetooth  Pointer to bluetooth struct
  *
@@ -236,7 +459,83 @@ bool bluetooth_has_message(bluetooth_t *bluetooth)
 char *bluetooth_get_message(bluetooth_t *bluetooth)
 {
     bluetooth->has_message = false;
-    return bluetooth->uart_buffer;
+    return bluetooth->message;
+}
+
+/*!
+ * @brief Checks if the phone has asked for a firmware update
+ *
+ * Returns true once the phone has written a start command to
+ * the DFU control point, until bluetooth_enter_bootloader
+ *
+ * @param[in]  bluetooth  Pointer to bluetooth struct
+ *
+ * @returns    True if a firmware update was asked for, false otherwise
+ */
+bool bluetooth_dfu_requested(bluetooth_t *bluetooth)
+{
+    return bluetooth->dfu_requested == true;
+}
+
+/*!
+ * @brief Hands the link over to the bootloader for a firmware update
+ *
+ * Asks the phone for the shortest connection interval, which the
+ * bootloader keeps for the transfer, and waits for every command to
+ * be sent and every data credit to come back. Then stops taking
+ * events from the nRF8001, so the phone's next write is left for the
+ * bootloader, stores the link settings for it in EEPROM and resets
+ * into it. The phone stays connected throughout.
+ *
+ * The device has to have Nordic's DFU bootloader at
+ * BOOTLOADER_START_ADDR.
+ *
+ * @param[in,out]  bluetooth  Pointer to bluetooth struct, connected
+ *
+ * @returns    Only if the handover was not possible, as the phone
+ *             disconnected or the link did not settle in time
+ */
+void bluetooth_enter_bootloader(bluetooth_t *bluetooth)
+{
+    aci_state_t *aci_state = &bluetooth->aci_state;
+    bluetooth->dfu_requested = false;
+
+    /* the new interval is agreed with the phone after the handover */
+    if (CONNECTED == bluetooth->status && aci_state->connection_interval > DFU_MAX_INTERVAL) {
+        lib_aci_change_timing(DFU_MIN_INTERVAL, DFU_MAX_INTERVAL, 0, GAP_PPCP_CONN_TIMEOUT);
+    }
+
+    /* the bootloader takes the link as it is, and counts on every
+       data credit being back */
+    uint32_t started = millis();
+    while (CONNECTED == bluetooth->status
+           && (!lib_aci_command_queue_empty()
+               || aci_state->data_credit_available != aci_state->data_credit_total)) {
+        if (millis() - started >= DFU_HANDOVER_TIMEOUT) {
+            return;
+        }
+        bluetooth_poll(bluetooth);
+    }
+    if (CONNECTED != bluetooth->status) {
+        return;
+    }
+
+    /* take no more events from the nRF8001 and handle those already
+       taken, the bootloader reads the rest */
+    lib_aci_events_hold(true);
+    while (!lib_aci_event_queue_empty() || NULL != bluetooth->message) {
+        bluetooth_poll(bluetooth);
+    }
+
+    uint8_t pipes[] = {PIPE_DEVICE_FIRMWARE_UPDATE_BLE_SERVICE_DFU_PACKET_RX,
+                       PIPE_DEVICE_FIRMWARE_UPDATE_BLE_SERVICE_DFU_CONTROL_POINT_TX,
+                       PIPE_DEVICE_FIRMWARE_UPDATE_BLE_SERVICE_DFU_CONTROL_POINT_RX_ACK_AUTO};
+    if (bootloader_data_store(aci_state, DFU_ADVERTISING_TIMEOUT, 0x100, pipes, sizeof(pipes))) {
+        bootloader_jump(aci_state);
+    }
+
+    /* the jump was not possible, carry on as before */
+    lib_aci_events_hold(false);
 }
 
 /*!
@@ -254,13 +553,23 @@ void bluetooth_poll(bluetooth_t *bluetooth)
 {
     /* still a bit fuzzy on all this, probably needs some work */
 
-    hal_aci_evt_t aci_data;
+    hal_aci_evt_t *aci_data;
+
+    /* the last message was read in place, release its event */
+    if (NULL != bluetooth->message)
+    {
+        lib_aci_event_consume();
+        bluetooth->message = NULL;
+        bluetooth->has_message = false;
+    }
 
     // We enter the if statement only when there is a ACI event available to be processed
-    if (lib_aci_event_get(&bluetooth->aci_state, &aci_data))
+    // The event is handled in place in the event queue rather than copied out
+    aci_data = lib_aci_event_front(&bluetooth->aci_state);
+    if (NULL != aci_data)
     {
         aci_evt_t *aci_evt;
-        aci_evt = &aci_data.evt;
+        aci_evt = &aci_data->evt;
 
         switch(aci_evt->evt_opcode)
         {
@@ -290,6 +599,13 @@ void bluetooth_poll(bluetooth_t *bluetooth)
         case ACI_EVT_CMD_RSP:
             if (ACI_CMD_CONNECT == aci_evt->params.cmd_rsp.cmd_opcode) {
                 bluetooth->status = ADVERTISING;
+                bluetooth->connect_pending = false;
+            }
+            if (ACI_CMD_BROADCAST == aci_evt->params.cmd_rsp.cmd_opcode) {
+                if (ACI_STATUS_SUCCESS == aci_evt->params.cmd_rsp.cmd_status) {
+                    bluetooth->status = BROADCASTING;
+                }
+                bluetooth->broadcast_pending = false;
             }
             if (ACI_CMD_WAKEUP == aci_evt->params.cmd_rsp.cmd_opcode) {
                 bluetooth->status = STANDBY;
@@ -333,24 +649,35 @@ void bluetooth_poll(bluetooth_t *bluetooth)
 
         case ACI_EVT_DISCONNECTED:
             bluetooth->status = STANDBY;
+            bluetooth->dfu_requested = false;
             break;
 
         case ACI_EVT_DATA_RECEIVED:
             /* if data is recieved over uart pipe */
             if (PIPE_UART_OVER_BTLE_UART_RX_RX == aci_evt->params.data_received.rx_data.pipe_number)
             {
-                /* copy into uart buffer */
                 /* subtract 2 from event length because the event length
                    includes the length byte and the event byte */
-                for(int i=0; i<aci_evt->len - 2; i++)
-                {
-                    bluetooth->uart_buffer[i] = aci_evt->params.data_received.rx_data.aci_data[i];
+                uint8_t length = (aci_evt->len > 2) ? aci_evt->len - 2 : 0;
+                if (length > PIPE_UART_OVER_BTLE_UART_RX_RX_MAX_SIZE) {
+                    length = PIPE_UART_OVER_BTLE_UART_RX_RX_MAX_SIZE;
                 }
 
-                /* and null terminate */
-                bluetooth->uart_buffer[aci_evt->len - 2] = '\0';
+                /* null terminate in place, the event has room after the data,
+                   and keep the event queued until the next poll */
+                bluetooth->message = (char *)aci_evt->params.data_received.rx_data.aci_data;
+                bluetooth->message[length] = '\0';
                 bluetooth->has_message = true;
             }
+
+            /* the phone asks for a firmware update on the DFU control point */
+            if (PIPE_DEVICE_FIRMWARE_UPDATE_BLE_SERVICE_DFU_CONTROL_POINT_RX_ACK_AUTO
+                    == aci_evt->params.data_received.rx_data.pipe_number
+                && aci_evt->len > 2
+                && DFU_START == aci_evt->params.data_received.rx_data.aci_data[DFU_OPCODE_OFFSET])
+            {
+                bluetooth->dfu_requested = true;
+            }
             break;
 
         /* keep track of "credit", which is basically the space available in the "command queue" */
@@ -370,6 +697,12 @@ void bluetooth_poll(bluetooth_t *bluetooth)
             }
             break;
         }
+
+        /* a message keeps its event until the next poll */
+        if (NULL == bluetooth->message)
+        {
+            lib_aci_event_consume();
+        }
     }
 
     /* setup_required is set to true when the device starts up and enters setup mode.
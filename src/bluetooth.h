@@ -13,15 +13,32 @@
  * 
  */
 
+#ifndef BLUETOOTH_H
+#define BLUETOOTH_H
+
 #include <lib_aci.h>
 
+/* The setup last given to the nRF8001 is remembered in EEPROM, after
+   the last fix and TTFF log, so it can be skipped when the nRF8001
+   still holds it. Values are little endian. */
+#define BLUETOOTH_SETUP_CRC_ADDRESS 0x3C2  /* CRC of the setup messages (2 bytes) */
+#define BLUETOOTH_SETUP_ID_ADDRESS 0x3C4   /* setup ID the nRF8001 reported for it (4 bytes) */
+#define BLUETOOTH_CREDITS_ADDRESS 0x3C8    /* data credits of the nRF8001 (1 byte) */
+
+/* Marks put in the ACI trace (HAL_ACI_TRACE in hal_aci_tl.h) around
+   the firmware's own waits next to the nRF8001's traffic */
+#define BLUETOOTH_TRACE_SLEEP_DELAY 1  /* bluetooth_sleep() starts its delay before the LCD */
+#define BLUETOOTH_TRACE_SLEEP_DONE 2   /* bluetooth_sleep() ends its delay */
+#define BLUETOOTH_TRACE_SETUP_DELAY 3  /* setup() starts its delay between Bluetooth and LCD */
+#define BLUETOOTH_TRACE_SETUP_DONE 4   /* setup() ends its delay */
+
 /*!
  * @brief enum holding acceptable statuses of Bluetooth module
  *
  * Possible states of Bluetooth are listed in the enum below.
  *
  */
-enum bluetooth_status_t {SLEEPING, SETUP, STANDBY, ADVERTISING, CONNECTED};
+enum bluetooth_status_t {SLEEPING, SETUP, STANDBY, ADVERTISING, CONNECTED, BROADCASTING};
 
 /*!
  * @brief struct containing data needed for Bluetooth module
@@ -32,11 +49,16 @@ enum bluetooth_status_t {SLEEPING, SETUP, STANDBY, ADVERTISING, CONNECTED};
  */
 struct bluetooth_t {
     aci_state_t aci_state;      /* low level state */
-    char uart_buffer[21];       /* buffer for receiving messages */
+    char *message;              /* last message, in place in the ACI event queue */
     bluetooth_status_t status;  
     bool has_message;           /* tell if message ready */
     bool setup_required;        /* used internally for setup procedure */
     bool timing_change_done;    /* used internally for making timing changes */
+    bool connect_pending;       /* connect sent by bluetooth_start_advertising, not yet answered */
+    bool broadcast_pending;     /* broadcast sent by bluetooth_broadcast, not yet answered */
+    bool dfu_requested;         /* phone asked for a firmware update on the DFU control point */
+    bool setup_resumed;         /* nRF8001 still held its setup at the last bluetooth_setup */
+    uint16_t setup_time;        /* time the last bluetooth_setup took, in ms */
 };
 
 /*!
@@ -46,6 +68,10 @@ struct bluetooth_t {
  * and setting values in the bluetooth struct. Puts the device to sleep
  * after initialization.
  *
+ * The nRF8001 keeps its setup while only the AVR is reset. If it still
+ * holds the setup given to it last, as remembered in EEPROM, it is not
+ * reset and the setup is skipped.
+ *
  * @param[in,out]  bluetooth  Pointer to bluetooth struct to initialize
  *
  * @returns    Nothing.
@@ -66,6 +92,73 @@ void bluetooth_setup(bluetooth_t *bluetooth);
  */
 void bluetooth_advertise(bluetooth_t *bluetooth);
 
+/*!
+ * @brief Begins advertising again from standby without waiting
+ *
+ * Sends the connect command, as bluetooth_advertise does once the
+ * module is awake. The status turns to ADVERTISING on a later
+ * bluetooth_poll. Used to let the phone reconnect after it has
+ * disconnected.
+ *
+ * @param[in,out]  bluetooth  Pointer to bluetooth struct
+ *
+ * @returns    True if the connect command was sent, false if not in
+ *             standby or one is already waiting for its response
+ *
+ */
+bool bluetooth_start_advertising(bluetooth_t *bluetooth);
+
+/*!
+ * @brief Sends data to the phone without waiting
+ *
+ * Sends the data over the UART TX pipe if the phone is connected and
+ * has the pipe open, and the nRF8001 has a data credit left. The
+ * credit comes back in a data credit event once the data is sent.
+ *
+ * @param[in,out]  bluetooth  Pointer to bluetooth struct
+ * @param[in]      data       Data to send
+ * @param[in]      length     Length of the data, at most ACI_PIPE_TX_DATA_MAX_LEN
+ *
+ * @returns    True if sent, false if it has to be sent later
+ *
+ */
+bool bluetooth_send(bluetooth_t *bluetooth, const uint8_t *data, uint8_t length);
+
+/*!
+ * @brief Wakes up bluetooth and begins broadcasting
+ *
+ * Wakes up the Bluetooth module, opens the tracking state broadcast
+ * pipe for advertising and advertises without accepting connections
+ * until put to sleep. The broadcast pipe has to be in the nRFgo
+ * Studio setup, as PIPE_GPS_WATCH_TRACKING_STATE_TX_BROADCAST.
+ *
+ * @param[in,out]  bluetooth  Pointer to bluetooth struct, asleep
+ * @param[in]      interval   Advertising interval, 100 to 10240 ms
+ *
+ * @returns    True if broadcasting, false if the setup has no
+ *             broadcast pipe or the interval is out of range, leaving
+ *             the module asleep, or if the nRF8001 refused, leaving it
+ *             in standby
+ *
+ */
+bool bluetooth_broadcast(bluetooth_t *bluetooth, uint16_t interval);
+
+/*!
+ * @brief Sets the data broadcast without waiting
+ *
+ * Sends the data as the local data of the broadcast pipe, which the
+ * nRF8001 puts in the advertising packets from then on.
+ *
+ * @param[in,out]  bluetooth  Pointer to bluetooth struct
+ * @param[in]      data       Data to broadcast
+ * @param[in]      length     Length of the data, at most the size of the broadcast pipe
+ *
+ * @returns    True if sent, false if not broadcasting or the command
+ *             queue is full
+ *
+ */
+bool bluetooth_set_broadcast_data(bluetooth_t *bluetooth, const uint8_t *data, uint8_t length);
+
 /*!
  * @brief Disconnects bluetooth (if necessary) and puts it to sleep
  *
@@ -106,12 +199,10 @@ bool bluetooth_has_message(bluetooth_t *bluetooth);
 /*!
  * @brief Fetch a message over bluetooth
  *
- * Returns last message recieved from bluetooth.Only a 
- * pointer is returned, so care must be taken to ensure
- * the value is consumed before the next message is read.
- * If bluetooth module receives a new message,and 
- * bluetooth_poll is called, the new message will stomp 
- * the current message. 
+ * Returns last message recieved from bluetooth. The message
+ * is not copied out of the driver's event queue, so it is
+ * only valid until the next call to bluetooth_poll, which
+ * drops it whether it has been read or not.
  *
  * @param[in]  bluetooth  Pointer to bluetooth struct
  *
@@ -119,6 +210,38 @@ bool bluetooth_has_message(bluetooth_t *bluetooth);
  */
 char *bluetooth_get_message(bluetooth_t *bluetooth);
 
+/*!
+ * @brief Checks if the phone has asked for a firmware update
+ *
+ * Returns true once the phone has written a start command to
+ * the DFU control point, until bluetooth_enter_bootloader
+ *
+ * @param[in]  bluetooth  Pointer to bluetooth struct
+ *
+ * @returns    True if a firmware update was asked for, false otherwise
+ */
+bool bluetooth_dfu_requested(bluetooth_t *bluetooth);
+
+/*!
+ * @brief Hands the link over to the bootloader for a firmware update
+ *
+ * Asks the phone for the shortest connection interval, which the
+ * bootloader keeps for the transfer, and waits for every command to
+ * be sent and every data credit to come back. Then stops taking
+ * events from the nRF8001, so the phone's next write is left for the
+ * bootloader, stores the link settings for it in EEPROM and resets
+ * into it. The phone stays connected throughout.
+ *
+ * The device has to have Nordic's DFU bootloader at
+ * BOOTLOADER_START_ADDR.
+ *
+ * @param[in,out]  bluetooth  Pointer to bluetooth struct, connected
+ *
+ * @returns    Only if the handover was not possible, as the phone
+ *             disconnected or the link did not settle in time
+ */
+void bluetooth_enter_bootloader(bluetooth_t *bluetooth);
+
 /*!
  * @brief Updates Bluetooth statuses 
  *
@@ -131,3 +254,5 @@ char *bluetooth_get_message(bluetooth_t *bluetooth);
  * @returns    Nothing
  */   
 void bluetooth_poll(bluetooth_t *bluetooth);
+
+#endif
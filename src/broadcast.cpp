@@ -0,0 +1,138 @@
+/*!
+ * @file
+ *
+ * @brief Interface for broadcasting the tracking state
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains the function definitions used to pack the
+ * tracking state of each fix and put it in the advertising data.
+ *
+ * See broadcast format for details on the record layout
+ */
+
+#include <stdint.h>
+#include <math.h>
+#include "Arduino.h"
+
+#include "broadcast.h"
+
+/*!
+ * @brief Converts an angle to signed fixed point
+ *
+ * @param[in]  degrees  Angle to convert, in degrees
+ *
+ * @returns    The angle in units of 1/BROADCAST_DEGREE_SCALE degrees
+ *
+ */
+static int32_t to_fixed_degrees(float degrees)
+{
+    float fixed = degrees*BROADCAST_DEGREE_SCALE;
+    return fixed < 0 ? fixed - 0.5 : fixed + 0.5;
+}
+
+/*!
+ * @brief Encodes a 32 bit value little endian
+ *
+ * @param[out] buffer  Buffer to encode into
+ * @param[in]  value   Value to encode
+ *
+ * @returns    Nothing.
+ *
+ */
+static void put_u32(uint8_t *buffer, uint32_t value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+    buffer[2] = value >> 16;
+    buffer[3] = value >> 24;
+}
+
+/*!
+ * @brief Initializes broadcasting for a tracking session
+ *
+ * @param[in,out] broadcast  Pointer to broadcast struct to initialize
+ * @param[in]     interval   Least time between records set, in ms
+ *
+ * @returns    Nothing.
+ *
+ */
+void broadcast_initialize(broadcast_t *broadcast, uint16_t interval)
+{
+    memset(broadcast, 0, sizeof(*broadcast));
+    broadcast->interval = interval;
+}
+
+/*!
+ * @brief Packs the tracking state after a fix
+ *
+ * Encodes the position of the fix and the speed and heading of the
+ * tracking data as the newest record, replacing one which has not
+ * been set yet. The record is set by broadcast_poll.
+ *
+ * @param[in,out] broadcast  Pointer to broadcast struct
+ * @param[in]     fix        Pointer to the gps data of the fix
+ * @param[in]     data       Pointer to the tracking data of the fix
+ *
+ * @returns    Nothing.
+ *
+ */
+void broadcast_update(broadcast_t *broadcast, gps_data_t *fix, tracking_data_t *data)
+{
+    if (broadcast->pending) {
+        broadcast->coalesced++;
+    }
+
+    /* the sequence number is given when the record is set */
+    uint8_t *record = broadcast->record;
+    record[BROADCAST_FLAGS_OFFSET] = data->waypoint_done ? BROADCAST_WAYPOINT_DONE : 0;
+    put_u32(&record[BROADCAST_LATITUDE_OFFSET], to_fixed_degrees(fix->location.latitude));
+    put_u32(&record[BROADCAST_LONGITUDE_OFFSET], to_fixed_degrees(fix->location.longitude));
+
+    float speed = data->instant_speed*BROADCAST_SPEED_SCALE + 0.5;
+    uint16_t fixed_speed = !(speed >= 0) ? 0 : speed >= 0xFFFF ? 0xFFFF : (uint16_t)speed;
+    record[BROADCAST_SPEED_OFFSET] = fixed_speed;
+    record[BROADCAST_SPEED_OFFSET + 1] = fixed_speed >> 8;
+
+    /* 256 steps to the turn, wrapping 360 to 0 */
+    float heading = data->heading*(256/360.0) + 0.5;
+    record[BROADCAST_HEADING_OFFSET] = heading >= 0 ? (uint16_t)heading : 0;
+
+    broadcast->pending = true;
+}
+
+/*!
+ * @brief Keeps the nRF8001 serviced and sets the newest record
+ *
+ * Handles one Bluetooth event and, once the interval has passed since
+ * the last record was set, sets the newest record as the advertising
+ * data if it is new. Never waits on the nRF8001, so it can be called
+ * on every pass of the tracking loop.
+ *
+ * @param[in,out] broadcast  Pointer to broadcast struct
+ * @param[in,out] bluetooth  Pointer to bluetooth struct, broadcasting
+ * @param[in]     now        Current time, in ms
+ *
+ * @returns    Nothing.
+ *
+ */
+void broadcast_poll(broadcast_t *broadcast, bluetooth_t *bluetooth, uint32_t now)
+{
+    bluetooth_poll(bluetooth);
+
+    if (!broadcast->pending
+        || (broadcast->updates > 0 && now - broadcast->set_at < broadcast->interval)) {
+        return;
+    }
+
+    broadcast->record[BROADCAST_SEQUENCE_OFFSET] = broadcast->sequence + 1;
+    if (bluetooth_set_broadcast_data(bluetooth, broadcast->record, BROADCAST_SIZE)) {
+        broadcast->sequence++;
+        broadcast->pending = false;
+        broadcast->set_at = now;
+        broadcast->updates++;
+    }
+}
@@ -0,0 +1,93 @@
+/*!
+ * @file
+ *
+ * @brief Header file for broadcasting the tracking state
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains the data structures and function prototypes
+ * used to put the position and speed of the latest fix in the
+ * advertising data, where any phone in range can read it without
+ * connecting.
+ *
+ * See broadcast format for details on the record layout
+ */
+
+#ifndef BROADCAST_H
+#define BROADCAST_H
+
+#include <stdint.h>
+#include "Arduino.h"
+
+#include "bluetooth.h"
+#include "broadcast_format.h"
+#include "gps.h"
+#include "types.h"
+
+/*!
+ * @brief struct holding the newest record and bookkeeping values
+ *
+ * Every fix is packed into the record, but it is given to the nRF8001
+ * at most once per interval, as scanners only see it a few times a
+ * second anyway. A record waiting for its turn is replaced by the
+ * next fix.
+ *
+ */
+struct broadcast_t {
+    uint8_t record[BROADCAST_SIZE]; /*!< Newest record, encoded */
+    uint8_t sequence;               /*!< Sequence number of the last record set */
+    boolean pending;                /*!< Flag set while the newest record is not set */
+    uint16_t interval;              /*!< Least time between records set, in ms */
+    uint32_t set_at;                /*!< Time the last record was set, in ms */
+    uint16_t updates;               /*!< Number of records set */
+    uint16_t coalesced;             /*!< Number of records replaced before they were set */
+};
+
+/*!
+ * @brief Initializes broadcasting for a tracking session
+ *
+ * @param[in,out] broadcast  Pointer to broadcast struct to initialize
+ * @param[in]     interval   Least time between records set, in ms
+ *
+ * @returns    Nothing.
+ *
+ */
+void broadcast_initialize(broadcast_t *broadcast, uint16_t interval);
+
+/*!
+ * @brief Packs the tracking state after a fix
+ *
+ * Encodes the position of the fix and the speed and heading of the
+ * tracking data as the newest record, replacing one which has not
+ * been set yet. The record is set by broadcast_poll.
+ *
+ * @param[in,out] broadcast  Pointer to broadcast struct
+ * @param[in]     fix        Pointer to the gps data of the fix
+ * @param[in]     data       Pointer to the tracking data of the fix
+ *
+ * @returns    Nothing.
+ *
+ */
+void broadcast_update(broadcast_t *broadcast, gps_data_t *fix, tracking_data_t *data);
+
+/*!
+ * @brief Keeps the nRF8001 serviced and sets the newest record
+ *
+ * Handles one Bluetooth event and, once the interval has passed since
+ * the last record was set, sets the newest record as the advertising
+ * data if it is new. Never waits on the nRF8001, so it can be called
+ * on every pass of the tracking loop.
+ *
+ * @param[in,out] broadcast  Pointer to broadcast struct
+ * @param[in,out] bluetooth  Pointer to bluetooth struct, broadcasting
+ * @param[in]     now        Current time, in ms
+ *
+ * @returns    Nothing.
+ *
+ */
+void broadcast_poll(broadcast_t *broadcast, bluetooth_t *bluetooth, uint32_t now);
+
+#endif
@@ -0,0 +1,53 @@
+/*!
+ * @file
+ *
+ * @brief Layout of the tracking state broadcast while tracking
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains only the constants describing a broadcast record
+ * so that it can be shared between the firmware and a scanner on the
+ * phone side.
+ *
+ * The record is the service data of the tracking state broadcast
+ * pipe, sent in every advertising packet to any scanner in range
+ * without a connection, and is laid out as follows:
+ *
+ *   0x00 sequence (1 byte, incremented for every record set)
+ *   0x01 flags (1 byte, BROADCAST_WAYPOINT_DONE)
+ *   0x02 latitude (4 bytes, signed)
+ *   0x06 longitude (4 bytes, signed)
+ *   0x0A instant speed (2 bytes)
+ *   0x0C heading (1 byte)
+ *
+ * A scanner sees the same record in many packets, and the sequence
+ * number tells it when the record has changed.
+ *
+ * Multi-byte values are little endian. Latitude and longitude are in
+ * units of 1/BROADCAST_DEGREE_SCALE degrees, north and east positive,
+ * the speed in units of 1/BROADCAST_SPEED_SCALE mph and the heading in
+ * units of 360/256 degrees clockwise from north.
+ *
+ */
+
+#ifndef BROADCAST_FORMAT_H
+#define BROADCAST_FORMAT_H
+
+#define BROADCAST_SIZE 13                  /*!< Size of a record, within the advertising packet */
+
+#define BROADCAST_SEQUENCE_OFFSET 0        /*!< Offset of the sequence byte */
+#define BROADCAST_FLAGS_OFFSET 1           /*!< Offset of the flags byte */
+#define BROADCAST_LATITUDE_OFFSET 2        /*!< Offset of the latitude */
+#define BROADCAST_LONGITUDE_OFFSET 6       /*!< Offset of the longitude */
+#define BROADCAST_SPEED_OFFSET 10          /*!< Offset of the instant speed */
+#define BROADCAST_HEADING_OFFSET 12        /*!< Offset of the heading */
+
+#define BROADCAST_WAYPOINT_DONE 0x01       /*!< Flag set once the waypoint path is complete */
+
+#define BROADCAST_DEGREE_SCALE 100000L     /*!< Fixed point units per degree of latitude or longitude */
+#define BROADCAST_SPEED_SCALE 100          /*!< Fixed point units per mph */
+
+#endif
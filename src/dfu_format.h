@@ -0,0 +1,73 @@
+/*!
+ * @file
+ *
+ * @brief Layout of the firmware update control point messages
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains only the constants describing the messages of
+ * the Device Firmware Update service, as Nordic's DFU bootloader and
+ * the phone apps use them, so that they can be shared between the
+ * firmware and host tools.
+ *
+ * The phone writes commands to the control point pipe, their opcode
+ * first, and the image to the packet pipe. The bootloader notifies
+ * the phone on the control point:
+ *
+ *   response      0x00 DFU_RESPONSE
+ *                 0x01 opcode of the command answered
+ *                 0x02 status (DFU_SUCCESS or an error)
+ *   receipt       0x00 DFU_PACKET_RECEIPT
+ *                 0x01 image bytes received so far (4 bytes)
+ *
+ * A transfer goes as follows:
+ *
+ *   1. DFU_START, with the image type, which the application answers
+ *      by handing the link over to the bootloader
+ *   2. the image sizes on the packet pipe: softdevice, bootloader and
+ *      application (4 bytes each), answered with a response
+ *   3. DFU_PACKET_RECEIPT_REQUEST, with the number of packets between
+ *      receipts (2 bytes, 0 for none)
+ *   4. DFU_RECEIVE_IMAGE, then the image in packets of up to 20 bytes,
+ *      answered with a response once it is all in
+ *   5. DFU_VALIDATE, answered with a response
+ *   6. DFU_ACTIVATE_AND_RESET
+ *
+ * Multi-byte values are little endian.
+ *
+ */
+
+#ifndef DFU_FORMAT_H
+#define DFU_FORMAT_H
+
+#define DFU_START 0x01                     /*!< Start a transfer */
+#define DFU_INITIALIZE 0x02                /*!< Initialization parameters follow */
+#define DFU_RECEIVE_IMAGE 0x03             /*!< The image follows on the packet pipe */
+#define DFU_VALIDATE 0x04                  /*!< Check the image received */
+#define DFU_ACTIVATE_AND_RESET 0x05        /*!< Run the new image */
+#define DFU_RESET 0x06                     /*!< Give up and reset */
+#define DFU_REPORT_SIZE 0x07               /*!< Report the image bytes received */
+#define DFU_PACKET_RECEIPT_REQUEST 0x08    /*!< Ask for receipts every so many packets */
+#define DFU_RESPONSE 0x10                  /*!< Notification answering a command */
+#define DFU_PACKET_RECEIPT 0x11            /*!< Notification of the image bytes received */
+
+#define DFU_IMAGE_APPLICATION 0x04         /*!< Image type of DFU_START for an application */
+
+#define DFU_SUCCESS 0x01                   /*!< Response status of a command carried out */
+#define DFU_INVALID_STATE 0x02             /*!< Response status of a command out of turn */
+#define DFU_NOT_SUPPORTED 0x03             /*!< Response status of an unknown command */
+#define DFU_DATA_SIZE_EXCEEDS_LIMIT 0x04   /*!< Response status of an image too large */
+#define DFU_CRC_ERROR 0x05                 /*!< Response status of a damaged image */
+#define DFU_OPERATION_FAILED 0x06          /*!< Response status of a failed flash write */
+
+#define DFU_OPCODE_OFFSET 0                /*!< Offset of the opcode of any message */
+#define DFU_RESPONSE_OPCODE_OFFSET 1       /*!< Offset of the opcode answered in a response */
+#define DFU_RESPONSE_STATUS_OFFSET 2       /*!< Offset of the status in a response */
+#define DFU_RECEIPT_BYTES_OFFSET 1         /*!< Offset of the bytes received in a receipt */
+#define DFU_SIZES_APPLICATION_OFFSET 8     /*!< Offset of the application size in the sizes packet */
+#define DFU_SIZES_SIZE 12                  /*!< Size of the sizes packet */
+
+#endif
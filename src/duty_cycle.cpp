@@ -0,0 +1,90 @@
+/*!
+ * @file
+ *
+ * @brief Interface for choosing the GPS duty cycle while tracking
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains the function definitions which choose how long
+ * the GPS may sleep between fixes.
+ *
+ * See the header for a description of the policy
+ */
+
+#include "Arduino.h"
+
+#include "duty_cycle.h"
+#include "tracking.h"
+
+#define MPH_TO_METRES_PER_SECOND 0.44704
+
+/*!
+ * @brief Initializes the duty cycle
+ *
+ * The GPS starts fully on.
+ *
+ * @param[in,out] duty_cycle  Pointer to duty cycle struct to initialize
+ *
+ * @returns    Nothing.
+ *
+ */
+void duty_cycle_initialize(duty_cycle_t *duty_cycle)
+{
+    duty_cycle->sleep = 0;
+    duty_cycle->enabled = true;
+}
+
+/*!
+ * @brief Chooses the sleep after a tracked fix
+ *
+ * The sleep is only changed when it differs from the one in effect by
+ * more than a quarter, so that the GPS is not sent a new mode after
+ * every fix.
+ *
+ * @param[in,out] duty_cycle  Pointer to duty cycle struct
+ * @param[in]     data        Pointer to tracking data after the fix
+ *
+ * @returns    True if the sleep changed and must be sent to the GPS
+ *
+ */
+boolean duty_cycle_update(duty_cycle_t *duty_cycle, tracking_data_t *data)
+{
+    if (!duty_cycle->enabled) {
+        return false;
+    }
+
+    float speed = data->instant_speed*MPH_TO_METRES_PER_SECOND;
+    float sleep = DUTY_CYCLE_MAX_SLEEP/1000.0;
+
+    /* limit the distance covered asleep */
+    if (speed > 0) {
+        sleep = min(sleep, DUTY_CYCLE_STEP_DISTANCE/speed);
+    }
+
+    /* wake at least twice before the waypoint could be reached */
+    if (!data->waypoint_done) {
+        float to_waypoint = max(data->waypoint_distance - WAYPOINT_DISTANCE_THRESHOLD, 0);
+        float approach = max(speed, DUTY_CYCLE_WAYPOINT_SPEED);
+        sleep = min(sleep, to_waypoint/approach/2);
+    }
+
+    /* whole seconds, as the gps fixes once a second */
+    uint16_t chosen = (uint16_t)sleep*1000U;
+    if (chosen < DUTY_CYCLE_MIN_SLEEP) {
+        chosen = 0;
+    }
+
+    uint16_t current = duty_cycle->sleep;
+    if (chosen == current) {
+        return false;
+    }
+    if (chosen != 0 && current != 0 && abs((int32_t)chosen - current) <= current/4) {
+        return false;
+    }
+
+    duty_cycle->sleep = chosen;
+    return true;
+}
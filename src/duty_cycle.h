@@ -0,0 +1,74 @@
+/*!
+ * @file
+ *
+ * @brief Header file for choosing the GPS duty cycle while tracking
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains the data structures and function prototypes
+ * which choose how long the GPS may sleep between fixes on long rides.
+ *
+ * The GPS runs in periodic standby (PMTK225): it tracks for
+ * DUTY_CYCLE_RUN_TIME, then sleeps. The sleep is chosen after each fix
+ * so that:
+ *   - the rider covers at most DUTY_CYCLE_STEP_DISTANCE while asleep
+ *   - the GPS wakes at least twice before the rider can reach the
+ *     current waypoint, even from a stop
+ * Sleeps shorter than DUTY_CYCLE_MIN_SLEEP keep the GPS fully on, as
+ * the GPS would spend most of them reacquiring.
+ *
+ */
+
+#ifndef DUTY_CYCLE_H
+#define DUTY_CYCLE_H
+
+#include <stdint.h>
+#include "Arduino.h"
+
+#include "types.h"
+
+#define DUTY_CYCLE_RUN_TIME 3000        /*!< Time the GPS tracks each cycle, in ms */
+#define DUTY_CYCLE_MIN_SLEEP 4000       /*!< Shortest sleep used, in ms */
+#define DUTY_CYCLE_MAX_SLEEP 30000      /*!< Longest sleep used, in ms */
+#define DUTY_CYCLE_STEP_DISTANCE 150.0  /*!< Largest distance covered asleep, in metres */
+#define DUTY_CYCLE_WAYPOINT_SPEED 8.0   /*!< Speed assumed when nearing a waypoint from a stop, in m/s */
+
+/*!
+ * @brief struct holding the duty cycle in effect
+ */
+struct duty_cycle_t {
+    uint16_t sleep;    /*!< Sleep between runs, in ms, or 0 when fully on */
+    boolean enabled;   /*!< Flag cleared if the GPS does not accept periodic mode */
+};
+
+/*!
+ * @brief Initializes the duty cycle
+ *
+ * The GPS starts fully on.
+ *
+ * @param[in,out] duty_cycle  Pointer to duty cycle struct to initialize
+ *
+ * @returns    Nothing.
+ *
+ */
+void duty_cycle_initialize(duty_cycle_t *duty_cycle);
+
+/*!
+ * @brief Chooses the sleep after a tracked fix
+ *
+ * The sleep is only changed when it differs from the one in effect by
+ * more than a quarter, so that the GPS is not sent a new mode after
+ * every fix.
+ *
+ * @param[in,out] duty_cycle  Pointer to duty cycle struct
+ * @param[in]     data        Pointer to tracking data after the fix
+ *
+ * @returns    True if the sleep changed and must be sent to the GPS
+ *
+ */
+boolean duty_cycle_update(duty_cycle_t *duty_cycle, tracking_data_t *data);
+
+#endif
@@ -0,0 +1,133 @@
+/*!
+ * @file
+ *
+ * @brief Interface for rejecting bad fixes before they are tracked
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains the function definitions used to keep GPS
+ * noise out of the distance travelled.
+ *
+ * See the header for a description of the filter
+ */
+
+#include "Arduino.h"
+
+#include "fix_filter.h"
+#include "haversine.h"
+
+#define MPH_TO_METRES_PER_SECOND 0.44704
+
+/*!
+ * @brief Makes a fix the new anchor
+ *
+ * @param[in,out] filter  Pointer to filter struct
+ * @param[in]     data    Pointer to gps data of the fix
+ *
+ * @returns    Nothing.
+ *
+ */
+static void set_anchor(fix_filter_t *filter, gps_data_t *data)
+{
+    filter->anchor = data->location;
+    filter->anchor_time = data->time;
+    filter->anchor_milliseconds = data->milliseconds;
+    filter->anchor_speed = data->speed*MPH_TO_METRES_PER_SECOND;
+    filter->has_anchor = true;
+    filter->rejects = 0;
+}
+
+/*!
+ * @brief Checks the quality the GPS reports for a fix
+ *
+ * Quality is only known if the fix includes a GGA datastring (HDOP
+ * is 0 otherwise), in which case it must be a fix with a low HDOP.
+ *
+ * @param[in]  data  Pointer to gps data of the fix
+ *
+ * @returns    True if the fix is good enough to track
+ *
+ */
+static boolean quality_good(gps_data_t *data)
+{
+    if (data->hdop == 0) return true;
+    return data->fix_quality > 0 && data->hdop <= FIX_FILTER_MAX_HDOP;
+}
+
+/*!
+ * @brief Initializes the fix filter
+ *
+ * @param[in,out] filter  Pointer to filter struct to initialize
+ *
+ * @returns    Nothing.
+ *
+ */
+void fix_filter_initialize(fix_filter_t *filter)
+{
+    filter->has_anchor = false;
+    filter->rejects = 0;
+}
+
+/*!
+ * @brief Filters a fix
+ *
+ * Decides whether a fix is tracked. Held fixes have their location
+ * replaced by the anchor. After FIX_FILTER_MAX_REJECTS consecutive
+ * outliers the next good quality fix resets the anchor, so that a
+ * bad anchor cannot block tracking.
+ *
+ * @param[in,out] filter  Pointer to filter struct
+ * @param[in,out] data    Pointer to gps data of the fix
+ *
+ * @returns    Outcome for the fix
+ *
+ */
+fix_filter_result_t fix_filter_update(fix_filter_t *filter, gps_data_t *data)
+{
+    if (!quality_good(data)) {
+        return FIX_REJECTED;
+    }
+
+    if (!filter->has_anchor || filter->rejects >= FIX_FILTER_MAX_REJECTS) {
+        boolean reset = filter->has_anchor;
+        set_anchor(filter, data);
+        return reset ? FIX_RESET : FIX_MOVED;
+    }
+
+    /* time since the anchor, assuming 1 s if the gps has no date */
+    float dt = 1.0;
+    if (data->time != 0 && filter->anchor_time != 0) {
+        dt = (int32_t)(data->time - filter->anchor_time)
+           + ((int16_t)data->milliseconds - (int16_t)filter->anchor_milliseconds)/1000.0;
+    }
+    if (dt <= 0) {
+        return FIX_REJECTED;
+    }
+
+    float distance = distance_between(filter->anchor, data->location);
+    float speed = data->speed*MPH_TO_METRES_PER_SECOND;
+
+    /* fastest the rider could have gone since the anchor */
+    float limit = max(speed, filter->anchor_speed)
+                + FIX_FILTER_MAX_ACCELERATION*dt + FIX_FILTER_SPEED_SLACK;
+    if (distance > limit*dt) {
+        filter->rejects++;
+        return FIX_REJECTED;
+    }
+
+    /* hold jitter while stopped, scaling the radius with HDOP */
+    float radius = max(FIX_FILTER_JITTER_RADIUS, data->hdop*FIX_FILTER_UERE);
+    if (data->speed < FIX_FILTER_STOPPED_SPEED && distance < radius) {
+        point_t anchor = filter->anchor;
+        set_anchor(filter, data);
+        filter->anchor = anchor;
+        data->location = anchor;
+        return FIX_HELD;
+    }
+
+    set_anchor(filter, data);
+    return FIX_MOVED;
+}
@@ -0,0 +1,91 @@
+/*!
+ * @file
+ *
+ * @brief Header file for rejecting bad fixes before they are tracked
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains the data structures and function prototypes
+ * used to keep GPS noise out of the distance travelled.
+ *
+ * Each fix is compared with the last accepted fix (the anchor):
+ *
+ *   - fixes the GPS reports as poor (no fix, high HDOP) are rejected
+ *   - fixes implying a speed the rider could not have reached from
+ *     the anchor, given the speed reported at both fixes and a maximum
+ *     acceleration, are rejected as outliers
+ *   - while stopped, fixes within the jitter radius of the anchor
+ *     are held at the anchor, so jitter adds no distance
+ *
+ * Only the anchor is stored, so memory use is constant.
+ *
+ */
+
+#ifndef FIX_FILTER_H
+#define FIX_FILTER_H
+
+#include <stdint.h>
+#include "Arduino.h"
+
+#include "gps.h"
+#include "types.h"
+
+#define FIX_FILTER_MAX_HDOP 5.0          /*!< Largest HDOP accepted */
+#define FIX_FILTER_STOPPED_SPEED 2.0     /*!< Reported speed below which the rider is stopped, in mph */
+#define FIX_FILTER_JITTER_RADIUS 8.0     /*!< Smallest radius of jitter held while stopped, in metres */
+#define FIX_FILTER_UERE 4.0              /*!< Position error per unit of HDOP, in metres */
+#define FIX_FILTER_MAX_ACCELERATION 5.0  /*!< Largest plausible acceleration, in m/s^2 */
+#define FIX_FILTER_SPEED_SLACK 5.0       /*!< Allowance for speed and position error, in m/s */
+#define FIX_FILTER_MAX_REJECTS 5         /*!< Consecutive outliers before the anchor is reset */
+
+/*!
+ * @brief enum holding the possible outcomes of filtering a fix
+ *
+ * A held fix has its location replaced by the anchor. A reset fix
+ * becomes the anchor without any distance being travelled to it.
+ *
+ */
+enum fix_filter_result_t {FIX_REJECTED, FIX_HELD, FIX_MOVED, FIX_RESET};
+
+/*!
+ * @brief struct holding the state of the fix filter
+ */
+struct fix_filter_t {
+    point_t anchor;                 /*!< Location of the last accepted fix */
+    uint32_t anchor_time;           /*!< GPS time of the last accepted fix, in seconds */
+    uint16_t anchor_milliseconds;   /*!< Milliseconds past anchor_time */
+    float anchor_speed;             /*!< Reported speed at the last accepted fix, in m/s */
+    boolean has_anchor;             /*!< Flag indicating a fix has been accepted */
+    uint8_t rejects;                /*!< Number of consecutive outliers */
+};
+
+/*!
+ * @brief Initializes the fix filter
+ *
+ * @param[in,out] filter  Pointer to filter struct to initialize
+ *
+ * @returns    Nothing.
+ *
+ */
+void fix_filter_initialize(fix_filter_t *filter);
+
+/*!
+ * @brief Filters a fix
+ *
+ * Decides whether a fix is tracked. Held fixes have their location
+ * replaced by the anchor. After FIX_FILTER_MAX_REJECTS consecutive
+ * outliers the next good quality fix resets the anchor, so that a
+ * bad anchor cannot block tracking.
+ *
+ * @param[in,out] filter  Pointer to filter struct
+ * @param[in,out] data    Pointer to gps data of the fix
+ *
+ * @returns    Outcome for the fix
+ *
+ */
+fix_filter_result_t fix_filter_update(fix_filter_t *filter, gps_data_t *data);
+
+#endif
@@ -36,35 +36,149 @@
    http://www.adafruit.com/datasheets/PMTK_A11.pdf */
 
 /* Formatting packets for GPS - sets output type and update frequency */
-#define PMTK_SET_NMEA_OUTPUT_RMCONLY "$PMTK314,0,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0*29"
+#define PMTK_SET_NMEA_OUTPUT_RMCGGAGSA "$PMTK314,0,1,0,1,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0*29"
 #define PMTK_SET_NMEA_UPDATE_1HZ "$PMTK220,1000*1F"
+#define PMTK_SET_NMEA_UPDATE_5HZ "$PMTK220,200*2C"
+
+/* Baud rate packets */
+#define PMTK_SET_BAUD_9600 "$PMTK251,9600*17"
+#define PMTK_SET_BAUD_115200 "$PMTK251,115200*1F"
 
 /* Wakeup and standby packets */
 #define PMTK_Q_RELEASE "$PMTK605*31"
 #define PMTK_STANDBY "$PMTK161,0*28"
 
-/* Index offsets into a valid NMEA buffer */
-#define LATITUDE_OFFSET 20  
-#define NS_OFFSET 30
-#define LONGITUDE_OFFSET 32
-#define EW_OFFSET 43
-#define SPEED_OFFSET 45
+/* Periodic power mode packets. Type 2 is periodic standby; the second
+   run and sleep times (used when no fix is found) are disabled */
+#define PMTK_SET_PERIODIC_NORMAL "$PMTK225,0*2B"
+#define PMTK_SET_PERIODIC_STANDBY "$PMTK225,2,%u,%u,0,0"
+
+/* Position and time aiding packet, completed at run time */
+#define PMTK_SET_POSITION_AIDING "$PMTK741,"
+
+/* Binary output packet of the DIYDrones MTK firmware. Other firmware
+   ignores it */
+#define PGCMD_SET_BINARY_OUTPUT "$PGCMD,16,0,0,0,0,0*6A"
+
+/* MTK binary packets (protocol 1.9):
+   0xD1 0xDD <length> <payload> <checksum a> <checksum b>
+   The checksum is a Fletcher checksum of the length and payload.
+   Payload fields are little endian */
+#define BINARY_PREAMBLE_1 0xD1
+#define BINARY_PREAMBLE_2 0xDD
+
+/* Payload offsets */
+#define BINARY_LATITUDE 0     /* int32, degrees x 10^7 */
+#define BINARY_LONGITUDE 4    /* int32, degrees x 10^7 */
+#define BINARY_ALTITUDE 8     /* int32, cm */
+#define BINARY_SPEED 12       /* int32, cm/s */
+#define BINARY_COURSE 16      /* int32, degrees x 100 */
+#define BINARY_SATELLITES 20  /* uint8 */
+#define BINARY_FIX_TYPE 21    /* uint8, 1 no fix, 2 2D, 3 3D, 6 2D SBAS, 7 3D SBAS */
+#define BINARY_DATE 22        /* uint32, ddmmyy in decimal */
+#define BINARY_TIME 26        /* uint32, hhmmssmmm in decimal */
+#define BINARY_HDOP 30        /* uint16, x 100 */
+
+#define BINARY_FIX_2D 2
+#define BINARY_SBAS_OFFSET 4
+#define BINARY_MAX_LATITUDE 900000000L
+#define BINARY_MAX_LONGITUDE 1800000000L
+
+/* Steps through a binary packet */
+#define BINARY_IDLE 0
+#define BINARY_PREAMBLE 1
+#define BINARY_LENGTH 2
+#define BINARY_PAYLOAD 3
+#define BINARY_CHECKSUM_A 4
+#define BINARY_CHECKSUM_B 5
+
+/* What a received byte completed */
+#define RECEIVED_NOTHING 0
+#define RECEIVED_LINE 1
+#define RECEIVED_PACKET 2
+
+/* Field numbers in NMEA datastrings, 0 being the sentence id */
+#define TIME_FIELD 1
+#define RMC_STATUS_FIELD 2
+#define RMC_LATITUDE_FIELD 3
+#define RMC_SPEED_FIELD 7
+#define RMC_COURSE_FIELD 8
+#define RMC_DATE_FIELD 9
+#define GGA_LATITUDE_FIELD 2
+#define GGA_QUALITY_FIELD 6
+#define GSA_FIX_TYPE_FIELD 2
+#define VTG_COURSE_FIELD 1
+#define VTG_SPEED_FIELD 5
 
 #define KNOTS_TO_MPH 1.150779
+#define CM_PER_SECOND_TO_MPH 0.02236936
 
-/*!
- * @brief Ignores a line of data from the GPS
- *
- * This routine simply ignores a line from the GPS. Used for ignoring
- * redundant notifications during startup process
- *
- * @returns    Nothing.
- *
- */
-static void ignore_line(void) {
-    /* DANGEROUS */
-    while (!GPSSerial.available() || GPSSerial.read() != '\n');
-}
+#define SECONDS_PER_DAY 86400UL
+#define NO_TIME 0xFFFFFFFFUL
+
+/* Command sequences sent at initialisation */
+static const gps_command_t initialize_commands[] = {
+    {PMTK_Q_RELEASE, 0},
+    {PMTK_SET_NMEA_OUTPUT_RMCGGAGSA, 0},
+    {PMTK_SET_NMEA_UPDATE_1HZ, 0}
+};
+
+/* the update rate is set after the baud rate, so its acknowledgement
+   verifies the link at the new baud rate */
+static const gps_command_t fast_commands[] = {
+    {PMTK_Q_RELEASE, 0},
+    {PMTK_SET_NMEA_OUTPUT_RMCGGAGSA, 0},
+    {PMTK_SET_BAUD_115200, GPS_FAST_BAUD},
+    {PMTK_SET_NMEA_UPDATE_5HZ, 0}
+};
+
+/* binary fixes fit GPS_BAUD at either rate */
+static const gps_command_t binary_commands[] = {
+    {PMTK_Q_RELEASE, 0},
+    {PMTK_SET_NMEA_UPDATE_1HZ, 0},
+    {PGCMD_SET_BINARY_OUTPUT, 0}
+};
+
+static const gps_command_t binary_fast_commands[] = {
+    {PMTK_Q_RELEASE, 0},
+    {PMTK_SET_NMEA_UPDATE_5HZ, 0},
+    {PGCMD_SET_BINARY_OUTPUT, 0}
+};
+
+static const gps_command_t fallback_commands[] = {
+    {PMTK_SET_BAUD_9600, GPS_BAUD},
+    {PMTK_Q_RELEASE, 0},
+    {PMTK_SET_NMEA_OUTPUT_RMCGGAGSA, 0},
+    {PMTK_SET_NMEA_UPDATE_1HZ, 0}
+};
+
+/* Command sequences sent at boot and standby. The GPS may be at
+   either baud rate and in periodic mode, so it is first set back to
+   GPS_BAUD and full power */
+static const gps_command_t boot_commands[] = {
+    {PMTK_SET_BAUD_9600, GPS_BAUD},
+    {PMTK_Q_RELEASE, 0},
+    {PMTK_SET_PERIODIC_NORMAL, 0},
+    {PMTK_STANDBY, 0}
+};
+
+static const gps_command_t standby_commands[] = {
+    {PMTK_SET_BAUD_9600, GPS_BAUD},
+    {PMTK_SET_PERIODIC_NORMAL, 0},
+    {PMTK_STANDBY, 0}
+};
+
+#define COUNT(array) (sizeof(array)/sizeof(array[0]))
+
+/* Acknowledgement packet and success flag */
+#define PMTK_ACK 1
+#define PMTK_ACK_SUCCESS 3
+
+/* Query commands (PMTK6xx) are answered with a PMTK7xx packet */
+#define PMTK_QUERY_REPLY_OFFSET 100
+
+static boolean reply_received(gps_t *gps);
+static void next_command(gps_t *gps, boolean success);
 
 /*!
  * @brief Parses single hex character into decimal
@@ -72,229 +186,1238 @@ static void ignore_line(void) {
  * This function implements a simple algorithm to convert hexadecimal
  * characters into decimal integers.
  *
- * @param[in]  c    Hexadecimal character (0-9, A-F) 
+ * @param[in]  c    Hexadecimal character (0-9, A-F, a-f)
  *
- * @returns    Decimal equivalent of hexadecimal value
+ * @returns    Decimal equivalent of hexadecimal value, or -1 if c is
+ *             not a hexadecimal character
  *
  */
-static uint8_t parse_hex(char c) {
-    if (c <= '9') {
+static int8_t parse_hex(char c) {
+    if (c >= '0' && c <= '9') {
         return c - '0';
-    } else {
+    } else if (c >= 'A' && c <= 'F') {
         return c - 'A' + 10;
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
     }
+    return -1;
 }
 
 /*!
  * @brief Validates the checksum of a GPS datastring
  *
  * This function checks to ensure that the GPS datastring
- * checksum is valid.
+ * checksum is valid. The datastring must end in '*' and two
+ * hexadecimal digits; the scan stops at the end of the string.
  *
- * @param[in]  nmea  Pointer to buffer with NMEA datastring 
+ * @param[in]  nmea  Pointer to buffer with NUL terminated NMEA datastring
  *
  * @returns    True (1) is checksum valid, 0 otherwise
  *
  */
-static boolean checksum_good(char *nmea) {
+static boolean checksum_good(const char *nmea) {
+    if (nmea[0] != '$') return false;
+
     uint8_t i = 1;
-    char c = nmea[1];
-    char checksum = 0;
+    uint8_t checksum = 0;
 
     /* checksum is computed by xor all bytes between $ and * */
-    while (c != '*') {
-        checksum ^= c;
-        c = nmea[++i];
+    while (nmea[i] != '*') {
+        if (nmea[i] == '\0') return false;
+        checksum ^= nmea[i++];
     }
 
-    /* skip '*' and compare with checksum */
-    checksum ^= parse_hex(nmea[i + 1])*16 + parse_hex(nmea[i + 2]);
+    /* skip '*' and compare with checksum. The second digit is only
+       read if the first is not the end of the string */
+    int8_t high = parse_hex(nmea[i + 1]);
+    if (high < 0) return false;
+    int8_t low = parse_hex(nmea[i + 2]);
+    if (low < 0) return false;
 
-    return checksum == 0;
+    return checksum == (high << 4 | low);
 }
 
 /*!
- * @brief Checks the validity of a GPS datastring with valid flag
+ * @brief Finds a field of an NMEA datastring
+ *
+ * @param[in]  nmea    Pointer to buffer with NMEA datastring, may be NULL
+ * @param[in]  number  Number of the field, 0 being the sentence id
+ *
+ * @returns    Pointer to the start of the field, or NULL if missing
  *
- * This function implements a simplistic algorithm to check the valid
- * flag on a GPS datastring
+ */
+static char *find_field(char *nmea, uint8_t number)
+{
+    if (nmea == NULL) return NULL;
+    while (number--) {
+        nmea = strchr(nmea, ',');
+        if (nmea == NULL) return NULL;
+        nmea++;
+    }
+    return nmea;
+}
+
+/*!
+ * @brief Checks whether a field is empty
  *
- * @param[in]  nmea    Pointer to a buffer containing a NMEA datastring 
+ * @param[in]  field  Pointer to the field, may be NULL
  *
- * @returns    True (1) if flag is valid, 0 otherwise.
+ * @returns    True (1) if the field is missing or empty
  *
  */
-static boolean data_valid(char *nmea) {
-    char *iter = nmea;
-    /* field after second comma */
-    iter = strchr(iter, ',');
-    if (iter == NULL) return 0;
-    iter = strchr(iter + 1, ',');
-    if (iter == NULL) return 0;
-    /* A means valid */
-    return iter[1] == 'A';
+static boolean field_empty(const char *field)
+{
+    return field == NULL || *field == ',' || *field == '*' || *field == '\0';
 }
 
 /*!
- * @brief Validates the GPS datastring checksum/valid flag
+ * @brief Parses two decimal digits
  *
- * This function implements error checking for receiving GPS datastrings by
- * by validating the checksum and valid flag
+ * @param[in]  digits  Pointer to the first of two digit characters
  *
- * @param[in]  gps    Pointer to a GPS struct containing an NMEA string
+ * @returns    Value of the digits
  *
- * @returns    1 if checksum/flag is valid, 0 otherwise
+ */
+static uint8_t parse_2_digits(const char *digits)
+{
+    return (digits[0] - '0')*10 + (digits[1] - '0');
+}
+
+/*!
+ * @brief Checks that a field starts with six decimal digits
+ *
+ * @param[in]  field  Pointer to the field, may be NULL
+ *
+ * @returns    True (1) if the first six characters are digits
  *
  */
-boolean gps_valid(gps_t *gps)
+static boolean six_digits(const char *field)
 {
-    return checksum_good(gps->nmea) && data_valid(gps->nmea);
+    if (field == NULL) return false;
+    for (uint8_t i = 0; i < 6; i++) {
+        if (field[i] < '0' || field[i] > '9') return false;
+    }
+    return true;
 }
 
 /*!
- * @brief Parses an NMEA datastring
+ * @brief Parses a hhmmss.sss UTC time field
  *
- * This function parses an NMEA datastring by reading and translating the buffer 
- * stored in the gps_t struct, and storing the results in a gps_data_t struct 
- * for ease of use
+ * @param[in]  field  Pointer to the time field, may be NULL
  *
- * @param[in]      gps    Pointer to a GPS struct containing an NMEA string
- * @param[in,out]  data   Pointer to a gps_data struct to store parsed data
+ * @returns    Milliseconds since midnight, or NO_TIME if invalid
+ *
+ */
+static uint32_t parse_time_of_day(const char *field)
+{
+    if (!six_digits(field)) return NO_TIME;
+
+    uint32_t seconds = parse_2_digits(field)*3600UL
+                     + parse_2_digits(field + 2)*60
+                     + parse_2_digits(field + 4);
+
+    /* up to three decimal places */
+    uint16_t milliseconds = 0;
+    if (field[6] == '.') {
+        uint16_t scale = 100;
+        for (const char *c = field + 7; *c >= '0' && *c <= '9' && scale; c++) {
+            milliseconds += (*c - '0')*scale;
+            scale /= 10;
+        }
+    }
+
+    return seconds*1000 + milliseconds;
+}
+
+/* days before each month in a non leap year */
+static const uint16_t days_before_month[12] =
+    {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+
+/*!
+ * @brief Counts the days from 1 January 2000 to a date
+ *
+ * @param[in]  day    Day of the month (1-31)
+ * @param[in]  month  Month (1-12)
+ * @param[in]  year   Year since 2000 (0-99)
+ *
+ * @returns    Days since 1 January 2000, or NO_TIME if invalid
+ *
+ */
+static uint32_t date_to_days(uint8_t day, uint8_t month, uint8_t year)
+{
+    if (day < 1 || day > 31 || month < 1 || month > 12 || year > 99) return NO_TIME;
+
+    /* every fourth year from 2000 is a leap year (valid until 2099) */
+    uint32_t days = year*365UL + (year + 3)/4
+                  + days_before_month[month - 1] + day - 1;
+    if (year % 4 == 0 && month > 2) {
+        days++;
+    }
+    return days;
+}
+
+/*!
+ * @brief Parses a ddmmyy UTC date field
+ *
+ * @param[in]  field  Pointer to the date field, may be NULL
+ *
+ * @returns    Days since 1 January 2000, or NO_TIME if invalid
+ *
+ */
+static uint32_t parse_date(const char *field)
+{
+    if (!six_digits(field)) return NO_TIME;
+
+    return date_to_days(parse_2_digits(field), parse_2_digits(field + 2),
+                        parse_2_digits(field + 4));
+}
+
+/*!
+ * @brief Splits a day count into a date
+ *
+ * @param[in]   days   Days since 1 January 2000
+ * @param[out]  year   Year
+ * @param[out]  month  Month (1-12)
+ * @param[out]  day    Day of the month (1-31)
  *
  * @returns    Nothing.
  *
  */
-void gps_parse(gps_t *gps, gps_data_t *data)
+static void split_date(uint32_t days, uint16_t *year, uint8_t *month, uint8_t *day)
 {
-    char buffer[7];
+    /* every fourth year from 2000 is a leap year (valid until 2099) */
+    uint8_t years = 0;
+    while (days >= (years % 4 == 0 ? 366U : 365U)) {
+        days -= years % 4 == 0 ? 366 : 365;
+        years++;
+    }
 
-    /* latitude */
-    char *latitude_field = gps->nmea + LATITUDE_OFFSET;
+    uint8_t leap = years % 4 == 0;
+    uint8_t m = 12;
+    while (days < days_before_month[m - 1] + (m > 2 ? leap : 0U)) {
+        m--;
+    }
 
-    /* parse degrees */
-    strncpy(buffer, latitude_field, 2);
-    buffer[2] = '\0';
-    int degrees = atoi(buffer);
+    *year = 2000 + years;
+    *month = m;
+    *day = days - days_before_month[m - 1] - (m > 2 ? leap : 0) + 1;
+}
 
-    /* parse minutes */
-    strncpy(buffer, latitude_field + 2, 2);
-    strncpy(buffer + 2, latitude_field + 5, 4);
-    buffer[6] = '\0';
-    long minutes = atol(buffer);
+/*!
+ * @brief Parses a latitude or longitude field and its hemisphere
+ *
+ * This function converts a (d)ddmm.mmmm field into decimal degrees,
+ * keeping minutes in integer units of 1/10000 of a minute so that no
+ * precision is lost to floating point before the final division.
+ *
+ * @param[in]   field        Pointer to the coordinate field, followed by N/S/E/W
+ * @param[in]   max_degrees  Largest valid value, 90 or 180
+ * @param[out]  coordinate   Decimal degrees, negative for S and W
+ *
+ * @returns    True (1) if the field is a valid coordinate
+ *
+ */
+static boolean parse_coordinate(char *field, uint8_t max_degrees, float *coordinate)
+{
+    /* one to three degree digits, two whole minute digits */
+    char *dot = strchr(field, '.');
+    if (dot == NULL || dot - field < 3 || dot - field > 5) return false;
+    for (char *c = field; c < dot; c++) {
+        if (*c < '0' || *c > '9') return false;
+    }
+
+    /* degrees are the digits before the two whole minute digits */
+    char *minutes_field = dot - 2;
+    int degrees = 0;
+    for (char *c = field; c < minutes_field; c++) {
+        degrees = degrees*10 + (*c - '0');
+    }
+
+    long minutes = parse_2_digits(minutes_field);
+    if (minutes >= 60) return false;
+    const char *c = dot + 1;
+    for (uint8_t i = 0; i < 4; i++) {
+        minutes *= 10;
+        if (*c >= '0' && *c <= '9') {
+            minutes += *c++ - '0';
+        }
+    }
 
     /* convert from GGPGA to decimal degrees */
-    float latitude = degrees + minutes/600000.0;
+    *coordinate = degrees + minutes/600000.0;
+    if (*coordinate > max_degrees) return false;
 
-    /* parse N/S */
-    if (gps->nmea[NS_OFFSET] == 'S') {
-        latitude = -latitude;
+    /* parse N/S/E/W */
+    char *hemisphere = find_field(field, 1);
+    if (hemisphere != NULL && (*hemisphere == 'S' || *hemisphere == 'W')) {
+        *coordinate = -*coordinate;
     }
+    return true;
+}
 
-    data->location.latitude = latitude;
+/*!
+ * @brief Parses the location fields of an RMC or GGA datastring
+ *
+ * The location is left as is unless both coordinates are valid.
+ *
+ * @param[in]      latitude_field  Pointer to the latitude field
+ * @param[in,out]  data            Pointer to a gps_data struct to store the location
+ *
+ * @returns    Nothing.
+ *
+ */
+static void parse_location(char *latitude_field, gps_data_t *data)
+{
+    char *longitude_field = find_field(latitude_field, 2);
+    if (field_empty(latitude_field) || field_empty(longitude_field)) return;
 
-    /* longitude */
-    char *longitude_field = gps->nmea + LONGITUDE_OFFSET;
+    point_t location;
+    if (parse_coordinate(latitude_field, 90, &location.latitude)
+            && parse_coordinate(longitude_field, 180, &location.longitude)) {
+        data->location = location;
+    }
+}
 
-    /* parse degrees */
-    strncpy(buffer, longitude_field, 3);
-    buffer[3] = '\0';
-    degrees = atoi(buffer);
+/*!
+ * @brief Identifies the type of an NMEA datastring
+ *
+ * The talker id (GP, GN, ...) is ignored.
+ *
+ * @param[in]  nmea  Pointer to buffer with NMEA datastring
+ *
+ * @returns    GPS_SENTENCE_* bit of the sentence, or 0 if not handled
+ *
+ */
+static uint8_t sentence_type(char *nmea)
+{
+    if (nmea[0] != '$' || strlen(nmea) < 7 || nmea[6] != ',') return 0;
 
-    /* parse minutes */
-    strncpy(buffer, longitude_field + 3, 2);
-    strncpy(buffer + 2, longitude_field + 6, 4);
-    buffer[6] = '\0';
-    minutes = atol(buffer);
+    const char *id = nmea + 3;
+    if (strncmp(id, "RMC", 3) == 0) return GPS_SENTENCE_RMC;
+    if (strncmp(id, "GGA", 3) == 0) return GPS_SENTENCE_GGA;
+    if (strncmp(id, "GSA", 3) == 0) return GPS_SENTENCE_GSA;
+    if (strncmp(id, "VTG", 3) == 0) return GPS_SENTENCE_VTG;
+    return 0;
+}
 
-    /* convert from GGPGA to decimal degrees */
-    float longitude = degrees + minutes/600000.0;
+/*!
+ * @brief Merges an RMC datastring into an epoch
+ *
+ * RMC gives the date, location, speed, course and the valid flag.
+ *
+ * @param[in]      nmea   Pointer to buffer with RMC datastring
+ * @param[in]      clock  Milliseconds since midnight of the datastring
+ * @param[in,out]  gps    Pointer to GPS struct with the epoch being assembled
+ *
+ * @returns    Nothing.
+ *
+ */
+static void merge_rmc(char *nmea, uint32_t clock, gps_t *gps)
+{
+    gps_data_t *data = &gps->epoch;
+
+    /* A means valid */
+    char *status = find_field(nmea, RMC_STATUS_FIELD);
+    gps->epoch_valid = status != NULL && *status == 'A';
+
+    parse_location(find_field(nmea, RMC_LATITUDE_FIELD), data);
+
+    char *speed = find_field(nmea, RMC_SPEED_FIELD);
+    if (!field_empty(speed)) {
+        /* convert from knots to mph */
+        data->speed = atof(speed)*KNOTS_TO_MPH;
+    }
+
+    char *course = find_field(nmea, RMC_COURSE_FIELD);
+    if (!field_empty(course)) {
+        data->course = atof(course);
+    }
+
+    uint32_t days = parse_date(find_field(nmea, RMC_DATE_FIELD));
+    if (days != NO_TIME && clock != NO_TIME) {
+        data->time = days*SECONDS_PER_DAY + clock/1000;
+        data->milliseconds = clock % 1000;
+    }
+}
+
+/*!
+ * @brief Merges a GGA datastring into an epoch
+ *
+ * GGA gives the location, fix quality, satellite count, HDOP and altitude.
+ *
+ * @param[in]      nmea   Pointer to buffer with GGA datastring
+ * @param[in,out]  data   Pointer to gps_data struct being assembled
+ *
+ * @returns    Nothing.
+ *
+ */
+static void merge_gga(char *nmea, gps_data_t *data)
+{
+    parse_location(find_field(nmea, GGA_LATITUDE_FIELD), data);
+
+    char *field = find_field(nmea, GGA_QUALITY_FIELD);
+    if (field_empty(field)) return;
+    data->fix_quality = atoi(field);
+
+    field = find_field(field, 1);
+    if (field_empty(field)) return;
+    data->satellites = atoi(field);
+
+    field = find_field(field, 1);
+    if (field_empty(field)) return;
+    data->hdop = atof(field);
+
+    field = find_field(field, 1);
+    if (field_empty(field)) return;
+    data->altitude = atof(field);
+}
+
+/*!
+ * @brief Merges a GSA datastring into an epoch
+ *
+ * GSA gives the fix type (2D or 3D).
+ *
+ * @param[in]      nmea   Pointer to buffer with GSA datastring
+ * @param[in,out]  data   Pointer to gps_data struct being assembled
+ *
+ * @returns    Nothing.
+ *
+ */
+static void merge_gsa(char *nmea, gps_data_t *data)
+{
+    char *field = find_field(nmea, GSA_FIX_TYPE_FIELD);
+    if (!field_empty(field)) {
+        data->fix_type = atoi(field);
+    }
+}
+
+/*!
+ * @brief Merges a VTG datastring into an epoch
+ *
+ * VTG gives the speed and course.
+ *
+ * @param[in]      nmea   Pointer to buffer with VTG datastring
+ * @param[in,out]  data   Pointer to gps_data struct being assembled
+ *
+ * @returns    Nothing.
+ *
+ */
+static void merge_vtg(char *nmea, gps_data_t *data)
+{
+    char *field = find_field(nmea, VTG_COURSE_FIELD);
+    if (!field_empty(field)) {
+        data->course = atof(field);
+    }
+
+    field = find_field(nmea, VTG_SPEED_FIELD);
+    if (!field_empty(field)) {
+        /* convert from knots to mph */
+        data->speed = atof(field)*KNOTS_TO_MPH;
+    }
+}
+
+/*!
+ * @brief Closes the epoch being assembled
+ *
+ * The assembled fields become the latest fix and the assembly buffer
+ * is cleared. The sentences seen in this epoch are the ones expected
+ * in the next.
+ *
+ * @param[in,out]  gps  Pointer to GPS struct with the epoch being assembled
+ *
+ * @returns    Nothing.
+ *
+ */
+static void close_epoch(gps_t *gps)
+{
+    gps->fix = gps->epoch;
+    gps->fix_valid = gps->epoch_valid && (gps->epoch_sentences & GPS_SENTENCE_RMC);
+    gps->fix_sentences = gps->epoch_sentences;
+    gps->expected_sentences = gps->epoch_sentences;
+
+    memset(&gps->epoch, 0, sizeof(gps->epoch));
+    gps->epoch_valid = false;
+    gps->epoch_sentences = 0;
+}
+
+/*!
+ * @brief Decodes a little endian 16 bit value
+ *
+ * @param[in]  bytes  Pointer to the first byte
+ *
+ * @returns    Value of the bytes
+ *
+ */
+static uint16_t get_u16(const uint8_t *bytes)
+{
+    return bytes[0] | (uint16_t)bytes[1] << 8;
+}
+
+/*!
+ * @brief Decodes a little endian 32 bit value
+ *
+ * @param[in]  bytes  Pointer to the first byte
+ *
+ * @returns    Value of the bytes
+ *
+ */
+static uint32_t get_u32(const uint8_t *bytes)
+{
+    return get_u16(bytes) | (uint32_t)get_u16(bytes + 2) << 16;
+}
+
+/*!
+ * @brief Decodes an MTK binary packet into the latest epoch
+ *
+ * A binary packet holds every field of one epoch, so it replaces the
+ * latest epoch as a whole. Any NMEA epoch being assembled is left as is.
+ *
+ * The checksum misses some pairs of bit errors (in the top bit of two
+ * bytes an even distance apart), so a packet with an impossible
+ * position is dropped as well.
+ *
+ * @param[in,out]  gps  Pointer to GPS struct with a verified payload in the NMEA buffer
+ *
+ * @returns    1 if the packet was decoded, 0 if it was dropped
+ *
+ */
+static boolean merge_binary(gps_t *gps)
+{
+    const uint8_t *payload = (const uint8_t*)gps->nmea;
+    int32_t latitude = get_u32(payload + BINARY_LATITUDE);
+    int32_t longitude = get_u32(payload + BINARY_LONGITUDE);
+    if (latitude < -BINARY_MAX_LATITUDE || latitude > BINARY_MAX_LATITUDE
+            || longitude < -BINARY_MAX_LONGITUDE || longitude > BINARY_MAX_LONGITUDE) {
+        return false;
+    }
+
+    gps_data_t *data = &gps->fix;
+    memset(data, 0, sizeof(*data));
+
+    data->location.latitude = latitude/10000000.0;
+    data->location.longitude = longitude/10000000.0;
+    data->altitude = (int32_t)get_u32(payload + BINARY_ALTITUDE)/100.0;
+    data->speed = (int32_t)get_u32(payload + BINARY_SPEED)*CM_PER_SECOND_TO_MPH;
+    data->course = (int32_t)get_u32(payload + BINARY_COURSE)/100.0;
+    data->satellites = payload[BINARY_SATELLITES];
+    data->hdop = get_u16(payload + BINARY_HDOP)/100.0;
+
+    /* SBAS fixes are reported as DGPS, as in GGA */
+    uint8_t type = payload[BINARY_FIX_TYPE];
+    if (type > BINARY_SBAS_OFFSET) {
+        type -= BINARY_SBAS_OFFSET;
+        data->fix_quality = type >= BINARY_FIX_2D ? 2 : 0;
+    } else {
+        data->fix_quality = type >= BINARY_FIX_2D ? 1 : 0;
+    }
+    data->fix_type = type;
+
+    uint32_t date = get_u32(payload + BINARY_DATE);
+    uint32_t days = NO_TIME;
+    if (date < 1000000) {
+        days = date_to_days(date/10000, date/100 % 100, date % 100);
+    }
+    uint32_t clock = get_u32(payload + BINARY_TIME);
+    uint32_t seconds = clock/10000000*3600UL + clock/100000 % 100*60 + clock/1000 % 100;
+    if (days != NO_TIME && seconds < SECONDS_PER_DAY) {
+        data->time = days*SECONDS_PER_DAY + seconds;
+        data->milliseconds = clock % 1000;
+    }
+
+    gps->fix_valid = data->fix_quality != 0;
+    gps->fix_sentences = 0;
+    return true;
+}
+
+/*!
+ * @brief Clears the epoch assembly of a GPS struct
+ *
+ * This function also empties the receive buffer and leaves no PMTK
+ * command awaiting a reply. It must be called before the first call
+ * to gps_assemble or gps_available, and is called by gps_initialize.
+ *
+ * @param[in,out]  gps  Pointer to GPS struct
+ *
+ * @returns    Nothing.
+ *
+ */
+void gps_reset_epoch(gps_t *gps)
+{
+    gps->index = 0;
+    gps->binary_step = BINARY_IDLE;
+    memset(&gps->epoch, 0, sizeof(gps->epoch));
+    memset(&gps->fix, 0, sizeof(gps->fix));
+    gps->epoch_valid = false;
+    gps->fix_valid = false;
+    gps->epoch_sentences = 0;
+    gps->fix_sentences = 0;
+    gps->expected_sentences = 0;
+    gps->epoch_clock = NO_TIME;
+    gps->command_index = 0;
+    gps->command_count = 0;
+}
+
+/*!
+ * @brief Merges the datastring in the NMEA buffer into the current epoch
+ *
+ * This function dispatches RMC, GGA, GSA and VTG datastrings with a
+ * valid checksum to their parsers, which merge their fields into the
+ * epoch being assembled. Other datastrings are ignored. An epoch is
+ * complete once every sentence seen in the previous epoch has
+ * arrived, or when a datastring with a new UTC time starts the next
+ * one. Each datastring is parsed once, so the cost per epoch is
+ * bounded by the number of sentences enabled.
+ *
+ * @param[in,out]  gps    Pointer to a GPS struct containing an NMEA string
+ *
+ * @returns    1 if an epoch was completed, 0 otherwise
+ *
+ */
+boolean gps_assemble(gps_t *gps)
+{
+    char *nmea = gps->nmea;
+    uint8_t type = sentence_type(nmea);
+    if (type == 0 || !checksum_good(nmea)) {
+        return false;
+    }
+
+    boolean complete = false;
+    uint32_t clock = NO_TIME;
+
+    /* a new time means the previous epoch is over, even if some of
+       its sentences were lost */
+    if (type == GPS_SENTENCE_RMC || type == GPS_SENTENCE_GGA) {
+        clock = parse_time_of_day(find_field(nmea, TIME_FIELD));
+        if (clock != NO_TIME && clock != gps->epoch_clock) {
+            if (gps->epoch_sentences) {
+                close_epoch(gps);
+                complete = true;
+            }
+            gps->epoch_clock = clock;
+        }
+    }
 
-    /* parse E/W */
-    if (gps->nmea[EW_OFFSET] == 'W') {
-        longitude = -longitude;
+    switch (type) {
+    case GPS_SENTENCE_RMC: merge_rmc(nmea, clock, gps); break;
+    case GPS_SENTENCE_GGA: merge_gga(nmea, &gps->epoch); break;
+    case GPS_SENTENCE_GSA: merge_gsa(nmea, &gps->epoch); break;
+    case GPS_SENTENCE_VTG: merge_vtg(nmea, &gps->epoch); break;
     }
+    gps->epoch_sentences |= type;
 
-    data->location.longitude = longitude;
+    /* if this datastring both ended the previous epoch and completes
+       its own (only one sentence enabled), the newer epoch is kept so
+       that epochs are not reported a whole interval late */
+    if (gps->expected_sentences
+            && (gps->epoch_sentences & gps->expected_sentences) == gps->expected_sentences) {
+        close_epoch(gps);
+        complete = true;
+    }
+
+    return complete;
+}
+
+/*!
+ * @brief Validates the latest complete epoch
+ *
+ * This function checks that the latest epoch included an RMC datastring
+ * with the valid flag set, or was an MTK binary packet with a 2D or 3D
+ * fix. Datastrings with a bad checksum were already dropped by gps_assemble.
+ *
+ * @param[in]  gps    Pointer to a GPS struct after gps_available returned 1
+ *
+ * @returns    1 if the epoch has a valid fix, 0 otherwise
+ *
+ */
+boolean gps_valid(gps_t *gps)
+{
+    return gps->fix_valid;
+}
+
+/*!
+ * @brief Gets the fields of the latest complete epoch
+ *
+ * This function copies the fields merged from every datastring of the
+ * latest epoch into a gps_data_t struct for ease of use. Fields of
+ * sentences which were not received are 0, and time is 0 if the epoch
+ * has no valid date.
+ *
+ * @param[in]      gps    Pointer to a GPS struct after gps_available returned 1
+ * @param[in,out]  data   Pointer to a gps_data struct to store parsed data
+ *
+ * @returns    Nothing.
+ *
+ */
+void gps_parse(gps_t *gps, gps_data_t *data)
+{
+    *data = gps->fix;
+}
+
+/*!
+ * @brief Adds a byte from the GPS to the NMEA buffer
+ *
+ * This function collects text lines and MTK binary packets in the NMEA
+ * buffer. A binary packet starts with a byte which never appears in
+ * NMEA text, so the GPS may send either. The payload of a binary
+ * packet is only reported once both checksum bytes have matched.
+ *
+ * @param[in,out]  gps  Pointer to a GPS struct
+ * @param[in]      c    Byte received from the GPS
+ *
+ * @returns    RECEIVED_LINE if a line is complete, RECEIVED_PACKET if
+ *             a binary payload is complete, RECEIVED_NOTHING otherwise
+ *
+ */
+static uint8_t receive(gps_t *gps, uint8_t c)
+{
+    switch (gps->binary_step) {
+    case BINARY_IDLE:
+        break;
+    case BINARY_PREAMBLE:
+        gps->binary_step = c == BINARY_PREAMBLE_2 ? BINARY_LENGTH : BINARY_IDLE;
+        return RECEIVED_NOTHING;
+    case BINARY_LENGTH:
+        gps->binary_step = c == GPS_BINARY_PAYLOAD_LENGTH ? BINARY_PAYLOAD : BINARY_IDLE;
+        gps->checksum_a = c;
+        gps->checksum_b = c;
+        return RECEIVED_NOTHING;
+    case BINARY_PAYLOAD:
+        gps->nmea[gps->index++] = c;
+        gps->checksum_a += c;
+        gps->checksum_b += gps->checksum_a;
+        if (gps->index == GPS_BINARY_PAYLOAD_LENGTH) {
+            gps->binary_step = BINARY_CHECKSUM_A;
+        }
+        return RECEIVED_NOTHING;
+    case BINARY_CHECKSUM_A:
+        gps->binary_step = c == gps->checksum_a ? BINARY_CHECKSUM_B : BINARY_IDLE;
+        gps->index = 0;
+        return RECEIVED_NOTHING;
+    case BINARY_CHECKSUM_B:
+        gps->binary_step = BINARY_IDLE;
+        return c == gps->checksum_b ? RECEIVED_PACKET : RECEIVED_NOTHING;
+    }
 
-    /* speed */
-    char *speed_field = gps->nmea + SPEED_OFFSET;
-    strncpy(buffer, speed_field, 4);
-    buffer[4] = '\0';
+    /* a binary packet drops any partial line */
+    if (c == BINARY_PREAMBLE_1) {
+        gps->binary_step = BINARY_PREAMBLE;
+        gps->index = 0;
+    /* return on new line */
+    } else if (c == '\n') {
+        gps->nmea[gps->index] = '\0';
+        gps->index = 0;
+        return RECEIVED_LINE;
+    /* ignore carriage return */
+    } else if (c != '\r') {
+        /* if more than 80 characters read without newline,
+           drop remaining */
+        if (gps->index < NMEA_LINE_LENGTH) {
+            gps->nmea[gps->index++] = c;
+        }
+    }
+    return RECEIVED_NOTHING;
+}
 
-    /* convert from knots to mph */
-    data->speed = atof(buffer)*KNOTS_TO_MPH;
+/*!
+ * @brief Reads a line from the GPS without blocking
+ *
+ * This function reads available characters from the GPS into the NMEA
+ * buffer and stops at the end of a line, so that no line is lost when
+ * several have been received. Binary packets are dropped.
+ *
+ * @param[in,out]  gps    Pointer to a GPS struct 
+ *
+ * @returns    1 if a complete line is in the buffer, 0 otherwise
+ *
+ */
+static boolean read_line(gps_t *gps)
+{
+    while (GPSSerial.available()) {
+        if (receive(gps, GPSSerial.read()) == RECEIVED_LINE) {
+            return true;
+        }
+    }
+    return false;
 }
 
 /*!
  * @brief Checks if GPS is available
  *
- * This function checks to see if a new, valid NMEA GPS datastring is available.
- * Only returns true (1) once per datastring
+ * This function reads every available NMEA datastring into the epoch
+ * being assembled and checks to see if a new epoch is complete.
+ * An MTK binary packet holds a whole epoch, and is decoded as soon as
+ * its checksum is verified. Both kinds of output are read, whichever
+ * the GPS sends. Only returns true (1) once per epoch
+ *
+ * A reply to a PMTK command sent after initialisation arrives among
+ * the datastrings, and is taken here as well.
  *
  * @param[in,out]  gps    Pointer to a GPS struct 
  *
- * @returns    1 if a new, valid gps NMEA string is available/ 0 otherwise
+ * @returns    1 if a new epoch is available, 0 otherwise
  *
  */
 boolean gps_available(gps_t *gps)
 {
     while (GPSSerial.available()) {
-        char c = GPSSerial.read();
-        /* return on new line with valid gps nmea string */
-        if (c == '\n') {
-            gps->nmea[gps->index] = '\0';
-            gps->index = 0;
-            /* if more is available, throwout line and read in next */
-            if (GPSSerial.available()) {
-                continue;
-            } else {
-                return true;
-            }
-        /* ignore carriage return */
-        } else if (c == '\r') {
-            continue;
-        } else {
-            /* if more than 80 characters read without newline,
-               drop remaining */
-            if (gps->index < 80) {
-                gps->nmea[gps->index++] = c;
-            }
+        uint8_t received = receive(gps, GPSSerial.read());
+        if (received == RECEIVED_LINE && !reply_received(gps) && gps_assemble(gps)) {
+            return true;
+        }
+        if (received == RECEIVED_PACKET && merge_binary(gps)) {
+            return true;
         }
     }
     return false;
 }
 
 /*!
- * @brief Initialises the Adafruit Ultimate GPS
+ * @brief Parses the command id of a PMTK packet
  *
- * This function completes the required initialisation procedures to
- * use the Adafruit Ultimate GPS. This wakes up the GPS, sets the update
- * frequency, and sets up the output packet format.
- * 
- * @param[in,out]  gps  Pointer to uninitialised GPS struct
+ * @param[in]  packet  Pointer to a PMTK packet
+ *
+ * @returns    Command id, or -1 if packet is not a PMTK packet
+ *
+ */
+static int pmtk_id(const char *packet)
+{
+    if (strncmp(packet, "$PMTK", 5) != 0) return -1;
+    return atoi(packet + 5);
+}
+
+/*!
+ * @brief Checks whether a line from the GPS answers a PMTK command
+ *
+ * This function matches a line against the command awaiting a reply.
+ * Set commands are answered by $PMTK001,<id>,<flag> and query commands
+ * by a packet whose id is 100 more than the query's.
+ *
+ * @param[in]  nmea     Pointer to buffer with a line from the GPS
+ * @param[in]  command  Pointer to the PMTK command awaiting a reply
+ * @param[out] success  Set to 1 if the GPS accepted the command
+ *
+ * @returns    1 if the line answers the command, 0 otherwise
+ *
+ */
+static boolean is_reply(char *nmea, const char *command, boolean *success)
+{
+    int id = pmtk_id(command);
+    int reply = pmtk_id(nmea);
+
+    if (reply < 0 || !checksum_good(nmea)) {
+        return false;
+    }
+
+    if (reply == PMTK_ACK) {
+        /* $PMTK001,<id>,<flag>*<checksum> */
+        char *field = strchr(nmea, ',');
+        if (field == NULL || atoi(field + 1) != id) return false;
+        field = strchr(field + 1, ',');
+        *success = field != NULL && atoi(field + 1) == PMTK_ACK_SUCCESS;
+        return true;
+    }
+
+    if (reply == id + PMTK_QUERY_REPLY_OFFSET) {
+        *success = true;
+        return true;
+    }
+
+    return false;
+}
+
+/*!
+ * @brief Sends the PMTK command awaiting a reply
+ *
+ * @param[in,out]  gps  Pointer to a GPS struct with a command sequence
  *
  * @returns    Nothing.
  *
  */
-void gps_initialize(gps_t *gps)
+static void send_command(gps_t *gps)
 {
-    gps->index = 0;
+    const gps_command_t *command = &gps->commands[gps->command_index];
+
+    GPSSerial.println(command->packet);
+    gps->sent_at = millis();
+    gps->attempts++;
+
+    /* baud rate changes are not acknowledged: wait for the packet to
+       leave at the old rate, then switch and move on */
+    if (command->baud) {
+        GPSSerial.flush();
+        GPSSerial.begin(command->baud);
+        next_command(gps, true);
+    /* neither are packets other than PMTK packets */
+    } else if (pmtk_id(command->packet) < 0) {
+        next_command(gps, true);
+    }
+}
+
+/*!
+ * @brief Moves on to the next PMTK command of a sequence
+ *
+ * @param[in,out]  gps      Pointer to a GPS struct with a command sequence
+ * @param[in]      success  1 if the current command was accepted
+ *
+ * @returns    Nothing.
+ *
+ */
+static void next_command(gps_t *gps, boolean success)
+{
+    if (!success) {
+        gps->command_failed = true;
+    }
+
+    gps->command_index++;
+    gps->attempts = 0;
+
+    if (gps->command_index < gps->command_count) {
+        send_command(gps);
+    }
+}
+
+/*!
+ * @brief Sends a sequence of PMTK commands alongside the GPS output
+ *
+ * The epoch being assembled and the data already received are kept,
+ * so that a command can be sent while tracking.
+ *
+ * @param[in,out]  gps       Pointer to a GPS struct
+ * @param[in]      commands  Array of PMTK commands
+ * @param[in]      count     Number of commands
+ *
+ * @returns    Nothing.
+ *
+ */
+static void send_commands(gps_t *gps, const gps_command_t *commands, uint8_t count)
+{
+    gps->commands = commands;
+    gps->command_count = count;
+    gps->command_index = 0;
+    gps->attempts = 0;
+    gps->command_failed = false;
+
+    send_command(gps);
+}
+
+/*!
+ * @brief Starts sending a sequence of PMTK commands
+ *
+ * The epoch and any data received before the sequence are dropped, as
+ * the GPS changes its output.
+ *
+ * @param[in,out]  gps       Pointer to a GPS struct
+ * @param[in]      commands  Array of PMTK commands
+ * @param[in]      count     Number of commands
+ *
+ * @returns    Nothing.
+ *
+ */
+static void start_commands(gps_t *gps, const gps_command_t *commands, uint8_t count)
+{
+    gps_reset_epoch(gps);
 
     /* clear any available data */
     while (GPSSerial.available()) {
         GPSSerial.read();
     }
 
-    /* send message to wakeup gps */
-    GPSSerial.println(PMTK_Q_RELEASE);
-    ignore_line(); /* startup notification */
-    ignore_line(); /* EPO? notification */
+    send_commands(gps, commands, count);
+}
+
+/*!
+ * @brief Checks whether the line in the NMEA buffer answers the PMTK
+ *        command awaiting a reply, and moves on if it does
+ *
+ * @param[in,out]  gps  Pointer to a GPS struct with a line received
+ *
+ * @returns    1 if the line was a reply, 0 otherwise
+ *
+ */
+static boolean reply_received(gps_t *gps)
+{
+    boolean success;
+
+    if (gps->command_index < gps->command_count
+            && is_reply(gps->nmea, gps->commands[gps->command_index].packet, &success)) {
+        next_command(gps, success);
+        return true;
+    }
+    return false;
+}
+
+/*!
+ * @brief Resends or skips a PMTK command with no reply in time
+ *
+ * Commands with no reply are resent after GPS_COMMAND_TIMEOUT and
+ * skipped after GPS_COMMAND_ATTEMPTS.
+ *
+ * @param[in,out]  gps  Pointer to a GPS struct with a command sequence
+ *
+ * @returns    Status of the sequence
+ *
+ */
+static gps_command_status_t retry_commands(gps_t *gps)
+{
+    if (gps->command_index < gps->command_count
+            && millis() - gps->sent_at >= GPS_COMMAND_TIMEOUT) {
+        if (gps->attempts < GPS_COMMAND_ATTEMPTS) {
+            send_command(gps);
+        } else {
+            next_command(gps, false);
+        }
+    }
+
+    if (gps->command_index < gps->command_count) {
+        return GPS_COMMANDS_IN_PROGRESS;
+    }
+    return gps->command_failed ? GPS_COMMANDS_FAILED : GPS_COMMANDS_DONE;
+}
+
+/*!
+ * @brief Advances a sequence of PMTK commands
+ *
+ * This function reads replies from the GPS without blocking, moving to
+ * the next command once the current one is answered, and resends
+ * commands which are not. Lines which are not replies (startup
+ * notifications, NMEA output) are ignored.
+ *
+ * @param[in,out]  gps  Pointer to a GPS struct with a command sequence
+ *
+ * @returns    Status of the sequence
+ *
+ */
+static gps_command_status_t poll_commands(gps_t *gps)
+{
+    while (gps->command_index < gps->command_count && read_line(gps)) {
+        reply_received(gps);
+    }
+
+    return retry_commands(gps);
+}
 
-    GPSSerial.println(PMTK_SET_NMEA_OUTPUT_RMCONLY);
-    ignore_line();
+/*!
+ * @brief Sends a sequence of PMTK commands and waits for it to finish
+ *
+ * The wait is bounded by the command timeouts.
+ *
+ * @param[in]  commands  Array of PMTK commands
+ * @param[in]  count     Number of commands
+ *
+ * @returns    Nothing.
+ *
+ */
+static void run_commands(const gps_command_t *commands, uint8_t count)
+{
+    gps_t gps;
+    start_commands(&gps, commands, count);
+    while (poll_commands(&gps) == GPS_COMMANDS_IN_PROGRESS);
+}
 
-    GPSSerial.println(PMTK_SET_NMEA_UPDATE_1HZ);
-    ignore_line();
+/*!
+ * @brief Initialises the Adafruit Ultimate GPS
+ *
+ * This function starts the initialisation procedure required to use
+ * the Adafruit Ultimate GPS: waking up the GPS, setting the update
+ * frequency and setting up the output packet format. It returns
+ * immediately; gps_initialize_poll must be called until the
+ * procedure is no longer in progress.
+ *
+ * In high rate mode the GPS is switched to GPS_FAST_BAUD and updates
+ * every GPS_FAST_INTERVAL ms. If the GPS does not acknowledge the new
+ * update rate over the new baud rate, it is set back to GPS_BAUD and
+ * 1 Hz updates. gps->interval holds the update interval in effect.
+ * At 8 MHz, Serial1 can only get within 3.5% of GPS_FAST_BAUD, which
+ * leaves little margin, so high rate mode may well end in the fallback.
+ *
+ * In binary mode the GPS is asked for MTK binary output instead of
+ * NMEA, which only GPS modules running the DIYDrones MTK firmware
+ * (protocol 1.9) support. A binary fix is 37 bytes against around 190
+ * for RMC, GGA and GSA, so high rate mode fits GPS_BAUD and the baud
+ * rate is left alone. The request is not acknowledged; GPS modules
+ * without binary output keep sending NMEA, which is still read.
+ * 
+ * @param[in,out]  gps     Pointer to uninitialised GPS struct
+ * @param[in]      fast    1 to set up high rate mode, 0 for 1 Hz updates
+ * @param[in]      binary  1 to ask for MTK binary output, 0 for NMEA
+ *
+ * @returns    Nothing.
+ *
+ */
+void gps_initialize(gps_t *gps, boolean fast, boolean binary)
+{
+    gps->fast = fast;
+
+    /* the first command also wakes up the gps, which sends startup
+       notifications before answering it */
+    if (binary) {
+        gps->interval = fast ? GPS_FAST_INTERVAL : GPS_INTERVAL;
+        if (fast) {
+            start_commands(gps, binary_fast_commands, COUNT(binary_fast_commands));
+        } else {
+            start_commands(gps, binary_commands, COUNT(binary_commands));
+        }
+    } else if (fast) {
+        gps->interval = GPS_FAST_INTERVAL;
+        start_commands(gps, fast_commands, COUNT(fast_commands));
+    } else {
+        gps->interval = GPS_INTERVAL;
+        start_commands(gps, initialize_commands, COUNT(initialize_commands));
+    }
+}
+
+/*!
+ * @brief Advances initialisation of the Adafruit Ultimate GPS
+ *
+ * This function reads replies from the GPS without blocking. Each
+ * PMTK command is sent on its own and the next is only sent once the
+ * GPS acknowledges it. A command with no reply within
+ * GPS_COMMAND_TIMEOUT is resent, up to GPS_COMMAND_ATTEMPTS times.
+ * Progress is available as gps->command_index out of gps->command_count.
+ *
+ * @param[in,out]  gps  Pointer to GPS struct passed to gps_initialize
+ *
+ * @returns    Status of the initialisation
+ *
+ */
+gps_command_status_t gps_initialize_poll(gps_t *gps)
+{
+    gps_command_status_t status = poll_commands(gps);
+
+    /* fall back to 1 Hz at the original baud rate */
+    if (status == GPS_COMMANDS_FAILED && gps->fast) {
+        gps->fast = false;
+        gps->interval = GPS_INTERVAL;
+        start_commands(gps, fallback_commands, COUNT(fallback_commands));
+        return GPS_COMMANDS_IN_PROGRESS;
+    }
+
+    return status;
+}
+
+/*!
+ * @brief Appends the checksum to a PMTK packet
+ *
+ * @param[in,out]  packet  Packet from '$' to the last field, with room
+ *                         for three more characters
+ *
+ * @returns    Nothing.
+ *
+ */
+static void add_checksum(char *packet)
+{
+    /* checksum is the xor of all bytes between $ and * */
+    uint8_t checksum = 0;
+    char *c = packet + 1;
+    while (*c) {
+        checksum ^= *c++;
+    }
+    sprintf(c, "*%02X", checksum);
+}
+
+/*!
+ * @brief Sends the packet built in a GPS struct alongside the GPS output
+ *
+ * @param[in,out]  gps  Pointer to GPS struct with a packet built
+ *
+ * @returns    Nothing.
+ *
+ */
+static void send_packet(gps_t *gps)
+{
+    gps->command.packet = gps->packet;
+    gps->command.baud = 0;
+    send_commands(gps, &gps->command, 1);
+}
+
+/*!
+ * @brief Sets the periodic power mode of the Adafruit Ultimate GPS
+ *
+ * This function starts sending a PMTK225 command which makes the GPS
+ * track for run ms, then sleep in standby for sleep ms, repeatedly.
+ * A sleep of 0 returns the GPS to full power. It returns immediately;
+ * gps_command_poll must be called until the command is no longer in
+ * progress, and gps_available to read the reply. The GPS output keeps
+ * being read meanwhile. Periodic mode is meant for 1 Hz updates.
+ *
+ * @param[in,out]  gps    Pointer to initialised GPS struct
+ * @param[in]      run    Time to track each period, in ms
+ * @param[in]      sleep  Time to sleep each period, in ms, or 0
+ *
+ * @returns    Nothing.
+ *
+ */
+void gps_set_periodic(gps_t *gps, uint16_t run, uint16_t sleep)
+{
+    if (sleep == 0) {
+        strcpy(gps->packet, PMTK_SET_PERIODIC_NORMAL);
+    } else {
+        sprintf(gps->packet, PMTK_SET_PERIODIC_STANDBY, run, sleep);
+        add_checksum(gps->packet);
+    }
+    send_packet(gps);
+}
+
+/*!
+ * @brief Gives the Adafruit Ultimate GPS its position and time
+ *
+ * This function starts sending a PMTK741 command with a recent
+ * position and the current UTC time, so that the GPS knows which
+ * satellites to look for and finds its first fix sooner. It returns
+ * immediately; gps_command_poll must be called until the command is
+ * no longer in progress, and gps_available to read the reply. The
+ * epoch being assembled and the GPS output already received are kept.
+ *
+ * @param[in,out]  gps       Pointer to initialised GPS struct
+ * @param[in]      location  Recent position
+ * @param[in]      altitude  Recent altitude, in metres
+ * @param[in]      time      Current UTC time, in seconds since 1 January 2000
+ *
+ * @returns    Nothing.
+ *
+ */
+void gps_aid(gps_t *gps, point_t location, float altitude, uint32_t time)
+{
+    uint16_t year;
+    uint8_t month, day;
+    split_date(time/SECONDS_PER_DAY, &year, &month, &day);
+    uint32_t seconds = time % SECONDS_PER_DAY;
+
+    /* $PMTK741,<lat>,<long>,<alt>,<YYYY>,<MM>,<DD>,<hh>,<mm>,<ss> */
+    char *p = gps->packet;
+    strcpy(p, PMTK_SET_POSITION_AIDING);
+    p += strlen(p);
+    dtostrf(location.latitude, 1, 5, p);
+    p += strlen(p);
+    *p++ = ',';
+    dtostrf(location.longitude, 1, 5, p);
+    p += strlen(p);
+    *p++ = ',';
+    dtostrf(constrain(altitude, -1000, 10000), 1, 0, p);
+    p += strlen(p);
+    sprintf(p, ",%d,%02d,%02d,%02d,%02d,%02d", year, month, day,
+            (int)(seconds/3600), (int)(seconds/60 % 60), (int)(seconds % 60));
+    add_checksum(gps->packet);
+
+    send_packet(gps);
+}
+
+/*!
+ * @brief Advances a PMTK command sent after initialisation
+ *
+ * The reply is read by gps_available along with the datastrings, so
+ * this function only resends the command when no reply came within
+ * GPS_COMMAND_TIMEOUT and reports its status. Unlike
+ * gps_initialize_poll, it does not fall back to other settings.
+ *
+ * @param[in,out]  gps  Pointer to GPS struct with a command in progress
+ *
+ * @returns    Status of the command
+ *
+ */
+gps_command_status_t gps_command_poll(gps_t *gps)
+{
+    return retry_commands(gps);
 }
 
 /*!
@@ -308,7 +1431,7 @@ void gps_initialize(gps_t *gps)
  */
 void gps_standby(void)
 {
-    GPSSerial.println(PMTK_STANDBY);
+    run_commands(standby_commands, COUNT(standby_commands));
 }
 
 /*!
@@ -323,9 +1446,9 @@ void gps_standby(void)
  */
 void gps_boot(void)
 {
-    GPSSerial.begin(9600);
-    /* send any message to wakeup if in standby already */
-    GPSSerial.println(PMTK_Q_RELEASE);
-    ignore_line();
-    gps_standby();
+    /* the gps keeps a high baud rate in standby, so start there and
+       send it back to the original baud rate. Any message also wakes
+       it up if in standby already */
+    GPSSerial.begin(GPS_FAST_BAUD);
+    run_commands(boot_commands, COUNT(boot_commands));
 }
@@ -21,28 +21,105 @@
 
 #define NMEA_LINE_LENGTH 80  /*!< Length of NMEA datastrings coming from GPS */
 
+#define GPS_COMMAND_TIMEOUT 1000  /*!< Time to wait for a PMTK reply, in ms */
+#define GPS_COMMAND_ATTEMPTS 3    /*!< Times a PMTK command is sent before giving up */
+
+#define GPS_BAUD 9600           /*!< GPS serial baud rate at power up */
+#define GPS_FAST_BAUD 115200    /*!< GPS serial baud rate in high rate mode */
+#define GPS_INTERVAL 1000       /*!< GPS update interval, in ms */
+#define GPS_FAST_INTERVAL 200   /*!< GPS update interval in high rate mode, in ms */
+
+#define GPS_PACKET_LENGTH 64    /*!< Length of PMTK packets built at run time */
+
+#define GPS_BINARY_PAYLOAD_LENGTH 32  /*!< Length of an MTK binary fix payload */
+
 /*!
- * @brief struct to hold raw NMEA datastrings coming from GPS
+ * @brief enum holding possible statuses of a sequence of PMTK commands
  *
- * This struct holds the buffer which takes in NMEA datastrings from the GPS,
- * as well as the index into the buffer for parsing and error checking.
+ * A command sequence is in progress until every command has been
+ * acknowledged or has run out of attempts. It fails if any command
+ * was rejected or never acknowledged.
  *
  */
-struct gps_t {
-    char nmea[NMEA_LINE_LENGTH + 1];  /*!< NMEA buffer */
-    int index;                        /*!< Index into NMEA buffer */
+enum gps_command_status_t {GPS_COMMANDS_IN_PROGRESS, GPS_COMMANDS_DONE, GPS_COMMANDS_FAILED};
+
+/*!
+ * @brief struct holding a single PMTK command of a command sequence
+ *
+ * The GPS does not acknowledge baud rate changes, so a command with a
+ * baud rate set is not waited on: the serial port is switched to the
+ * new rate as soon as the command has been sent. Packets which are not
+ * PMTK packets (PGCMD) are not acknowledged either, and are not waited on.
+ *
+ */
+struct gps_command_t {
+    const char *packet;  /*!< PMTK packet to send */
+    uint32_t baud;       /*!< Baud rate to switch to after sending, or 0 */
 };
 
+/* Sentence bits, used to track which sentences an epoch has merged */
+#define GPS_SENTENCE_RMC 0x01
+#define GPS_SENTENCE_GGA 0x02
+#define GPS_SENTENCE_GSA 0x04
+#define GPS_SENTENCE_VTG 0x08
+
 /*!
  * @brief struct to hold the lat/long coordinate and speed for a GPS data packet
  *
- * This struct holds the latitude and longitude pair, as well as the current 
- * speed, for a data packet delivered by the GPS
+ * This struct holds the latitude and longitude pair, the current 
+ * speed and the UTC time of the fix, as well as the fix quality and
+ * altitude, merged from the datastrings the GPS delivers for one fix
+ * (epoch). Fields of datastrings which were not received are 0.
  *
  */
 struct gps_data_t {
     point_t location; /* (latitude, longitude) coordinate */
-    float speed; /* speed in mph */
+    float speed; /* speed in mph (RMC, VTG) */
+    float course; /* course over ground, degrees clockwise from true north (RMC, VTG) */
+    uint32_t time; /* UTC time of fix, in seconds since 1 January 2000 (RMC) */
+    uint16_t milliseconds; /* milliseconds past time */
+    uint8_t fix_quality; /* 0 no fix, 1 GPS, 2 DGPS (GGA) */
+    uint8_t satellites; /* satellites used in fix (GGA) */
+    float hdop; /* horizontal dilution of precision (GGA) */
+    float altitude; /* altitude above mean sea level in metres (GGA) */
+    uint8_t fix_type; /* 1 no fix, 2 2D, 3 3D (GSA) */
+};
+
+/*!
+ * @brief struct to hold raw NMEA datastrings coming from GPS
+ *
+ * This struct holds the buffer which takes in NMEA datastrings from the GPS,
+ * as well as the index into the buffer for parsing and error checking.
+ * The same buffer takes in the payload of MTK binary packets.
+ * It also holds the epoch being assembled from several datastrings and
+ * the latest complete epoch, and the progress of the PMTK command
+ * sequence being sent to the GPS.
+ *
+ */
+struct gps_t {
+    char nmea[NMEA_LINE_LENGTH + 1];  /*!< NMEA buffer */
+    int index;                        /*!< Index into NMEA buffer */
+    uint8_t binary_step;              /*!< Progress through an MTK binary packet, 0 between packets */
+    uint8_t checksum_a;               /*!< First checksum byte of the binary packet so far */
+    uint8_t checksum_b;               /*!< Second checksum byte of the binary packet so far */
+    gps_data_t epoch;                 /*!< Fields of the epoch being assembled */
+    gps_data_t fix;                   /*!< Fields of the latest complete epoch */
+    uint32_t epoch_clock;             /*!< UTC time of the epoch being assembled, in ms since midnight */
+    uint8_t epoch_sentences;          /*!< Sentences merged into the epoch being assembled */
+    uint8_t fix_sentences;            /*!< Sentences merged into the latest epoch */
+    uint8_t expected_sentences;       /*!< Sentences which complete an epoch */
+    boolean epoch_valid;              /*!< Valid flag of the epoch being assembled */
+    boolean fix_valid;                /*!< Valid flag of the latest epoch */
+    const gps_command_t *commands;    /*!< PMTK command sequence being sent */
+    uint8_t command_count;            /*!< Number of commands in the sequence */
+    uint8_t command_index;            /*!< Index of the command awaiting a reply */
+    uint8_t attempts;                 /*!< Times the current command has been sent */
+    boolean command_failed;           /*!< Flag set if any command was not acknowledged */
+    uint32_t sent_at;                 /*!< Time the current command was last sent, in ms */
+    boolean fast;                     /*!< Flag set while setting up high rate mode */
+    uint16_t interval;                /*!< Update interval being set up, in ms */
+    char packet[GPS_PACKET_LENGTH + 1];  /*!< PMTK packet built at run time */
+    gps_command_t command;            /*!< Command sequence sending packet */
 };
 
 /*!
@@ -61,7 +138,9 @@ void gps_boot(void);
  * @brief Puts the Adafruit Ultimate GPS in standby mode 
  *
  * This function sends a serial packet to put the Adafruit Ultimate GPS
- * into standby (low power state). 
+ * into standby (low power state). The GPS is first set back to
+ * GPS_BAUD if it was in high rate mode, and to full power if it was
+ * in periodic mode.
  *
  * @returns    Nothing.
  *
@@ -71,51 +150,179 @@ void gps_standby(void);
 /*!
  * @brief Initialises the Adafruit Ultimate GPS
  *
- * This function completes the required initialisation procedures to
- * use the Adafruit Ultimate GPS. This wakes up the GPS, sets the update
- * frequency, and sets up the output packet format.
+ * This function starts the initialisation procedure required to use
+ * the Adafruit Ultimate GPS: waking up the GPS, setting the update
+ * frequency and setting up the output packet format. It returns
+ * immediately; gps_initialize_poll must be called until the
+ * procedure is no longer in progress.
+ *
+ * In high rate mode the GPS is switched to GPS_FAST_BAUD and updates
+ * every GPS_FAST_INTERVAL ms. If the GPS does not acknowledge the new
+ * update rate over the new baud rate, it is set back to GPS_BAUD and
+ * 1 Hz updates. gps->interval holds the update interval in effect.
+ * At 8 MHz, Serial1 can only get within 3.5% of GPS_FAST_BAUD, which
+ * leaves little margin, so high rate mode may well end in the fallback.
+ *
+ * In binary mode the GPS is asked for MTK binary output instead of
+ * NMEA, which only GPS modules running the DIYDrones MTK firmware
+ * (protocol 1.9) support. A binary fix is 37 bytes against around 190
+ * for RMC, GGA and GSA, so high rate mode fits GPS_BAUD and the baud
+ * rate is left alone. The request is not acknowledged; GPS modules
+ * without binary output keep sending NMEA, which is still read.
  * 
- * @param[in,out]  gps  Pointer to uninitialised GPS struct
+ * @param[in,out]  gps     Pointer to uninitialised GPS struct
+ * @param[in]      fast    1 to set up high rate mode, 0 for 1 Hz updates
+ * @param[in]      binary  1 to ask for MTK binary output, 0 for NMEA
+ *
+ * @returns    Nothing.
+ *
+ */
+void gps_initialize(gps_t *gps, boolean fast, boolean binary);
+
+/*!
+ * @brief Advances initialisation of the Adafruit Ultimate GPS
+ *
+ * This function reads replies from the GPS without blocking. Each
+ * PMTK command is sent on its own and the next is only sent once the
+ * GPS acknowledges it. A command with no reply within
+ * GPS_COMMAND_TIMEOUT is resent, up to GPS_COMMAND_ATTEMPTS times.
+ * Progress is available as gps->command_index out of gps->command_count.
+ *
+ * @param[in,out]  gps  Pointer to GPS struct passed to gps_initialize
+ *
+ * @returns    Status of the initialisation
+ *
+ */
+gps_command_status_t gps_initialize_poll(gps_t *gps);
+
+/*!
+ * @brief Sets the periodic power mode of the Adafruit Ultimate GPS
+ *
+ * This function starts sending a PMTK225 command which makes the GPS
+ * track for run ms, then sleep in standby for sleep ms, repeatedly.
+ * A sleep of 0 returns the GPS to full power. It returns immediately;
+ * gps_command_poll must be called until the command is no longer in
+ * progress, and gps_available to read the reply. The GPS output keeps
+ * being read meanwhile. Periodic mode is meant for 1 Hz updates.
+ *
+ * @param[in,out]  gps    Pointer to initialised GPS struct
+ * @param[in]      run    Time to track each period, in ms
+ * @param[in]      sleep  Time to sleep each period, in ms, or 0
  *
  * @returns    Nothing.
  *
  */
-void gps_initialize(gps_t *gps);
+void gps_set_periodic(gps_t *gps, uint16_t run, uint16_t sleep);
+
+/*!
+ * @brief Gives the Adafruit Ultimate GPS its position and time
+ *
+ * This function starts sending a PMTK741 command with a recent
+ * position and the current UTC time, so that the GPS knows which
+ * satellites to look for and finds its first fix sooner. It returns
+ * immediately; gps_command_poll must be called until the command is
+ * no longer in progress, and gps_available to read the reply. The
+ * epoch being assembled and the GPS output already received are kept.
+ *
+ * @param[in,out]  gps       Pointer to initialised GPS struct
+ * @param[in]      location  Recent position
+ * @param[in]      altitude  Recent altitude, in metres
+ * @param[in]      time      Current UTC time, in seconds since 1 January 2000
+ *
+ * @returns    Nothing.
+ *
+ */
+void gps_aid(gps_t *gps, point_t location, float altitude, uint32_t time);
+
+/*!
+ * @brief Advances a PMTK command sent after initialisation
+ *
+ * The reply is read by gps_available along with the datastrings, so
+ * this function only resends the command when no reply came within
+ * GPS_COMMAND_TIMEOUT and reports its status. Unlike
+ * gps_initialize_poll, it does not fall back to other settings.
+ *
+ * @param[in,out]  gps  Pointer to GPS struct with a command in progress
+ *
+ * @returns    Status of the command
+ *
+ */
+gps_command_status_t gps_command_poll(gps_t *gps);
 
 /*!
  * @brief Checks if GPS is available
  *
- * This function checks to see if a new, valid NMEA GPS datastring is available.
- * Only returns true (1) once per datastring
+ * This function reads every available NMEA datastring into the epoch
+ * being assembled and checks to see if a new epoch is complete.
+ * An MTK binary packet holds a whole epoch, and is decoded as soon as
+ * its checksum is verified. Both kinds of output are read, whichever
+ * the GPS sends. Only returns true (1) once per epoch
+ *
+ * A reply to a PMTK command sent after initialisation arrives among
+ * the datastrings, and is taken here as well.
  *
  * @param[in,out]  gps    Pointer to a GPS struct 
  *
- * @returns    1 if a new, valid gps NMEA string is available/ 0 otherwise
+ * @returns    1 if a new epoch is available, 0 otherwise
  *
  */
 boolean gps_available(gps_t *gps);
 
 /*!
- * @brief Validates the GPS datastring checksum/valid flag
+ * @brief Clears the epoch assembly of a GPS struct
+ *
+ * This function also empties the receive buffer and leaves no PMTK
+ * command awaiting a reply. It must be called before the first call
+ * to gps_assemble or gps_available, and is called by gps_initialize.
+ *
+ * @param[in,out]  gps  Pointer to GPS struct
+ *
+ * @returns    Nothing.
+ *
+ */
+void gps_reset_epoch(gps_t *gps);
+
+/*!
+ * @brief Merges the datastring in the NMEA buffer into the current epoch
+ *
+ * This function dispatches RMC, GGA, GSA and VTG datastrings with a
+ * valid checksum to their parsers, which merge their fields into the
+ * epoch being assembled. Other datastrings are ignored. An epoch is
+ * complete once every sentence seen in the previous epoch has
+ * arrived, or when a datastring with a new UTC time starts the next
+ * one. Each datastring is parsed once, so the cost per epoch is
+ * bounded by the number of sentences enabled.
+ *
+ * @param[in,out]  gps    Pointer to a GPS struct containing an NMEA string
+ *
+ * @returns    1 if an epoch was completed, 0 otherwise
+ *
+ */
+boolean gps_assemble(gps_t *gps);
+
+/*!
+ * @brief Validates the latest complete epoch
  *
- * This function implements error checking for receiving GPS datastrings by
- * by validating the checksum and valid flag
+ * This function checks that the latest epoch included an RMC datastring
+ * with the valid flag set. Datastrings with a bad checksum were already
+ * dropped by gps_assemble.
  *
- * @param[in]  gps    Pointer to a GPS struct containing an NMEA string
+ * @param[in]  gps    Pointer to a GPS struct after gps_available returned 1
  *
- * @returns    1 if checksum/flag is valid, 0 otherwise
+ * @returns    1 if the epoch has a valid fix, 0 otherwise
  *
  */
 boolean gps_valid(gps_t *gps);
 
 /*!
- * @brief Parses an NMEA datastring
+ * @brief Gets the fields of the latest complete epoch
  *
- * This function parses an NMEA datastring by reading and translating the buffer 
- * stored in the gps_t struct, and storing the results in a gps_data_t struct 
- * for ease of use
+ * This function copies the fields merged from every datastring of the
+ * latest epoch into a gps_data_t struct for ease of use. Fields of
+ * sentences which were not received are 0, and time is 0 if the epoch
+ * has no valid date.
  *
- * @param[in]      gps    Pointer to a GPS struct containing an NMEA string
+ * @param[in]      gps    Pointer to a GPS struct after gps_available returned 1
  * @param[in,out]  data   Pointer to a gps_data struct to store parsed data
  *
  * @returns    Nothing.
@@ -0,0 +1,257 @@
+/*!
+ * @file
+ *
+ * @brief Interface for smoothing position and speed
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains the function definitions of a constant velocity
+ * Kalman filter over the GPS position and velocity.
+ *
+ * See the header for a description of the filter and its units
+ */
+
+#include <math.h>
+#include "Arduino.h"
+
+#include "kalman_filter.h"
+
+#define CM_PER_DEGREE 11119490.0     /*!< Length of a degree of latitude, in cm */
+#define CM_PER_SECOND_PER_MPH 44.704 /*!< Centimetres per second in one mph */
+#define GAIN_SHIFT 12                /*!< Gains are Q12 */
+#define TIME_SHIFT 8                 /*!< Time steps are Q8 seconds */
+#define MAX_RESIDUAL 100000L         /*!< Largest position residual used, in cm */
+#define MAX_VELOCITY_RESIDUAL 5000L  /*!< Largest velocity residual used, in cm/s */
+#define MAX_VELOCITY_GAIN (4L << GAIN_SHIFT)  /*!< Largest position gain of a velocity, in s */
+
+/*!
+ * @brief Limits a covariance to KALMAN_MAX_COVARIANCE
+ *
+ * @param[in]  value  Covariance
+ *
+ * @returns    The covariance, capped in magnitude
+ *
+ */
+static int32_t cap(int32_t value)
+{
+    if (value > KALMAN_MAX_COVARIANCE) return KALMAN_MAX_COVARIANCE;
+    if (value < -KALMAN_MAX_COVARIANCE) return -KALMAN_MAX_COVARIANCE;
+    return value;
+}
+
+/*!
+ * @brief Computes the measurement variance of a fix
+ *
+ * @param[in]  data  Pointer to gps data of the fix
+ *
+ * @returns    Position variance, in dm^2
+ *
+ */
+static int32_t measurement_variance(gps_data_t *data)
+{
+    /* assume an HDOP of 1 without GGA */
+    float hdop = data->hdop > 0 ? data->hdop : 1.0;
+    int32_t deviation = hdop*KALMAN_UERE;
+    return cap(deviation*deviation);
+}
+
+/*!
+ * @brief Restarts the filter at a fix, at rest
+ *
+ * @param[in,out] filter    Pointer to filter struct
+ * @param[in]     east      East position of the fix, in cm
+ * @param[in]     north     North position of the fix, in cm
+ * @param[in]     variance  Position variance of the fix, in dm^2
+ *
+ * @returns    Nothing.
+ *
+ */
+static void restart(kalman_filter_t *filter, int32_t east, int32_t north, int32_t variance)
+{
+    filter->east = (kalman_axis_t){east, 0};
+    filter->north = (kalman_axis_t){north, 0};
+    filter->p00 = variance;
+    filter->p01 = 0;
+    filter->p11 = KALMAN_INITIAL_VELOCITY;
+}
+
+/*!
+ * @brief Moves an axis forward by a time step
+ *
+ * @param[in,out] axis  Pointer to axis state
+ * @param[in]     dt    Time step, in Q8 seconds
+ *
+ * @returns    Nothing.
+ *
+ */
+static void predict_axis(kalman_axis_t *axis, int32_t dt)
+{
+    axis->position += (axis->velocity*dt) >> TIME_SHIFT;
+}
+
+/*!
+ * @brief Corrects an axis with a measured position
+ *
+ * @param[in,out] axis      Pointer to axis state
+ * @param[in]     measured  Measured position, in cm
+ * @param[in]     k0        Position gain, Q12
+ * @param[in]     k1        Velocity gain, Q12 per second
+ *
+ * @returns    Nothing.
+ *
+ */
+static void correct_axis(kalman_axis_t *axis, int32_t measured, int32_t k0, int32_t k1)
+{
+    int32_t residual = measured - axis->position;
+    residual = constrain(residual, -MAX_RESIDUAL, MAX_RESIDUAL);
+
+    axis->position += (k0*residual) >> GAIN_SHIFT;
+    axis->velocity += (k1*residual) >> GAIN_SHIFT;
+}
+
+/*!
+ * @brief Corrects an axis with a measured velocity
+ *
+ * @param[in,out] axis      Pointer to axis state
+ * @param[in]     measured  Measured velocity, in cm/s
+ * @param[in]     k0        Position gain, Q12 seconds
+ * @param[in]     k1        Velocity gain, Q12
+ *
+ * @returns    Nothing.
+ *
+ */
+static void correct_axis_velocity(kalman_axis_t *axis, int32_t measured, int32_t k0, int32_t k1)
+{
+    int32_t residual = measured - axis->velocity;
+    residual = constrain(residual, -MAX_VELOCITY_RESIDUAL, MAX_VELOCITY_RESIDUAL);
+
+    axis->position += (k0*residual) >> GAIN_SHIFT;
+    axis->velocity += (k1*residual) >> GAIN_SHIFT;
+}
+
+/*!
+ * @brief Initializes the Kalman filter
+ *
+ * The next fix passed to kalman_filter_update starts the filter.
+ *
+ * @param[in,out] filter  Pointer to filter struct to initialize
+ *
+ * @returns    Nothing.
+ *
+ */
+void kalman_filter_initialize(kalman_filter_t *filter)
+{
+    filter->has_origin = false;
+    filter->heading = 0.0;
+}
+
+/*!
+ * @brief Adds a fix to the Kalman filter
+ *
+ * Predicts the state to the time of the fix, corrects it with the
+ * fix's position (weighted by its HDOP) and velocity, and replaces
+ * the fix's location and speed with the smoothed ones.
+ *
+ * @param[in,out] filter  Pointer to filter struct
+ * @param[in,out] data    Pointer to gps data of the fix
+ *
+ * @returns    Nothing.
+ *
+ */
+void kalman_filter_update(kalman_filter_t *filter, gps_data_t *data)
+{
+    int32_t r = measurement_variance(data);
+
+    if (!filter->has_origin) {
+        filter->origin = data->location;
+        filter->east_scale = CM_PER_DEGREE*cos(data->location.latitude*M_PI/180);
+        filter->has_origin = true;
+        filter->time = data->time;
+        filter->milliseconds = data->milliseconds;
+        restart(filter, 0, 0, r);
+        return;
+    }
+
+    /* project the fix onto the east/north plane */
+    int32_t east = (data->location.longitude - filter->origin.longitude)*filter->east_scale;
+    int32_t north = (data->location.latitude - filter->origin.latitude)*CM_PER_DEGREE;
+
+    /* time step in Q8 seconds, assuming 1 s if the gps has no date */
+    int32_t dt = 1 << TIME_SHIFT;
+    if (data->time != 0 && filter->time != 0) {
+        if (data->time - filter->time > KALMAN_MAX_GAP) {
+            /* long gaps (or time going backwards) restart the filter */
+            dt = (int32_t)(KALMAN_MAX_GAP + 1) << TIME_SHIFT;
+        } else {
+            int32_t milliseconds = (int32_t)(data->time - filter->time)*1000
+                                 + ((int32_t)data->milliseconds - filter->milliseconds);
+            dt = (milliseconds << TIME_SHIFT)/1000;
+        }
+    }
+    filter->time = data->time;
+    filter->milliseconds = data->milliseconds;
+
+    if (dt > ((int32_t)KALMAN_MAX_GAP << TIME_SHIFT)) {
+        restart(filter, east, north, r);
+    } else if (dt > 0) {
+        /* predict: x += v dt, P = F P F' + Q */
+        predict_axis(&filter->east, dt);
+        predict_axis(&filter->north, dt);
+
+        int32_t q = KALMAN_ACCELERATION_NOISE;
+        int32_t dt2 = (dt*dt) >> TIME_SHIFT;
+        int32_t p11_dt = (filter->p11*dt) >> TIME_SHIFT;
+
+        filter->p00 = cap(filter->p00 + ((2*filter->p01*dt) >> TIME_SHIFT)
+                          + ((p11_dt*dt) >> TIME_SHIFT)
+                          + ((q*dt2*dt/3) >> (2*TIME_SHIFT)));
+        filter->p01 = cap(filter->p01 + p11_dt + ((q*dt2) >> (TIME_SHIFT + 1)));
+        filter->p11 = cap(filter->p11 + ((q*dt) >> TIME_SHIFT));
+    }
+
+    /* correct: K = P H' / (H P H' + R) */
+    int32_t s = filter->p00 + r;
+    int32_t k0 = (filter->p00 << GAIN_SHIFT)/s;
+    int32_t k1 = (filter->p01 << GAIN_SHIFT)/s;
+
+    correct_axis(&filter->east, east, k0, k1);
+    correct_axis(&filter->north, north, k0, k1);
+
+    filter->p11 -= (k1*filter->p01) >> GAIN_SHIFT;
+    filter->p01 -= (k0*filter->p01) >> GAIN_SHIFT;
+    filter->p00 -= (k0*filter->p00) >> GAIN_SHIFT;
+
+    /* correct with the measured velocity: K = P H' / (H P H' + Rv),
+       H = [0 1] */
+    float course = data->course*M_PI/180;
+    float measured = data->speed*CM_PER_SECOND_PER_MPH;
+    s = filter->p11 + KALMAN_SPEED_VARIANCE;
+    k0 = constrain((filter->p01 << GAIN_SHIFT)/s, -MAX_VELOCITY_GAIN, MAX_VELOCITY_GAIN);
+    k1 = (filter->p11 << GAIN_SHIFT)/s;
+
+    correct_axis_velocity(&filter->east, measured*sin(course), k0, k1);
+    correct_axis_velocity(&filter->north, measured*cos(course), k0, k1);
+
+    filter->p00 -= (k0*filter->p01) >> GAIN_SHIFT;
+    filter->p01 -= (k0*filter->p11) >> GAIN_SHIFT;
+    filter->p11 -= (k1*filter->p11) >> GAIN_SHIFT;
+
+    /* smoothed location, speed and heading */
+    data->location.latitude = filter->origin.latitude + filter->north.position/CM_PER_DEGREE;
+    data->location.longitude = filter->origin.longitude + filter->east.position/filter->east_scale;
+
+    float east_velocity = filter->east.velocity;
+    float north_velocity = filter->north.velocity;
+    data->speed = sqrt(east_velocity*east_velocity + north_velocity*north_velocity)
+                / CM_PER_SECOND_PER_MPH;
+
+    if (data->speed >= KALMAN_HEADING_SPEED) {
+        filter->heading = atan2(east_velocity, north_velocity)*180/M_PI;
+        if (filter->heading < 0) {
+            filter->heading += 360;
+        }
+    }
+}
@@ -0,0 +1,106 @@
+/*!
+ * @file
+ *
+ * @brief Header file for smoothing position and speed
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains the data structures and function prototypes of
+ * a constant velocity Kalman filter over the GPS position and velocity.
+ *
+ * Each fix corrects the state twice: with its position, and with the
+ * velocity from its speed and course. The GPS measures velocity from
+ * Doppler shift, so its errors do not follow the slow drift of the
+ * position errors, and the two together give a steadier speed than
+ * either alone.
+ *
+ * Positions are projected onto a flat east/north plane around the
+ * first fix. East and north are filtered independently with the same
+ * model and the same measurement noise, so they share one covariance
+ * matrix and one set of gains. The filter runs in 32 bit fixed point:
+ *
+ *   position  cm
+ *   velocity  cm/s
+ *   covariance  dm^2, dm^2/s and dm^2/s^2
+ *   gains       Q12 (units of 1/4096)
+ *   time steps  Q8 seconds (units of 1/256 s)
+ *
+ * Covariances are capped and time steps limited to KALMAN_MAX_GAP so
+ * no product overflows. Floating point is only used to convert to and
+ * from latitude/longitude, speed and heading.
+ *
+ */
+
+#ifndef KALMAN_FILTER_H
+#define KALMAN_FILTER_H
+
+#include <stdint.h>
+#include "Arduino.h"
+
+#include "gps.h"
+#include "types.h"
+
+#define KALMAN_ACCELERATION_NOISE 25     /*!< Process noise (acceleration spectral density), in dm^2/s^3 */
+#define KALMAN_UERE 40                   /*!< Position error per unit of HDOP, in dm */
+#define KALMAN_SPEED_VARIANCE 25         /*!< Velocity measurement variance, in dm^2/s^2 */
+#define KALMAN_INITIAL_VELOCITY 2500     /*!< Velocity variance at the first fix, in dm^2/s^2 */
+#define KALMAN_MAX_COVARIANCE 100000L    /*!< Cap on covariances */
+#define KALMAN_MAX_GAP 5                 /*!< Longest time step before restarting, in seconds */
+#define KALMAN_HEADING_SPEED 1.0         /*!< Speed below which heading is not updated, in mph */
+
+/*!
+ * @brief struct holding the state of one axis of the filter
+ */
+struct kalman_axis_t {
+    int32_t position;  /*!< Position from the origin, in cm */
+    int32_t velocity;  /*!< Velocity, in cm/s */
+};
+
+/*!
+ * @brief struct holding the state of the Kalman filter
+ */
+struct kalman_filter_t {
+    point_t origin;              /*!< Origin of the east/north plane */
+    float east_scale;            /*!< cm per degree of longitude at the origin */
+    kalman_axis_t east;          /*!< East axis state */
+    kalman_axis_t north;         /*!< North axis state */
+    int32_t p00;                 /*!< Position variance, in dm^2 */
+    int32_t p01;                 /*!< Position/velocity covariance, in dm^2/s */
+    int32_t p11;                 /*!< Velocity variance, in dm^2/s^2 */
+    uint32_t time;               /*!< GPS time of the last fix, in seconds */
+    uint16_t milliseconds;       /*!< Milliseconds past time */
+    float heading;               /*!< Smoothed heading, in degrees clockwise from north */
+    boolean has_origin;          /*!< Flag indicating the filter has a fix */
+};
+
+/*!
+ * @brief Initializes the Kalman filter
+ *
+ * The next fix passed to kalman_filter_update starts the filter.
+ *
+ * @param[in,out] filter  Pointer to filter struct to initialize
+ *
+ * @returns    Nothing.
+ *
+ */
+void kalman_filter_initialize(kalman_filter_t *filter);
+
+/*!
+ * @brief Adds a fix to the Kalman filter
+ *
+ * Predicts the state to the time of the fix, corrects it with the
+ * fix's position (weighted by its HDOP) and velocity, and replaces
+ * the fix's location and speed with the smoothed ones.
+ *
+ * @param[in,out] filter  Pointer to filter struct
+ * @param[in,out] data    Pointer to gps data of the fix
+ *
+ * @returns    Nothing.
+ *
+ */
+void kalman_filter_update(kalman_filter_t *filter, gps_data_t *data);
+
+#endif
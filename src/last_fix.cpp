@@ -0,0 +1,127 @@
+/*!
+ * @file
+ *
+ * @brief Interface for keeping the last fix between tracking sessions
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains the function definitions which keep the last
+ * fix of a tracking session in EEPROM and log the time to first fix
+ * of each session.
+ *
+ * See last fix format for details on the layout in EEPROM
+ */
+
+#include <stdint.h>
+#include <avr/eeprom.h>
+#include "Arduino.h"
+
+#include "last_fix.h"
+
+/*!
+ * @brief Loads the last fix from EEPROM
+ *
+ * @param[out] last_fix  Pointer to last fix struct to load
+ *
+ * @returns    Nothing.
+ *
+ */
+void last_fix_load(last_fix_t *last_fix)
+{
+    last_fix->has_location =
+        eeprom_read_byte((uint8_t*)LAST_FIX_VALID_ADDRESS) == LAST_FIX_VALID;
+    last_fix->location.latitude = eeprom_read_float((float*)LAST_FIX_LATITUDE_ADDRESS);
+    last_fix->location.longitude = eeprom_read_float((float*)LAST_FIX_LONGITUDE_ADDRESS);
+    last_fix->altitude = eeprom_read_float((float*)LAST_FIX_ALTITUDE_ADDRESS);
+    last_fix->time = eeprom_read_dword((uint32_t*)LAST_FIX_TIME_ADDRESS);
+
+    /* millis() started again at power up */
+    last_fix->saved_at = 0;
+    last_fix->has_time = false;
+}
+
+/*!
+ * @brief Saves the last fix of a tracking session
+ *
+ * The fix is kept in RAM along with the time it was saved, and
+ * written to EEPROM. Bytes which have not changed are not rewritten.
+ *
+ * @param[in,out] last_fix  Pointer to last fix struct
+ * @param[in]     data      Pointer to gps data of the last tracked fix
+ *
+ * @returns    Nothing.
+ *
+ */
+void last_fix_save(last_fix_t *last_fix, gps_data_t *data)
+{
+    last_fix->location = data->location;
+    last_fix->altitude = data->altitude;
+    last_fix->time = data->time;
+    last_fix->saved_at = millis();
+    last_fix->has_location = true;
+    last_fix->has_time = true;
+
+    eeprom_update_float((float*)LAST_FIX_LATITUDE_ADDRESS, data->location.latitude);
+    eeprom_update_float((float*)LAST_FIX_LONGITUDE_ADDRESS, data->location.longitude);
+    eeprom_update_float((float*)LAST_FIX_ALTITUDE_ADDRESS, data->altitude);
+    eeprom_update_dword((uint32_t*)LAST_FIX_TIME_ADDRESS, data->time);
+    eeprom_update_byte((uint8_t*)LAST_FIX_VALID_ADDRESS, LAST_FIX_VALID);
+}
+
+/*!
+ * @brief Gets the current time to aid the GPS with
+ *
+ * @param[in]  last_fix  Pointer to last fix struct
+ * @param[in]  reported  Time reported by the GPS without a fix, or 0
+ *
+ * @returns    Current GPS time in seconds since 2000, or 0 if unknown
+ *             or the last fix is older than LAST_FIX_MAX_AGE
+ *
+ */
+uint32_t last_fix_aiding_time(last_fix_t *last_fix, uint32_t reported)
+{
+    if (!last_fix->has_location || last_fix->time == 0) {
+        return 0;
+    }
+
+    uint32_t time = reported;
+    if (last_fix->has_time) {
+        time = last_fix->time + (millis() - last_fix->saved_at)/1000;
+    }
+
+    /* a gps without a clock reports a default date, long before or
+       after the last fix */
+    if (time < last_fix->time || time - last_fix->time > LAST_FIX_MAX_AGE) {
+        return 0;
+    }
+    return time;
+}
+
+/*!
+ * @brief Logs the time to first fix of a tracking session
+ *
+ * @param[in]  ttff   Time from entering tracking mode to the first fix, in ms
+ * @param[in]  aided  Flag set if the GPS was given the last fix
+ *
+ * @returns    Nothing.
+ *
+ */
+void last_fix_log_ttff(uint32_t ttff, boolean aided)
+{
+    /* capped so that an aided entry never reads as unused */
+    uint16_t entry = min(ttff/(1000/LAST_FIX_TTFF_SCALE), LAST_FIX_TTFF_AIDED - 2UL);
+    if (aided) {
+        entry |= LAST_FIX_TTFF_AIDED;
+    }
+
+    uint8_t index = eeprom_read_byte((uint8_t*)LAST_FIX_TTFF_INDEX_ADDRESS);
+    if (index >= LAST_FIX_TTFF_COUNT) {
+        index = 0;
+    }
+
+    eeprom_update_word((uint16_t*)(LAST_FIX_TTFF_ADDRESS + 2*index), entry);
+    eeprom_update_byte((uint8_t*)LAST_FIX_TTFF_INDEX_ADDRESS, (index + 1) % LAST_FIX_TTFF_COUNT);
+}
@@ -0,0 +1,97 @@
+/*!
+ * @file
+ *
+ * @brief Header file for keeping the last fix between tracking sessions
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains the data structures and function prototypes
+ * which keep the last fix of a tracking session, so that the GPS can
+ * be given its position and time (aided) at the start of the next
+ * one, and which log the time to first fix (TTFF) of each session.
+ *
+ * The fix is kept in EEPROM, so the position survives power cycles.
+ * The device has no clock of its own, so the current time is only
+ * known while the device has stayed powered since the fix was saved
+ * (from millis()). Otherwise the time the GPS reports before it has
+ * a fix is used, if it is plausible.
+ *
+ * See last fix format for the layout in EEPROM
+ *
+ */
+
+#ifndef LAST_FIX_H
+#define LAST_FIX_H
+
+#include <stdint.h>
+#include "Arduino.h"
+
+#include "gps.h"
+#include "last_fix_format.h"
+#include "types.h"
+
+#define LAST_FIX_MAX_AGE (180UL*86400UL)  /*!< Oldest fix given to the GPS, in seconds */
+
+/*!
+ * @brief struct holding the last fix of a tracking session
+ */
+struct last_fix_t {
+    point_t location;     /*!< Location of the fix */
+    float altitude;       /*!< Altitude of the fix, in metres */
+    uint32_t time;        /*!< GPS time of the fix, in seconds since 2000 */
+    uint32_t saved_at;    /*!< millis() when the fix was saved */
+    boolean has_location; /*!< Flag set if a fix has ever been saved */
+    boolean has_time;     /*!< Flag set if saved_at is valid (saved since power up) */
+};
+
+/*!
+ * @brief Loads the last fix from EEPROM
+ *
+ * @param[out] last_fix  Pointer to last fix struct to load
+ *
+ * @returns    Nothing.
+ *
+ */
+void last_fix_load(last_fix_t *last_fix);
+
+/*!
+ * @brief Saves the last fix of a tracking session
+ *
+ * The fix is kept in RAM along with the time it was saved, and
+ * written to EEPROM. Bytes which have not changed are not rewritten.
+ *
+ * @param[in,out] last_fix  Pointer to last fix struct
+ * @param[in]     data      Pointer to gps data of the last tracked fix
+ *
+ * @returns    Nothing.
+ *
+ */
+void last_fix_save(last_fix_t *last_fix, gps_data_t *data);
+
+/*!
+ * @brief Gets the current time to aid the GPS with
+ *
+ * @param[in]  last_fix  Pointer to last fix struct
+ * @param[in]  reported  Time reported by the GPS without a fix, or 0
+ *
+ * @returns    Current GPS time in seconds since 2000, or 0 if unknown
+ *             or the last fix is older than LAST_FIX_MAX_AGE
+ *
+ */
+uint32_t last_fix_aiding_time(last_fix_t *last_fix, uint32_t reported);
+
+/*!
+ * @brief Logs the time to first fix of a tracking session
+ *
+ * @param[in]  ttff   Time from entering tracking mode to the first fix, in ms
+ * @param[in]  aided  Flag set if the GPS was given the last fix
+ *
+ * @returns    Nothing.
+ *
+ */
+void last_fix_log_ttff(uint32_t ttff, boolean aided);
+
+#endif
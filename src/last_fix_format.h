@@ -0,0 +1,50 @@
+/*!
+ * @file
+ *
+ * @brief Layout of the last fix and TTFF log in EEPROM
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains only the constants describing where the last
+ * fix of a tracking session and the time to first fix (TTFF) of
+ * recent sessions are kept, so that they can be shared between the
+ * firmware and the host side report.
+ *
+ * They are stored in EEPROM after the track log:
+ *
+ *   0x3A0 valid (1 byte, LAST_FIX_VALID once a fix has been saved)
+ *   0x3A1 latitude (float, degrees)
+ *   0x3A5 longitude (float, degrees)
+ *   0x3A9 altitude (float, metres)
+ *   0x3AD time (4 bytes, GPS time in seconds since 1 January 2000)
+ *   0x3B1 index of the next TTFF entry (1 byte)
+ *   0x3B2 TTFF entries (LAST_FIX_TTFF_COUNT x 2 bytes)
+ *
+ * A TTFF entry is the time from entering tracking mode to the first
+ * tracked fix in units of 1/LAST_FIX_TTFF_SCALE s, with the top bit
+ * (LAST_FIX_TTFF_AIDED) set if the GPS was given the last fix. Unused
+ * entries are 0xFFFF. Multi-byte values are little endian.
+ *
+ */
+
+#ifndef LAST_FIX_FORMAT_H
+#define LAST_FIX_FORMAT_H
+
+#define LAST_FIX_VALID_ADDRESS 0x3A0      /*!< EEPROM address of the valid byte */
+#define LAST_FIX_LATITUDE_ADDRESS 0x3A1   /*!< EEPROM address of the latitude */
+#define LAST_FIX_LONGITUDE_ADDRESS 0x3A5  /*!< EEPROM address of the longitude */
+#define LAST_FIX_ALTITUDE_ADDRESS 0x3A9   /*!< EEPROM address of the altitude */
+#define LAST_FIX_TIME_ADDRESS 0x3AD       /*!< EEPROM address of the time */
+#define LAST_FIX_TTFF_INDEX_ADDRESS 0x3B1 /*!< EEPROM address of the next TTFF entry index */
+#define LAST_FIX_TTFF_ADDRESS 0x3B2       /*!< EEPROM address of the first TTFF entry */
+
+#define LAST_FIX_VALID 0xA5           /*!< Valid byte once a fix has been saved */
+#define LAST_FIX_TTFF_COUNT 8         /*!< Number of TTFF entries kept */
+#define LAST_FIX_TTFF_SCALE 10        /*!< TTFF units per second */
+#define LAST_FIX_TTFF_AIDED 0x8000    /*!< TTFF entry flag set for aided sessions */
+#define LAST_FIX_TTFF_UNUSED 0xFFFF   /*!< Value of an unused TTFF entry */
+
+#endif
@@ -24,17 +24,34 @@
 #include "bluetooth.h"
 #include "lcd.h"
 #include "types.h"
-#include "haversine.h"
 #include "waypoint_reader.h"
 #include "waypoint_writer.h"
 #include "gps.h"
-
-#define WAYPOINT_DISTANCE_THRESHOLD 100 /* Distance before changing waypoint to next waypoint */
-#define BUSY_LED 17                     /* Fio Pin for BUSY LED */
+#include "last_fix.h"
+#include "track_recorder.h"
+#include "track_simplifier.h"
+#include "tracking.h"
+#include "duty_cycle.h"
+#include "telemetry.h"
+#include "broadcast.h"
+
+#define TRACK_TOLERANCE 5  /* Deviation in metres before a point is recorded */
+#define BUSY_LED 17        /* Fio Pin for BUSY LED */
+#define GPS_HIGH_RATE 0    /* Track with 5 Hz GPS updates at 115200 baud (falls back to 1 Hz) */
+#define GPS_LOW_POWER 0    /* Let the GPS sleep between fixes on long rides (1 Hz updates only) */
+#define GPS_BINARY 0       /* Ask for MTK binary output (DIYDrones MTK firmware only) */
+#define BLE_TELEMETRY 0    /* Keep Bluetooth up while tracking and send each fix to the phone */
+#define BLE_BROADCAST 0    /* Broadcast position and speed while tracking, without a connection */
+#define BROADCAST_INTERVAL 1000  /* Least time between broadcast records, in ms */
+#define DISPLAY_INTERVAL 1000  /* Time between tracking display updates, in ms */
 
 #define GREEN_BUTTON_INTERRUPT_NUM 1  /* Corresponds to pin 2 (D2) */
 #define BLUE_BUTTON_INTERRUPT_NUM 0   /* Corresponds to pin 3 (D3) */
 
+#if BLE_TELEMETRY && BLE_BROADCAST
+#error "the nRF8001 cannot broadcast and take a connection at once"
+#endif
+
 /*
  * Global flags indicating a button press has not yet been handled.
  * Will be set to 1 on button press, and should be read and cleared
@@ -87,6 +104,22 @@ void blue_button_handler(void)
     last = current;
 }
 
+#if HAL_ACI_TRACE
+/*!
+ * @brief Writes part of the ACI trace to the USB serial port
+ *
+ * @param[in]  data    Bytes to write
+ * @param[in]  length  Number of bytes
+ *
+ * @returns    Nothing.
+ *
+ */
+void trace_write(const uint8_t *data, uint16_t length)
+{
+    Serial.write(data, length);
+}
+#endif
+
 /*!
  * @brief Setup function - required by Arduino
  *
@@ -103,6 +136,11 @@ void blue_button_handler(void)
  */
 void setup(void)
 {
+#if HAL_ACI_TRACE
+    /* the ACI trace is read over USB */
+    Serial.begin(115200);
+#endif
+
     gps_boot(); /* start gps */
 
     /* bluetooth and lcd use SPI, so initialization must be done first */
@@ -112,8 +150,14 @@ void setup(void)
     bluetooth_t bluetooth;
     bluetooth_setup(&bluetooth);
 
+    /* last fix of the previous ride, used to aid the gps */
+    last_fix_t last_fix;
+    last_fix_load(&last_fix);
+
     /* magic between bluetooth and lcd */
+    hal_aci_tl_trace_mark(BLUETOOTH_TRACE_SETUP_DELAY);
     delay(1);
+    hal_aci_tl_trace_mark(BLUETOOTH_TRACE_SETUP_DONE);
 
     /* Initialise LCD - Print startup message */
     lcd_init();
@@ -135,7 +179,7 @@ void setup(void)
             g_green_button_pressed = 0;
             interrupts();
 
-            run_tracking();
+            run_tracking(&last_fix, &bluetooth);
             gps_standby();
 
             /* clear all blue presses that occured while in tracking */
@@ -162,6 +206,13 @@ void setup(void)
         }
 
         interrupts();
+
+#if HAL_ACI_TRACE
+        /* send the ACI trace to a host asking for it, see aci_trace */
+        if (Serial.available() && 'T' == Serial.read()) {
+            hal_aci_tl_trace_export(trace_write);
+        }
+#endif
     }
 }
 
@@ -249,41 +300,111 @@ void print_home(void)
     lcd_print_str(buffer);
 }
 
+/*! @brief Prints the progress of GPS initialisation
+ *
+ * Prints which of the GPS setup commands is being sent while
+ * tracking mode waits for the GPS to acknowledge them.
+ *
+ * @param[in]  gps  Pointer to GPS struct being initialised
+ *
+ * @returns    Nothing.
+ *
+ */
+void print_gps_progress(gps_t *gps)
+{
+    lcd_clear_display();
+    lcd_print_str("GPS Setup");
+
+    lcd_pos(0, 1);
+    char buffer[13];
+    sprintf(buffer, "%d/%d", gps->command_index + 1, gps->command_count);
+    lcd_print_str(buffer);
+}
+
 
 /*!
  * @brief Runs tracking mode
  *
  * This function runs tracking mode (entered when green button
- * is pressed). Tracking mode is implemented by waiting for a 
- * gps packet. Once a packet is received and validated, it is 
+ * is pressed). The GPS is set up in the background while the
+ * setup progress is shown. Tracking mode is implemented by waiting
+ * for a gps packet. Once a packet is received and validated, it is 
  * parsed and the resulting data is fed into the tracking data
- * structs
+ * structs and recorded to the track log. Elapsed time is taken from
+ * the GPS time of each fix and the display is updated every
+ * DISPLAY_INTERVAL, so neither depends on the GPS update rate.
+ *
+ * With GPS_LOW_POWER set, the GPS is put in periodic standby after
+ * each fix for as long as duty_cycle_update allows, trading
+ * precision for battery life.
+ *
+ * Until its first fix, the GPS is given the last fix of the previous
+ * ride and the current time, if known, to shorten the time to first
+ * fix (TTFF). The TTFF of each ride is logged, and the last fix of
+ * this ride is saved on return.
+ *
+ * With BLE_TELEMETRY set, Bluetooth advertises while tracking and a
+ * snapshot of the tracking data is sent to a connected phone after
+ * each fix. Snapshots which cannot go at once wait for the next pass
+ * of the loop, and are replaced by the next fix, so the loop never
+ * waits on the radio.
+ *
+ * With BLE_BROADCAST set instead, the position and speed of the
+ * latest fix are put in the advertising data for any phone in range,
+ * at most once every BROADCAST_INTERVAL.
+ *
+ * @param[in,out]  last_fix   Pointer to last fix of the previous ride
+ * @param[in,out]  bluetooth  Pointer to bluetooth struct, asleep
  *
  * @returns    Nothing.
  *
  */
-void run_tracking(void)
+void run_tracking(last_fix_t *last_fix, bluetooth_t *bluetooth)
 {
-    gps_t gps;
-    gps_data_t gps_data;
-    gps_initialize(&gps);
-
-    waypoint_reader_t waypoint_reader;
-    waypoint_reader_initialize(&waypoint_reader);
-    point_t initial_waypoint = waypoint_reader_get_next(&waypoint_reader);
+    uint32_t entered_at = millis();
 
-    tracking_data_t tracking_data = (tracking_data_t){0.0,0,0.0,0.0,0.0,false};
+    gps_t gps;
+    gps_initialize(&gps, GPS_HIGH_RATE && !GPS_LOW_POWER, GPS_BINARY);
+    gps_command_status_t gps_status = GPS_COMMANDS_IN_PROGRESS;
+    uint8_t gps_step = gps.command_index;
+
+    /* power mode changes are sent while tracking */
+    duty_cycle_t duty_cycle;
+    duty_cycle_initialize(&duty_cycle);
+    gps_command_status_t duty_status = GPS_COMMANDS_DONE;
+
+    /* the gps is aided once, if it has no fix of its own yet */
+    boolean aid_pending = last_fix->has_location;
+    boolean aided = false;
+    gps_command_status_t aid_status = GPS_COMMANDS_DONE;
+
+    tracking_t tracking;
+    tracking_initialize(&tracking);
+
+    /* points pass through the simplifier before being recorded */
+    track_simplifier_t track_simplifier;
+    track_simplifier_initialize(&track_simplifier, TRACK_TOLERANCE);
+    track_recorder_t track_recorder;
+    track_recorder_initialize(&track_recorder);
+    uint32_t kept_time;
+    gps_data_t kept_data;
+
+    /* time of last display update */
+    uint32_t shown_at = 0;
+
+    /* live tracking data for a connected phone */
+    telemetry_t telemetry;
+    telemetry_initialize(&telemetry);
+    if (BLE_TELEMETRY) {
+        bluetooth_advertise(bluetooth);
+    }
 
-    tracking_record_t tracking_record = {.num_points = 0,
-                                         .aggregate_speed = 0.0,
-                                         .current_waypoint = initial_waypoint};
+    /* tracking state for any phone in range, if the setup can broadcast */
+    broadcast_t broadcast;
+    broadcast_initialize(&broadcast, BROADCAST_INTERVAL);
+    boolean broadcasting = BLE_BROADCAST && bluetooth_broadcast(bluetooth, BROADCAST_INTERVAL);
 
-    /* Started will be set to true after the first valid gps packet.
-       This indicates that tracking has begun.*/
-    boolean started = false;
-
-    lcd_clear_display();
-    lcd_print_str("Pending Fix");
+    print_gps_progress(&gps);
 
     while (1) {
 
@@ -292,126 +413,118 @@ void run_tracking(void)
         if (g_green_button_pressed) {
             g_green_button_pressed = 0;
             interrupts();
+            if (track_simplifier_finish(&track_simplifier, &kept_time, &kept_data)) {
+                track_recorder_append(&track_recorder, kept_time, &kept_data);
+            }
+            track_recorder_finish(&track_recorder);
+            if (tracking.started) {
+                last_fix_save(last_fix, &tracking.gps_data);
+            }
+            if (BLE_TELEMETRY || BLE_BROADCAST) {
+                bluetooth_sleep(bluetooth);
+            }
             return;
         }
         interrupts();
 
+        /* copy recorded points to storage while waiting */
+        track_recorder_poll(&track_recorder);
+
+        /* keep the link up and send the newest fix when it can go */
+        if (BLE_TELEMETRY) {
+            telemetry_poll(&telemetry, bluetooth);
+        }
+        if (broadcasting) {
+            broadcast_poll(&broadcast, bluetooth, millis());
+        }
+
+        /* wait for the gps to acknowledge its setup */
+        if (gps_status == GPS_COMMANDS_IN_PROGRESS) {
+            gps_status = gps_initialize_poll(&gps);
+            if (gps_status != GPS_COMMANDS_IN_PROGRESS) {
+                /* an unacknowledged command leaves the gps defaults,
+                   which still output RMC packets */
+                lcd_clear_display();
+                lcd_print_str("Pending Fix");
+            } else if (gps.command_index != gps_step) {
+                gps_step = gps.command_index;
+                print_gps_progress(&gps);
+            }
+            continue;
+        }
+
+        /* follow the last fix sent to the gps; its reply is read
+           along with the fixes, which keep being tracked */
+        if (aid_status == GPS_COMMANDS_IN_PROGRESS) {
+            aid_status = gps_command_poll(&gps);
+        }
+
+        /* follow a power mode change the same way, and stay fully on
+           if the gps does not acknowledge it */
+        if (duty_status == GPS_COMMANDS_IN_PROGRESS) {
+            duty_status = gps_command_poll(&gps);
+            if (duty_status == GPS_COMMANDS_FAILED) {
+                duty_cycle.enabled = false;
+            }
+        }
+
         /* spin until a gps packet has arrived */
         if (gps_available(&gps)) {
 
-            /* ignore invalid packets */
-            if (gps_valid(&gps)) {
+            /* aid the gps once the time is known, until it has a fix */
+            if (aid_pending) {
+                uint32_t time = last_fix_aiding_time(last_fix, gps.fix.time);
+                if (gps_valid(&gps)) {
+                    aid_pending = false;
+                } else if (time != 0) {
+                    gps_aid(&gps, last_fix->location, last_fix->altitude, time);
+                    aid_status = GPS_COMMANDS_IN_PROGRESS;
+                    aid_pending = false;
+                    aided = true;
+                    continue;
+                }
+            }
+
+            /* tracking has begun once the first valid gps packet arrives */
+            boolean started = tracking.started;
+
+            if (tracking_update(&tracking, &gps)) {
 
                 /* only clear lcd for the first gps packet after fix */
                 if (!started) {
+                    last_fix_log_ttff(millis() - entered_at, aided);
                     lcd_clear_display();
-                    started = true;
+                    shown_at = millis() - DISPLAY_INTERVAL;
                 }
 
-                gps_parse(&gps, &gps_data);
-
-                update_tracking_record(&tracking_record, &gps_data);
-                update_tracking_data(&tracking_data, &gps_data, &tracking_record);
-
-                if (!tracking_data.waypoint_done) {
-                    update_waypoint(&waypoint_reader, &tracking_data, &tracking_record);
+                if (track_simplifier_add(&track_simplifier, tracking.gps_data.time,
+                                         &tracking.gps_data, &kept_time, &kept_data)) {
+                    track_recorder_append(&track_recorder, kept_time, &kept_data);
                 }
 
-            }
+                if (BLE_TELEMETRY) {
+                    telemetry_update(&telemetry, &tracking.data);
+                }
+                if (broadcasting) {
+                    broadcast_update(&broadcast, &tracking.gps_data, &tracking.data);
+                }
 
-            /* only update time and display after fix */
-            if (started) {
-                print_tracking_display(&tracking_data);
-                tracking_data.time_elapsed++;
+                /* sleep until the next fix is needed, one command at a time */
+                if (GPS_LOW_POWER && aid_status != GPS_COMMANDS_IN_PROGRESS
+                        && duty_status != GPS_COMMANDS_IN_PROGRESS
+                        && duty_cycle_update(&duty_cycle, &tracking.data)) {
+                    gps_set_periodic(&gps, DUTY_CYCLE_RUN_TIME, duty_cycle.sleep);
+                    duty_status = GPS_COMMANDS_IN_PROGRESS;
+                }
             }
         }
-    }
-}
 
-/*!
- * @brief Updates record for average speed/previous point tracking
- *
- * Updates the tracking record struct with the previous and current points,
- * and adds the current speed to the aggregate speed (used to calculate the
- * average speed).
- *
- * @param[in,out] record  Pointer to tracking record to update
- * @param[in]     gps     Pointer to gps struct with received datastring
- *
- * @returns    Nothing.
- *
- */
-void update_tracking_record(tracking_record_t *record, gps_data_t *gps)
-{
-    record->previous_tracking_point = record->current_tracking_point;
-    record->current_tracking_point = gps->location;
-    record->num_points++;
-    record->aggregate_speed += gps->speed;
-}
-
-/*!
- * @brief Updates record for average speed/previous point tracking
- *
- * Updates the tracking record struct with the previous and current points,
- * and adds the current speed to the aggregate speed (used to calculate the
- * average speed).
- *
- * @param[in,out] data    Pointer to data struct for current tracking cycle
- * @param[in]     gps     Pointer to gps struct with received datastring
- * @param[in]     record  Pointer to updated record for current gps data set
- *
- * @returns    Nothing.
- *
- */
-void update_tracking_data(tracking_data_t *data, gps_data_t *gps, tracking_record_t *record)
-{
-    /* only add distance if for points 2..n */
-    if (record->num_points > 1) {
-        data->total_distance +=
-            distance_between(record->previous_tracking_point,
-                             record->current_tracking_point);
-    }
-    data->instant_speed = gps->speed;
-    data->average_speed = record->aggregate_speed/record->num_points;
-}
-
-/*!
- * @brief Updates waypoint information
- *
- * Updates tracking_data->waypoint_done, current_waypoint and
- * tracking_data->waypoint_distance for current set of data read 
- * from the gps. Tells us the distance from the current waypoint, 
- * switches to next waypoint if needed, or ends the path if all
- * waypoints have been passed.
- *
- * @param[in]      waypoint_reader   Pointer to waypoint_reader for current tracking session
- * @param[in,out]  data              Pointer to tracking data struct to update
- * @param[in,out]  record            Pointer to tracking record struct to update
- *
- * @returns    Nothing.
- *
- */
-void update_waypoint(waypoint_reader_t *waypoint_reader,
-                     tracking_data_t *tracking_data,
-                     tracking_record_t *tracking_record)
-{
-    point_t waypoint = tracking_record->current_waypoint;
-    point_t tracking_point = tracking_record->current_tracking_point;
-
-    float distance_to_waypoint = distance_between(waypoint, tracking_point);
-
-    while (distance_to_waypoint < WAYPOINT_DISTANCE_THRESHOLD
-           && !tracking_data->waypoint_done) {
-        if (waypoint_reader_end(waypoint_reader)) {
-            tracking_data->waypoint_done = true;
-        } else {
-            waypoint = waypoint_reader_get_next(waypoint_reader);
-            distance_to_waypoint = distance_between(waypoint, tracking_point);
+        /* only update display after fix, at a fixed rate */
+        if (tracking.started && millis() - shown_at >= DISPLAY_INTERVAL) {
+            shown_at += DISPLAY_INTERVAL;
+            print_tracking_display(&tracking.data);
         }
     }
-
-    tracking_record->current_waypoint = waypoint;
-    tracking_data->waypoint_distance = distance_to_waypoint;
 }
 
 /*!
@@ -423,6 +536,9 @@ void update_waypoint(waypoint_reader_t *waypoint_reader,
  * (containing waypoint data) and write them to storage. The result of
  * the transaction (success or failure) is displayed on the LCD.
  *
+ * The phone can also start a firmware update instead, which resets
+ * into the bootloader.
+ *
  * @param[in,out]  bluetooth  Pointer to bluetooth struct
  *
  * @returns    Nothing.
@@ -497,6 +613,13 @@ boolean get_and_store_waypoints(bluetooth_t *bluetooth)
         bluetooth_poll(bluetooth);
         status = bluetooth_get_status(bluetooth);
 
+        /* hand the link to the bootloader at once if the phone asks for
+           a firmware update, this returns only if that was not possible */
+        if (bluetooth_dfu_requested(bluetooth)) {
+            bluetooth_enter_bootloader(bluetooth);
+            return false;
+        }
+
         /* If a message is available, we want to write it
          * to EEPROM. If not, we wait for a connection or
          * a message.
@@ -0,0 +1,149 @@
+/*!
+ * @file
+ *
+ * @brief Interface for live telemetry while tracking
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains the function definitions used to send
+ * snapshots of the tracking data to a connected phone.
+ *
+ * See telemetry format for details on the snapshot layout
+ */
+
+#include <stdint.h>
+#include <math.h>
+#include "Arduino.h"
+
+#include "telemetry.h"
+
+/*!
+ * @brief Converts a value to unsigned fixed point
+ *
+ * @param[in]  value    Value to convert
+ * @param[in]  scale    Fixed point units per unit of the value
+ * @param[in]  maximum  Largest fixed point value
+ *
+ * @returns    The value in fixed point, clamped to 0 and maximum
+ *
+ */
+static uint32_t to_fixed(float value, float scale, uint32_t maximum)
+{
+    float fixed = value*scale + 0.5;
+    if (!(fixed >= 0)) return 0;
+    if (fixed >= maximum) return maximum;
+    return fixed;
+}
+
+/*!
+ * @brief Encodes a 16 bit value little endian
+ *
+ * @param[out] buffer  Buffer to encode into
+ * @param[in]  value   Value to encode
+ *
+ * @returns    Nothing.
+ *
+ */
+static void put_u16(uint8_t *buffer, uint16_t value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+}
+
+/*!
+ * @brief Encodes a 32 bit value little endian
+ *
+ * @param[out] buffer  Buffer to encode into
+ * @param[in]  value   Value to encode
+ *
+ * @returns    Nothing.
+ *
+ */
+static void put_u32(uint8_t *buffer, uint32_t value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+    buffer[2] = value >> 16;
+    buffer[3] = value >> 24;
+}
+
+/*!
+ * @brief Initializes telemetry for a tracking session
+ *
+ * @param[in,out] telemetry  Pointer to telemetry struct to initialize
+ *
+ * @returns    Nothing.
+ *
+ */
+void telemetry_initialize(telemetry_t *telemetry)
+{
+    memset(telemetry, 0, sizeof(*telemetry));
+    telemetry->snapshot[TELEMETRY_TAG_OFFSET] = TELEMETRY_TAG;
+}
+
+/*!
+ * @brief Takes a snapshot of the tracking data after a fix
+ *
+ * Encodes the tracking data as the newest snapshot, replacing one
+ * which has not been sent yet. The snapshot is sent by telemetry_poll.
+ *
+ * @param[in,out] telemetry  Pointer to telemetry struct
+ * @param[in]     data       Pointer to the tracking data of the fix
+ *
+ * @returns    Nothing.
+ *
+ */
+void telemetry_update(telemetry_t *telemetry, tracking_data_t *data)
+{
+    if (telemetry->pending) {
+        telemetry->coalesced++;
+    }
+
+    uint8_t *snapshot = telemetry->snapshot;
+    telemetry->sequence++;
+    snapshot[TELEMETRY_SEQUENCE_OFFSET] = telemetry->sequence;
+    snapshot[TELEMETRY_FLAGS_OFFSET] = data->waypoint_done ? TELEMETRY_WAYPOINT_DONE : 0;
+    put_u16(&snapshot[TELEMETRY_TIME_OFFSET], data->time_elapsed > 0 ? data->time_elapsed : 0);
+    put_u16(&snapshot[TELEMETRY_SPEED_OFFSET],
+            to_fixed(data->instant_speed, TELEMETRY_SPEED_SCALE, 0xFFFF));
+    put_u16(&snapshot[TELEMETRY_AVERAGE_OFFSET],
+            to_fixed(data->average_speed, TELEMETRY_SPEED_SCALE, 0xFFFF));
+    put_u32(&snapshot[TELEMETRY_DISTANCE_OFFSET], to_fixed(data->total_distance, 1, 0xFFFFFF00));
+    put_u32(&snapshot[TELEMETRY_WAYPOINT_OFFSET], to_fixed(data->waypoint_distance, 1, 0xFFFFFF00));
+    put_u16(&snapshot[TELEMETRY_HEADING_OFFSET],
+            to_fixed(data->heading, TELEMETRY_HEADING_SCALE, 0xFFFF));
+    telemetry->pending = true;
+}
+
+/*!
+ * @brief Keeps the link serviced and sends the newest snapshot
+ *
+ * Handles one Bluetooth event, starts advertising again if the phone
+ * has disconnected and sends the newest snapshot if it is unsent and
+ * can go now. Never waits on the nRF8001, so it can be called on
+ * every pass of the tracking loop.
+ *
+ * @param[in,out] telemetry  Pointer to telemetry struct
+ * @param[in,out] bluetooth  Pointer to bluetooth struct, advertising or connected
+ *
+ * @returns    Nothing.
+ *
+ */
+void telemetry_poll(telemetry_t *telemetry, bluetooth_t *bluetooth)
+{
+    bluetooth_poll(bluetooth);
+
+    /* let the phone connect again after it disconnects */
+    if (STANDBY == bluetooth_get_status(bluetooth)) {
+        bluetooth_start_advertising(bluetooth);
+        return;
+    }
+
+    if (telemetry->pending && bluetooth_send(bluetooth, telemetry->snapshot, TELEMETRY_SIZE)) {
+        telemetry->pending = false;
+        telemetry->sent++;
+    }
+}
@@ -0,0 +1,84 @@
+/*!
+ * @file
+ *
+ * @brief Header file for live telemetry while tracking
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains the data structures and function prototypes
+ * used to send a snapshot of the tracking data to a connected phone
+ * after each fix, without holding up the tracking loop.
+ *
+ * See telemetry format for details on the snapshot layout
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include "Arduino.h"
+
+#include "bluetooth.h"
+#include "telemetry_format.h"
+#include "types.h"
+
+/*!
+ * @brief struct holding the newest snapshot and bookkeeping values
+ *
+ * Only the newest snapshot is kept. If it cannot be sent before the
+ * next fix, as the nRF8001 is out of data credits or the phone is not
+ * connected, the next fix replaces it, so sending never waits.
+ *
+ */
+struct telemetry_t {
+    uint8_t snapshot[TELEMETRY_SIZE]; /*!< Newest snapshot, encoded */
+    uint8_t sequence;                 /*!< Sequence number of the newest snapshot */
+    boolean pending;                  /*!< Flag set while the newest snapshot is unsent */
+    uint16_t sent;                    /*!< Number of snapshots sent */
+    uint16_t coalesced;               /*!< Number of snapshots replaced before they were sent */
+};
+
+/*!
+ * @brief Initializes telemetry for a tracking session
+ *
+ * @param[in,out] telemetry  Pointer to telemetry struct to initialize
+ *
+ * @returns    Nothing.
+ *
+ */
+void telemetry_initialize(telemetry_t *telemetry);
+
+/*!
+ * @brief Takes a snapshot of the tracking data after a fix
+ *
+ * Encodes the tracking data as the newest snapshot, replacing one
+ * which has not been sent yet. The snapshot is sent by telemetry_poll.
+ *
+ * @param[in,out] telemetry  Pointer to telemetry struct
+ * @param[in]     data       Pointer to the tracking data of the fix
+ *
+ * @returns    Nothing.
+ *
+ */
+void telemetry_update(telemetry_t *telemetry, tracking_data_t *data);
+
+/*!
+ * @brief Keeps the link serviced and sends the newest snapshot
+ *
+ * Handles one Bluetooth event, starts advertising again if the phone
+ * has disconnected and sends the newest snapshot if it is unsent and
+ * can go now. Never waits on the nRF8001, so it can be called on
+ * every pass of the tracking loop.
+ *
+ * @param[in,out] telemetry  Pointer to telemetry struct
+ * @param[in,out] bluetooth  Pointer to bluetooth struct, advertising or connected
+ *
+ * @returns    Nothing.
+ *
+ */
+void telemetry_poll(telemetry_t *telemetry, bluetooth_t *bluetooth);
+
+#endif
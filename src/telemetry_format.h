@@ -0,0 +1,58 @@
+/*!
+ * @file
+ *
+ * @brief Layout of the live telemetry sent while tracking
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains only the constants describing a telemetry
+ * snapshot so that it can be shared between the firmware and a
+ * decoder on the phone side.
+ *
+ * A snapshot of the tracking data is sent as one notification on the
+ * UART TX pipe and is laid out as follows:
+ *
+ *   0x00 tag (1 byte, TELEMETRY_TAG)
+ *   0x01 sequence (1 byte, incremented for every fix)
+ *   0x02 flags (1 byte, TELEMETRY_WAYPOINT_DONE)
+ *   0x03 time elapsed (2 bytes, seconds)
+ *   0x05 instant speed (2 bytes)
+ *   0x07 average speed (2 bytes)
+ *   0x09 total distance (4 bytes, metres)
+ *   0x0D waypoint distance (4 bytes, metres)
+ *   0x11 heading (2 bytes)
+ *
+ * Only the newest snapshot is sent, so a gap in the sequence numbers
+ * means the fixes in between were not sent.
+ *
+ * Multi-byte values are little endian and unsigned. Speeds are in
+ * units of 1/TELEMETRY_SPEED_SCALE mph and the heading in units of
+ * 1/TELEMETRY_HEADING_SCALE degrees clockwise from north.
+ *
+ */
+
+#ifndef TELEMETRY_FORMAT_H
+#define TELEMETRY_FORMAT_H
+
+#define TELEMETRY_TAG 0x01                 /*!< First byte of a snapshot, not printable text */
+#define TELEMETRY_SIZE 19                  /*!< Size of a snapshot, within one notification */
+
+#define TELEMETRY_TAG_OFFSET 0             /*!< Offset of the tag byte */
+#define TELEMETRY_SEQUENCE_OFFSET 1        /*!< Offset of the sequence byte */
+#define TELEMETRY_FLAGS_OFFSET 2           /*!< Offset of the flags byte */
+#define TELEMETRY_TIME_OFFSET 3            /*!< Offset of the time elapsed */
+#define TELEMETRY_SPEED_OFFSET 5           /*!< Offset of the instant speed */
+#define TELEMETRY_AVERAGE_OFFSET 7         /*!< Offset of the average speed */
+#define TELEMETRY_DISTANCE_OFFSET 9        /*!< Offset of the total distance */
+#define TELEMETRY_WAYPOINT_OFFSET 13       /*!< Offset of the waypoint distance */
+#define TELEMETRY_HEADING_OFFSET 17        /*!< Offset of the heading */
+
+#define TELEMETRY_WAYPOINT_DONE 0x01       /*!< Flag set once the waypoint path is complete */
+
+#define TELEMETRY_SPEED_SCALE 100          /*!< Fixed point units per mph */
+#define TELEMETRY_HEADING_SCALE 100        /*!< Fixed point units per degree */
+
+#endif
@@ -0,0 +1,70 @@
+/*!
+ * @file
+ *
+ * @brief Layout of the recorded track log in EEPROM
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains only the constants describing the track log
+ * layout so that it can be shared between the firmware and the
+ * host side decoder.
+ *
+ * The track log is a ring of fixed size pages stored in EEPROM
+ * after the waypoint path:
+ *
+ *   0x1A0 page 0 (64 bytes)
+ *   0x1E0 page 1 (64 bytes)
+ *   ...
+ *   0x360 page 7 (64 bytes)
+ *
+ * Each page is decodable on its own and is laid out as follows:
+ *
+ *   0x00 sequence (1 byte, 0xFF if the page has never been written)
+ *   0x01 session (1 byte, incremented each time tracking is entered)
+ *   0x02 length (1 byte, number of valid bytes in the page, stored
+ *        once the page is closed and 0 until then)
+ *   0x03 records...
+ *
+ * A record is either a keyframe or a delta. Every page starts
+ * with a keyframe.
+ *
+ *   keyframe: 0x00, time (4 bytes), latitude (4 bytes),
+ *             longitude (4 bytes), speed (1 byte)
+ *   delta:    dt (1 byte, 1..255), latitude delta (varint),
+ *             longitude delta (varint), speed (1 byte)
+ *
+ * Times are GPS (UTC) times in seconds since 1 January 2000, the
+ * Unix time TRACK_EPOCH.
+ *
+ * Multi-byte values are little endian. Latitude and longitude are
+ * in units of TRACK_DEGREE_SCALE, speed in units of 1/TRACK_SPEED_SCALE
+ * mph, and deltas are zigzag encoded base 128 varints.
+ *
+ */
+
+#ifndef TRACK_FORMAT_H
+#define TRACK_FORMAT_H
+
+#define TRACK_BASE_ADDRESS 0x1A0  /*!< EEPROM address of the first page */
+#define TRACK_PAGE_SIZE 64        /*!< Size of a page in bytes */
+#define TRACK_PAGE_COUNT 8        /*!< Number of pages in the ring */
+
+#define TRACK_SEQUENCE_OFFSET 0   /*!< Offset of the sequence byte in a page */
+#define TRACK_SESSION_OFFSET 1    /*!< Offset of the session byte in a page */
+#define TRACK_LENGTH_OFFSET 2     /*!< Offset of the length byte in a page */
+#define TRACK_HEADER_SIZE 3       /*!< Size of the page header */
+
+#define TRACK_ERASED 0xFF         /*!< Sequence byte of an unwritten page */
+#define TRACK_KEYFRAME 0x00       /*!< Tag byte starting a keyframe record */
+#define TRACK_KEYFRAME_SIZE 14    /*!< Size of a keyframe record */
+#define TRACK_DELTA_MAX_SIZE 12   /*!< Largest possible delta record */
+
+#define TRACK_DEGREE_SCALE 100000 /*!< Fixed point units per degree */
+#define TRACK_SPEED_SCALE 2       /*!< Fixed point units per mph */
+
+#define TRACK_EPOCH 946684800UL   /*!< Unix time of 1 January 2000 */
+
+#endif
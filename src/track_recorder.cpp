@@ -0,0 +1,357 @@
+/*!
+ * @file
+ *
+ * @brief Interface for recording tracks to EEPROM
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains the function definitions used to record
+ * tracks to EEPROM.
+ *
+ * See track format for details on the track log layout in memory
+ */
+
+#include <stdint.h>
+#include <math.h>
+#include <avr/eeprom.h>
+#include "Arduino.h"
+
+#include "track_recorder.h"
+
+/*!
+ * @brief Returns the EEPROM address of a page in the ring
+ *
+ * @param[in]  slot  Index of the page in the ring
+ *
+ * @returns    Pointer to the first byte of the page in EEPROM
+ *
+ */
+static uint8_t *page_address(uint8_t slot)
+{
+    return (uint8_t*)(uintptr_t)(TRACK_BASE_ADDRESS + slot*TRACK_PAGE_SIZE);
+}
+
+/*!
+ * @brief Returns the sequence number following another
+ *
+ * Sequence numbers wrap around before reaching TRACK_ERASED, so that
+ * a written page can always be told apart from an erased one.
+ *
+ * @param[in]  sequence  A sequence number
+ *
+ * @returns    The next sequence number
+ *
+ */
+static uint8_t next_sequence(uint8_t sequence)
+{
+    return sequence + 1 == TRACK_ERASED ? 0 : sequence + 1;
+}
+
+/*!
+ * @brief Converts degrees to fixed point
+ *
+ * @param[in]  degrees  A latitude or longitude in degrees
+ *
+ * @returns    The value in units of TRACK_DEGREE_SCALE
+ *
+ */
+static int32_t degrees_to_fixed(float degrees)
+{
+    return lround(degrees*TRACK_DEGREE_SCALE);
+}
+
+/*!
+ * @brief Converts a speed to fixed point
+ *
+ * @param[in]  speed  A speed in mph
+ *
+ * @returns    The speed in units of 1/TRACK_SPEED_SCALE mph, clamped to a byte
+ *
+ */
+static uint8_t speed_to_fixed(float speed)
+{
+    long fixed = lround(speed*TRACK_SPEED_SCALE);
+    if (fixed < 0) return 0;
+    if (fixed > 255) return 255;
+    return fixed;
+}
+
+/*!
+ * @brief Encodes a 32 bit value little endian
+ *
+ * @param[out] buffer  Buffer to encode into
+ * @param[in]  value   Value to encode
+ *
+ * @returns    Number of bytes written (always 4)
+ *
+ */
+static uint8_t put_u32(uint8_t *buffer, uint32_t value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+    buffer[2] = value >> 16;
+    buffer[3] = value >> 24;
+    return 4;
+}
+
+/*!
+ * @brief Encodes a signed value as a zigzag varint
+ *
+ * Zigzag encoding maps small negative and positive values to small
+ * unsigned values, which are then written 7 bits per byte with the
+ * high bit set on all but the last byte.
+ *
+ * @param[out] buffer  Buffer to encode into
+ * @param[in]  value   Value to encode
+ *
+ * @returns    Number of bytes written (1 to 5)
+ *
+ */
+static uint8_t put_varint(uint8_t *buffer, int32_t value)
+{
+    uint32_t zigzag = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+    uint8_t i = 0;
+    while (zigzag >= 0x80) {
+        buffer[i++] = (zigzag & 0x7F) | 0x80;
+        zigzag >>= 7;
+    }
+    buffer[i++] = zigzag;
+    return i;
+}
+
+/*!
+ * @brief Copies pending bytes of a page to EEPROM
+ *
+ * The length in the page header is written once, after every other
+ * byte of a closed page, so the header never claims bytes that are not
+ * yet in EEPROM and is not worn faster than the rest of the page.
+ * Until then it reads 0. Nothing is written for a page with no records.
+ *
+ * @param[in,out] page   Pointer to page struct
+ * @param[in]     block  Wait for the EEPROM instead of returning when busy
+ *
+ * @returns    True once the page is fully written, false otherwise
+ *
+ */
+static boolean drain_page(track_page_t *page, boolean block)
+{
+    uint8_t *base = page_address(page->slot);
+
+    /* leave the page untouched until something is recorded in it */
+    if (page->length == TRACK_HEADER_SIZE) return true;
+
+    while (page->written < page->length) {
+        if (!block && !eeprom_is_ready()) return false;
+        eeprom_write_byte(base + page->written, page->data[page->written]);
+        page->written++;
+    }
+
+    if (page->closed && !page->committed) {
+        if (!block && !eeprom_is_ready()) return false;
+        eeprom_write_byte(base + TRACK_LENGTH_OFFSET, page->length);
+        page->committed = true;
+    }
+
+    return true;
+}
+
+/*!
+ * @brief Copies pending bytes to EEPROM, the page before first
+ *
+ * @param[in,out] recorder  Pointer to recorder struct
+ * @param[in]     block     Wait for the EEPROM instead of returning when busy
+ *
+ * @returns    Nothing.
+ *
+ */
+static void drain(track_recorder_t *recorder, boolean block)
+{
+    if (drain_page(&recorder->pages[!recorder->current], block)) {
+        drain_page(&recorder->pages[recorder->current], block);
+    }
+}
+
+/*!
+ * @brief Starts a new page in RAM
+ *
+ * The length byte is left zero; the real length is only written to
+ * EEPROM once the page is closed and the bytes it covers are written.
+ *
+ * @param[in,out] recorder  Pointer to recorder struct
+ * @param[in]     slot      Index of the page in the ring
+ *
+ * @returns    Nothing.
+ *
+ */
+static void start_page(track_recorder_t *recorder, uint8_t slot)
+{
+    track_page_t *page = &recorder->pages[recorder->current];
+    page->data[TRACK_SEQUENCE_OFFSET] = recorder->sequence;
+    page->data[TRACK_SESSION_OFFSET] = recorder->session;
+    page->data[TRACK_LENGTH_OFFSET] = 0;
+    page->length = TRACK_HEADER_SIZE;
+    page->written = 0;
+    page->slot = slot;
+    page->closed = false;
+    page->committed = false;
+}
+
+/*!
+ * @brief Closes the current page and moves to the next page in the ring
+ *
+ * The closed page is left for track_recorder_poll to finish. Only if
+ * the page before it is still not written, a whole page of records
+ * later, is it finished here first.
+ *
+ * @param[in,out] recorder  Pointer to recorder struct
+ *
+ * @returns    Nothing.
+ *
+ */
+static void next_page(track_recorder_t *recorder)
+{
+    track_page_t *page = &recorder->pages[recorder->current];
+    drain_page(&recorder->pages[!recorder->current], true);
+
+    page->closed = true;
+    recorder->current = !recorder->current;
+    recorder->sequence = next_sequence(recorder->sequence);
+    start_page(recorder, (page->slot + 1) % TRACK_PAGE_COUNT);
+}
+
+/*!
+ * @brief Initializes recording of a new track session
+ *
+ * Scans the page headers in EEPROM to find the most recently written
+ * page, then positions the recorder on the page following it with a
+ * new session number.
+ *
+ * @param[in,out] recorder  Pointer to recorder struct to initialize
+ *
+ * @returns    Nothing.
+ *
+ */
+void track_recorder_initialize(track_recorder_t *recorder)
+{
+    uint8_t slot = 0;
+    recorder->sequence = 0;
+    recorder->session = 0;
+
+    /* the newest page is the written page not followed by its successor */
+    for (uint8_t i = 0; i < TRACK_PAGE_COUNT; i++) {
+        uint8_t sequence = eeprom_read_byte(page_address(i) + TRACK_SEQUENCE_OFFSET);
+        uint8_t following = eeprom_read_byte(
+            page_address((i + 1) % TRACK_PAGE_COUNT) + TRACK_SEQUENCE_OFFSET);
+        if (sequence != TRACK_ERASED && following != next_sequence(sequence)) {
+            uint8_t session = eeprom_read_byte(page_address(i) + TRACK_SESSION_OFFSET);
+            slot = (i + 1) % TRACK_PAGE_COUNT;
+            recorder->sequence = next_sequence(sequence);
+            recorder->session = session + 1;
+            break;
+        }
+    }
+
+    /* there is no page before the first */
+    recorder->current = 0;
+    recorder->pages[1].length = TRACK_HEADER_SIZE;
+    start_page(recorder, slot);
+}
+
+/*!
+ * @brief Appends a point to the track
+ *
+ * Encodes the point as a delta against the previously recorded point
+ * (or as a keyframe at the start of a page) and appends it to the page
+ * buffered in RAM. The oldest page in the ring is overwritten when the
+ * ring is full.
+ *
+ * @param[in,out] recorder  Pointer to recorder struct
+ * @param[in]     time      Timestamp of the point, in seconds
+ * @param[in]     data      Pointer to gps data to record
+ *
+ * @returns    Nothing.
+ *
+ */
+void track_recorder_append(track_recorder_t *recorder, uint32_t time,
+                           gps_data_t *data)
+{
+    track_page_t *page = &recorder->pages[recorder->current];
+    uint8_t record[TRACK_KEYFRAME_SIZE];
+    uint8_t size = 0;
+
+    int32_t latitude = degrees_to_fixed(data->location.latitude);
+    int32_t longitude = degrees_to_fixed(data->location.longitude);
+    uint32_t dt = time - recorder->last_time;
+
+    /* delta encode unless this is the first record of the page
+       or the time step does not fit in a byte */
+    if (page->length > TRACK_HEADER_SIZE && dt > 0 && dt < 256) {
+        record[size++] = dt;
+        size += put_varint(record + size, latitude - recorder->last_latitude);
+        size += put_varint(record + size, longitude - recorder->last_longitude);
+        record[size++] = speed_to_fixed(data->speed);
+
+        /* no room left, start the next page with a keyframe instead */
+        if (page->length + size > TRACK_PAGE_SIZE) {
+            next_page(recorder);
+            page = &recorder->pages[recorder->current];
+            size = 0;
+        }
+    }
+
+    if (size == 0) {
+        if (page->length + TRACK_KEYFRAME_SIZE > TRACK_PAGE_SIZE) {
+            next_page(recorder);
+            page = &recorder->pages[recorder->current];
+        }
+        record[size++] = TRACK_KEYFRAME;
+        size += put_u32(record + size, time);
+        size += put_u32(record + size, latitude);
+        size += put_u32(record + size, longitude);
+        record[size++] = speed_to_fixed(data->speed);
+    }
+
+    memcpy(page->data + page->length, record, size);
+    page->length += size;
+
+    recorder->last_time = time;
+    recorder->last_latitude = latitude;
+    recorder->last_longitude = longitude;
+}
+
+/*!
+ * @brief Copies pending bytes to EEPROM without blocking
+ *
+ * Should be called regularly from the tracking loop. Writes pending
+ * bytes of the page before, then of the current page, for as long as
+ * the EEPROM is ready to accept them.
+ *
+ * @param[in,out] recorder  Pointer to recorder struct
+ *
+ * @returns    Nothing.
+ *
+ */
+void track_recorder_poll(track_recorder_t *recorder)
+{
+    drain(recorder, false);
+}
+
+/*!
+ * @brief Finishes the track session
+ *
+ * Closes the current page and copies all pending bytes to EEPROM,
+ * blocking until done.
+ *
+ * @param[in,out] recorder  Pointer to recorder struct
+ *
+ * @returns    Nothing.
+ *
+ */
+void track_recorder_finish(track_recorder_t *recorder)
+{
+    recorder->pages[recorder->current].closed = true;
+    drain(recorder, true);
+}
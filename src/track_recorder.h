@@ -0,0 +1,123 @@
+/*!
+ * @file
+ *
+ * @brief Header file for recording tracks to EEPROM
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains the data structures and function prototypes
+ * used to record the points received in tracking mode to
+ * non-volatile storage.
+ *
+ * See track format for details on the track log layout in memory
+ */
+
+#ifndef TRACK_RECORDER_H
+#define TRACK_RECORDER_H
+
+#include <stdint.h>
+#include "Arduino.h"
+
+#include "gps.h"
+#include "track_format.h"
+
+/*!
+ * @brief struct holding a page buffered in RAM and its copy progress
+ *
+ * The length in the page header is stored in EEPROM once, after the
+ * rest of the page, when the page is closed.
+ *
+ */
+struct track_page_t {
+    uint8_t data[TRACK_PAGE_SIZE]; /*!< RAM copy of the page */
+    uint8_t length;                /*!< Number of bytes used in the page */
+    uint8_t written;               /*!< Number of bytes copied to EEPROM */
+    uint8_t slot;                  /*!< Index of the page in the ring */
+    boolean closed;                /*!< Flag set once no more records go in the page */
+    boolean committed;             /*!< Flag set once the length is stored in EEPROM */
+};
+
+/*!
+ * @brief struct holding the pages being recorded and bookkeeping values
+ *
+ * Records are appended to a page buffered in RAM. The page is copied
+ * to EEPROM a byte at a time whenever the EEPROM is ready, so a fix
+ * never waits on a full page write. A full page is handed over to be
+ * finished in the background while the next one fills, so moving to
+ * the next page does not wait either. The last recorded point is kept
+ * so that following points can be delta encoded against it.
+ *
+ */
+struct track_recorder_t {
+    track_page_t pages[2];         /*!< Page being recorded and the page before */
+    uint8_t current;               /*!< Index in pages of the page being recorded */
+    uint8_t sequence;              /*!< Sequence number of the page being recorded */
+    uint8_t session;               /*!< Session number of this recording */
+    uint32_t last_time;            /*!< Time of the last recorded point */
+    int32_t last_latitude;         /*!< Latitude of the last recorded point */
+    int32_t last_longitude;        /*!< Longitude of the last recorded point */
+};
+
+/*!
+ * @brief Initializes recording of a new track session
+ *
+ * Scans the page headers in EEPROM to find the most recently written
+ * page, then positions the recorder on the page following it with a
+ * new session number.
+ *
+ * @param[in,out] recorder  Pointer to recorder struct to initialize
+ *
+ * @returns    Nothing.
+ *
+ */
+void track_recorder_initialize(track_recorder_t *recorder);
+
+/*!
+ * @brief Appends a point to the track
+ *
+ * Encodes the point as a delta against the previously recorded point
+ * (or as a keyframe at the start of a page) and appends it to the page
+ * buffered in RAM. The oldest page in the ring is overwritten when the
+ * ring is full.
+ *
+ * @param[in,out] recorder  Pointer to recorder struct
+ * @param[in]     time      Timestamp of the point, in seconds
+ * @param[in]     data      Pointer to gps data to record
+ *
+ * @returns    Nothing.
+ *
+ */
+void track_recorder_append(track_recorder_t *recorder, uint32_t time,
+                           gps_data_t *data);
+
+/*!
+ * @brief Copies pending bytes to EEPROM without blocking
+ *
+ * Should be called regularly from the tracking loop. Writes pending
+ * bytes of the page before, then of the current page, for as long as
+ * the EEPROM is ready to accept them.
+ *
+ * @param[in,out] recorder  Pointer to recorder struct
+ *
+ * @returns    Nothing.
+ *
+ */
+void track_recorder_poll(track_recorder_t *recorder);
+
+/*!
+ * @brief Finishes the track session
+ *
+ * Closes the current page and copies all pending bytes to EEPROM,
+ * blocking until done.
+ *
+ * @param[in,out] recorder  Pointer to recorder struct
+ *
+ * @returns    Nothing.
+ *
+ */
+void track_recorder_finish(track_recorder_t *recorder);
+
+#endif
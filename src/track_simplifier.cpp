@@ -0,0 +1,252 @@
+/*!
+ * @file
+ *
+ * @brief Interface for simplifying tracks as they are recorded
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains the function definitions used to drop points
+ * which add nothing to the shape of a track before they are recorded.
+ *
+ * See the header for a description of the algorithm
+ */
+
+#include <math.h>
+#include "Arduino.h"
+
+#include "track_simplifier.h"
+
+#define METRES_PER_DEGREE 111194.9  /*!< Length of a degree of latitude, in metres */
+
+/*!
+ * @brief Wraps an angle into the range -pi to pi
+ *
+ * @param[in]  angle  An angle in radians
+ *
+ * @returns    The same angle in the range -pi to pi
+ *
+ */
+static float wrap_angle(float angle)
+{
+    while (angle > M_PI) angle -= 2*M_PI;
+    while (angle < -M_PI) angle += 2*M_PI;
+    return angle;
+}
+
+/*!
+ * @brief Makes a point the new anchor
+ *
+ * @param[in,out] simplifier  Pointer to simplifier struct
+ * @param[in]     time        Timestamp of the point, in seconds
+ * @param[in]     point       The point to use as anchor
+ *
+ * @returns    Nothing.
+ *
+ */
+static void set_anchor(track_simplifier_t *simplifier, uint32_t time, point_t point)
+{
+    simplifier->anchor = point;
+    simplifier->anchor_scale = METRES_PER_DEGREE*cos(point.latitude*M_PI/180.0);
+    simplifier->anchor_time = time;
+    simplifier->has_anchor = true;
+    simplifier->constrained = false;
+    simplifier->has_pending = false;
+    simplifier->farthest = 0;
+}
+
+/*!
+ * @brief Projects a point onto a flat plane around the anchor
+ *
+ * @param[in]  simplifier  Pointer to simplifier struct
+ * @param[in]  point       The point to project
+ * @param[out] east        Distance east of the anchor, in metres
+ * @param[out] north       Distance north of the anchor, in metres
+ *
+ * @returns    Nothing.
+ *
+ */
+static void project(track_simplifier_t *simplifier, point_t point,
+                    float *east, float *north)
+{
+    *east = (point.longitude - simplifier->anchor.longitude)*simplifier->anchor_scale;
+    *north = (point.latitude - simplifier->anchor.latitude)*METRES_PER_DEGREE;
+}
+
+/*!
+ * @brief Checks if a line from the anchor to a point passes all skipped points
+ *
+ * @param[in]  simplifier  Pointer to simplifier struct
+ * @param[in]  east        Distance east of the anchor, in metres
+ * @param[in]  north       Distance north of the anchor, in metres
+ *
+ * @returns    True if every skipped point is within tolerance of the segment
+ *             from the anchor to the point
+ *
+ */
+static boolean inside(track_simplifier_t *simplifier, float east, float north)
+{
+    /* no skipped point has left the tolerance circle of the anchor yet */
+    if (!simplifier->constrained) {
+        return true;
+    }
+
+    /* back near the anchor after moving away, the direction means nothing */
+    float distance = sqrt(east*east + north*north);
+    if (distance <= simplifier->tolerance) {
+        return false;
+    }
+
+    /* a point falling short of a skipped point leaves it past the
+       end of the segment, however close it is to the line; letting
+       it fall a tolerance short would allow 1.4 tolerances off */
+    if (distance < simplifier->farthest) {
+        return false;
+    }
+
+    float angle = wrap_angle(atan2(north, east) - simplifier->center);
+    return angle >= simplifier->low && angle <= simplifier->high;
+}
+
+/*!
+ * @brief Narrows the sector so a line from the anchor passes near a point
+ *
+ * @param[in,out] simplifier  Pointer to simplifier struct
+ * @param[in]     east        Distance east of the anchor, in metres
+ * @param[in]     north       Distance north of the anchor, in metres
+ *
+ * @returns    Nothing.
+ *
+ */
+static void narrow(track_simplifier_t *simplifier, float east, float north)
+{
+    float distance = sqrt(east*east + north*north);
+    simplifier->farthest = max(simplifier->farthest, distance);
+
+    /* any direction passes within tolerance of a point this close */
+    if (distance <= simplifier->tolerance) {
+        return;
+    }
+
+    float angle = atan2(north, east);
+    float spread = asin(simplifier->tolerance/distance);
+
+    if (!simplifier->constrained) {
+        simplifier->center = angle;
+        simplifier->low = -spread;
+        simplifier->high = spread;
+        simplifier->constrained = true;
+    } else {
+        angle = wrap_angle(angle - simplifier->center);
+        simplifier->low = max(simplifier->low, angle - spread);
+        simplifier->high = min(simplifier->high, angle + spread);
+    }
+}
+
+/*!
+ * @brief Initializes the track simplifier
+ *
+ * @param[in,out] simplifier  Pointer to simplifier struct to initialize
+ * @param[in]     tolerance   Largest allowed deviation of a skipped point, in metres
+ *
+ * @returns    Nothing.
+ *
+ */
+void track_simplifier_initialize(track_simplifier_t *simplifier, float tolerance)
+{
+    simplifier->tolerance = tolerance;
+    simplifier->has_anchor = false;
+    simplifier->constrained = false;
+    simplifier->has_pending = false;
+    simplifier->farthest = 0;
+}
+
+/*!
+ * @brief Adds a point to the track
+ *
+ * Adds a point and decides whether a point should be kept. The point
+ * kept is not necessarily the one just added: a point is only known
+ * to be needed once the following point deviates from the sector.
+ *
+ * Points are timestamped to the second, so with more than one fix a
+ * second only the first of each second is added; the others are
+ * dropped. Kept points are then always at least a second apart.
+ *
+ * @param[in,out] simplifier  Pointer to simplifier struct
+ * @param[in]     time        Timestamp of the point, in seconds
+ * @param[in]     data        Pointer to gps data of the point
+ * @param[out]    kept_time   Timestamp of the kept point
+ * @param[out]    kept        Pointer to gps data of the kept point
+ *
+ * @returns    True if a point was kept, false otherwise
+ *
+ */
+boolean track_simplifier_add(track_simplifier_t *simplifier, uint32_t time,
+                             gps_data_t *data, uint32_t *kept_time,
+                             gps_data_t *kept)
+{
+    float east, north;
+    boolean keep = false;
+
+    /* the first point is always kept */
+    if (!simplifier->has_anchor) {
+        set_anchor(simplifier, time, data->location);
+        *kept_time = time;
+        *kept = *data;
+        return true;
+    }
+
+    /* the first fix of a second is closest to its timestamp */
+    if (time == (simplifier->has_pending ? simplifier->pending_time : simplifier->anchor_time)) {
+        return false;
+    }
+
+    project(simplifier, data->location, &east, &north);
+
+    /* keep the pending point if the new point can't be reached in a
+       straight line from the anchor, or the anchor is getting old */
+    if (simplifier->has_pending
+        && (!inside(simplifier, east, north)
+            || time - simplifier->anchor_time > TRACK_SIMPLIFIER_MAX_GAP)) {
+        *kept_time = simplifier->pending_time;
+        *kept = simplifier->pending;
+        set_anchor(simplifier, simplifier->pending_time, simplifier->pending.location);
+        project(simplifier, data->location, &east, &north);
+        keep = true;
+    }
+
+    narrow(simplifier, east, north);
+    simplifier->pending_time = time;
+    simplifier->pending = *data;
+    simplifier->has_pending = true;
+
+    return keep;
+}
+
+/*!
+ * @brief Finishes the track
+ *
+ * The last point of a track is always kept. This returns it if it has
+ * not been kept already.
+ *
+ * @param[in,out] simplifier  Pointer to simplifier struct
+ * @param[out]    kept_time   Timestamp of the kept point
+ * @param[out]    kept        Pointer to gps data of the kept point
+ *
+ * @returns    True if a point was kept, false otherwise
+ *
+ */
+boolean track_simplifier_finish(track_simplifier_t *simplifier,
+                                uint32_t *kept_time, gps_data_t *kept)
+{
+    if (!simplifier->has_pending) {
+        return false;
+    }
+
+    *kept_time = simplifier->pending_time;
+    *kept = simplifier->pending;
+    simplifier->has_pending = false;
+    return true;
+}
@@ -0,0 +1,113 @@
+/*!
+ * @file
+ *
+ * @brief Header file for simplifying tracks as they are recorded
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains the data structures and function prototypes
+ * used to drop points which add nothing to the shape of a track
+ * before they are recorded.
+ *
+ * Points are simplified with the sleeve (sector) algorithm: the
+ * directions from the last kept point (the anchor) that pass within
+ * the tolerance of every skipped point form a sector which narrows
+ * with each new point. A point is kept as soon as the next point
+ * falls outside the sector, or falls short of the farthest skipped
+ * point, which would leave that point beyond the end of the segment.
+ * Only the anchor, the sector, that farthest distance and a
+ * single pending point are stored, so memory use does not depend on
+ * the number of points skipped.
+ *
+ */
+
+#ifndef TRACK_SIMPLIFIER_H
+#define TRACK_SIMPLIFIER_H
+
+#include <stdint.h>
+#include "Arduino.h"
+
+#include "gps.h"
+#include "types.h"
+
+#define TRACK_SIMPLIFIER_MAX_GAP 120 /*!< Longest time between kept points, in seconds */
+
+/*!
+ * @brief struct holding the state of the track simplifier
+ *
+ * The sector of acceptable directions is stored as an offset either
+ * side of a center direction, with angles in radians measured from
+ * east in a local flat projection around the anchor.
+ *
+ */
+struct track_simplifier_t {
+    float tolerance;           /*!< Largest allowed deviation of a skipped point, in metres */
+    point_t anchor;            /*!< The last kept point */
+    float anchor_scale;        /*!< Metres per degree of longitude at the anchor */
+    uint32_t anchor_time;      /*!< Time of the last kept point */
+    float center;              /*!< Direction of the middle of the sector */
+    float low;                 /*!< Lower edge of the sector, relative to center */
+    float high;                /*!< Upper edge of the sector, relative to center */
+    float farthest;            /*!< Largest distance of a skipped point from the anchor, in metres */
+    boolean has_anchor;        /*!< Flag indicating a point has been kept */
+    boolean constrained;       /*!< Flag indicating the sector has been narrowed */
+    boolean has_pending;       /*!< Flag indicating a point is waiting to be kept or dropped */
+    uint32_t pending_time;     /*!< Time of the pending point */
+    gps_data_t pending;        /*!< The most recent point, not yet kept */
+};
+
+/*!
+ * @brief Initializes the track simplifier
+ *
+ * @param[in,out] simplifier  Pointer to simplifier struct to initialize
+ * @param[in]     tolerance   Largest allowed deviation of a skipped point, in metres
+ *
+ * @returns    Nothing.
+ *
+ */
+void track_simplifier_initialize(track_simplifier_t *simplifier, float tolerance);
+
+/*!
+ * @brief Adds a point to the track
+ *
+ * Adds a point and decides whether a point should be kept. The point
+ * kept is not necessarily the one just added: a point is only known
+ * to be needed once the following point deviates from the sector.
+ *
+ * Points are timestamped to the second, so with more than one fix a
+ * second only the first of each second is added; the others are
+ * dropped. Kept points are then always at least a second apart.
+ *
+ * @param[in,out] simplifier  Pointer to simplifier struct
+ * @param[in]     time        Timestamp of the point, in seconds
+ * @param[in]     data        Pointer to gps data of the point
+ * @param[out]    kept_time   Timestamp of the kept point
+ * @param[out]    kept        Pointer to gps data of the kept point
+ *
+ * @returns    True if a point was kept, false otherwise
+ *
+ */
+boolean track_simplifier_add(track_simplifier_t *simplifier, uint32_t time,
+                             gps_data_t *data, uint32_t *kept_time,
+                             gps_data_t *kept);
+
+/*!
+ * @brief Finishes the track
+ *
+ * The last point of a track is always kept. This returns it if it has
+ * not been kept already.
+ *
+ * @param[in,out] simplifier  Pointer to simplifier struct
+ * @param[out]    kept_time   Timestamp of the kept point
+ * @param[out]    kept        Pointer to gps data of the kept point
+ *
+ * @returns    True if a point was kept, false otherwise
+ *
+ */
+boolean track_simplifier_finish(track_simplifier_t *simplifier,
+                                uint32_t *kept_time, gps_data_t *kept);
+
+#endif
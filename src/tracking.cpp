@@ -0,0 +1,238 @@
+/*!
+ * @file
+ *
+ * @brief Interface for tracking mode book-keeping
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains the routines which turn gps packets into the
+ * tracking data displayed in tracking mode.
+ *
+ */
+
+#include "Arduino.h"
+
+#include "haversine.h"
+#include "tracking.h"
+
+#define MPH_TO_METRES_PER_SECOND 0.44704
+
+/*!
+ * @brief Initializes a tracking session
+ *
+ * Clears the tracking data and record and loads the first waypoint
+ * of the stored waypoint path.
+ *
+ * @param[in,out] tracking  Pointer to tracking struct to initialize
+ *
+ * @returns    Nothing.
+ *
+ */
+void tracking_initialize(tracking_t *tracking)
+{
+    waypoint_reader_initialize(&tracking->waypoint_reader);
+    point_t initial_waypoint = waypoint_reader_get_next(&tracking->waypoint_reader);
+
+    tracking->data = (tracking_data_t){0.0,0,0.0,0.0,0.0,false,0.0};
+
+    tracking->record = (tracking_record_t){.num_points = 0,
+                                           .aggregate_speed = 0.0,
+                                           .start_time = 0,
+                                           .start_milliseconds = 0,
+                                           .elapsed = 0.0,
+                                           .current_speed = 0.0,
+                                           .previous_speed = 0.0,
+                                           .step_time = 0.0,
+                                           .current_waypoint = initial_waypoint,
+                                           .current_tracking_point = {0.0, 0.0},
+                                           .previous_tracking_point = {0.0, 0.0}};
+
+    fix_filter_initialize(&tracking->filter);
+    kalman_filter_initialize(&tracking->kalman);
+
+    /* Started will be set to true after the first accepted gps packet.
+       This indicates that tracking has begun.*/
+    tracking->started = false;
+}
+
+/*!
+ * @brief Updates tracking with a received gps packet
+ *
+ * Validates the packet and, if valid, parses it, passes it through
+ * the fix filter, smooths it with the Kalman filter and updates the
+ * tracking record, tracking data and waypoint information.
+ *
+ * @param[in,out] tracking  Pointer to tracking struct
+ * @param[in]     gps       Pointer to gps struct with received datastring
+ *
+ * @returns    True if the packet was accepted and tracking was updated
+ *
+ */
+boolean tracking_update(tracking_t *tracking, gps_t *gps)
+{
+    /* ignore invalid packets */
+    if (!gps_valid(gps)) {
+        return false;
+    }
+
+    gps_parse(gps, &tracking->gps_data);
+
+    /* ignore poor fixes and outliers */
+    fix_filter_result_t result = fix_filter_update(&tracking->filter, &tracking->gps_data);
+    if (result == FIX_REJECTED) {
+        return false;
+    }
+
+    tracking->started = true;
+
+    /* smooth position and speed, starting over at a reset anchor */
+    if (result == FIX_RESET) {
+        kalman_filter_initialize(&tracking->kalman);
+    }
+    kalman_filter_update(&tracking->kalman, &tracking->gps_data);
+    tracking->data.heading = tracking->kalman.heading;
+
+    update_tracking_record(&tracking->record, &tracking->gps_data);
+
+    /* no distance is travelled to a reset anchor */
+    if (result == FIX_RESET) {
+        tracking->record.previous_tracking_point = tracking->record.current_tracking_point;
+        tracking->record.step_time = 0.0;
+    }
+
+    update_tracking_data(&tracking->data, &tracking->gps_data, &tracking->record);
+
+    if (!tracking->data.waypoint_done) {
+        update_waypoint(&tracking->waypoint_reader, &tracking->data, &tracking->record);
+    }
+
+    return true;
+}
+
+/*!
+ * @brief Updates record for average speed/previous point tracking
+ *
+ * Updates the tracking record struct with the previous and current points
+ * and the time since the first point, and integrates speed over the time
+ * since the previous point (used to calculate the average speed). Using
+ * the GPS time keeps the average right when packets are dropped.
+ *
+ * @param[in,out] record  Pointer to tracking record to update
+ * @param[in]     gps     Pointer to gps struct with received datastring
+ *
+ * @returns    Nothing.
+ *
+ */
+void update_tracking_record(tracking_record_t *record, gps_data_t *gps)
+{
+    if (record->num_points == 0) {
+        record->start_time = gps->time;
+        record->start_milliseconds = gps->milliseconds;
+    } else {
+        float elapsed = (int32_t)(gps->time - record->start_time)
+                      + ((int16_t)gps->milliseconds - (int16_t)record->start_milliseconds)/1000.0;
+
+        /* trapezoidal integration, ignoring fixes which go back in time */
+        record->step_time = 0.0;
+        if (elapsed > record->elapsed) {
+            record->step_time = elapsed - record->elapsed;
+            record->aggregate_speed += (record->current_speed + gps->speed)/2
+                                     * record->step_time;
+            record->elapsed = elapsed;
+        }
+    }
+
+    record->previous_tracking_point = record->current_tracking_point;
+    record->current_tracking_point = gps->location;
+    record->previous_speed = record->current_speed;
+    record->current_speed = gps->speed;
+    record->num_points++;
+}
+
+/*!
+ * @brief Updates tracking data for the current gps data set
+ *
+ * Adds the distance from the previous point, and updates the speeds and
+ * the elapsed time since the first fix. Over gaps of more than
+ * TRACKING_GAP_TIME while moving, the distance at the reported speeds
+ * is used if it is longer than the straight line.
+ *
+ * @param[in,out] data    Pointer to data struct for current tracking cycle
+ * @param[in]     gps     Pointer to gps struct with received datastring
+ * @param[in]     record  Pointer to updated record for current gps data set
+ *
+ * @returns    Nothing.
+ *
+ */
+void update_tracking_data(tracking_data_t *data, gps_data_t *gps, tracking_record_t *record)
+{
+    /* only add distance if for points 2..n */
+    if (record->num_points > 1) {
+        float distance = distance_between(record->previous_tracking_point,
+                                          record->current_tracking_point);
+
+        /* across a gap (a sleeping or lost gps) the straight line cuts
+           corners, so while moving use the distance at the reported
+           speeds if it is longer */
+        if (record->step_time > TRACKING_GAP_TIME
+                && record->previous_speed >= FIX_FILTER_STOPPED_SPEED
+                && record->current_speed >= FIX_FILTER_STOPPED_SPEED) {
+            float travelled = (record->previous_speed + record->current_speed)/2
+                            * MPH_TO_METRES_PER_SECOND*record->step_time;
+            distance = max(distance, travelled);
+        }
+
+        data->total_distance += distance;
+    }
+    data->instant_speed = gps->speed;
+    data->time_elapsed = record->elapsed;
+
+    /* average over time once time has passed */
+    if (record->elapsed > 0) {
+        data->average_speed = record->aggregate_speed/record->elapsed;
+    } else {
+        data->average_speed = gps->speed;
+    }
+}
+
+/*!
+ * @brief Updates waypoint information
+ *
+ * Updates tracking_data->waypoint_done, current_waypoint and
+ * tracking_data->waypoint_distance for current set of data read 
+ * from the gps. Tells us the distance from the current waypoint, 
+ * switches to next waypoint if needed, or ends the path if all
+ * waypoints have been passed.
+ *
+ * @param[in]      waypoint_reader   Pointer to waypoint_reader for current tracking session
+ * @param[in,out]  data              Pointer to tracking data struct to update
+ * @param[in,out]  record            Pointer to tracking record struct to update
+ *
+ * @returns    Nothing.
+ *
+ */
+void update_waypoint(waypoint_reader_t *waypoint_reader,
+                     tracking_data_t *tracking_data,
+                     tracking_record_t *tracking_record)
+{
+    point_t waypoint = tracking_record->current_waypoint;
+    point_t tracking_point = tracking_record->current_tracking_point;
+
+    float distance_to_waypoint = distance_between(waypoint, tracking_point);
+
+    while (distance_to_waypoint < WAYPOINT_DISTANCE_THRESHOLD
+           && !tracking_data->waypoint_done) {
+        if (waypoint_reader_end(waypoint_reader)) {
+            tracking_data->waypoint_done = true;
+        } else {
+            waypoint = waypoint_reader_get_next(waypoint_reader);
+            distance_to_waypoint = distance_between(waypoint, tracking_point);
+        }
+    }
+
+    tracking_record->current_waypoint = waypoint;
+    tracking_data->waypoint_distance = distance_to_waypoint;
+}
@@ -0,0 +1,132 @@
+/*!
+ * @file
+ *
+ * @brief Header file for tracking mode book-keeping
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains the data structures and function prototypes
+ * which turn gps packets into the tracking data displayed in
+ * tracking mode. Nothing here touches the LCD or the GPS serial port,
+ * so the same code can be run over recorded logs.
+ *
+ */
+
+#ifndef TRACKING_H
+#define TRACKING_H
+
+#include <stdint.h>
+#include "Arduino.h"
+
+#include "fix_filter.h"
+#include "gps.h"
+#include "kalman_filter.h"
+#include "types.h"
+#include "waypoint_reader.h"
+
+#define WAYPOINT_DISTANCE_THRESHOLD 100 /*!< Distance before changing waypoint to next waypoint */
+#define TRACKING_GAP_TIME 2.0 /*!< Time between points beyond which distance is bridged at the reported speeds, in seconds */
+
+/*!
+ * @brief struct holding all state of a tracking session
+ *
+ * This struct bundles the waypoint reader, the last parsed gps data,
+ * the fix and Kalman filters and the tracking data/record structs for
+ * a tracking session.
+ *
+ */
+struct tracking_t {
+    waypoint_reader_t waypoint_reader; /*!< Reader for the waypoint path */
+    gps_data_t gps_data;               /*!< Most recently parsed gps data */
+    fix_filter_t filter;               /*!< Filter rejecting bad fixes */
+    kalman_filter_t kalman;            /*!< Filter smoothing position and speed */
+    tracking_data_t data;              /*!< Data displayed in tracking mode */
+    tracking_record_t record;          /*!< Book-keeping for tracking data */
+    boolean started;                   /*!< Flag set after the first accepted gps packet */
+};
+
+/*!
+ * @brief Initializes a tracking session
+ *
+ * Clears the tracking data and record and loads the first waypoint
+ * of the stored waypoint path.
+ *
+ * @param[in,out] tracking  Pointer to tracking struct to initialize
+ *
+ * @returns    Nothing.
+ *
+ */
+void tracking_initialize(tracking_t *tracking);
+
+/*!
+ * @brief Updates tracking with a received gps packet
+ *
+ * Validates the packet and, if valid, parses it, passes it through
+ * the fix filter, smooths it with the Kalman filter and updates the
+ * tracking record, tracking data and waypoint information.
+ *
+ * @param[in,out] tracking  Pointer to tracking struct
+ * @param[in]     gps       Pointer to gps struct with received datastring
+ *
+ * @returns    True if the packet was accepted and tracking was updated
+ *
+ */
+boolean tracking_update(tracking_t *tracking, gps_t *gps);
+
+/*!
+ * @brief Updates record for average speed/previous point tracking
+ *
+ * Updates the tracking record struct with the previous and current points
+ * and the time since the first point, and integrates speed over the time
+ * since the previous point (used to calculate the average speed). Using
+ * the GPS time keeps the average right when packets are dropped.
+ *
+ * @param[in,out] record  Pointer to tracking record to update
+ * @param[in]     gps     Pointer to gps struct with received datastring
+ *
+ * @returns    Nothing.
+ *
+ */
+void update_tracking_record(tracking_record_t *record, gps_data_t *gps);
+
+/*!
+ * @brief Updates tracking data for the current gps data set
+ *
+ * Adds the distance from the previous point, and updates the speeds and
+ * the elapsed time since the first fix. Over gaps of more than
+ * TRACKING_GAP_TIME while moving, the distance at the reported speeds
+ * is used if it is longer than the straight line.
+ *
+ * @param[in,out] data    Pointer to data struct for current tracking cycle
+ * @param[in]     gps     Pointer to gps struct with received datastring
+ * @param[in]     record  Pointer to updated record for current gps data set
+ *
+ * @returns    Nothing.
+ *
+ */
+void update_tracking_data(tracking_data_t *data, gps_data_t *gps, tracking_record_t *record);
+
+/*!
+ * @brief Updates waypoint information
+ *
+ * Updates tracking_data->waypoint_done, current_waypoint and
+ * tracking_data->waypoint_distance for current set of data read 
+ * from the gps. Tells us the distance from the current waypoint, 
+ * switches to next waypoint if needed, or ends the path if all
+ * waypoints have been passed.
+ *
+ * @param[in]      waypoint_reader   Pointer to waypoint_reader for current tracking session
+ * @param[in,out]  data              Pointer to tracking data struct to update
+ * @param[in,out]  record            Pointer to tracking record struct to update
+ *
+ * @returns    Nothing.
+ *
+ */
+void update_waypoint(waypoint_reader_t *waypoint_reader,
+                     tracking_data_t *tracking_data,
+                     tracking_record_t *tracking_record);
+
+#endif
@@ -36,14 +36,21 @@ struct point_t {
  *
  * This struct holds various values to help handle book-keeping
  * during tracking mode. This includes number of points since entering
- * tracking mode, the sum (aggregate) of the speed, the current waypoint
- * in the ordered list, and the current and previous points received
- * in tracking mode.
+ * tracking mode, the integral of the speed over time, the time of the
+ * first and current points, the current waypoint in the ordered list,
+ * and the current and previous points and speeds received in tracking
+ * mode.
  *
  */
 struct tracking_record_t {
     int num_points;                  /*!< Number of points accumulated in tracking */
-    float aggregate_speed;           /*!< Sum of speeds since entering tracking mode */
+    float aggregate_speed;           /*!< Integral of speed over time since entering tracking mode, in mph*s */
+    uint32_t start_time;             /*!< GPS time of the first point, in seconds */
+    uint16_t start_milliseconds;     /*!< Milliseconds past start_time */
+    float elapsed;                   /*!< Time of the current point since the first, in seconds */
+    float current_speed;             /*!< Speed at the current point, in mph */
+    float previous_speed;            /*!< Speed at the previous point, in mph */
+    float step_time;                 /*!< Time from the previous point to the current, in seconds */
     point_t current_waypoint;        /*!< The current waypoint in the ordered list */
     point_t current_tracking_point;  /*!< The most recently received point in tracking */
     point_t previous_tracking_point; /*!< The previous point received in tracking mode */
@@ -64,6 +71,7 @@ struct tracking_data_t {
     float total_distance;      /*!< Total distance traveled since entering tracking mode, in meters */
     float waypoint_distance;   /*!< Distance to closest, non-passed waypoint in meters */
     boolean waypoint_done;     /*!< Flag to indicate waypoint path is complete */
+    float heading;             /*!< Heading, in degrees clockwise from north */
 };
 
 #endif
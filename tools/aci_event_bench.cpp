@@ -0,0 +1,224 @@
+/*!
+ * @file
+ *
+ * @brief Host benchmark of ACI event handling in bluetooth_poll()
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains a command line tool which runs the firmware's
+ * Bluetooth module and the nRF8001 driver against the mock nRF8001,
+ * which starts up in standby after a pin reset, swallows commands and
+ * sends the events it is given.
+ *
+ * After bluetooth_setup() it sends a stream of UART messages, as the
+ * phone app does when sending waypoints, and times three ways of
+ * taking them from the event queue:
+ *
+ *    transport lib_aci_event_consume() alone, the cost of getting an
+ *              event through the mock and the queue, included in
+ *              the others
+ *    copy      lib_aci_event_get() into a stack hal_aci_evt_t and a
+ *              byte copy into a message buffer, as bluetooth_poll()
+ *              used to
+ *    in place  lib_aci_event_front(), terminating the message in the
+ *              queue, then lib_aci_event_consume()
+ *    poll      bluetooth_poll() and bluetooth_get_message()
+ *
+ * Each path runs in several rounds and its best time is reported.
+ * Every received message is checked.
+ *
+ * Build and run with
+ *    g++ -O2 -D__AVR__ -Ihost -I../libraries/nordic_bluetooth_driver -I../src \
+ *        -include Arduino.h -o aci_event_bench aci_event_bench.cpp host/host.cpp \
+ *        host/nrf8001_mock.cpp ../src/bluetooth.cpp \
+ *        ../libraries/nordic_bluetooth_driver/{aci_queue,aci_setup,acilib,hal_aci_tl,lib_aci,bootloader_setup}.cpp
+ *    ./aci_event_bench [-n events] [-r rounds]
+ *
+ * Adding -fstack-usage shows the frame sizes of the functions involved.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "lib_aci.h"
+#include "services.h"
+#include "bluetooth.h"
+#include "nrf8001_mock.h"
+
+/* pins as wired in bluetooth.cpp */
+#define RDY 7
+#define REQ 9
+#define RST 10
+#define RDY_INTERRUPT_NUMBER 4
+
+#define MESSAGES 256  /*!< Number of distinct messages sent */
+
+static char messages[MESSAGES][PIPE_UART_OVER_BTLE_UART_RX_RX_MAX_SIZE + 1];
+
+/*!
+ * @brief Makes the messages, waypoint lines of various lengths
+ */
+static void make_messages(void)
+{
+    for (int i = 0; i < MESSAGES; i++) {
+        char text[48];
+        snprintf(text, sizeof(text), "%d,45.%04d,-122.%04d", i, i*37 % 10000, i*91 % 10000);
+        text[4 + i % (PIPE_UART_OVER_BTLE_UART_RX_RX_MAX_SIZE - 3)] = '\0';
+        strcpy(messages[i], text);
+    }
+}
+
+/*!
+ * @brief Has the mock send a message over the UART pipe
+ */
+static void send_message(long sequence)
+{
+    const char *message = messages[sequence % MESSAGES];
+    uint8_t event[HAL_ACI_MAX_LENGTH];
+    event[0] = ACI_EVT_DATA_RECEIVED;
+    event[1] = PIPE_UART_OVER_BTLE_UART_RX_RX;
+    uint8_t length = strlen(message);
+    memcpy(&event[2], message, length);
+    nrf8001_mock_send(event, length + 2);
+    nrf8001_mock_service();
+}
+
+/*!
+ * @brief Checks a received message against its sequence number
+ */
+static bool check_message(const char *message, long sequence)
+{
+    return message != NULL && strcmp(message, messages[sequence % MESSAGES]) == 0;
+}
+
+/*!
+ * @brief Takes a message the way bluetooth_poll() used to
+ */
+static bool take_copy(aci_state_t *aci_state, char *buffer)
+{
+    hal_aci_evt_t aci_data;
+    if (!lib_aci_event_get(aci_state, &aci_data)) return false;
+
+    aci_evt_t *aci_evt = &aci_data.evt;
+    for (int i = 0; i < aci_evt->len - 2; i++) {
+        buffer[i] = aci_evt->params.data_received.rx_data.aci_data[i];
+    }
+    buffer[aci_evt->len - 2] = '\0';
+    return true;
+}
+
+/*!
+ * @brief Takes a message in place
+ */
+static bool take_in_place(aci_state_t *aci_state, char **message)
+{
+    hal_aci_evt_t *aci_data = lib_aci_event_front(aci_state);
+    if (aci_data == NULL) return false;
+
+    aci_evt_t *aci_evt = &aci_data->evt;
+    *message = (char*)aci_evt->params.data_received.rx_data.aci_data;
+    (*message)[aci_evt->len - 2] = '\0';
+    return true;
+}
+
+enum path_t {TRANSPORT, COPY, IN_PLACE, POLL, PATHS};
+static const char *path_names[PATHS] = {"transport", "copy", "in_place", "poll"};
+
+/*!
+ * @brief Takes and checks one message by one of the paths
+ *
+ * @returns    true if the expected message was taken
+ */
+static bool take(int path, bluetooth_t *bluetooth, long sequence)
+{
+    char buffer[PIPE_UART_OVER_BTLE_UART_RX_RX_MAX_SIZE + 1];
+    char *message = NULL;
+    bool good;
+
+    switch (path) {
+    case TRANSPORT:
+        return lib_aci_event_consume();
+    case COPY:
+        return take_copy(&bluetooth->aci_state, buffer) && check_message(buffer, sequence);
+    case IN_PLACE:
+        good = take_in_place(&bluetooth->aci_state, &message) && check_message(message, sequence);
+        lib_aci_event_consume();
+        return good;
+    default:
+        bluetooth_poll(bluetooth);
+        return bluetooth_has_message(bluetooth)
+            && check_message(bluetooth_get_message(bluetooth), sequence);
+    }
+}
+
+/*!
+ * @brief Returns the time since an earlier timespec, in ns
+ */
+static double ns_since(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec)*1e9 + (now.tv_nsec - start->tv_nsec);
+}
+
+int main(int argc, char **argv)
+{
+    long events = 200000;
+    int rounds = 5;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+        switch (opt) {
+        case 'n': events = strtol(optarg, NULL, 10); break;
+        case 'r': rounds = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-n events] [-r rounds]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    nrf8001_mock_begin(RDY, REQ, RST, RDY_INTERRUPT_NUMBER);
+
+    bluetooth_t bluetooth;
+    bluetooth_setup(&bluetooth);
+    printf("setup: status %d, %lu commands sent to the mock\n",
+           bluetooth_get_status(&bluetooth), nrf8001_mock.commands);
+
+    double best[PATHS];
+    long errors = 0;
+    for (int path = 0; path < PATHS; path++) {
+        best[path] = 1e30;
+    }
+    make_messages();
+
+    for (int round = 0; round < rounds; round++) {
+        for (int path = 0; path < PATHS; path++) {
+            struct timespec start;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (long i = 0; i < events; i++) {
+                send_message(i);
+                if (!take(path, &bluetooth, i)) errors++;
+            }
+            if (path == POLL) {
+                /* releases the last message, still held in the queue */
+                bluetooth_poll(&bluetooth);
+            }
+            best[path] = fmin(best[path], ns_since(&start)/events);
+        }
+    }
+
+    printf("path\tns_per_event\tns_over_transport\n");
+    for (int path = 0; path < PATHS; path++) {
+        printf("%s\t%.1f\t%.1f\n", path_names[path], best[path], best[path] - best[TRANSPORT]);
+    }
+    printf("%d rounds of %ld events, %ld errors\n", rounds, events, errors);
+
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,231 @@
+/*!
+ * @file
+ *
+ * @brief Host stress test and benchmark of the ACI queues
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains a command line tool which runs the nRF8001
+ * driver's aci_queue on two threads, as the firmware runs it in the
+ * RDYN interrupt (m_aci_isr()) and the main loop. The interrupt thread
+ * takes commands from the TX queue and puts events on the RX queue;
+ * the main thread does the opposite, peeking at each event before
+ * taking it as lib_aci does. Every packet carries a sequence number
+ * and a length and contents derived from it, which the receiving side
+ * checks, so a lost, repeated or torn packet is reported.
+ *
+ * It then measures enqueue/dequeue pairs on one thread and packets
+ * per second through the queues between the two threads.
+ *
+ * Build and run with
+ *    g++ -O2 -pthread -Ihost -I../libraries/nordic_bluetooth_driver -include Arduino.h \
+ *        -o aci_queue_stress aci_queue_stress.cpp ../libraries/nordic_bluetooth_driver/aci_queue.cpp
+ *    ./aci_queue_stress [-n packets]
+ *
+ * Building with -fsanitize=thread also checks the queues for data races.
+ * A side which can neither send nor receive yields, so that the test
+ * also runs on a single core.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "aci_queue.h"
+
+/*!
+ * @brief Stops on a failed driver assertion
+ */
+void __ble_assert(const char *file, uint16_t line)
+{
+    fprintf(stderr, "assertion failed at %s:%u\n", file, line);
+    abort();
+}
+
+/*!
+ * @brief struct holding one direction of the stress test
+ */
+struct direction_t {
+    aci_queue_t *queue;   /*!< Queue the packets go through */
+    long packets;         /*!< Number of packets to send */
+    long full;            /*!< Times the producer found the queue full */
+    long errors;          /*!< Packets received out of order or corrupt */
+};
+
+static aci_queue_t tx_queue;
+static aci_queue_t rx_queue;
+static hal_aci_data_t tx_slots[ACI_QUEUE_SIZE];
+static hal_aci_data_t rx_slots[ACI_QUEUE_SIZE];
+
+/*!
+ * @brief Fills a packet for a sequence number
+ */
+static void fill(hal_aci_data_t *packet, uint32_t sequence)
+{
+    uint8_t length = 4 + sequence % (HAL_ACI_MAX_LENGTH - 3);
+    packet->status_byte = 0xFF;
+    packet->buffer[0] = length;
+    memcpy(&packet->buffer[1], &sequence, sizeof(sequence));
+    for (uint8_t i = 5; i <= length; i++) {
+        packet->buffer[i] = (uint8_t)(sequence*31 + i);
+    }
+}
+
+/*!
+ * @brief Checks a packet against its expected sequence number
+ */
+static bool check(const hal_aci_data_t *packet, uint32_t sequence)
+{
+    hal_aci_data_t expected;
+    fill(&expected, sequence);
+    return packet->status_byte == 0 && packet->buffer[0] == expected.buffer[0]
+        && memcmp(&packet->buffer[1], &expected.buffer[1], expected.buffer[0]) == 0;
+}
+
+/*!
+ * @brief Sends the next packet of one direction
+ *
+ * @returns    true if the packet was sent or all have been
+ */
+static bool produce(direction_t *direction, long *sent)
+{
+    hal_aci_data_t packet;
+    if (*sent >= direction->packets) return true;
+    fill(&packet, (uint32_t)*sent);
+    if (!aci_queue_enqueue(direction->queue, &packet)) {
+        direction->full++;
+        return false;
+    }
+    (*sent)++;
+    return true;
+}
+
+/*!
+ * @brief Receives and checks the next packet of one direction
+ *
+ * @returns    true if a packet was received
+ */
+static bool consume(direction_t *direction, long *received, bool peek_first)
+{
+    hal_aci_data_t peeked, packet;
+    if (aci_queue_is_empty(direction->queue)) return false;
+
+    if (peek_first && (!aci_queue_peek(direction->queue, &peeked)
+                       || !check(&peeked, (uint32_t)*received))) {
+        direction->errors++;
+    }
+    if (!aci_queue_dequeue(direction->queue, &packet)) {
+        direction->errors++;
+        return false;
+    }
+    if (!check(&packet, (uint32_t)*received)) {
+        if (direction->errors++ < 5) {
+            fprintf(stderr, "packet %ld corrupt or out of order\n", *received);
+        }
+    }
+    (*received)++;
+    return true;
+}
+
+static direction_t commands;  /* main loop to interrupt, through tx_queue */
+static direction_t events;    /* interrupt to main loop, through rx_queue */
+
+/*!
+ * @brief Runs the interrupt side: takes commands, sends events
+ */
+static void *interrupt_side(void *)
+{
+    long received = 0, sent = 0;
+    while (received < commands.packets || sent < events.packets) {
+        bool took = consume(&commands, &received, false);
+        bool gave = produce(&events, &sent);
+        if (!took && !gave) sched_yield();
+    }
+    return NULL;
+}
+
+/*!
+ * @brief Returns the time since an earlier timespec, in ns
+ */
+static double ns_since(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec)*1e9 + (now.tv_nsec - start->tv_nsec);
+}
+
+/*!
+ * @brief Measures enqueue/dequeue pairs on one thread
+ *
+ * @returns    Time per pair, in ns
+ */
+static double time_pairs(long pairs)
+{
+    aci_queue_t queue;
+    static hal_aci_data_t slots[ACI_QUEUE_SIZE];
+    hal_aci_data_t packet, received;
+    aci_queue_init(&queue, slots, ACI_QUEUE_SIZE);
+    fill(&packet, 12345);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < pairs; i++) {
+        packet.buffer[1] = (uint8_t)i;
+        aci_queue_enqueue(&queue, &packet);
+        aci_queue_dequeue(&queue, &received);
+    }
+    double ns = ns_since(&start);
+    if (received.buffer[1] != (uint8_t)(pairs - 1)) fprintf(stderr, "pairs failed\n");
+    return ns/pairs;
+}
+
+int main(int argc, char **argv)
+{
+    long packets = 10000000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+        case 'n': packets = strtol(optarg, NULL, 10); break;
+        default:
+            fprintf(stderr, "usage: %s [-n packets]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    aci_queue_init(&tx_queue, tx_slots, ACI_QUEUE_SIZE);
+    aci_queue_init(&rx_queue, rx_slots, ACI_QUEUE_SIZE);
+    commands = (direction_t){&tx_queue, packets, 0, 0};
+    events = (direction_t){&rx_queue, packets, 0, 0};
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, interrupt_side, NULL);
+
+    /* the main loop: sends commands, takes events */
+    long received = 0, sent = 0;
+    while (received < events.packets || sent < commands.packets) {
+        bool gave = produce(&commands, &sent);
+        bool took = consume(&events, &received, true);
+        if (!took && !gave) sched_yield();
+    }
+    pthread_join(thread, NULL);
+    double ns = ns_since(&start);
+
+    printf("queue size %d, %ld packets each way\n", ACI_QUEUE_SIZE, packets);
+    printf("commands: %ld errors, queue full %ld times\n", commands.errors, commands.full);
+    printf("events:   %ld errors, queue full %ld times\n", events.errors, events.full);
+    printf("%.1f M packets/s between threads, %.1f ns per enqueue/dequeue pair on one thread\n",
+           2*packets/ns*1e3, time_pairs(packets));
+
+    return commands.errors || events.errors ? 1 : 0;
+}
@@ -0,0 +1,219 @@
+/*!
+ * @file
+ *
+ * @brief Host simulation of sustained inbound ACI throughput
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains a command line tool which runs the nRF8001
+ * transport layer against the mock nRF8001 on virtual time, while a
+ * phone streams UART messages to it as fast as the link allows.
+ *
+ * Every connection interval the phone sends up to a number of
+ * packets. The nRF8001 passes each on as it arrives; those it has no
+ * buffer for, while the driver holds it off, are refused by link layer
+ * flow control and wait for the next connection event. Each
+ * packet becomes an ACI Data Received event. The main loop takes
+ * events in place, spends some time on each one (as writing a
+ * waypoint does) and is also busy now and then with other work (as
+ * redrawing the display does). Transfers run in the RDYN interrupt
+ * and take time from the main loop.
+ *
+ * It prints the event queue depth it was built with, the messages per
+ * second received, the latency from the nRF8001 receiving a message to
+ * the main loop taking it, the packets refused by flow control and the
+ * transport layer's queue counters.
+ *
+ * The depth is fixed at build time, so build once per depth:
+ *    for depth in 2 4 8 16; do
+ *        g++ -O2 -D__AVR__ -DACI_RX_QUEUE_SIZE=$depth -Ihost \
+ *            -I../libraries/nordic_bluetooth_driver -include Arduino.h \
+ *            -o aci_rx_bench aci_rx_bench.cpp host/host.cpp host/nrf8001_mock.cpp \
+ *            ../libraries/nordic_bluetooth_driver/{aci_queue,hal_aci_tl}.cpp
+ *        ./aci_rx_bench [-n messages] [-c interval_ms] [-k packets] [-f buffers]
+ *                       [-w work_us] [-b busy_ms] [-p period_ms]
+ *    done
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "aci_queue.h"
+#include "hal_aci_tl.h"
+#include "aci_cmds.h"
+#include "aci_evts.h"
+#include "nrf8001_mock.h"
+
+/* pins as wired in bluetooth.cpp */
+#define RDY 7
+#define REQ 9
+#define RST 10
+#define RDY_INTERRUPT_NUMBER 4
+
+#define UART_RX_PIPE 11      /*!< Pipe of the UART messages */
+#define MESSAGE_LENGTH 20    /*!< Length of each message */
+#define IDLE_US 50           /*!< Time of a main loop pass without an event, in us */
+
+/*!
+ * @brief struct holding the simulation parameters
+ */
+struct parameters_t {
+    long messages;            /*!< Number of messages the phone sends */
+    unsigned long interval;   /*!< Connection interval, in us */
+    int packets;              /*!< Most packets the phone sends per connection event */
+    int buffers;              /*!< Events the nRF8001 can hold */
+    unsigned long work;       /*!< Main loop time per message, in us */
+    unsigned long busy;       /*!< Length of other work, in us */
+    unsigned long period;     /*!< Period of other work, in us */
+};
+
+static parameters_t parameters = {5000, 20000, 4, 2, 2000, 60000, 500000};
+
+static unsigned long long *received_at;   /* time the nRF8001 took each message */
+static long sent;                         /* messages the nRF8001 has taken */
+static long refused;                      /* packets refused by flow control */
+static unsigned long long next_connection;
+
+/*!
+ * @brief Stops on a failed driver assertion
+ */
+void __ble_assert(const char *file, uint16_t line)
+{
+    fprintf(stderr, "assertion failed at %s:%u\n", file, line);
+    abort();
+}
+
+/*!
+ * @brief Runs a connection event, the phone sending what the nRF8001 takes
+ */
+static void connection_event(void)
+{
+    for (int i = 0; i < parameters.packets && sent < parameters.messages; i++) {
+        uint8_t event[2 + MESSAGE_LENGTH] = {ACI_EVT_DATA_RECEIVED, UART_RX_PIPE};
+        memcpy(&event[2], &sent, sizeof(sent));
+        if (!nrf8001_mock_send(event, sizeof(event))) {
+            refused += parameters.packets - i;
+            break;
+        }
+        received_at[sent++] = host_time_us;
+        nrf8001_mock_service();
+    }
+}
+
+/*!
+ * @brief Runs the main loop for some time, less what interrupts take
+ */
+static void run(unsigned long us)
+{
+    while (us > 0) {
+        if (host_time_us >= next_connection) {
+            next_connection += parameters.interval;
+            connection_event();
+            continue;
+        }
+        unsigned long long step = next_connection - host_time_us;
+        if (step > us) step = us;
+        host_time_us += step;
+        us -= step;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:c:k:f:w:b:p:")) != -1) {
+        switch (opt) {
+        case 'n': parameters.messages = strtol(optarg, NULL, 10); break;
+        case 'c': parameters.interval = atof(optarg)*1000; break;
+        case 'k': parameters.packets = atoi(optarg); break;
+        case 'f': parameters.buffers = atoi(optarg); break;
+        case 'w': parameters.work = strtoul(optarg, NULL, 10); break;
+        case 'b': parameters.busy = atof(optarg)*1000; break;
+        case 'p': parameters.period = atof(optarg)*1000; break;
+        default:
+            fprintf(stderr, "usage: %s [-n messages] [-c interval_ms] [-k packets] [-f buffers]"
+                            " [-w work_us] [-b busy_ms] [-p period_ms]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (parameters.messages <= 0 || parameters.interval == 0 || parameters.packets <= 0
+        || parameters.buffers <= 0 || parameters.buffers > NRF8001_MOCK_EVENTS
+        || parameters.period == 0) {
+        fprintf(stderr, "%s: bad parameters\n", argv[0]);
+        return 1;
+    }
+    received_at = (unsigned long long*)calloc(parameters.messages, sizeof(*received_at));
+
+    host_virtual_time = true;
+    nrf8001_mock_begin(RDY, REQ, RST, RDY_INTERRUPT_NUMBER);
+    nrf8001_mock.capacity = parameters.buffers;
+
+    aci_pins_t pins = {};
+    pins.board_name = BOARD_DEFAULT;
+    pins.reqn_pin = REQ;
+    pins.rdyn_pin = RDY;
+    pins.reset_pin = RST;
+    pins.active_pin = UNUSED;
+    pins.optional_chip_sel_pin = UNUSED;
+    pins.interface_is_interrupt = true;
+    pins.interrupt_number = RDY_INTERRUPT_NUMBER;
+    hal_aci_tl_init(&pins, false);
+
+    /* the Device Started event after the reset */
+    while (hal_aci_tl_event_front() != NULL) {
+        hal_aci_tl_event_consume();
+    }
+    hal_aci_tl_stats_clear();
+
+    const unsigned long long start = host_time_us;
+    unsigned long long next_busy = start + parameters.period;
+    unsigned long long latency_sum = 0, latency_max = 0;
+    long handled = 0, errors = 0;
+    next_connection = start;
+
+    while (handled < parameters.messages) {
+        hal_aci_data_t *event = hal_aci_tl_event_front();
+        if (event == NULL) {
+            run(IDLE_US);
+        } else {
+            long sequence;
+            memcpy(&sequence, &event->buffer[3], sizeof(sequence));
+            if (event->buffer[1] != ACI_EVT_DATA_RECEIVED || sequence != handled) {
+                errors++;
+            } else {
+                unsigned long long latency = host_time_us - received_at[sequence];
+                latency_sum += latency;
+                if (latency > latency_max) latency_max = latency;
+            }
+            handled++;
+
+            /* the message is used in place before the event is released */
+            run(parameters.work);
+            hal_aci_tl_event_consume();
+        }
+
+        if (host_time_us >= next_busy) {
+            run(parameters.busy);
+            next_busy += parameters.period;
+        }
+    }
+
+    hal_aci_tl_stats_t stats;
+    hal_aci_tl_stats_get(&stats);
+    double seconds = (host_time_us - start)/1e6;
+
+    printf("depth\tmessages_per_s\tmean_latency_ms\tmax_latency_ms\trefused"
+           "\trx_high_water\trx_full\trx_stalls\trx_dropped\terrors\n");
+    printf("%d\t%.1f\t%.2f\t%.2f\t%ld\t%u\t%u\t%u\t%u\t%ld\n", ACI_RX_QUEUE_SIZE,
+           handled/seconds, latency_sum/1000.0/handled, latency_max/1000.0, refused,
+           stats.rx_high_water, stats.rx_full, stats.rx_stalls, stats.rx_dropped, errors);
+
+    free(received_at);
+    return errors || stats.rx_dropped ? 1 : 0;
+}
@@ -0,0 +1,219 @@
+/*!
+ * @file
+ *
+ * @brief Host benchmark of the bytes and time an ACI SPI transfer takes
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains a command line tool which runs the nRF8001
+ * transport layer against the mock nRF8001 and times one kind of SPI
+ * transfer at a time:
+ *
+ *    event    a Data Received event with 20 bytes of data, as a
+ *             waypoint upload brings, and no command
+ *    command  a Send Data command with 20 bytes of data and no event
+ *    both     the two in the same transfer
+ *    short    a one byte command (Get Device Version) and no event
+ *    credit   a Data Credit event and no command
+ *
+ * Each transfer is checked: the command the mock receives and the
+ * event the driver queues must match what was sent.
+ *
+ * For each kind it prints the bytes clocked per transfer, how many of
+ * them went through a block transfer, the host time per transfer and
+ * an estimate of the time on the device. The estimate adds to the
+ * mock's time (the interrupt overhead and 8 SPI clocks a byte at
+ * 2 MHz) the gap the AVR leaves between bytes: SINGLE_GAP_CYCLES for a
+ * byte sent on its own, BLOCK_GAP_CYCLES for a byte of a block
+ * transfer, which loads the next byte while the last is shifted out.
+ * The gaps are counted from the AVR SPI library's loops and the clock
+ * is a parameter. Copies of the packets in RAM are not included.
+ *
+ * Build and run with
+ *    g++ -O2 -D__AVR__ -Ihost -I../libraries/nordic_bluetooth_driver -include Arduino.h \
+ *        -o aci_spi_bench aci_spi_bench.cpp host/host.cpp host/nrf8001_mock.cpp \
+ *        ../libraries/nordic_bluetooth_driver/{aci_queue,hal_aci_tl}.cpp
+ *    ./aci_spi_bench [-n transfers] [-m cpu_mhz]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "SPI.h"
+#include "aci_queue.h"
+#include "hal_aci_tl.h"
+#include "aci_cmds.h"
+#include "aci_evts.h"
+#include "nrf8001_mock.h"
+
+/* pins as wired in bluetooth.cpp */
+#define RDY 7
+#define REQ 9
+#define RST 10
+#define RDY_INTERRUPT_NUMBER 4
+
+#define UART_PIPE 11           /*!< Pipe of the UART messages */
+#define DATA_LENGTH 20         /*!< Data bytes of a full data packet */
+#define SINGLE_GAP_CYCLES 12   /*!< Cycles between bytes sent one at a time */
+#define BLOCK_GAP_CYCLES 4     /*!< Cycles between bytes of a block transfer */
+
+/*!
+ * @brief struct describing one kind of transfer
+ */
+struct kind_t {
+    const char *name;         /*!< Name printed */
+    uint8_t command[HAL_ACI_MAX_LENGTH + 1];  /*!< Command sent, its length first, or none */
+    uint8_t event[HAL_ACI_MAX_LENGTH + 1];    /*!< Event received, its length first, or none */
+};
+
+static kind_t kinds[] = {
+    {"event", {0}, {2 + DATA_LENGTH, ACI_EVT_DATA_RECEIVED, UART_PIPE}},
+    {"command", {2 + DATA_LENGTH, ACI_CMD_SEND_DATA, UART_PIPE}, {0}},
+    {"both", {2 + DATA_LENGTH, ACI_CMD_SEND_DATA, UART_PIPE}, {2 + DATA_LENGTH, ACI_EVT_DATA_RECEIVED, UART_PIPE}},
+    {"short", {1, ACI_CMD_GET_DEVICE_VERSION}, {0}},
+    {"credit", {0}, {2, ACI_EVT_DATA_CREDIT, 1}},
+};
+#define KINDS (sizeof(kinds)/sizeof(kinds[0]))
+
+static const uint8_t *expected_command;  /* command the mock should receive next */
+static long errors;
+
+/*!
+ * @brief Stops on a failed driver assertion
+ */
+void __ble_assert(const char *file, uint16_t line)
+{
+    fprintf(stderr, "assertion failed at %s:%u\n", file, line);
+    abort();
+}
+
+/*!
+ * @brief Checks each command the mock receives
+ */
+static void command_received(const uint8_t *command)
+{
+    if (expected_command == NULL || memcmp(command, expected_command, expected_command[0] + 1) != 0) {
+        errors++;
+    }
+    expected_command = NULL;
+}
+
+/*!
+ * @brief Fills the data bytes of a packet from a sequence number
+ */
+static void fill(uint8_t *packet, long sequence)
+{
+    for (uint8_t i = 3; i <= packet[0]; i++) {
+        packet[i] = (uint8_t)(sequence*7 + i);
+    }
+}
+
+/*!
+ * @brief Runs transfers of one kind, printing what they take
+ */
+static void run(kind_t *kind, long transfers, double mhz)
+{
+    unsigned long bytes = nrf8001_mock.bytes;
+    unsigned long block_bytes = host_spi_block_bytes;
+    unsigned long count = nrf8001_mock.transfers;
+    unsigned long long device_us = host_time_us;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (long i = 0; i < transfers; i++) {
+        hal_aci_data_t command;
+        if (kind->event[0] > 0) {
+            fill(kind->event, i);
+            nrf8001_mock_send(&kind->event[1], kind->event[0]);
+        }
+        if (kind->command[0] > 0) {
+            fill(kind->command, i);
+            command.status_byte = 0;
+            memcpy(command.buffer, kind->command, kind->command[0] + 1);
+            expected_command = kind->command;
+            hal_aci_tl_send(&command);
+        }
+        nrf8001_mock_service();
+
+        hal_aci_data_t *event = hal_aci_tl_event_front();
+        if (kind->event[0] > 0) {
+            if (event == NULL || memcmp(event->buffer, kind->event, kind->event[0] + 1) != 0) {
+                errors++;
+            }
+            hal_aci_tl_event_consume();
+        } else if (event != NULL) {
+            errors++;
+            hal_aci_tl_event_consume();
+        }
+        if (expected_command != NULL) {
+            errors++;
+            expected_command = NULL;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double host_ns = (end.tv_sec - start.tv_sec)*1e9 + (end.tv_nsec - start.tv_nsec);
+    count = nrf8001_mock.transfers - count;
+    bytes = nrf8001_mock.bytes - bytes;
+    block_bytes = host_spi_block_bytes - block_bytes;
+    double gaps = ((bytes - block_bytes)*SINGLE_GAP_CYCLES + block_bytes*BLOCK_GAP_CYCLES)/mhz;
+    double per = count ? count : 1;
+
+    printf("%s\t%.2f\t%.1f\t%.1f\t%.1f\t%.1f\n", kind->name, count/(double)transfers,
+           bytes/per, block_bytes/per, host_ns/per, (host_time_us - device_us + gaps)/per);
+}
+
+int main(int argc, char **argv)
+{
+    long transfers = 100000;
+    double mhz = 8;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:m:")) != -1) {
+        switch (opt) {
+        case 'n': transfers = strtol(optarg, NULL, 10); break;
+        case 'm': mhz = atof(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-n transfers] [-m cpu_mhz]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (transfers <= 0 || mhz <= 0) {
+        fprintf(stderr, "%s: bad parameters\n", argv[0]);
+        return 1;
+    }
+
+    host_virtual_time = true;
+    nrf8001_mock_begin(RDY, REQ, RST, RDY_INTERRUPT_NUMBER);
+
+    aci_pins_t pins = {};
+    pins.board_name = BOARD_DEFAULT;
+    pins.reqn_pin = REQ;
+    pins.rdyn_pin = RDY;
+    pins.reset_pin = RST;
+    pins.active_pin = UNUSED;
+    pins.optional_chip_sel_pin = UNUSED;
+    pins.interface_is_interrupt = true;
+    pins.interrupt_number = RDY_INTERRUPT_NUMBER;
+    hal_aci_tl_init(&pins, false);
+
+    /* the Device Started event after the reset */
+    while (hal_aci_tl_event_front() != NULL) {
+        hal_aci_tl_event_consume();
+    }
+    nrf8001_mock.command_handler = command_received;
+
+    printf("kind\ttransfers_each\tbytes\tblock_bytes\thost_ns\tdevice_us\n");
+    for (size_t i = 0; i < KINDS; i++) {
+        run(&kinds[i], transfers, mhz);
+    }
+    printf("%ld transfers of each kind, %.0f MHz; %ld errors\n", transfers, mhz, errors);
+
+    return errors ? 1 : 0;
+}
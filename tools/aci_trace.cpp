@@ -0,0 +1,363 @@
+/*!
+ * @file
+ *
+ * @brief Host tool rendering an ACI trace as a timeline
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains a command line tool which decodes a trace of the
+ * ACI traffic, as hal_aci_tl_trace_export() writes it with
+ * HAL_ACI_TRACE set in hal_aci_tl.h, and prints it as a timeline.
+ *
+ * Each line gives the time since the first record, in ms, the time
+ * since the line before, in us, and what happened:
+ *
+ *    command   a command was queued by hal_aci_tl_send()
+ *    transfer  an SPI transfer started, sending the command named,
+ *              with the time it waited in the command queue
+ *    event     the transfer ended, receiving the event named, with
+ *              the time the transfer took
+ *    consume   the firmware was done with the event, with the time
+ *              it waited in the event queue
+ *    hold off  the event queue was full, the nRF8001 was held off
+ *    release   there was room again, and whether the nRF8001 had
+ *              been waiting with an event
+ *    mark      a mark of the firmware, with the time since the last
+ *    flush     the command and event queues were emptied
+ *
+ * A summary of the transfer and queue times follows. Times are only
+ * as fine as the trace's ticks, 4 us on a 16 MHz AVR.
+ *
+ * The firmware, built with HAL_ACI_TRACE, sends the trace over the
+ * USB serial port when it receives a 'T'. With -r the tool asks for
+ * it and reads it from the port, which must be set to raw first.
+ *
+ * Build and run with
+ *    g++ -O2 -D__AVR__ -Ihost -I../libraries/nordic_bluetooth_driver -I../src \
+ *        -include Arduino.h -o aci_trace aci_trace.cpp
+ *    ./aci_trace [-s] trace.bin
+ *    stty -F /dev/ttyACM0 raw && ./aci_trace -r /dev/ttyACM0
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "hal_aci_tl.h"
+#include "bluetooth.h"
+
+#define PENDING 256  /*!< Commands or events waiting at once, at most */
+
+/*!
+ * @brief Returns the name of a command opcode
+ */
+static const char *command_name(uint8_t opcode)
+{
+    switch (opcode) {
+    case 0: return "-";
+    case ACI_CMD_TEST: return "Test";
+    case ACI_CMD_ECHO: return "Echo";
+    case ACI_CMD_DTM_CMD: return "DtmCommand";
+    case ACI_CMD_SLEEP: return "Sleep";
+    case ACI_CMD_WAKEUP: return "Wakeup";
+    case ACI_CMD_SETUP: return "Setup";
+    case ACI_CMD_READ_DYNAMIC_DATA: return "ReadDynamicData";
+    case ACI_CMD_WRITE_DYNAMIC_DATA: return "WriteDynamicData";
+    case ACI_CMD_GET_DEVICE_VERSION: return "GetDeviceVersion";
+    case ACI_CMD_GET_DEVICE_ADDRESS: return "GetDeviceAddress";
+    case ACI_CMD_GET_BATTERY_LEVEL: return "GetBatteryLevel";
+    case ACI_CMD_GET_TEMPERATURE: return "GetTemperature";
+    case ACI_CMD_SET_LOCAL_DATA: return "SetLocalData";
+    case ACI_CMD_RADIO_RESET: return "RadioReset";
+    case ACI_CMD_CONNECT: return "Connect";
+    case ACI_CMD_BOND: return "Bond";
+    case ACI_CMD_DISCONNECT: return "Disconnect";
+    case ACI_CMD_SET_TX_POWER: return "SetTxPower";
+    case ACI_CMD_CHANGE_TIMING: return "ChangeTiming";
+    case ACI_CMD_OPEN_REMOTE_PIPE: return "OpenRemotePipe";
+    case ACI_CMD_SEND_DATA: return "SendData";
+    case ACI_CMD_SEND_DATA_ACK: return "SendDataAck";
+    case ACI_CMD_REQUEST_DATA: return "RequestData";
+    case ACI_CMD_SEND_DATA_NACK: return "SendDataNack";
+    case ACI_CMD_SET_APP_LATENCY: return "SetApplLatency";
+    case ACI_CMD_SET_KEY: return "SetKey";
+    case ACI_CMD_OPEN_ADV_PIPE: return "OpenAdvPipe";
+    case ACI_CMD_BROADCAST: return "Broadcast";
+    case ACI_CMD_BOND_SECURITY_REQUEST: return "BondSecurityRequest";
+    case ACI_CMD_CONNECT_DIRECT: return "DirectedConnect";
+    case ACI_CMD_CLOSE_REMOTE_PIPE: return "CloseRemotePipe";
+    default: return "?";
+    }
+}
+
+/*!
+ * @brief Returns the name of an event opcode
+ */
+static const char *event_name(uint8_t opcode)
+{
+    switch (opcode) {
+    case 0: return "-";
+    case ACI_EVT_DEVICE_STARTED: return "DeviceStarted";
+    case ACI_EVT_ECHO: return "Echo";
+    case ACI_EVT_HW_ERROR: return "HardwareError";
+    case ACI_EVT_CMD_RSP: return "CommandResponse";
+    case ACI_EVT_CONNECTED: return "Connected";
+    case ACI_EVT_DISCONNECTED: return "Disconnected";
+    case ACI_EVT_BOND_STATUS: return "BondStatus";
+    case ACI_EVT_PIPE_STATUS: return "PipeStatus";
+    case ACI_EVT_TIMING: return "Timing";
+    case ACI_EVT_DATA_CREDIT: return "DataCredit";
+    case ACI_EVT_DATA_ACK: return "DataAck";
+    case ACI_EVT_DATA_RECEIVED: return "DataReceived";
+    case ACI_EVT_PIPE_ERROR: return "PipeError";
+    case ACI_EVT_DISPLAY_PASSKEY: return "DisplayPasskey";
+    case ACI_EVT_KEY_REQUEST: return "KeyRequest";
+    default: return "?";
+    }
+}
+
+/*!
+ * @brief Returns the name of a mark of the firmware
+ */
+static const char *mark_name(uint8_t id)
+{
+    switch (id) {
+    case BLUETOOTH_TRACE_SLEEP_DELAY: return "sleep delay";
+    case BLUETOOTH_TRACE_SLEEP_DONE: return "sleep delay done";
+    case BLUETOOTH_TRACE_SETUP_DELAY: return "setup delay";
+    case BLUETOOTH_TRACE_SETUP_DONE: return "setup delay done";
+    default: return "";
+    }
+}
+
+/*!
+ * @brief struct holding the commands or events waiting in a queue,
+ *        oldest first
+ */
+struct pending_t {
+    unsigned long long times[PENDING];  /*!< Time each was put in the queue */
+    uint8_t opcodes[PENDING];           /*!< Opcode of each */
+    unsigned head;
+    unsigned tail;
+};
+
+/*!
+ * @brief Puts one at the back of the queue, dropping the oldest if full
+ */
+static void push(pending_t *pending, uint8_t opcode, unsigned long long time)
+{
+    if (pending->tail - pending->head == PENDING) pending->head++;
+    pending->opcodes[pending->tail % PENDING] = opcode;
+    pending->times[pending->tail++ % PENDING] = time;
+}
+
+/*!
+ * @brief Takes the one at the front of the queue, if it has the opcode
+ *
+ * @returns    1 if it was there, 0 if the queue was empty or the
+ *             front was another, as the trace starts after it was put
+ */
+static int pop(pending_t *pending, uint8_t opcode, unsigned long long *time)
+{
+    if (pending->head == pending->tail || pending->opcodes[pending->head % PENDING] != opcode) return 0;
+    *time = pending->times[pending->head++ % PENDING];
+    return 1;
+}
+
+/*!
+ * @brief struct holding the least, greatest and total of some times
+ */
+struct spread_t {
+    unsigned long count;
+    unsigned long long least;
+    unsigned long long most;
+    unsigned long long total;
+};
+
+/*!
+ * @brief Adds a time to a spread
+ */
+static void add(spread_t *spread, unsigned long long time)
+{
+    if (spread->count == 0 || time < spread->least) spread->least = time;
+    if (time > spread->most) spread->most = time;
+    spread->total += time;
+    spread->count++;
+}
+
+/*!
+ * @brief Prints a spread of times, in us
+ */
+static void print_spread(const char *what, const spread_t *spread)
+{
+    if (spread->count == 0) {
+        printf("%-16s      0\n", what);
+        return;
+    }
+    printf("%-16s %6lu %8llu %8.0f %8llu\n", what, spread->count, spread->least,
+           (double)spread->total/spread->count, spread->most);
+}
+
+int main(int argc, char **argv)
+{
+    bool summary_only = false;
+    bool request = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "sr")) != -1) {
+        switch (opt) {
+        case 's': summary_only = true; break;
+        case 'r': request = true; break;
+        default:
+            fprintf(stderr, "usage: %s [-s] [-r] trace\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-s] [-r] trace\n", argv[0]);
+        return 1;
+    }
+
+    const char *path = argv[optind];
+    FILE *file = fopen(path, request ? "r+b" : "rb");
+    if (file == NULL) {
+        perror(path);
+        return 1;
+    }
+    if (request) {
+        fputc('T', file);
+        fflush(file);
+    }
+
+    uint8_t header[sizeof(hal_aci_tl_trace_header_t)];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header)
+        || (header[0] | header[1] << 8) != HAL_ACI_TRACE_MAGIC) {
+        fprintf(stderr, "%s: not an ACI trace\n", path);
+        return 1;
+    }
+    if (header[2] != HAL_ACI_TRACE_VERSION) {
+        fprintf(stderr, "%s: trace version %u, not %u\n", path, header[2], HAL_ACI_TRACE_VERSION);
+        return 1;
+    }
+    const unsigned tick_us = header[3];
+    const unsigned records = header[4] | header[5] << 8;
+    const unsigned lost = header[6] | header[7] << 8;
+    unsigned long long epoch = header[8] | header[9] << 8;
+
+    pending_t commands = {{0}, {0}, 0, 0};
+    pending_t events = {{0}, {0}, 0, 0};
+    spread_t transfers = {0, 0, 0, 0};
+    spread_t command_waits = {0, 0, 0, 0};
+    spread_t event_waits = {0, 0, 0, 0};
+    unsigned long hold_offs = 0;
+    unsigned long stalls = 0;
+    unsigned long marks = 0;
+    unsigned long long first = 0;
+    unsigned long long last = 0;
+    unsigned long long transfer_start = 0;
+    unsigned long long mark_at = 0;
+    bool transferring = false;
+    bool started = false;
+    unsigned read = 0;
+
+    if (!summary_only) printf("   time_ms   delta_us  what\n");
+    for (; read < records; read++) {
+        uint8_t record[sizeof(hal_aci_tl_trace_record_t)];
+        if (fread(record, 1, sizeof(record), file) != sizeof(record)) {
+            fprintf(stderr, "%s: trace ends after %u of %u records\n", path, read, records);
+            break;
+        }
+        const uint8_t type = record[0];
+        const uint8_t argument = record[1];
+        const unsigned time = record[2] | record[3] << 8;
+
+        if (HAL_ACI_TRACE_EPOCH == type) {
+            epoch = time;
+            continue;
+        }
+
+        const unsigned long long now = (epoch << 16 | time)*tick_us;
+        if (!started) {
+            first = last = now;
+            started = true;
+        }
+        if (!summary_only) printf("%10.3f %10llu  ", (now - first)/1000.0, now - last);
+        last = now;
+
+        unsigned long long since;
+        switch (type) {
+        case HAL_ACI_TRACE_COMMAND:
+            push(&commands, argument, now);
+            if (!summary_only) printf("command   %s\n", command_name(argument));
+            break;
+        case HAL_ACI_TRACE_TRANSFER:
+            transfer_start = now;
+            transferring = true;
+            if (!summary_only) printf("transfer  %s", command_name(argument));
+            if (argument != 0 && pop(&commands, argument, &since)) {
+                add(&command_waits, now - since);
+                if (!summary_only) printf(", queued %llu us", now - since);
+            }
+            if (!summary_only) printf("\n");
+            break;
+        case HAL_ACI_TRACE_EVENT:
+            if (!summary_only) printf("event     %s", event_name(argument));
+            if (argument != 0) push(&events, argument, now);
+            if (transferring) {
+                add(&transfers, now - transfer_start);
+                transferring = false;
+                if (!summary_only) printf(", transfer %llu us", now - transfer_start);
+            }
+            if (!summary_only) printf("\n");
+            break;
+        case HAL_ACI_TRACE_CONSUME:
+            if (!summary_only) printf("consume   %s", event_name(argument));
+            if (pop(&events, argument, &since)) {
+                add(&event_waits, now - since);
+                if (!summary_only) printf(", waited %llu us", now - since);
+            }
+            if (!summary_only) printf("\n");
+            break;
+        case HAL_ACI_TRACE_HOLD_OFF:
+            hold_offs++;
+            if (!summary_only) printf("hold off\n");
+            break;
+        case HAL_ACI_TRACE_RELEASE:
+            stalls += argument;
+            if (!summary_only) printf("release%s\n", argument ? ", nRF8001 was waiting" : "");
+            break;
+        case HAL_ACI_TRACE_MARK:
+            if (!summary_only) {
+                printf("mark      %u %s", argument, mark_name(argument));
+                if (marks > 0) printf(", %llu us since the last", now - mark_at);
+                printf("\n");
+            }
+            mark_at = now;
+            marks++;
+            break;
+        case HAL_ACI_TRACE_FLUSH:
+            commands.head = commands.tail;
+            events.head = events.tail;
+            transferring = false;
+            if (!summary_only) printf("flush\n");
+            break;
+        default:
+            if (!summary_only) printf("record type 0x%02X\n", type);
+            break;
+        }
+    }
+    fclose(file);
+
+    printf("%u records over %.3f ms, %s%u lost before them; %lu hold offs, %lu with the nRF8001 waiting; %lu marks\n",
+           read, (last - first)/1000.0, lost == 0xFFFF ? "at least " : "", lost, hold_offs, stalls, marks);
+    printf("%-16s %6s %8s %8s %8s\n", "us", "count", "least", "mean", "most");
+    print_spread("transfer", &transfers);
+    print_spread("command queued", &command_waits);
+    print_spread("event waited", &event_waits);
+
+    return 0;
+}
@@ -0,0 +1,305 @@
+/*!
+ * @file
+ *
+ * @brief Host benchmark of the Bluetooth module against the nRF8001 model
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains a command line tool which runs the firmware's
+ * Bluetooth module, the Nordic driver and aci_setup against the
+ * nRF8001 model on virtual time, and checks the model ends up where
+ * the firmware thinks it is after each step.
+ *
+ * Each round goes through
+ *
+ *    setup      bluetooth_setup() after one of three boots, taking
+ *               turns:
+ *                 cold   the nRF8001 is powered up and EEPROM holds
+ *                        no setup record: pin reset, setup messages,
+ *                        version, sleep
+ *                 warm   only the AVR restarts, the nRF8001 is asleep
+ *                        and still holds the setup: wakeup, version,
+ *                        sleep
+ *                 power  the nRF8001 is powered up but EEPROM keeps
+ *                        the record: the setup is tried, found lost
+ *                        and sent again
+ *    advertise  bluetooth_advertise(): wakeup, connect
+ *    connect    the phone connects and opens the UART TX pipe; the
+ *               firmware changes the timing and sets the hardware
+ *               revision
+ *    receive    the phone writes messages to the UART RX pipe, each
+ *               taken by bluetooth_poll() in a main loop of a set
+ *               period, as a waypoint upload does
+ *    sleep      bluetooth_sleep(): disconnect, radio reset, sleep
+ *
+ * For each step it prints the time it takes on the device, from the
+ * virtual clock, the SPI transfers and bytes it needs, and the host
+ * time it takes. Receive times are per message, from the phone's
+ * write to bluetooth_has_message(). The device times count the SPI
+ * clock and the nRF8001's command handling as the model assumes them,
+ * not the AVR's own instructions.
+ *
+ * Built with -DHAL_ACI_TRACE=1, -t writes the ACI trace of the last
+ * round to a file, for aci_trace. Raise HAL_ACI_TRACE_RECORDS, or
+ * lower the messages, to keep the whole round.
+ *
+ * Build and run with
+ *    g++ -O2 -D__AVR__ -Ihost -I../libraries/nordic_bluetooth_driver -I../src \
+ *        -include Arduino.h -o bluetooth_bench bluetooth_bench.cpp host/host.cpp \
+ *        host/nrf8001_mock.cpp host/nrf8001_model.cpp ../src/bluetooth.cpp \
+ *        ../libraries/nordic_bluetooth_driver/{aci_queue,aci_setup,acilib,hal_aci_tl,lib_aci,bootloader_setup}.cpp
+ *    ./bluetooth_bench [-r rounds] [-n messages] [-l loop_us] [-t trace_file]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "avr/eeprom.h"
+#include "lib_aci.h"
+#include "services.h"
+#include "bluetooth.h"
+#include "nrf8001_model.h"
+
+/* pins as wired in bluetooth.cpp */
+#define RDY 7
+#define REQ 9
+#define RST 10
+#define RDY_INTERRUPT_NUMBER 4
+
+#define POLLS 16    /*!< Polls to let the firmware answer the phone */
+
+enum step_t {COLD_SETUP_STEP, WARM_SETUP_STEP, POWER_SETUP_STEP, ADVERTISE_STEP, CONNECT_STEP,
+             RECEIVE_STEP, SLEEP_STEP, STEPS};
+static const char *step_names[STEPS] = {"cold_setup", "warm_setup", "power_setup", "advertise",
+                                        "connect", "receive", "sleep"};
+
+/*!
+ * @brief struct holding the totals of one step
+ */
+struct step_stats_t {
+    double device_us;         /*!< Virtual time */
+    double host_ns;           /*!< Host time */
+    unsigned long transfers;  /*!< SPI transfers */
+    unsigned long bytes;      /*!< SPI bytes */
+    long count;               /*!< Times the step ran */
+};
+
+static step_stats_t stats[STEPS];
+static long errors;
+
+/*!
+ * @brief struct holding the clocks at the start of a step
+ */
+struct mark_t {
+    unsigned long long device_us;
+    struct timespec host;
+    unsigned long transfers;
+    unsigned long bytes;
+};
+
+/*!
+ * @brief Marks the start of a step
+ */
+static mark_t mark(void)
+{
+    mark_t start;
+    start.device_us = host_time_us;
+    clock_gettime(CLOCK_MONOTONIC, &start.host);
+    start.transfers = nrf8001_mock.transfers;
+    start.bytes = nrf8001_mock.bytes;
+    return start;
+}
+
+/*!
+ * @brief Adds the time and transfers since a mark to a step
+ */
+static void account(step_t step, const mark_t *start, long count)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    stats[step].device_us += host_time_us - start->device_us;
+    stats[step].host_ns += (now.tv_sec - start->host.tv_sec)*1e9 + (now.tv_nsec - start->host.tv_nsec);
+    stats[step].transfers += nrf8001_mock.transfers - start->transfers;
+    stats[step].bytes += nrf8001_mock.bytes - start->bytes;
+    stats[step].count += count;
+}
+
+/*!
+ * @brief Counts an error if the firmware and the model disagree
+ */
+static void check(bool good, const char *what)
+{
+    if (!good) {
+        if (errors++ < 10) fprintf(stderr, "check failed: %s\n", what);
+    }
+}
+
+static FILE *trace_file;
+
+/*!
+ * @brief Writes part of the ACI trace to the trace file, if any
+ */
+static void trace_write(const uint8_t *data, uint16_t length)
+{
+    if (trace_file) fwrite(data, 1, length, trace_file);
+}
+
+/*!
+ * @brief Polls the firmware a few times, to answer what the phone did
+ */
+static void poll(bluetooth_t *bluetooth)
+{
+    for (int i = 0; i < POLLS; i++) {
+        bluetooth_poll(bluetooth);
+    }
+}
+
+/*!
+ * @brief Has the phone write messages, timing each until the firmware has it
+ */
+static void receive(bluetooth_t *bluetooth, long messages, unsigned long loop_us)
+{
+    char expected[PIPE_UART_OVER_BTLE_UART_RX_RX_MAX_SIZE + 1];
+
+    for (long i = 0; i < messages; i++) {
+        int length = snprintf(expected, sizeof(expected), "%ld,45.%04ld,-122.%04ld",
+                              i, i*37 % 10000, i*91 % 10000);
+        if (length > PIPE_UART_OVER_BTLE_UART_RX_RX_MAX_SIZE) {
+            length = PIPE_UART_OVER_BTLE_UART_RX_RX_MAX_SIZE;
+            expected[length] = '\0';
+        }
+
+        mark_t start = mark();
+        check(nrf8001_model_write(PIPE_UART_OVER_BTLE_UART_RX_RX, (const uint8_t*)expected, length),
+              "phone write");
+
+        /* the main loop finishes whatever it was doing before it polls */
+        host_time_us += rand() % loop_us;
+        int polls = 0;
+        while (!bluetooth_has_message(bluetooth) && polls++ < POLLS) {
+            bluetooth_poll(bluetooth);
+            if (!bluetooth_has_message(bluetooth)) host_time_us += loop_us;
+        }
+        check(bluetooth_has_message(bluetooth)
+              && strcmp(bluetooth_get_message(bluetooth), expected) == 0, "message received");
+        account(RECEIVE_STEP, &start, 1);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = 20;
+    long messages = 200;
+    unsigned long loop_us = 1000;
+    const char *trace_path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:n:l:t:")) != -1) {
+        switch (opt) {
+        case 'r': rounds = atoi(optarg); break;
+        case 'n': messages = strtol(optarg, NULL, 10); break;
+        case 'l': loop_us = strtoul(optarg, NULL, 10); break;
+        case 't': trace_path = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-r rounds] [-n messages] [-l loop_us] [-t trace_file]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (rounds <= 0 || messages < 0 || loop_us == 0) {
+        fprintf(stderr, "%s: bad parameters\n", argv[0]);
+        return 1;
+    }
+    if (trace_path && !HAL_ACI_TRACE) {
+        fprintf(stderr, "%s: built without HAL_ACI_TRACE\n", argv[0]);
+        return 1;
+    }
+
+    srand(1);
+    host_virtual_time = true;
+    nrf8001_model_begin(RDY, REQ, RST, RDY_INTERRUPT_NUMBER);
+
+    bluetooth_t bluetooth;
+    for (int round = 0; round < rounds; round++) {
+        /* the nRF8001 was left asleep by the last round */
+        step_t boot = (step_t)(COLD_SETUP_STEP + round % 3);
+        if (COLD_SETUP_STEP == boot) {
+            memset(&host_eeprom[BLUETOOTH_SETUP_CRC_ADDRESS], 0xFF,
+                   BLUETOOTH_CREDITS_ADDRESS + 1 - BLUETOOTH_SETUP_CRC_ADDRESS);
+        }
+        if (WARM_SETUP_STEP != boot) {
+            nrf8001_model_power_cycle();
+        }
+        if (round == rounds - 1) {
+            /* the trace starts with the last round */
+            hal_aci_tl_trace_export(trace_write);
+        }
+
+        mark_t start = mark();
+        bluetooth_setup(&bluetooth);
+        account(boot, &start, 1);
+        check((WARM_SETUP_STEP == boot) == bluetooth.setup_resumed, "setup: resumed on warm boot only");
+        check(bluetooth.setup_time == host_time_us/1000 - start.device_us/1000, "setup: setup_time");
+        check(SLEEPING == bluetooth_get_status(&bluetooth), "setup: firmware asleep");
+        check(NRF8001_MODEL_SLEEP == nrf8001_model.mode, "setup: nRF8001 asleep");
+        check(NB_SETUP_MESSAGES == nrf8001_model.setup_messages && 0 != nrf8001_model.setup_id,
+              "setup: setup accepted");
+        check(NRF8001_MODEL_CREDITS == bluetooth.aci_state.data_credit_total, "setup: credits");
+
+        start = mark();
+        bluetooth_advertise(&bluetooth);
+        account(ADVERTISE_STEP, &start, 1);
+        check(ADVERTISING == bluetooth_get_status(&bluetooth), "advertise: firmware advertising");
+        check(NRF8001_MODEL_ADVERTISING == nrf8001_model.mode, "advertise: nRF8001 advertising");
+
+        start = mark();
+        check(nrf8001_model_connect(), "connect: phone connected");
+        check(nrf8001_model_open_pipe(PIPE_UART_OVER_BTLE_UART_TX_TX), "connect: pipe opened");
+        poll(&bluetooth);
+        account(CONNECT_STEP, &start, 1);
+        check(CONNECTED == bluetooth_get_status(&bluetooth), "connect: firmware connected");
+        check(lib_aci_is_pipe_available(&bluetooth.aci_state, PIPE_UART_OVER_BTLE_UART_TX_TX),
+              "connect: pipe available");
+        check(NRF8001_MODEL_PPCP_INTERVAL == nrf8001_model.interval
+              && NRF8001_MODEL_PPCP_INTERVAL == bluetooth.aci_state.connection_interval,
+              "connect: timing changed");
+        check(sizeof(aci_evt_cmd_rsp_params_get_device_version_t)
+              == nrf8001_model.local_length[PIPE_DEVICE_INFORMATION_HARDWARE_REVISION_STRING_SET],
+              "connect: hardware revision set");
+
+        receive(&bluetooth, messages, loop_us);
+
+        start = mark();
+        bluetooth_sleep(&bluetooth);
+        account(SLEEP_STEP, &start, 1);
+        check(SLEEPING == bluetooth_get_status(&bluetooth), "sleep: firmware asleep");
+        check(NRF8001_MODEL_SLEEP == nrf8001_model.mode, "sleep: nRF8001 asleep");
+    }
+
+    if (trace_path) {
+        trace_file = fopen(trace_path, "wb");
+        if (trace_file == NULL) {
+            perror(trace_path);
+            return 1;
+        }
+        hal_aci_tl_trace_export(trace_write);
+        fclose(trace_file);
+    }
+
+    printf("step\tdevice_ms\thost_us\ttransfers\tbytes\n");
+    for (int step = 0; step < STEPS; step++) {
+        double count = stats[step].count ? stats[step].count : 1;
+        printf("%s\t%.3f\t%.3f\t%.1f\t%.1f\n", step_names[step], stats[step].device_us/1000/count,
+               stats[step].host_ns/1000/count, stats[step].transfers/count, stats[step].bytes/count);
+    }
+    printf("%d rounds, %ld messages each, %lu us main loop; nRF8001 answered %lu commands"
+           " with an error, lost %lu events; %ld errors\n", rounds, messages, loop_us,
+           nrf8001_model.errors, nrf8001_model.lost, errors);
+
+    return errors ? 1 : 0;
+}
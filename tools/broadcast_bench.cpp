@@ -0,0 +1,327 @@
+/*!
+ * @file
+ *
+ * @brief Host test of the tracking state broadcast against the nRF8001 model
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains a command line tool which checks the packing of
+ * broadcast records and runs the tracking loop's broadcast calls, the
+ * firmware's Bluetooth module and the Nordic driver against the
+ * nRF8001 model on virtual time, measuring what each fix costs.
+ *
+ * First a grid of positions, speeds and headings, including the
+ * limits and values past them, is packed with broadcast_update() and
+ * decoded as a scanner would. Each value must come back within half a
+ * unit of the format, clamped or wrapped as the format says.
+ *
+ * Then the loop runs as run_tracking() does with BLE_BROADCAST set:
+ * bluetooth_broadcast() once, broadcast_poll() on every pass and
+ * broadcast_update() after each fix of a made up ride. Each pass also
+ * does a set amount of other work. A phone scans the broadcast every
+ * advertising interval and checks each new record against the fix it
+ * was packed from, and that sequence numbers only go up.
+ *
+ * It prints the device time the broadcast calls add to a pass, for
+ * passes which pack a fix, which set a record and neither, along with
+ * the host time to pack a fix and the records set, coalesced and
+ * scanned. The device times count the SPI transfers and the nRF8001's
+ * command handling as the model assumes them, not the AVR's own
+ * instructions.
+ *
+ * The setup in services.h has no broadcast pipe yet, so one is added
+ * by host/broadcast_services.h, which must be force included.
+ *
+ * Build and run with
+ *    g++ -O2 -D__AVR__ -Ihost -I../libraries/nordic_bluetooth_driver -I../src \
+ *        -include Arduino.h -include broadcast_services.h -o broadcast_bench \
+ *        broadcast_bench.cpp host/host.cpp host/nrf8001_mock.cpp host/nrf8001_model.cpp \
+ *        ../src/bluetooth.cpp ../src/broadcast.cpp \
+ *        ../libraries/nordic_bluetooth_driver/{aci_queue,aci_setup,acilib,hal_aci_tl,lib_aci,bootloader_setup}.cpp
+ *    ./broadcast_bench [-n fixes] [-r rate_hz] [-i interval_ms] [-a adv_interval_ms] [-l loop_us]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "lib_aci.h"
+#include "services.h"
+#include "bluetooth.h"
+#include "broadcast.h"
+#include "nrf8001_model.h"
+
+#ifndef PIPE_GPS_WATCH_TRACKING_STATE_TX_BROADCAST
+#error "build with -include broadcast_services.h"
+#endif
+
+/* pins as wired in bluetooth.cpp */
+#define RDY 7
+#define REQ 9
+#define RST 10
+#define RDY_INTERRUPT_NUMBER 4
+
+#define BROADCAST_PIPE PIPE_GPS_WATCH_TRACKING_STATE_TX_BROADCAST
+
+/*!
+ * @brief struct holding the simulation parameters
+ */
+struct parameters_t {
+    long fixes;               /*!< Number of fixes */
+    unsigned long period;     /*!< Time between fixes, in us */
+    uint16_t interval;        /*!< Least time between records set, in ms */
+    uint16_t adv_interval;    /*!< Advertising interval, in ms */
+    unsigned long loop;       /*!< Other work in each pass of the loop, in us */
+};
+
+static parameters_t parameters = {3000, 200000, 1000, 500, 500};
+
+/*!
+ * @brief struct holding the time the broadcast calls add to passes
+ */
+struct added_t {
+    unsigned long long total;  /*!< Sum over the passes, in us */
+    unsigned long long most;   /*!< Most for one pass, in us */
+    long passes;               /*!< Number of passes */
+};
+
+enum pass_t {FIX_PASS, SET_PASS, IDLE_PASS, PASSES};
+static const char *pass_names[PASSES] = {"fix", "set", "idle"};
+static added_t added[PASSES];
+
+/*!
+ * @brief struct holding the values a record was packed from
+ */
+struct packed_t {
+    gps_data_t fix;
+    tracking_data_t data;
+};
+
+static packed_t packed[256];  /* fix of each sequence number */
+static long errors;
+
+/*!
+ * @brief Counts an error, printing the first few
+ */
+static void check(bool good, const char *what)
+{
+    if (!good) {
+        if (errors++ < 10) fprintf(stderr, "check failed: %s\n", what);
+    }
+}
+
+/*!
+ * @brief Decodes a little endian value of a record
+ */
+static uint32_t get(const uint8_t *record, int offset, int size)
+{
+    uint32_t value = 0;
+    for (int i = size - 1; i >= 0; i--) {
+        value = (value << 8) | record[offset + i];
+    }
+    return value;
+}
+
+/*!
+ * @brief Checks a decoded record against the values it was packed from
+ */
+static void check_record(const uint8_t *record, const gps_data_t *fix, const tracking_data_t *data)
+{
+    double latitude = (int32_t)get(record, BROADCAST_LATITUDE_OFFSET, 4)/(double)BROADCAST_DEGREE_SCALE;
+    double longitude = (int32_t)get(record, BROADCAST_LONGITUDE_OFFSET, 4)/(double)BROADCAST_DEGREE_SCALE;
+    double speed = get(record, BROADCAST_SPEED_OFFSET, 2)/(double)BROADCAST_SPEED_SCALE;
+    double heading = record[BROADCAST_HEADING_OFFSET]*360/256.0;
+
+    /* the AVR's floats hold about 7 digits, a little more than the
+       format gives a longitude */
+    double degree_error = 0.5/BROADCAST_DEGREE_SCALE + fabs(fix->location.longitude)*6e-8
+                          + fabs(fix->location.latitude)*6e-8;
+    check(fabs(latitude - fix->location.latitude) <= degree_error, "latitude");
+    check(fabs(longitude - fix->location.longitude) <= degree_error, "longitude");
+
+    double expected_speed = data->instant_speed < 0 ? 0 : data->instant_speed > 655.35 ? 655.35
+                            : data->instant_speed;
+    check(fabs(speed - expected_speed) <= 0.5/BROADCAST_SPEED_SCALE + 1e-6, "speed");
+
+    double heading_error = fabs(heading - fmod(data->heading, 360));
+    check(fmin(heading_error, 360 - heading_error) <= 180/256.0 + 1e-6, "heading");
+
+    check(record[BROADCAST_FLAGS_OFFSET] == (data->waypoint_done ? BROADCAST_WAYPOINT_DONE : 0),
+          "flags");
+}
+
+/*!
+ * @brief Packs a grid of values, including the limits, and checks each
+ */
+static long check_packing(void)
+{
+    static const float latitudes[] = {-90, -45.123456, -0.000004, 0, 0.000006, 45.5231, 89.99999, 90};
+    static const float longitudes[] = {-180, -122.6765, -0.5, 0, 0.000005, 12.34567, 179.99999, 180};
+    static const float speeds[] = {-1, 0, 0.004, 0.005, 12.345, 99.99, 655.34, 655.35, 700, NAN};
+    static const float headings[] = {0, 0.7, 1.41, 90, 180, 269.3, 359.2, 359.9};
+    long packs = 0;
+
+    broadcast_t broadcast;
+    broadcast_initialize(&broadcast, 0);
+    for (size_t a = 0; a < sizeof(latitudes)/sizeof(latitudes[0]); a++) {
+        for (size_t o = 0; o < sizeof(longitudes)/sizeof(longitudes[0]); o++) {
+            for (size_t s = 0; s < sizeof(speeds)/sizeof(speeds[0]); s++) {
+                for (size_t h = 0; h < sizeof(headings)/sizeof(headings[0]); h++) {
+                    gps_data_t fix = {};
+                    tracking_data_t data = {};
+                    fix.location.latitude = latitudes[a];
+                    fix.location.longitude = longitudes[o];
+                    data.instant_speed = speeds[s];
+                    data.heading = headings[h];
+                    data.waypoint_done = (packs % 3) == 0;
+                    broadcast_update(&broadcast, &fix, &data);
+                    if (isnan(data.instant_speed)) data.instant_speed = 0;
+                    check_record(broadcast.record, &fix, &data);
+                    packs++;
+                }
+            }
+        }
+    }
+    return packs;
+}
+
+/*!
+ * @brief Makes up the fix of a ride heading out in a slow curve
+ */
+static void make_fix(gps_data_t *fix, tracking_data_t *data, long n)
+{
+    memset(fix, 0, sizeof(*fix));
+    memset(data, 0, sizeof(*data));
+    fix->location.latitude = 45.5231 + n*1.3e-5*cos(n*0.001);
+    fix->location.longitude = -122.6765 + n*1.8e-5*sin(n*0.001);
+    data->instant_speed = 12 + (n % 50)*0.1;
+    data->heading = fmod(n*0.057, 360);
+    data->waypoint_done = (n % 1000) == 999;
+}
+
+/*!
+ * @brief Adds the time of one pass's broadcast calls
+ */
+static void account(pass_t pass, unsigned long long us)
+{
+    added[pass].total += us;
+    if (us > added[pass].most) added[pass].most = us;
+    added[pass].passes++;
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:i:a:l:")) != -1) {
+        switch (opt) {
+        case 'n': parameters.fixes = strtol(optarg, NULL, 10); break;
+        case 'r': parameters.period = atof(optarg) > 0 ? 1e6/atof(optarg) : 0; break;
+        case 'i': parameters.interval = strtoul(optarg, NULL, 10); break;
+        case 'a': parameters.adv_interval = strtoul(optarg, NULL, 10); break;
+        case 'l': parameters.loop = strtoul(optarg, NULL, 10); break;
+        default:
+            fprintf(stderr, "usage: %s [-n fixes] [-r rate_hz] [-i interval_ms] [-a adv_interval_ms]"
+                            " [-l loop_us]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (parameters.fixes <= 0 || parameters.period == 0 || parameters.adv_interval == 0
+        || parameters.loop == 0) {
+        fprintf(stderr, "%s: bad parameters\n", argv[0]);
+        return 1;
+    }
+
+    long packs = check_packing();
+    long packing_errors = errors;
+
+    host_virtual_time = true;
+    nrf8001_model_begin(RDY, REQ, RST, RDY_INTERRUPT_NUMBER);
+
+    /* run_tracking() wakes the nRF8001 and broadcasts before the loop */
+    bluetooth_t bluetooth;
+    bluetooth_setup(&bluetooth);
+    unsigned long long start = host_time_us;
+    check(bluetooth_broadcast(&bluetooth, parameters.adv_interval), "broadcast started");
+    unsigned long long start_us = host_time_us - start;
+    check(BROADCASTING == bluetooth_get_status(&bluetooth), "firmware broadcasting");
+    check(NRF8001_MODEL_BROADCASTING == nrf8001_model.mode, "nRF8001 broadcasting");
+
+    broadcast_t broadcast;
+    broadcast_initialize(&broadcast, parameters.interval);
+
+    unsigned long long next_fix = host_time_us;
+    unsigned long long next_scan = host_time_us;
+    unsigned long long pack_ns = 0;
+    long fix_count = 0, scanned = 0;
+    bool have_last = false;
+    uint8_t last_sequence = 0;
+    packed_t newest;  /* fix of the newest record, until it is set */
+
+    while (fix_count < parameters.fixes) {
+
+        /* the phone scans once an advertising interval */
+        if (host_time_us >= next_scan) {
+            uint8_t record[ACI_PIPE_TX_DATA_MAX_LEN];
+            uint8_t length = nrf8001_model_scan(BROADCAST_PIPE, record);
+            next_scan += parameters.adv_interval*1000UL;
+            if (length > 0 && (!have_last || record[BROADCAST_SEQUENCE_OFFSET] != last_sequence)) {
+                uint8_t sequence = record[BROADCAST_SEQUENCE_OFFSET];
+                check(BROADCAST_SIZE == length, "scanned length");
+                check(!have_last || (uint8_t)(sequence - last_sequence) < 128, "sequence goes up");
+                check_record(record, &packed[sequence].fix, &packed[sequence].data);
+                have_last = true;
+                last_sequence = sequence;
+                scanned++;
+            }
+        }
+
+        /* a pass of the loop */
+        uint16_t updates = broadcast.updates;
+        unsigned long long pass_start = host_time_us;
+        broadcast_poll(&broadcast, &bluetooth, millis());
+        pass_t pass = broadcast.updates != updates ? SET_PASS : IDLE_PASS;
+        if (SET_PASS == pass) {
+            packed[broadcast.sequence] = newest;
+        }
+        if (host_time_us >= next_fix) {
+            make_fix(&newest.fix, &newest.data, fix_count++);
+
+            struct timespec before, after;
+            clock_gettime(CLOCK_MONOTONIC, &before);
+            broadcast_update(&broadcast, &newest.fix, &newest.data);
+            clock_gettime(CLOCK_MONOTONIC, &after);
+            pack_ns += (after.tv_sec - before.tv_sec)*1000000000ULL + (after.tv_nsec - before.tv_nsec);
+            next_fix += parameters.period;
+            if (IDLE_PASS == pass) pass = FIX_PASS;
+        }
+        account(pass, host_time_us - pass_start);
+        host_time_us += parameters.loop;
+    }
+
+    /* run_tracking() puts the nRF8001 to sleep on the way out */
+    bluetooth_sleep(&bluetooth);
+    check(NRF8001_MODEL_SLEEP == nrf8001_model.mode, "nRF8001 asleep");
+
+    printf("pass\tpasses\tmean_us\tmax_us\n");
+    for (int pass = 0; pass < PASSES; pass++) {
+        printf("%s\t%ld\t%.1f\t%llu\n", pass_names[pass], added[pass].passes,
+               (double)added[pass].total/(added[pass].passes ? added[pass].passes : 1), added[pass].most);
+    }
+    printf("%ld packings checked with %ld errors; broadcast started in %.1f ms; packing a fix"
+           " takes %.0f ns on the host\n", packs, packing_errors, start_us/1000.0,
+           (double)pack_ns/parameters.fixes);
+    printf("%ld fixes at %.1f Hz, %u ms between records, %u ms advertising interval;"
+           " %u set, %u coalesced, %ld scanned; nRF8001 answered %lu commands with an error;"
+           " %ld errors\n", parameters.fixes, 1e6/parameters.period, parameters.interval,
+           parameters.adv_interval, broadcast.updates, broadcast.coalesced, scanned,
+           nrf8001_model.errors, errors);
+
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,631 @@
+/*!
+ * @file
+ *
+ * @brief Host simulation of a firmware update over Bluetooth
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains a command line tool which runs a whole firmware
+ * update against the nRF8001 model on virtual time and measures the
+ * throughput of the image transfer.
+ *
+ * The firmware's Bluetooth module runs as in run_bluetooth() until
+ * the phone writes DFU_START to the DFU control point, and
+ * bluetooth_enter_bootloader() hands the link over. The handover ends
+ * in the watchdog reset of bootloader_jump(), which resets into a
+ * stand-in for Nordic's DFU bootloader.
+ *
+ * The bootloader takes up the link from the settings
+ * bootloader_data_store() left in EEPROM, without a pin reset, and
+ * answers the phone as in dfu_format.h. It writes the
+ * image to flash a page at a time, and while a page is written it
+ * handles no events, which the nRF8001 and the driver's queue hold
+ * until they are full, when the phone's writes are held back.
+ *
+ * The phone writes up to a set number of packets in each connection
+ * event, and waits for a packet receipt every so many packets. At the
+ * end it checks the bootloader's flash against the image.
+ *
+ * It prints the handover time, the connection interval before and
+ * after it, and for the image transfer its time, throughput, packets
+ * per connection event and the writes held back. The flash page
+ * write time and the packets the nRF8001 takes in a connection event
+ * are assumptions, set from the command line.
+ *
+ * Build and run with
+ *    g++ -O2 -D__AVR__ -Ihost -I../libraries/nordic_bluetooth_driver -I../src \
+ *        -include Arduino.h -o dfu_bench dfu_bench.cpp host/host.cpp \
+ *        host/nrf8001_mock.cpp host/nrf8001_model.cpp ../src/bluetooth.cpp \
+ *        ../libraries/nordic_bluetooth_driver/{aci_queue,aci_setup,acilib,hal_aci_tl,lib_aci,bootloader_setup}.cpp
+ *    ./dfu_bench [-s image_bytes] [-k packets_per_event] [-p receipt_packets]
+ *                [-w page_write_us] [-c interval_ms]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <setjmp.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "avr/wdt.h"
+#include "EEPROM.h"
+#include "lib_aci.h"
+#include "bootloader_setup.h"
+#include "services.h"
+#include "bluetooth.h"
+#include "dfu_format.h"
+#include "nrf8001_model.h"
+
+/* pins as wired in bluetooth.cpp */
+#define RDY 7
+#define REQ 9
+#define RST 10
+#define RDY_INTERRUPT_NUMBER 4
+
+#define PACKET_PIPE PIPE_DEVICE_FIRMWARE_UPDATE_BLE_SERVICE_DFU_PACKET_RX
+#define CONTROL_TX_PIPE PIPE_DEVICE_FIRMWARE_UPDATE_BLE_SERVICE_DFU_CONTROL_POINT_TX
+#define CONTROL_RX_PIPE PIPE_DEVICE_FIRMWARE_UPDATE_BLE_SERVICE_DFU_CONTROL_POINT_RX_ACK_AUTO
+
+#define FLASH_SIZE 0x7000     /*!< Application flash below the bootloader, in bytes */
+#define PAGE_SIZE 128         /*!< Flash page of the ATmega32u4, in bytes */
+#define PACKET_SIZE 20        /*!< Image bytes in a full packet */
+#define LOOP_US 1000          /*!< Firmware main loop pass, in us */
+#define BOOT_LOOP_US 50       /*!< Bootloader main loop pass, in us */
+#define TIME_LIMIT 600000000ULL  /*!< Longest transfer simulated, in us */
+
+/*!
+ * @brief struct holding the simulation parameters
+ */
+struct parameters_t {
+    unsigned long size;        /*!< Image size, in bytes */
+    int per_event;             /*!< Packets the phone writes in a connection event at most */
+    uint16_t receipts;         /*!< Packets between packet receipts, 0 for none */
+    unsigned long page_us;     /*!< Time to erase and write a flash page, in us */
+    double interval_ms;        /*!< Connection interval the phone keeps to, 0 for any asked for */
+};
+
+static parameters_t parameters = {24576, 4, 10, 8000, 0};
+
+static long errors;
+
+/*!
+ * @brief Counts an error, printing the first few
+ */
+static void check(bool good, const char *what)
+{
+    if (!good) {
+        if (errors++ < 10) fprintf(stderr, "check failed: %s\n", what);
+    }
+}
+
+/*
+ * The handover
+ */
+
+extern uint16_t boot_key;
+
+static jmp_buf reset;
+
+/*!
+ * @brief Resets the AVR, into the bootloader
+ */
+static void watchdog_reset(void)
+{
+    longjmp(reset, 1);
+}
+
+/*!
+ * @brief struct holding the link settings the bootloader reads from EEPROM
+ */
+struct stored_t {
+    uint8_t valid_ble;
+    aci_pins_t pins;
+    uint8_t credits;
+    uint8_t pipes[3];
+};
+
+static stored_t stored;
+
+/*
+ * The bootloader
+ */
+
+enum boot_state_t {BOOT_SIZES, BOOT_WAITING, BOOT_IMAGE, BOOT_RECEIVED, BOOT_VALIDATED, BOOT_DONE};
+
+/*!
+ * @brief struct holding the state of the bootloader
+ */
+struct bootloader_t {
+    aci_state_t aci_state;
+    boot_state_t state;
+    uint32_t size;              /*!< Application image size */
+    uint32_t received;          /*!< Image bytes received */
+    uint16_t receipts;          /*!< Packets between receipts */
+    uint16_t packets;           /*!< Packets since the last receipt */
+    uint8_t page[PAGE_SIZE];    /*!< Page being filled */
+    uint8_t flash[FLASH_SIZE];  /*!< Application flash */
+    uint8_t pending[3][ACI_PIPE_TX_DATA_MAX_LEN];  /*!< Notifications waiting for a credit */
+    uint8_t pending_length[3];
+    uint8_t pending_count;
+    unsigned long pages;        /*!< Pages written */
+};
+
+static bootloader_t boot;
+static services_pipe_type_mapping_t boot_pipe_types[NUMBER_OF_PIPES] = SERVICES_PIPE_TYPE_MAPPING_CONTENT;
+
+/*!
+ * @brief Sends the notifications waiting, as credits allow
+ */
+static void boot_flush(void)
+{
+    while (boot.pending_count > 0 && boot.aci_state.data_credit_available > 0) {
+        if (!lib_aci_send_data(CONTROL_TX_PIPE, boot.pending[0], boot.pending_length[0])) {
+            return;
+        }
+        boot.aci_state.data_credit_available--;
+        boot.pending_count--;
+        memmove(boot.pending[0], boot.pending[1], sizeof(boot.pending[0])*boot.pending_count);
+        memmove(boot.pending_length, &boot.pending_length[1], boot.pending_count);
+    }
+}
+
+/*!
+ * @brief Queues a notification to the phone on the control point
+ */
+static void boot_notify(const uint8_t *data, uint8_t length)
+{
+    check(boot.pending_count < 3, "bootloader notifications");
+    if (boot.pending_count < 3) {
+        memcpy(boot.pending[boot.pending_count], data, length);
+        boot.pending_length[boot.pending_count++] = length;
+    }
+    boot_flush();
+}
+
+/*!
+ * @brief Answers a command of the phone
+ */
+static void boot_respond(uint8_t opcode, uint8_t status)
+{
+    uint8_t response[3] = {DFU_RESPONSE, opcode, status};
+    boot_notify(response, sizeof(response));
+}
+
+/*!
+ * @brief Writes the page being filled to flash
+ */
+static void boot_write_page(void)
+{
+    uint32_t address = (boot.received - 1) / PAGE_SIZE * PAGE_SIZE;
+    memcpy(&boot.flash[address], boot.page, PAGE_SIZE);
+    memset(boot.page, 0xFF, PAGE_SIZE);
+    boot.pages++;
+    host_time_us += parameters.page_us;
+}
+
+/*!
+ * @brief Takes a packet of the image
+ */
+static void boot_image(const uint8_t *data, uint8_t length)
+{
+    for (uint8_t i = 0; i < length && boot.received < boot.size; i++) {
+        boot.page[boot.received % PAGE_SIZE] = data[i];
+        boot.received++;
+        if (boot.received % PAGE_SIZE == 0 || boot.received == boot.size) {
+            boot_write_page();
+        }
+    }
+
+    if (boot.received == boot.size) {
+        boot.state = BOOT_RECEIVED;
+        boot_respond(DFU_RECEIVE_IMAGE, DFU_SUCCESS);
+    } else if (boot.receipts > 0 && ++boot.packets == boot.receipts) {
+        uint8_t receipt[5] = {DFU_PACKET_RECEIPT, (uint8_t)boot.received, (uint8_t)(boot.received >> 8),
+                              (uint8_t)(boot.received >> 16), (uint8_t)(boot.received >> 24)};
+        boot.packets = 0;
+        boot_notify(receipt, sizeof(receipt));
+    }
+}
+
+/*!
+ * @brief Takes a command of the phone
+ */
+static void boot_command(const uint8_t *data, uint8_t length)
+{
+    switch (data[DFU_OPCODE_OFFSET]) {
+    case DFU_PACKET_RECEIPT_REQUEST:
+        boot.receipts = length >= 3 ? data[1] | data[2] << 8 : 0;
+        boot.packets = 0;
+        break;
+    case DFU_RECEIVE_IMAGE:
+        if (BOOT_WAITING == boot.state) {
+            boot.state = BOOT_IMAGE;
+        } else {
+            boot_respond(DFU_RECEIVE_IMAGE, DFU_INVALID_STATE);
+        }
+        break;
+    case DFU_VALIDATE:
+        if (BOOT_RECEIVED == boot.state) {
+            boot.state = BOOT_VALIDATED;
+            boot_respond(DFU_VALIDATE, DFU_SUCCESS);
+        } else {
+            boot_respond(DFU_VALIDATE, DFU_INVALID_STATE);
+        }
+        break;
+    case DFU_ACTIVATE_AND_RESET:
+        if (BOOT_VALIDATED == boot.state) {
+            boot.state = BOOT_DONE;
+        }
+        break;
+    default:
+        boot_respond(data[DFU_OPCODE_OFFSET], DFU_NOT_SUPPORTED);
+        break;
+    }
+}
+
+/*!
+ * @brief Takes up the link after the reset, from the settings stored
+ */
+static void boot_start(void)
+{
+    memset(&boot, 0, sizeof(boot));
+    memset(boot.page, 0xFF, sizeof(boot.page));
+    memset(boot.flash, 0xFF, sizeof(boot.flash));
+    int address = E2END - BOOTLOADER_EEPROM_SIZE + 1;
+    stored.valid_ble = EEPROM.read(address++);
+    for (uint8_t i = 0; i < sizeof(aci_pins_t); i++) {
+        ((uint8_t*)&stored.pins)[i] = EEPROM.read(address++);
+    }
+    stored.credits = EEPROM.read(address++);
+    for (uint8_t i = 0; i < sizeof(stored.pipes); i++) {
+        stored.pipes[i] = EEPROM.read(address++);
+    }
+
+    boot.aci_state.aci_pins = stored.pins;
+    boot.aci_state.aci_setup_info.services_pipe_type_mapping = boot_pipe_types;
+    boot.aci_state.aci_setup_info.number_of_pipes = NUMBER_OF_PIPES;
+    boot.aci_state.data_credit_total = stored.credits;
+    boot.aci_state.data_credit_available = stored.credits;
+    lib_aci_resume(&boot.aci_state, false);
+}
+
+/*!
+ * @brief Runs a pass of the bootloader's main loop
+ */
+static void boot_poll(void)
+{
+    hal_aci_evt_t *aci_data = lib_aci_event_front(&boot.aci_state);
+    if (NULL != aci_data) {
+        aci_evt_t *aci_evt = &aci_data->evt;
+        switch (aci_evt->evt_opcode) {
+        case ACI_EVT_DATA_RECEIVED: {
+            const uint8_t pipe = aci_evt->params.data_received.rx_data.pipe_number;
+            const uint8_t *data = aci_evt->params.data_received.rx_data.aci_data;
+            const uint8_t length = aci_evt->len - 2;
+            if (PACKET_PIPE == pipe && BOOT_SIZES == boot.state && DFU_SIZES_SIZE == length) {
+                boot.size = data[DFU_SIZES_APPLICATION_OFFSET] | data[DFU_SIZES_APPLICATION_OFFSET + 1] << 8
+                            | (uint32_t)data[DFU_SIZES_APPLICATION_OFFSET + 2] << 16
+                            | (uint32_t)data[DFU_SIZES_APPLICATION_OFFSET + 3] << 24;
+                if (0 == boot.size || boot.size > FLASH_SIZE) {
+                    boot_respond(DFU_START, DFU_DATA_SIZE_EXCEEDS_LIMIT);
+                } else {
+                    boot.state = BOOT_WAITING;
+                    boot_respond(DFU_START, DFU_SUCCESS);
+                }
+            } else if (PACKET_PIPE == pipe && BOOT_IMAGE == boot.state) {
+                boot_image(data, length);
+            } else if (CONTROL_RX_PIPE == pipe && length > 0) {
+                boot_command(data, length);
+            } else {
+                check(false, "bootloader: packet out of turn");
+            }
+            break;
+        }
+        case ACI_EVT_DATA_CREDIT:
+            boot.aci_state.data_credit_available += aci_evt->params.data_credit.credit;
+            break;
+        case ACI_EVT_DISCONNECTED:
+            check(false, "bootloader: link lost");
+            boot.state = BOOT_DONE;
+            break;
+        default:
+            break;
+        }
+        lib_aci_event_consume();
+    }
+    boot_flush();
+}
+
+/*
+ * The phone
+ */
+
+enum phone_state_t {PHONE_IDLE, PHONE_START, PHONE_SIZES, PHONE_START_WAIT, PHONE_RECEIPTS, PHONE_RECEIVE, PHONE_IMAGE,
+                    PHONE_IMAGE_WAIT, PHONE_VALIDATE, PHONE_VALIDATE_WAIT, PHONE_ACTIVATE, PHONE_DONE};
+
+/*!
+ * @brief struct holding the state of the phone
+ */
+struct phone_t {
+    phone_state_t state;
+    uint8_t image[FLASH_SIZE];
+    uint32_t sent;                  /*!< Image bytes written */
+    uint16_t unconfirmed;           /*!< Packets written since the last receipt */
+    uint8_t response[3];            /*!< Last response notified */
+    bool responded;
+    unsigned long packets;          /*!< Image packets written */
+    unsigned long held;             /*!< Writes held back by flow control */
+    unsigned long events;           /*!< Connection events during the image */
+    unsigned long long started_at;  /*!< Time of DFU_START */
+    unsigned long long image_start; /*!< Time of DFU_RECEIVE_IMAGE */
+    unsigned long long image_end;   /*!< Time of the response to the image */
+};
+
+static phone_t phone;
+
+/*!
+ * @brief Takes the bootloader's notifications
+ */
+static void phone_notified(uint8_t pipe, const uint8_t *data, uint8_t length)
+{
+    check(CONTROL_TX_PIPE == pipe, "phone: notification pipe");
+    if (DFU_PACKET_RECEIPT == data[DFU_OPCODE_OFFSET] && 5 == length) {
+        uint32_t bytes = data[1] | data[2] << 8 | (uint32_t)data[3] << 16 | (uint32_t)data[4] << 24;
+        check(bytes <= phone.sent, "phone: receipt");
+        phone.unconfirmed = 0;
+    } else if (DFU_RESPONSE == data[DFU_OPCODE_OFFSET] && 3 == length) {
+        memcpy(phone.response, data, 3);
+        phone.responded = true;
+    } else {
+        check(false, "phone: notification");
+    }
+}
+
+/*!
+ * @brief Checks for the response to a command
+ */
+static bool phone_response(uint8_t opcode)
+{
+    if (!phone.responded) {
+        return false;
+    }
+    phone.responded = false;
+    check(opcode == phone.response[DFU_RESPONSE_OPCODE_OFFSET]
+          && DFU_SUCCESS == phone.response[DFU_RESPONSE_STATUS_OFFSET], "phone: response");
+    return true;
+}
+
+/*!
+ * @brief Writes to a pipe, counting writes held back
+ */
+static bool phone_write(uint8_t pipe, const uint8_t *data, uint8_t length)
+{
+    if (!nrf8001_model_write(pipe, data, length)) {
+        phone.held++;
+        return false;
+    }
+    return true;
+}
+
+/*!
+ * @brief Writes what the phone has to in one connection event
+ */
+static void phone_event(void)
+{
+    if (PHONE_IMAGE == phone.state || PHONE_IMAGE_WAIT == phone.state) {
+        phone.events++;
+    }
+
+    for (int written = 0; written < parameters.per_event; written++) {
+        switch (phone.state) {
+        case PHONE_IDLE:
+            return;
+        case PHONE_START: {
+            /* a write request, acknowledged in the connection event,
+               so the sizes follow in the next */
+            const uint8_t start[2] = {DFU_START, DFU_IMAGE_APPLICATION};
+            if (!phone_write(CONTROL_RX_PIPE, start, sizeof(start))) return;
+            phone.started_at = host_time_us;
+            phone.state = PHONE_SIZES;
+            return;
+        }
+        case PHONE_SIZES: {
+            uint8_t sizes[DFU_SIZES_SIZE] = {0};
+            for (int i = 0; i < 4; i++) sizes[DFU_SIZES_APPLICATION_OFFSET + i] = parameters.size >> (8*i);
+            if (!phone_write(PACKET_PIPE, sizes, sizeof(sizes))) return;
+            phone.state = PHONE_START_WAIT;
+            break;
+        }
+        case PHONE_START_WAIT:
+            if (!phone_response(DFU_START)) return;
+            phone.state = PHONE_RECEIPTS;
+            /* fall through */
+        case PHONE_RECEIPTS: {
+            uint8_t request[3] = {DFU_PACKET_RECEIPT_REQUEST, (uint8_t)parameters.receipts,
+                                  (uint8_t)(parameters.receipts >> 8)};
+            if (!phone_write(CONTROL_RX_PIPE, request, sizeof(request))) return;
+            phone.state = PHONE_RECEIVE;
+            break;
+        }
+        case PHONE_RECEIVE: {
+            uint8_t command = DFU_RECEIVE_IMAGE;
+            if (!phone_write(CONTROL_RX_PIPE, &command, 1)) return;
+            phone.image_start = host_time_us;
+            phone.state = PHONE_IMAGE;
+            break;
+        }
+        case PHONE_IMAGE: {
+            if (parameters.receipts > 0 && phone.unconfirmed >= parameters.receipts) return;
+            uint8_t length = parameters.size - phone.sent < PACKET_SIZE ? parameters.size - phone.sent : PACKET_SIZE;
+            if (!phone_write(PACKET_PIPE, &phone.image[phone.sent], length)) return;
+            phone.sent += length;
+            phone.unconfirmed++;
+            phone.packets++;
+            if (phone.sent == parameters.size) phone.state = PHONE_IMAGE_WAIT;
+            break;
+        }
+        case PHONE_IMAGE_WAIT:
+            if (!phone_response(DFU_RECEIVE_IMAGE)) return;
+            phone.image_end = host_time_us;
+            phone.state = PHONE_VALIDATE;
+            /* fall through */
+        case PHONE_VALIDATE: {
+            uint8_t command = DFU_VALIDATE;
+            if (!phone_write(CONTROL_RX_PIPE, &command, 1)) return;
+            phone.state = PHONE_VALIDATE_WAIT;
+            break;
+        }
+        case PHONE_VALIDATE_WAIT:
+            if (!phone_response(DFU_VALIDATE)) return;
+            phone.state = PHONE_ACTIVATE;
+            /* fall through */
+        case PHONE_ACTIVATE: {
+            uint8_t command = DFU_ACTIVATE_AND_RESET;
+            if (!phone_write(CONTROL_RX_PIPE, &command, 1)) return;
+            phone.state = PHONE_DONE;
+            return;
+        }
+        case PHONE_DONE:
+            return;
+        }
+    }
+}
+
+static unsigned long long next_event;    /*!< Time of the next connection event */
+static void (*model_io_hook)(void);
+
+/*!
+ * @brief Runs the connection events due, the phone writing in each
+ */
+static void phone_poll(void)
+{
+    static bool polling;
+
+    if (polling) {
+        return;
+    }
+    polling = true;
+    while (host_time_us >= next_event) {
+        nrf8001_model_connection_event();
+        phone_event();
+        next_event += nrf8001_model.interval*1250UL;
+    }
+    polling = false;
+}
+
+/*!
+ * @brief Plays the nRF8001 and the phone on the pins
+ */
+static void io_hook(void)
+{
+    model_io_hook();
+    phone_poll();
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:k:p:w:c:")) != -1) {
+        switch (opt) {
+        case 's': parameters.size = strtoul(optarg, NULL, 10); break;
+        case 'k': parameters.per_event = atoi(optarg); break;
+        case 'p': parameters.receipts = strtoul(optarg, NULL, 10); break;
+        case 'w': parameters.page_us = strtoul(optarg, NULL, 10); break;
+        case 'c': parameters.interval_ms = atof(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-s image_bytes] [-k packets_per_event] [-p receipt_packets]"
+                            " [-w page_write_us] [-c interval_ms]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (parameters.size == 0 || parameters.size > FLASH_SIZE || parameters.per_event <= 0
+        || parameters.interval_ms < 0) {
+        fprintf(stderr, "%s: bad parameters\n", argv[0]);
+        return 1;
+    }
+
+    srand(1);
+    for (unsigned long i = 0; i < parameters.size; i++) {
+        phone.image[i] = rand();
+    }
+
+    host_virtual_time = true;
+    nrf8001_model_begin(RDY, REQ, RST, RDY_INTERRUPT_NUMBER);
+    nrf8001_model.data_handler = phone_notified;
+    model_io_hook = host_io_hook;
+    host_io_hook = io_hook;
+    host_watchdog_reset = watchdog_reset;
+
+    /* run_bluetooth() advertises and the phone connects, enabling
+       notifications of the DFU control point */
+    bluetooth_t bluetooth;
+    bluetooth_setup(&bluetooth);
+    bluetooth_advertise(&bluetooth);
+    check(nrf8001_model_connect(), "phone connected");
+    check(nrf8001_model_open_pipe(CONTROL_TX_PIPE), "control point opened");
+    for (int i = 0; i < 16; i++) {
+        bluetooth_poll(&bluetooth);
+    }
+    uint16_t interval_before = nrf8001_model.interval;
+
+    /* the phone asks for the update at its next connection event, and
+       the main loop hands over */
+    phone.state = PHONE_START;
+    next_event = host_time_us + nrf8001_model.interval*1250UL;
+    if (0 == setjmp(reset)) {
+        while (host_time_us < TIME_LIMIT) {
+            bluetooth_poll(&bluetooth);
+            if (bluetooth_dfu_requested(&bluetooth)) {
+                bluetooth_enter_bootloader(&bluetooth);
+                check(false, "handover returned");
+                break;
+            }
+            delay(LOOP_US/1000);
+        }
+        check(false, "handed over");
+        return 1;
+    }
+    unsigned long long handover_us = host_time_us - phone.started_at;
+
+    /* the bootloader takes up the link, with the phone's writes since
+       the handover waiting */
+    check((MCUSR & 1 << WDRF) && BOOTLOADER_KEY == boot_key, "reset into the bootloader");
+    boot_start();
+    check(1 == stored.valid_ble && PACKET_PIPE == stored.pipes[0] && CONTROL_TX_PIPE == stored.pipes[1]
+          && CONTROL_RX_PIPE == stored.pipes[2], "pipes stored");
+    check(NRF8001_MODEL_CREDITS == stored.credits && 0 == nrf8001_model.credits_used, "credits back");
+    check(NRF8001_MODEL_CONNECTED == nrf8001_model.mode, "still connected");
+    if (parameters.interval_ms > 0) {
+        nrf8001_model.interval = parameters.interval_ms/1.25 + 0.5;
+    }
+    while (PHONE_DONE != phone.state && host_time_us - phone.started_at < TIME_LIMIT) {
+        boot_poll();
+        host_time_us += BOOT_LOOP_US;
+        phone_poll();
+    }
+    /* let the bootloader take the last command */
+    for (int pass = 0; pass < 100 && BOOT_DONE != boot.state; pass++) {
+        boot_poll();
+    }
+
+    check(PHONE_DONE == phone.state && BOOT_DONE == boot.state, "update finished");
+    check(boot.received == parameters.size
+          && memcmp(boot.flash, phone.image, parameters.size) == 0, "image in flash");
+
+    double image_s = (phone.image_end - phone.image_start)/1e6;
+    printf("handover_ms\tinterval_ms\timage_s\tbytes_per_s\tpackets_per_event\theld\tpages\n");
+    printf("%.1f\t%.2f->%.2f\t%.2f\t%.0f\t%.2f\t%lu\t%lu\n", handover_us/1000.0,
+           interval_before*1.25, nrf8001_model.interval*1.25, image_s,
+           image_s > 0 ? parameters.size/image_s : 0,
+           phone.events ? (double)phone.packets/phone.events : 0, phone.held, boot.pages);
+    printf("%lu byte image, up to %d packets a connection event, receipt every %u packets,"
+           " %lu us page write; nRF8001 answered %lu commands with an error, lost %lu events;"
+           " %ld errors\n", parameters.size, parameters.per_event, parameters.receipts,
+           parameters.page_us, nrf8001_model.errors, nrf8001_model.lost, errors);
+
+    return errors ? 1 : 0;
+}
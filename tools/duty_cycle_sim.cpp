@@ -0,0 +1,278 @@
+/*!
+ * @file
+ *
+ * @brief Host tool simulating GPS duty cycling on recorded rides
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains a command line tool which replays recorded 1 Hz
+ * NMEA logs twice through the firmware's tracking code: once with
+ * every fix, as with the GPS fully on, and once with the fixes a GPS
+ * in periodic standby would have delivered, with the sleep chosen by
+ * duty_cycle_update() after each fix as in tracking mode.
+ *
+ * The GPS is modelled as tracking for DUTY_CYCLE_RUN_TIME each period
+ * and sleeping in between. After sleeping, fixes are only delivered
+ * once it has reacquired (REACQUIRE_TIME). A new mode takes effect at
+ * the fix which chose it.
+ *
+ * For each ride it prints the share of time the GPS was on, the
+ * number of mode changes sent, and the distance, average speed and
+ * waypoints passed with duty cycling against the fully on replay.
+ * The average GPS current is estimated from the receiver's datasheet
+ * figures for tracking and standby.
+ *
+ * A ride which ends while the GPS sleeps loses the distance covered
+ * since its last fix, up to DUTY_CYCLE_STEP_DISTANCE.
+ *
+ * Build and run with
+ *    g++ -O2 -Ihost -I../src -o duty_cycle_sim duty_cycle_sim.cpp \
+ *        host/host.cpp host/nmea_corpus.cpp ../src/gps.cpp ../src/haversine.cpp \
+ *        ../src/fix_filter.cpp ../src/kalman_filter.cpp ../src/tracking.cpp \
+ *        ../src/waypoint_reader.cpp ../src/duty_cycle.cpp
+ *    ./duty_cycle_sim -r route.bin logs/ride_*.nmea
+ *
+ * With -s ms a fixed sleep is used instead of the adaptive one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "avr/eeprom.h"
+#include "duty_cycle.h"
+#include "gps.h"
+#include "nmea_corpus.h"
+#include "tracking.h"
+
+#define REACQUIRE_TIME 1000   /*!< Time to the first fix after sleeping, in ms */
+#define TRACKING_CURRENT 20.0 /*!< GPS current while tracking, in mA */
+#define STANDBY_CURRENT 0.2   /*!< GPS current in standby, in mA */
+
+/*!
+ * @brief struct holding the results of one replay
+ */
+struct replay_t {
+    bool ok;                   /*!< Flag indicating the log could be read */
+    long epochs;               /*!< Number of epochs in the log */
+    long awake;                /*!< Number of epochs the GPS was on for, with or without a fix */
+    long changes;              /*!< Number of mode changes sent */
+    tracking_data_t data;      /*!< Tracking data at the end of the ride */
+    uint32_t waypoints_passed; /*!< Number of waypoints reached */
+};
+
+/*!
+ * @brief struct modelling a GPS in periodic standby
+ */
+struct receiver_t {
+    uint32_t start;   /*!< Time the current mode took effect, in ms */
+    uint16_t sleep;   /*!< Sleep of the current mode, in ms, or 0 */
+};
+
+/* Fixed sleep from -s, or 0 for the adaptive sleep */
+static unsigned long fixed_sleep = 0;
+
+/*!
+ * @brief Counts the waypoints reached in a tracking session
+ *
+ * @param[in]  tracking  Pointer to tracking struct at the end of the ride
+ *
+ * @returns    Number of waypoints reached
+ *
+ */
+static uint32_t waypoints_passed(tracking_t *tracking)
+{
+    uint32_t count = waypoint_reader_count(&tracking->waypoint_reader);
+    if (count == 0) return 0;
+    if (tracking->data.waypoint_done) return count;
+
+    /* the reader has moved one past each waypoint reached, plus the current one */
+    uint32_t read = ((uintptr_t)tracking->waypoint_reader.ptr - 0x4)/8;
+    return read - 1;
+}
+
+/*!
+ * @brief Checks whether the modelled GPS is on
+ *
+ * @param[in]  receiver  Pointer to receiver model
+ * @param[in]  now       Time, in ms
+ *
+ * @returns    True if the GPS is tracking or reacquiring at that time
+ *
+ */
+static bool is_on(const receiver_t *receiver, uint32_t now)
+{
+    if (receiver->sleep == 0) return true;
+    return (now - receiver->start) % (DUTY_CYCLE_RUN_TIME + receiver->sleep)
+        < DUTY_CYCLE_RUN_TIME;
+}
+
+/*!
+ * @brief Checks whether the modelled GPS delivers a fix
+ *
+ * @param[in]  receiver  Pointer to receiver model
+ * @param[in]  now       Time of the fix, in ms
+ *
+ * @returns    True if the GPS is on and has reacquired at that time
+ *
+ */
+static bool has_fix(const receiver_t *receiver, uint32_t now)
+{
+    if (!is_on(receiver, now)) return false;
+    if (receiver->sleep == 0) return true;
+
+    /* the gps already has a fix in the run the mode was set in */
+    uint32_t since = now - receiver->start;
+    uint32_t period = DUTY_CYCLE_RUN_TIME + receiver->sleep;
+    return since < period || since % period >= REACQUIRE_TIME;
+}
+
+/*!
+ * @brief Replays a log through the tracking code
+ *
+ * @param[in]  path    Path of the log
+ * @param[in]  duty    Flag to duty cycle the GPS
+ *
+ * @returns    Results of the replay
+ *
+ */
+static replay_t replay(const char *path, bool duty)
+{
+    replay_t result = {};
+
+    nmea_corpus_t corpus;
+    if (!nmea_corpus_open(&corpus, path)) return result;
+
+    tracking_t tracking;
+    tracking_initialize(&tracking);
+    duty_cycle_t duty_cycle;
+    duty_cycle_initialize(&duty_cycle);
+    receiver_t receiver = {0, 0};
+    gps_t gps;
+    gps_reset_epoch(&gps);
+    nmea_sentence_t sentence;
+
+    while (nmea_corpus_next(&corpus, &sentence)) {
+        if (!sentence.checksum_ok) continue;
+        nmea_sentence_to_gps(&sentence, &gps);
+        if (!gps_assemble(&gps)) continue;
+
+        result.epochs++;
+        uint32_t now = gps.fix.time*1000 + gps.fix.milliseconds;
+        if (duty && !is_on(&receiver, now)) continue;
+        result.awake++;
+        if (duty && !has_fix(&receiver, now)) continue;
+
+        if (!tracking_update(&tracking, &gps) || !duty) continue;
+
+        /* choose the next mode as tracking mode does */
+        boolean changed;
+        if (fixed_sleep) {
+            changed = duty_cycle.sleep != fixed_sleep;
+            duty_cycle.sleep = fixed_sleep;
+        } else {
+            changed = duty_cycle_update(&duty_cycle, &tracking.data);
+        }
+        if (changed) {
+            receiver.start = now;
+            receiver.sleep = duty_cycle.sleep;
+            result.changes++;
+        }
+    }
+
+    result.ok = true;
+    result.data = tracking.data;
+    result.waypoints_passed = waypoints_passed(&tracking);
+
+    nmea_corpus_close(&corpus);
+    return result;
+}
+
+/*!
+ * @brief Loads a waypoint image into the emulated EEPROM
+ *
+ * @param[in]  path  Path of the image
+ *
+ * @returns    True on success
+ *
+ */
+static bool load_route(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return false;
+    fread(host_eeprom, 1, sizeof(host_eeprom), file);
+    fclose(file);
+    return true;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-r route.bin] [-s sleep_ms] log...\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:s:")) != -1) {
+        switch (opt) {
+        case 'r':
+            if (!load_route(optarg)) {
+                perror(optarg);
+                return 1;
+            }
+            break;
+        case 's': fixed_sleep = strtoul(optarg, NULL, 10); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    uint32_t waypoint_count = host_eeprom[0] ? host_eeprom[1] : 0;
+    long epochs = 0, awake = 0;
+    double full_distance = 0, duty_distance = 0;
+    int status = 0;
+
+    printf("file\ton_%%\tchanges\tdistance_m\tduty_distance_m\terror_%%"
+           "\taverage_mph\tduty_average_mph\twaypoints\tduty_waypoints\n");
+    for (int i = optind; i < argc; i++) {
+        replay_t full = replay(argv[i], false);
+        replay_t duty = replay(argv[i], true);
+        if (!full.ok || !duty.ok) {
+            perror(argv[i]);
+            status = 1;
+            continue;
+        }
+
+        double error = full.data.total_distance > 0
+            ? (duty.data.total_distance/full.data.total_distance - 1)*100 : 0.0;
+        printf("%s\t%.1f\t%ld\t%.0f\t%.0f\t%+.1f\t%.1f\t%.1f\t%u/%u\t%u/%u\n", argv[i],
+               duty.epochs ? 100.0*duty.awake/duty.epochs : 0.0, duty.changes,
+               full.data.total_distance, duty.data.total_distance, error,
+               full.data.average_speed, duty.data.average_speed,
+               full.waypoints_passed, waypoint_count,
+               duty.waypoints_passed, waypoint_count);
+
+        epochs += duty.epochs;
+        awake += duty.awake;
+        full_distance += full.data.total_distance;
+        duty_distance += duty.data.total_distance;
+    }
+
+    if (epochs > 0) {
+        double on = (double)awake/epochs;
+        fprintf(stderr, "GPS on %.1f%% of the time, %.1f mA average against %.1f mA "
+                "fully on; %.0f m tracked against %.0f m fully on\n", on*100,
+                on*TRACKING_CURRENT + (1 - on)*STANDBY_CURRENT, TRACKING_CURRENT,
+                duty_distance, full_distance);
+    }
+
+    return status;
+}
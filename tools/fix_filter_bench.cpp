@@ -0,0 +1,296 @@
+/*!
+ * @file
+ *
+ * @brief Host tool measuring tracking error with and without filtering
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains a command line tool which synthesizes rides with
+ * a known path, adds GPS noise (correlated between fixes, as GPS
+ * errors drift rather than jump), HDOP spikes and outliers, and replays
+ * them as GGA and RMC datastrings through the firmware's gps and
+ * tracking code. For each ride it prints the true distance, the
+ * distance from summing every valid fix (as before filtering) and the
+ * distance tracked through the fix and Kalman filters, followed by the
+ * RMS position and speed errors of raw and tracked fixes.
+ *
+ * The time per kalman_filter_update() call is also reported. This is
+ * host time, useful to compare changes; the device runs the same code
+ * in 32 bit fixed point apart from the conversions to and from
+ * latitude/longitude, speed and heading.
+ *
+ * Rides are:
+ *   stationary  10 minutes stopped
+ *   moving      30 minutes at 10 mph around a loop, with a 2 minute stop
+ *
+ * Build and run with
+ *    g++ -O2 -Ihost -I../src -o fix_filter_bench fix_filter_bench.cpp \
+ *        host/host.cpp ../src/gps.cpp ../src/haversine.cpp ../src/fix_filter.cpp \
+ *        ../src/kalman_filter.cpp ../src/tracking.cpp ../src/waypoint_reader.cpp
+ *    ./fix_filter_bench [-s seed] [-w directory]
+ *
+ * With -w the noisy rides are also written as NMEA logs, which can be
+ * replayed with ride_analyzer.
+ */
+
+#include <math.h>
+#include <random>
+
+#include <stdio.h>
+#include <time.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "gps.h"
+#include "haversine.h"
+#include "kalman_filter.h"
+#include "tracking.h"
+
+#define METRES_PER_DEGREE 111194.9  /*!< Length of a degree of latitude, in metres */
+#define ORIGIN_LATITUDE 45.5
+#define ORIGIN_LONGITUDE -122.6
+#define NOISE 3.0                   /*!< Standard deviation of position noise, in metres */
+#define NOISE_CORRELATION 0.95      /*!< Correlation of position noise between fixes */
+#define OUTLIER_EVERY 97            /*!< Fixes between outliers */
+#define OUTLIER_DISTANCE 150.0      /*!< Size of an outlier jump, in metres */
+#define SPIKE_EVERY 61              /*!< Fixes between HDOP spikes */
+
+/*!
+ * @brief struct holding a synthetic ride's results
+ */
+struct result_t {
+    double truth;     /*!< Length of the true path, in metres */
+    double raw;       /*!< Sum of steps between all valid fixes, in metres */
+    double filtered;  /*!< Distance tracked with filtering, in metres */
+    double raw_position;      /*!< RMS position error of valid fixes, in metres */
+    double tracked_position;  /*!< RMS position error of tracked fixes, in metres */
+    double raw_speed;         /*!< RMS speed error of valid fixes, in mph */
+    double tracked_speed;     /*!< RMS speed error of tracked fixes, in mph */
+};
+
+/*!
+ * @brief Accumulator for a root mean square
+ */
+struct rms_t {
+    double sum;
+    long count;
+
+    void add(double error) { sum += error*error; count++; }
+    double value(void) const { return count ? sqrt(sum/count) : 0.0; }
+};
+
+/*!
+ * @brief Formats a coordinate as NMEA (d)ddmm.mmmm,H
+ */
+static void format_coordinate(char *buffer, size_t size, double degrees,
+                              int degree_digits, char positive, char negative)
+{
+    char hemisphere = degrees < 0 ? negative : positive;
+    degrees = fabs(degrees);
+    int whole = (int)degrees;
+    double minutes = (degrees - whole)*60;
+    snprintf(buffer, size, "%0*d%07.4f,%c", degree_digits, whole, minutes, hemisphere);
+}
+
+/*!
+ * @brief Writes a datastring with its checksum into a gps struct and a log
+ */
+static void put_sentence(gps_t *gps, FILE *log, const char *body)
+{
+    uint8_t checksum = 0;
+    for (const char *c = body; *c; c++) checksum ^= *c;
+    char line[2*NMEA_LINE_LENGTH + 8];
+    snprintf(line, sizeof(line), "$%s*%02X", body, checksum);
+    if (log != NULL) fprintf(log, "%s\r\n", line);
+
+    /* the firmware keeps the first NMEA_LINE_LENGTH characters of a line */
+    size_t length = min(strlen(line), (size_t)NMEA_LINE_LENGTH);
+    memcpy(gps->nmea, line, length);
+    gps->nmea[length] = '\0';
+}
+
+/*!
+ * @brief Synthesizes a ride and replays it through the tracking code
+ *
+ * @param[in]  moving  Flag to ride the loop, otherwise stay stopped
+ * @param[in]  seed    Seed of the noise
+ * @param[in]  log     Log to write the datastrings to, or NULL
+ *
+ * @returns    True, raw and filtered distances
+ *
+ */
+static result_t run_ride(bool moving, unsigned seed, FILE *log)
+{
+    std::mt19937 random(seed);
+    std::normal_distribution<double> noise(0, NOISE);
+    std::normal_distribution<double> speed_noise(0, 0.3);
+
+    tracking_t tracking;
+    tracking_initialize(&tracking);
+    gps_t gps;
+    gps_reset_epoch(&gps);
+
+    result_t result = {};
+    rms_t raw_position = {}, tracked_position = {}, raw_speed = {}, tracked_speed = {};
+    const double scale = METRES_PER_DEGREE*cos(ORIGIN_LATITUDE*M_PI/180);
+    const int duration = moving ? 1800 : 600;
+    const double radius = 400;
+
+    point_t previous_truth = {0, 0}, previous_raw = {0, 0};
+    double angle = 0;
+    double drift_east = 0, drift_north = 0;
+    const double innovation = sqrt(1 - NOISE_CORRELATION*NOISE_CORRELATION);
+
+    for (int t = 0; t <= duration; t++) {
+        /* 10 mph around a loop, stopped for two minutes half way */
+        double speed = moving && (t < 900 || t >= 1020) ? 4.4704 : 0;
+        angle += speed/radius;
+        double east = radius*sin(angle), north = radius - radius*cos(angle);
+
+        point_t truth = {(float)(ORIGIN_LATITUDE + north/METRES_PER_DEGREE),
+                         (float)(ORIGIN_LONGITUDE + east/scale)};
+        if (t > 0) result.truth += distance_between(previous_truth, truth);
+        previous_truth = truth;
+
+        drift_east = NOISE_CORRELATION*drift_east + innovation*noise(random);
+        drift_north = NOISE_CORRELATION*drift_north + innovation*noise(random);
+
+        double hdop = 0.9;
+        double error_east = drift_east, error_north = drift_north;
+        if (t % SPIKE_EVERY == SPIKE_EVERY - 1) {
+            hdop = 8.0;
+            error_east += 8*noise(random);
+            error_north += 8*noise(random);
+        }
+        if (t % OUTLIER_EVERY == OUTLIER_EVERY - 1) {
+            error_east += OUTLIER_DISTANCE;
+        }
+
+        char time[16], date[8], latitude[20], longitude[20], body[2*NMEA_LINE_LENGTH];
+        int clock = 36000 + t;
+        snprintf(time, sizeof(time), "%02d%02d%02d.000", clock/3600, clock/60 % 60, clock % 60);
+        snprintf(date, sizeof(date), "181015");
+        format_coordinate(latitude, sizeof(latitude),
+                          ORIGIN_LATITUDE + (north + error_north)/METRES_PER_DEGREE, 2, 'N', 'S');
+        format_coordinate(longitude, sizeof(longitude),
+                          ORIGIN_LONGITUDE + (east + error_east)/scale, 3, 'E', 'W');
+        double knots = fabs(speed/0.514444 + speed_noise(random));
+
+        /* course of the loop's tangent; a stopped receiver reports any course */
+        double course = speed > 0 ? 90 - angle*180/M_PI + 3*noise(random)/NOISE
+                                  : 360*(random() % 3600)/3600.0;
+        course = fmod(fmod(course, 360) + 360, 360);
+
+        snprintf(body, sizeof(body), "GPGGA,%s,%s,%s,1,08,%.2f,50.0,M,-19.6,M,,",
+                 time, latitude, longitude, hdop);
+        put_sentence(&gps, log, body);
+        gps_assemble(&gps);
+
+        snprintf(body, sizeof(body), "GPRMC,%s,A,%s,%s,%.2f,%.1f,%s,,,A",
+                 time, latitude, longitude, knots, course, date);
+        put_sentence(&gps, log, body);
+        if (!gps_assemble(&gps)) continue;
+
+        /* every valid fix, as tracked before filtering */
+        double true_mph = speed/0.44704;
+        if (gps_valid(&gps)) {
+            gps_data_t data;
+            gps_parse(&gps, &data);
+            if (previous_raw.latitude != 0) {
+                result.raw += distance_between(previous_raw, data.location);
+            }
+            previous_raw = data.location;
+            raw_position.add(distance_between(truth, data.location));
+            raw_speed.add(data.speed - true_mph);
+        }
+
+        if (tracking_update(&tracking, &gps)) {
+            tracked_position.add(distance_between(truth, tracking.gps_data.location));
+            tracked_speed.add(tracking.data.instant_speed - true_mph);
+        }
+    }
+
+    result.filtered = tracking.data.total_distance;
+    result.raw_position = raw_position.value();
+    result.tracked_position = tracked_position.value();
+    result.raw_speed = raw_speed.value();
+    result.tracked_speed = tracked_speed.value();
+    return result;
+}
+
+/*!
+ * @brief Measures the time taken by kalman_filter_update()
+ *
+ * @returns    Time per call, in ns
+ *
+ */
+static double time_kalman(void)
+{
+    const long calls = 1000000;
+    kalman_filter_t filter;
+    kalman_filter_initialize(&filter);
+    gps_data_t data = {};
+
+    struct timespec start, done;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < calls; i++) {
+        data.location.latitude = ORIGIN_LATITUDE + (i % 100)*1e-5;
+        data.location.longitude = ORIGIN_LONGITUDE + (i % 77)*1e-5;
+        data.time = i;
+        data.hdop = 0.9;
+        kalman_filter_update(&filter, &data);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &done);
+
+    return ((done.tv_sec - start.tv_sec)*1e9 + (done.tv_nsec - start.tv_nsec))/calls;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned seed = 1;
+    const char *directory = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:w:")) != -1) {
+        switch (opt) {
+        case 's': seed = strtoul(optarg, NULL, 10); break;
+        case 'w': directory = optarg; break;
+        default:
+            fprintf(stderr, "usage: %s [-s seed] [-w directory]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("ride\ttruth_m\traw_m\traw_error\tfiltered_m\tfiltered_error"
+           "\traw_rms_m\ttracked_rms_m\traw_rms_mph\ttracked_rms_mph\n");
+    for (int moving = 0; moving <= 1; moving++) {
+        const char *name = moving ? "moving" : "stationary";
+
+        FILE *log = NULL;
+        if (directory != NULL) {
+            char path[512];
+            snprintf(path, sizeof(path), "%s/%s.nmea", directory, name);
+            log = fopen(path, "w");
+            if (log == NULL) {
+                perror(path);
+                return 1;
+            }
+        }
+
+        result_t result = run_ride(moving, seed, log);
+        if (log != NULL) fclose(log);
+
+        printf("%s\t%.0f\t%.0f\t%+.0f\t%.0f\t%+.0f\t%.1f\t%.1f\t%.2f\t%.2f\n",
+               name, result.truth, result.raw, result.raw - result.truth,
+               result.filtered, result.filtered - result.truth,
+               result.raw_position, result.tracked_position,
+               result.raw_speed, result.tracked_speed);
+    }
+
+    fprintf(stderr, "%.0f ns per kalman_filter_update()\n", time_kalman());
+    return 0;
+}
@@ -0,0 +1,426 @@
+/*!
+ * @file
+ *
+ * @brief Host simulation of GPS bring-up against a scripted receiver
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains a command line tool which runs the firmware's
+ * PMTK command engine (gps_initialize() and gps_initialize_poll())
+ * against a fake GPS receiver on Serial1, on virtual time, through a
+ * list of scripted scenarios. Some scenarios then go on tracking, and
+ * set periodic mode while fixes arrive, as run_tracking() does.
+ *
+ * The receiver answers PMTK commands after a set delay: $PMTK001
+ * acknowledgements for set commands, $PMTK705 for the release query,
+ * and nothing for baud rate changes, which it takes once the command
+ * is in. It sends its startup notifications when woken, and RMC and
+ * GGA datastrings at the update rate in effect. Bytes sent or received
+ * while the port and the receiver disagree on the baud rate are lost.
+ * Each scenario scripts faults on top of that: replies lost, commands
+ * rejected, stray acknowledgements of other commands, a receiver which
+ * never answers or keeps its baud rate.
+ *
+ * For each scenario it prints the status the engine ended with, the
+ * update interval and baud rate in effect, the commands sent and the
+ * time taken, and checks them against what the scenario expects. The
+ * progress shown while waiting must only move forward, and no poll may
+ * take any time. While tracking, the periodic mode command must end
+ * as expected and every fix the receiver sends must come out of
+ * gps_available(), one second after the last. Failed checks are
+ * printed and the exit status is 1.
+ *
+ * Build and run with
+ *    g++ -O2 -Ihost -I../src -o gps_command_sim gps_command_sim.cpp \
+ *        host/host.cpp ../src/gps.cpp
+ *    ./gps_command_sim [-v]
+ *
+ * With -v every line sent and received is printed.
+ */
+
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "gps.h"
+
+#define REPLY_MS 20         /*!< Time the receiver takes to answer a command */
+#define STEP_US 1000        /*!< Time between polls */
+#define TIME_LIMIT_MS 60000 /*!< Longest a scenario runs */
+#define TRACK_MS 10000      /*!< Time tracked after bring-up */
+#define PERIODIC_AT_MS 3000 /*!< Time into tracking periodic mode is set */
+
+#define NO_ID -1
+
+/*!
+ * @brief struct holding the faults a scenario scripts and what it expects
+ */
+struct scenario_t {
+    const char *name;
+    boolean fast;                /*!< Bring up high rate mode */
+    boolean asleep;              /*!< Receiver starts in standby, the first line only wakes it */
+    int lose_id;                 /*!< Command whose first replies are lost, or NO_ID */
+    int lose_count;              /*!< Replies of lose_id lost */
+    const char *reject;          /*!< Start of a command rejected with flag 2, or NULL */
+    int stray_id;                /*!< Command acknowledged unasked before each reply, or NO_ID */
+    boolean silent;              /*!< Receiver never answers */
+    boolean fixed_baud;          /*!< Receiver ignores baud rate changes */
+    boolean periodic;            /*!< Tracks after bring-up, setting periodic mode */
+    gps_command_status_t status; /*!< Status expected */
+    uint16_t interval;           /*!< Update interval expected, in ms */
+    unsigned long baud;          /*!< Baud rate expected at the end */
+};
+
+static const scenario_t scenarios[] = {
+    {"1 Hz", false, false, NO_ID, 0, NULL, NO_ID, false, false, false,
+     GPS_COMMANDS_DONE, GPS_INTERVAL, GPS_BAUD},
+    {"5 Hz", true, false, NO_ID, 0, NULL, NO_ID, false, false, false,
+     GPS_COMMANDS_DONE, GPS_FAST_INTERVAL, GPS_FAST_BAUD},
+    {"woken from standby", false, true, NO_ID, 0, NULL, NO_ID, false, false, false,
+     GPS_COMMANDS_DONE, GPS_INTERVAL, GPS_BAUD},
+    {"reply lost once", false, false, 314, 1, NULL, NO_ID, false, false, false,
+     GPS_COMMANDS_DONE, GPS_INTERVAL, GPS_BAUD},
+    {"replies all lost", false, false, 314, GPS_COMMAND_ATTEMPTS, NULL, NO_ID, false, false, false,
+     GPS_COMMANDS_FAILED, GPS_INTERVAL, GPS_BAUD},
+    {"command rejected", false, false, NO_ID, 0, "$PMTK314", NO_ID, false, false, false,
+     GPS_COMMANDS_FAILED, GPS_INTERVAL, GPS_BAUD},
+    {"stray acknowledgements", false, false, NO_ID, 0, NULL, 220, false, false, false,
+     GPS_COMMANDS_DONE, GPS_INTERVAL, GPS_BAUD},
+    {"silent receiver", false, false, NO_ID, 0, NULL, NO_ID, true, false, false,
+     GPS_COMMANDS_FAILED, GPS_INTERVAL, GPS_BAUD},
+    {"5 Hz, baud rate kept", true, false, NO_ID, 0, NULL, NO_ID, false, true, false,
+     GPS_COMMANDS_DONE, GPS_INTERVAL, GPS_BAUD},
+    {"5 Hz, rate rejected", true, false, NO_ID, 0, "$PMTK220,200", NO_ID, false, false, false,
+     GPS_COMMANDS_DONE, GPS_INTERVAL, GPS_BAUD},
+    {"5 Hz, silent receiver", true, false, NO_ID, 0, NULL, NO_ID, true, false, false,
+     GPS_COMMANDS_FAILED, GPS_INTERVAL, GPS_BAUD},
+    {"periodic while tracking", false, false, NO_ID, 0, NULL, NO_ID, false, false, true,
+     GPS_COMMANDS_DONE, GPS_INTERVAL, GPS_BAUD},
+    {"periodic, reply lost", false, false, 225, 1, NULL, NO_ID, false, false, true,
+     GPS_COMMANDS_DONE, GPS_INTERVAL, GPS_BAUD},
+    {"periodic rejected", false, false, NO_ID, 0, "$PMTK225", NO_ID, false, false, true,
+     GPS_COMMANDS_DONE, GPS_INTERVAL, GPS_BAUD},
+};
+
+/*!
+ * @brief struct holding a line on its way from the receiver
+ */
+struct line_t {
+    unsigned long long at;  /*!< Time it is in the port, in us */
+    unsigned long baud;     /*!< Baud rate it is sent at */
+    std::string text;
+};
+
+/*!
+ * @brief struct holding the state of the fake receiver
+ */
+struct receiver_t {
+    const scenario_t *scenario;
+    unsigned long baud;        /*!< Baud rate of the receiver */
+    boolean asleep;            /*!< Flag set in standby */
+    int lost;                  /*!< Replies of lose_id lost so far */
+    uint16_t interval;         /*!< Update interval, in ms */
+    unsigned long long next_fix;  /*!< Time of the next datastrings, in us */
+    unsigned long fixes;       /*!< Datastrings sent */
+    std::vector<line_t> output;   /*!< Lines on their way, in order */
+    std::string port;          /*!< Bytes in the port, not read yet */
+    long commands;             /*!< Lines the firmware sent */
+};
+
+static receiver_t receiver;
+static bool verbose;
+static long errors;
+
+/*!
+ * @brief Counts an error, printing it
+ */
+static void check(bool good, const char *scenario, const char *what)
+{
+    if (!good) {
+        errors++;
+        fprintf(stderr, "%s: check failed: %s\n", scenario, what);
+    }
+}
+
+/*!
+ * @brief Completes an NMEA or PMTK line with its checksum
+ */
+static std::string with_checksum(const std::string &body)
+{
+    uint8_t checksum = 0;
+    for (size_t i = 1; i < body.size(); i++) {
+        checksum ^= body[i];
+    }
+    char tail[8];
+    snprintf(tail, sizeof(tail), "*%02X", checksum);
+    return body + tail;
+}
+
+/*!
+ * @brief Queues a line to the firmware
+ *
+ * @param[in]  delay_ms  Time until it is sent
+ * @param[in]  body      Line from '$' to the last field
+ *
+ * @returns    Nothing.
+ *
+ */
+static void reply(unsigned long delay_ms, const std::string &body)
+{
+    line_t line = {host_time_us + delay_ms*1000ULL, receiver.baud, with_checksum(body)};
+    receiver.output.push_back(line);
+}
+
+/*!
+ * @brief Takes a line from the firmware, as the receiver
+ */
+static void receiver_sent(const char *text)
+{
+    const scenario_t *scenario = receiver.scenario;
+    std::string line(text);
+    receiver.commands++;
+    if (verbose) printf("  %8.3f >  %s%s\n", host_time_us/1e6, text,
+                        Serial1.baud != receiver.baud ? " (baud rate differs)" : "");
+
+    if (Serial1.baud != receiver.baud || scenario->silent) return;
+
+    /* in standby, any byte wakes the receiver up but is lost */
+    if (receiver.asleep) {
+        receiver.asleep = false;
+        reply(REPLY_MS, "$PMTK011,MTKGPS");
+        reply(REPLY_MS, "$PMTK010,001");
+        receiver.next_fix = host_time_us + receiver.interval*1000ULL;
+        return;
+    }
+
+    if (line.compare(0, 5, "$PMTK") != 0) return;
+    size_t star = line.find('*');
+    if (star == std::string::npos || with_checksum(line.substr(0, star)) != line) return;
+    int id = atoi(line.c_str() + 5);
+
+    if (id == scenario->lose_id && receiver.lost < scenario->lose_count) {
+        receiver.lost++;
+        return;
+    }
+    if (scenario->stray_id != NO_ID && scenario->stray_id != id) {
+        reply(REPLY_MS/2, "$PMTK001," + std::to_string(scenario->stray_id) + ",3");
+    }
+
+    switch (id) {
+    case 605:
+        reply(REPLY_MS, "$PMTK705,AXN_2.10_3339_2012072601,5223,PA6H,1.0");
+        break;
+    case 251:
+        /* unacknowledged, the new rate applies once the command is in */
+        if (!scenario->fixed_baud) {
+            receiver.baud = strtoul(line.c_str() + 9, NULL, 10);
+        }
+        break;
+    default:
+        if (scenario->reject && line.compare(0, strlen(scenario->reject), scenario->reject) == 0) {
+            reply(REPLY_MS, "$PMTK001," + std::to_string(id) + ",2");
+            break;
+        }
+        if (id == 220) {
+            receiver.interval = atoi(line.c_str() + 9);
+        } else if (id == 161) {
+            receiver.asleep = true;
+        }
+        reply(REPLY_MS, "$PMTK001," + std::to_string(id) + ",3");
+        break;
+    }
+}
+
+/*!
+ * @brief Queues the RMC and GGA datastrings of a fix
+ */
+static void send_fix(void)
+{
+    unsigned long ms = (36000000UL + receiver.fixes*receiver.interval) % 86400000UL;
+    char clock[16];
+    snprintf(clock, sizeof(clock), "%02lu%02lu%02lu.%03lu", ms/3600000, ms/60000 % 60,
+             ms/1000 % 60, ms % 1000);
+    reply(0, std::string("$GPRMC,") + clock + ",A,4530.0000,N,12236.0000,W,10.0,90.0,181015,,,A");
+    reply(0, std::string("$GPGGA,") + clock + ",4530.0000,N,12236.0000,W,1,08,0.9,50.0,M,-19.6,M,,");
+    receiver.fixes++;
+}
+
+/*!
+ * @brief Moves the receiver's lines that have arrived into the port
+ */
+static void deliver(void)
+{
+    if (!receiver.asleep && !receiver.scenario->silent
+            && receiver.next_fix && host_time_us >= receiver.next_fix) {
+        send_fix();
+        receiver.next_fix += receiver.interval*1000ULL;
+    }
+
+    /* drop what the firmware has read */
+    receiver.port.erase(0, receiver.port.size() - Serial1.unread());
+
+    size_t i = 0;
+    for (; i < receiver.output.size() && receiver.output[i].at <= host_time_us; i++) {
+        const line_t &line = receiver.output[i];
+        if (verbose) printf("  %8.3f <  %s%s\n", host_time_us/1e6, line.text.c_str(),
+                            Serial1.baud != line.baud ? " (baud rate differs)" : "");
+        if (Serial1.baud == line.baud) {
+            receiver.port += line.text + "\r\n";
+        }
+    }
+    receiver.output.erase(receiver.output.begin(), receiver.output.begin() + i);
+
+    Serial1.receive((const uint8_t*)receiver.port.data(), receiver.port.size());
+}
+
+/*!
+ * @brief Tracks after bring-up, setting periodic mode on the way
+ *
+ * The receiver acknowledges periodic mode but keeps its update rate,
+ * so every fix it sends must come through.
+ *
+ * @param[in]      scenario  Pointer to the scenario
+ * @param[in,out]  gps       Pointer to the GPS struct after bring-up
+ *
+ * @returns    Nothing.
+ *
+ */
+static void track(const scenario_t *scenario, gps_t *gps)
+{
+    unsigned long long start = host_time_us;
+    unsigned long sent = receiver.fixes;
+    gps_command_status_t status = GPS_COMMANDS_DONE;
+    bool started = false;
+    bool slow = false;
+    long fixes = 0;
+    long gaps = 0;
+    uint32_t last_time = 0;
+
+    while (host_time_us - start < TRACK_MS*1000ULL) {
+        host_time_us += STEP_US;
+        deliver();
+
+        unsigned long long before = host_time_us;
+        if (!started && host_time_us - start >= PERIODIC_AT_MS*1000ULL) {
+            gps_set_periodic(gps, 1000, 4000);
+            status = GPS_COMMANDS_IN_PROGRESS;
+            started = true;
+        }
+        if (status == GPS_COMMANDS_IN_PROGRESS) {
+            status = gps_command_poll(gps);
+        }
+        if (gps_available(gps)) {
+            gaps += fixes > 0 && gps->fix.time != last_time + 1;
+            last_time = gps->fix.time;
+            fixes++;
+        }
+        slow |= host_time_us != before;
+    }
+
+    long missed = (long)(receiver.fixes - sent) - fixes;
+    const char *names[] = {"in progress", "done", "failed"};
+    printf("%-24s %-12s %ld fixes, %ld missed, %ld gaps\n", "  periodic mode", names[status],
+           fixes, missed, gaps);
+
+    gps_command_status_t expected = scenario->reject ? GPS_COMMANDS_FAILED : GPS_COMMANDS_DONE;
+    check(status == expected, scenario->name, "periodic mode status");
+    check(missed == 0 && gaps == 0, scenario->name, "fixes lost while setting periodic mode");
+    check(!slow, scenario->name, "a poll took time while tracking");
+}
+
+/*!
+ * @brief Runs a scenario
+ *
+ * @param[in]  scenario  Pointer to the scenario
+ *
+ * @returns    Nothing.
+ *
+ */
+static void run(const scenario_t *scenario)
+{
+    receiver = receiver_t();
+    receiver.scenario = scenario;
+    receiver.baud = GPS_BAUD;
+    receiver.asleep = scenario->asleep;
+    receiver.interval = GPS_INTERVAL;
+    receiver.next_fix = scenario->asleep ? 0 : host_time_us + receiver.interval*1000ULL;
+    Serial1.receive(NULL, 0);
+    Serial1.begin(GPS_BAUD);
+    deliver();
+
+    if (verbose) printf("%s\n", scenario->name);
+
+    unsigned long long start = host_time_us;
+    gps_t gps;
+    gps_initialize(&gps, scenario->fast, false);
+
+    gps_command_status_t status = GPS_COMMANDS_IN_PROGRESS;
+    bool backwards = false;
+    bool slow = false;
+    uint8_t step = gps.command_index;
+    const gps_command_t *commands = gps.commands;
+
+    while (status == GPS_COMMANDS_IN_PROGRESS && host_time_us - start < TIME_LIMIT_MS*1000ULL) {
+        host_time_us += STEP_US;
+        deliver();
+
+        unsigned long long before = host_time_us;
+        status = gps_initialize_poll(&gps);
+        slow |= host_time_us != before;
+
+        /* progress is shown per sequence, and restarts with the fallback */
+        if (gps.commands != commands) {
+            commands = gps.commands;
+        } else {
+            backwards |= gps.command_index < step;
+        }
+        step = gps.command_index;
+    }
+
+    double seconds = (host_time_us - start)/1e6;
+    const char *names[] = {"in progress", "done", "failed"};
+    printf("%-24s %-12s %6u %7lu %5ld %8.3f\n", scenario->name, names[status],
+           gps.interval, Serial1.baud, receiver.commands, seconds);
+
+    check(status == scenario->status, scenario->name, "status");
+    check(gps.interval == scenario->interval, scenario->name, "update interval");
+    check(Serial1.baud == scenario->baud, scenario->name, "baud rate");
+    check(Serial1.baud != receiver.baud || status == GPS_COMMANDS_FAILED
+          || receiver.interval == gps.interval, scenario->name, "receiver update interval");
+    check(!backwards, scenario->name, "progress moved backwards");
+    check(!slow, scenario->name, "a poll took time");
+
+    if (scenario->periodic && status != GPS_COMMANDS_IN_PROGRESS) {
+        track(scenario, &gps);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "v")) != -1) {
+        switch (opt) {
+        case 'v': verbose = true; break;
+        default:
+            fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    host_virtual_time = true;
+    Serial1.sent = receiver_sent;
+
+    printf("%-24s %-12s %6s %7s %5s %8s\n", "scenario", "status", "ms", "baud", "sent", "time_s");
+    for (size_t i = 0; i < sizeof(scenarios)/sizeof(scenarios[0]); i++) {
+        run(&scenarios[i]);
+    }
+
+    printf("%ld errors\n", errors);
+    return errors ? 1 : 0;
+}
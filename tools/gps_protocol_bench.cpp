@@ -0,0 +1,281 @@
+/*!
+ * @file
+ *
+ * @brief Host tool comparing NMEA and MTK binary GPS output
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains a command line tool which synthesizes a 5 Hz
+ * ride and encodes every fix twice: as the RMC, GGA and GSA
+ * datastrings the firmware enables, and as MTK binary packets. Each
+ * stream is received through the firmware's gps_available() and
+ * gps_parse(), as in tracking mode.
+ *
+ * For each protocol it prints the bytes sent per fix, the time to
+ * receive and decode a fix, the share of the serial link a fix takes
+ * at GPS_BAUD and GPS_FAST_BAUD (10 bits per byte) and the highest
+ * update rate each baud rate can carry, and the largest position and
+ * speed errors of the decoded fixes against the synthesized ones.
+ *
+ * Decode times are host time, useful to compare the two protocols;
+ * the device runs the same code. Most of the NMEA time is spent in
+ * atof() and the coordinate parsing, which are much slower again on
+ * an 8 bit AVR without a floating point unit.
+ *
+ * Build and run with
+ *    g++ -O2 -Ihost -I../src -o gps_protocol_bench gps_protocol_bench.cpp \
+ *        host/host.cpp ../src/gps.cpp ../src/haversine.cpp
+ *    ./gps_protocol_bench [-n fixes] [-r repeats]
+ */
+
+#include <math.h>
+#include <string>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "gps.h"
+#include "haversine.h"
+
+#define METRES_PER_DEGREE 111194.9  /*!< Length of a degree of latitude, in metres */
+#define ORIGIN_LATITUDE 45.5
+#define ORIGIN_LONGITUDE -122.6
+#define START_DAYS 5769             /*!< 18 October 2015, in days since 2000 */
+#define START_SECONDS 36000         /*!< 10:00:00 UTC */
+#define BITS_PER_BYTE 10            /*!< Bits sent per byte with a start and stop bit */
+
+/*!
+ * @brief struct holding a synthesized fix
+ */
+struct truth_t {
+    double latitude;   /*!< Latitude, in degrees */
+    double longitude;  /*!< Longitude, in degrees */
+    double speed;      /*!< Speed, in mph */
+    double course;     /*!< Course, in degrees */
+};
+
+/*!
+ * @brief struct holding the results of receiving one stream
+ */
+struct result_t {
+    long fixes;         /*!< Number of valid fixes decoded per pass */
+    double ns;          /*!< Time per decoded fix, in ns */
+    double position;    /*!< Largest position error, in metres */
+    double speed;       /*!< Largest speed error, in mph */
+};
+
+/*!
+ * @brief Appends a datastring with its checksum to a stream
+ */
+static void put_sentence(std::string *stream, const char *body)
+{
+    uint8_t checksum = 0;
+    for (const char *c = body; *c; c++) checksum ^= *c;
+    char line[2*NMEA_LINE_LENGTH + 8];
+    snprintf(line, sizeof(line), "$%s*%02X\r\n", body, checksum);
+    *stream += line;
+}
+
+/*!
+ * @brief Formats a coordinate as NMEA (d)ddmm.mmmm,H
+ */
+static void format_coordinate(char *buffer, size_t size, double degrees,
+                              int degree_digits, char positive, char negative)
+{
+    char hemisphere = degrees < 0 ? negative : positive;
+    degrees = fabs(degrees);
+    int whole = (int)degrees;
+    double minutes = (degrees - whole)*60;
+    snprintf(buffer, size, "%0*d%07.4f,%c", degree_digits, whole, minutes, hemisphere);
+}
+
+/*!
+ * @brief Appends a little endian value to a stream
+ */
+static void put_le(std::string *stream, uint32_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++) {
+        *stream += (char)(value >> 8*i);
+    }
+}
+
+/*!
+ * @brief Appends a fix as RMC, GGA and GSA datastrings
+ */
+static void put_nmea(std::string *stream, const truth_t *fix, int clock_ms)
+{
+    char time[16], latitude[20], longitude[20], body[2*NMEA_LINE_LENGTH];
+    int clock = clock_ms/1000;
+    snprintf(time, sizeof(time), "%02d%02d%02d.%03d",
+             clock/3600, clock/60 % 60, clock % 60, clock_ms % 1000);
+    format_coordinate(latitude, sizeof(latitude), fix->latitude, 2, 'N', 'S');
+    format_coordinate(longitude, sizeof(longitude), fix->longitude, 3, 'E', 'W');
+
+    snprintf(body, sizeof(body), "GPRMC,%s,A,%s,%s,%.2f,%.2f,181015,,,A",
+             time, latitude, longitude, fix->speed/1.150779, fix->course);
+    put_sentence(stream, body);
+    snprintf(body, sizeof(body), "GPGGA,%s,%s,%s,1,09,0.92,50.3,M,-19.6,M,,",
+             time, latitude, longitude);
+    put_sentence(stream, body);
+    put_sentence(stream, "GPGSA,A,3,29,21,26,15,18,09,06,10,24,,,,1.63,0.92,1.35");
+}
+
+/*!
+ * @brief Appends a fix as an MTK binary packet
+ */
+static void put_binary(std::string *stream, const truth_t *fix, int clock_ms)
+{
+    std::string payload;
+    int clock = clock_ms/1000;
+    put_le(&payload, (int32_t)lround(fix->latitude*1e7), 4);
+    put_le(&payload, (int32_t)lround(fix->longitude*1e7), 4);
+    put_le(&payload, 5030, 4);
+    put_le(&payload, (int32_t)lround(fix->speed*44.704), 4);
+    put_le(&payload, (int32_t)lround(fix->course*100), 4);
+    put_le(&payload, 9, 1);
+    put_le(&payload, 3, 1);
+    put_le(&payload, 181015, 4);
+    put_le(&payload, (clock/3600*10000 + clock/60 % 60*100 + clock % 60)*1000UL
+                     + clock_ms % 1000, 4);
+    put_le(&payload, 92, 2);
+
+    uint8_t checksum_a = payload.size(), checksum_b = payload.size();
+    for (size_t i = 0; i < payload.size(); i++) {
+        checksum_a += (uint8_t)payload[i];
+        checksum_b += checksum_a;
+    }
+
+    *stream += (char)0xD1;
+    *stream += (char)0xDD;
+    *stream += (char)payload.size();
+    *stream += payload;
+    *stream += (char)checksum_a;
+    *stream += (char)checksum_b;
+}
+
+/*!
+ * @brief Receives a stream through the firmware's gps code
+ *
+ * @param[in]  stream   Bytes sent by the GPS
+ * @param[in]  truth    Synthesized fixes
+ * @param[in]  count    Number of synthesized fixes
+ * @param[in]  repeats  Number of times to receive the stream
+ *
+ * @returns    Results of receiving the stream
+ *
+ */
+static result_t receive(const std::string &stream, const truth_t *truth, long count,
+                        int repeats)
+{
+    result_t result = {};
+    gps_t gps;
+    gps_data_t data;
+
+    struct timespec start, done;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < repeats; r++) {
+        gps_reset_epoch(&gps);
+        Serial1.receive((const uint8_t*)stream.data(), stream.size());
+        while (gps_available(&gps)) {
+            gps_parse(&gps, &data);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &done);
+
+    /* once more to check the fixes */
+    gps_reset_epoch(&gps);
+    Serial1.receive((const uint8_t*)stream.data(), stream.size());
+    while (gps_available(&gps)) {
+        if (!gps_valid(&gps)) continue;
+        gps_parse(&gps, &data);
+
+        long index = ((long)(data.time - START_DAYS*86400UL - START_SECONDS)*1000
+                      + data.milliseconds)/GPS_FAST_INTERVAL;
+        if (index < 0 || index >= count) continue;
+        point_t expected = {(float)truth[index].latitude, (float)truth[index].longitude};
+        result.position = fmax(result.position, distance_between(expected, data.location));
+        result.speed = fmax(result.speed, fabs(data.speed - truth[index].speed));
+        result.fixes++;
+    }
+
+    double ns = (done.tv_sec - start.tv_sec)*1e9 + (done.tv_nsec - start.tv_nsec);
+    result.ns = result.fixes ? ns/repeats/result.fixes : 0.0;
+    return result;
+}
+
+/*!
+ * @brief Prints the results of one protocol
+ */
+static void print_result(const char *name, const std::string &stream, long count,
+                         const result_t *result)
+{
+    double bytes = (double)stream.size()/count;
+    double ms_slow = bytes*BITS_PER_BYTE*1000/GPS_BAUD;
+    double ms_fast = bytes*BITS_PER_BYTE*1000/GPS_FAST_BAUD;
+    printf("%s\t%.1f\t%.0f\t%ld/%ld\t%.1f\t%.0f\t%.1f\t%.0f\t%.2f\t%.3f\n", name,
+           bytes, result->ns, result->fixes, count, ms_slow, 1000/ms_slow,
+           ms_fast, 1000/ms_fast, result->position, result->speed);
+}
+
+int main(int argc, char **argv)
+{
+    long count = 18000;
+    int repeats = 20;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+        switch (opt) {
+        case 'n': count = strtol(optarg, NULL, 10); break;
+        case 'r': repeats = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-n fixes] [-r repeats]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (count <= 0 || repeats <= 0) {
+        fprintf(stderr, "%s: fixes and repeats must be positive\n", argv[0]);
+        return 1;
+    }
+
+    /* a winding ride with the speed varying between 5 and 25 mph */
+    truth_t *truth = (truth_t*)malloc(count*sizeof(truth_t));
+    const double scale = METRES_PER_DEGREE*cos(ORIGIN_LATITUDE*M_PI/180);
+    double north = 0, east = 0;
+    for (long i = 0; i < count; i++) {
+        double t = i*GPS_FAST_INTERVAL/1000.0;
+        double speed = 15 + 10*sin(t/60);
+        double course = fmod(180 + 170*sin(t/300), 360);
+        double step = speed*0.44704*GPS_FAST_INTERVAL/1000;
+        north += step*cos(course*M_PI/180);
+        east += step*sin(course*M_PI/180);
+        truth[i].latitude = ORIGIN_LATITUDE + north/METRES_PER_DEGREE;
+        truth[i].longitude = ORIGIN_LONGITUDE + east/scale;
+        truth[i].speed = speed;
+        truth[i].course = course;
+    }
+
+    std::string nmea, binary;
+    for (long i = 0; i < count; i++) {
+        int clock_ms = START_SECONDS*1000 + i*GPS_FAST_INTERVAL;
+        put_nmea(&nmea, &truth[i], clock_ms);
+        put_binary(&binary, &truth[i], clock_ms);
+    }
+
+    result_t nmea_result = receive(nmea, truth, count, repeats);
+    result_t binary_result = receive(binary, truth, count, repeats);
+
+    printf("protocol\tbytes_per_fix\tns_per_fix\tfixes\tms_at_%d\tmax_hz_at_%d"
+           "\tms_at_%d\tmax_hz_at_%d\tmax_error_m\tmax_error_mph\n",
+           GPS_BAUD, GPS_BAUD, GPS_FAST_BAUD, GPS_FAST_BAUD);
+    print_result("nmea", nmea, count, &nmea_result);
+    print_result("binary", binary, count, &binary_result);
+
+    free(truth);
+    return 0;
+}
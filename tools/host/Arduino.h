@@ -0,0 +1,129 @@
+/*!
+ * @file
+ *
+ * @brief Host stand-in for the Arduino core header
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file provides just enough of the Arduino core for the
+ * firmware's hardware independent modules (gps parsing, haversine,
+ * tracking, waypoint reading) to compile and run in host tools.
+ *
+ * Pins and external interrupts do nothing by themselves. A host tool
+ * playing a device on the pins sets host_io_hook, which is called
+ * after every pin write, interrupt attach and delay, and raises an
+ * interrupt by calling its handler in host_interrupts.
+ *
+ * Time is the host's monotonic clock, unless a tool simulating time
+ * sets host_virtual_time. Then millis(), micros() and delay() run on
+ * host_time_us, which only the tool and delay() move forward.
+ *
+ * Like the real core, min, max, constrain and square are macros, so include
+ * standard C++ headers before this one.
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define PROGMEM
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define FALLING 2
+#define LSBFIRST 0
+#define MSBFIRST 1
+#define DEC 10
+#define HEX 16
+
+#define MISO 14
+#define SCK 15
+#define MOSI 16
+
+#define HOST_PINS 32       /*!< Number of digital pins */
+#define HOST_INTERRUPTS 8  /*!< Number of external interrupts */
+
+#define F(string) (string)
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define square(x) ((x)*(x))
+#define constrain(x, low, high) ((x) < (low) ? (low) : ((x) > (high) ? (high) : (x)))
+
+/*!
+ * @brief Formats a float like avr-libc's dtostrf()
+ */
+static inline char *dtostrf(double value, signed char width, unsigned char precision, char *buffer)
+{
+    sprintf(buffer, "%*.*f", width, precision, value);
+    return buffer;
+}
+
+/*!
+ * @brief Serial port which receives only the bytes a host tool hands it
+ *        with receive()
+ *
+ * Everything sent is discarded, except that a tool playing a device on
+ * the port can set sent, which is called with every line println()
+ * sends. The baud rate set by begin() is kept in baud.
+ */
+class HardwareSerial {
+public:
+    HardwareSerial(void) : sent(NULL), baud(0), input(NULL), input_length(0) {}
+    void receive(const uint8_t *data, size_t length) { input = data; input_length = length; }
+    size_t unread(void) { return input_length; }
+    void begin(unsigned long rate) { baud = rate; }
+    void end(void) {}
+    int available(void) { return input_length > 0; }
+    int read(void) { return input_length > 0 ? (input_length--, *input++) : -1; }
+    void flush(void) {}
+    size_t write(uint8_t) { return 1; }
+    size_t print(const char *s) { return strlen(s); }
+    size_t print(long, int = DEC) { return 0; }
+    size_t println(const char *s) { if (sent) sent(s); return strlen(s) + 2; }
+    size_t println(void) { return 2; }
+
+    void (*sent)(const char *line);  /*!< Device on the port, or NULL */
+    unsigned long baud;              /*!< Baud rate set by begin() */
+
+private:
+    const uint8_t *input;  /*!< Next byte to receive */
+    size_t input_length;   /*!< Number of bytes left to receive */
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+
+extern bool host_virtual_time;          /*!< Flag set to run on host_time_us */
+extern unsigned long long host_time_us;  /*!< Virtual time, in us */
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+
+void noInterrupts(void);
+void interrupts(void);
+
+extern uint8_t host_pins[HOST_PINS];                      /*!< Levels of the digital pins */
+extern void (*host_interrupts[HOST_INTERRUPTS])(void);   /*!< Attached interrupt handlers */
+extern void (*host_io_hook)(void);                        /*!< Device played by a host tool */
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void attachInterrupt(uint8_t interrupt, void (*handler)(void), int mode);
+void detachInterrupt(uint8_t interrupt);
+
+#endif
@@ -0,0 +1,33 @@
+/*!
+ * @file
+ *
+ * @brief Host stand-in for the Arduino EEPROM library
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * Reads and writes the host_eeprom array of the avr/eeprom.h
+ * stand-in, addressed as on the device.
+ */
+
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+#include "avr/eeprom.h"
+
+/*!
+ * @brief EEPROM addressed by byte, as the Arduino library has it
+ */
+class EEPROMClass {
+public:
+    uint8_t read(int address) { return host_eeprom[address & E2END]; }
+    void write(int address, uint8_t value) { host_eeprom[address & E2END] = value; }
+    void update(int address, uint8_t value) { write(address, value); }
+    uint16_t length(void) { return E2END + 1; }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
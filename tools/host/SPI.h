@@ -0,0 +1,64 @@
+/*!
+ * @file
+ *
+ * @brief Host stand-in for the Arduino SPI library
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * Every byte transferred goes to host_spi_transfer, which a host tool
+ * playing the device on the bus sets. Without one the bus reads 0.
+ * Block transfers exchange a buffer in place, a byte at a time, and
+ * are counted apart, as they cost the device less per byte.
+ */
+
+#ifndef HOST_SPI_H
+#define HOST_SPI_H
+
+#include "Arduino.h"
+
+#define SPI_MODE0 0x00
+#define SPI_CLOCK_DIV8 0x05
+
+extern uint8_t (*host_spi_transfer)(uint8_t data);
+extern unsigned long host_spi_blocks;       /*!< Number of block transfers */
+extern unsigned long host_spi_block_bytes;  /*!< Number of bytes moved by block transfers */
+
+/*!
+ * @brief Bus settings, ignored on the host
+ */
+class SPISettings {
+public:
+    SPISettings(void) {}
+    SPISettings(uint32_t, uint8_t, uint8_t) {}
+};
+
+/*!
+ * @brief SPI bus which hands every byte to host_spi_transfer
+ */
+class SPIClass {
+public:
+    void begin(void) {}
+    void end(void) {}
+    void setBitOrder(uint8_t) {}
+    void setDataMode(uint8_t) {}
+    void setClockDivider(uint8_t) {}
+    void usingInterrupt(uint8_t) {}
+    void beginTransaction(SPISettings) {}
+    void endTransaction(void) {}
+    uint8_t transfer(uint8_t data) { return host_spi_transfer ? host_spi_transfer(data) : 0; }
+    void transfer(void *buffer, size_t count)
+    {
+        host_spi_blocks++;
+        for (size_t i = 0; i < count; i++) {
+            ((uint8_t*)buffer)[i] = transfer(((uint8_t*)buffer)[i]);
+            host_spi_block_bytes++;
+        }
+    }
+};
+
+extern SPIClass SPI;
+
+#endif
@@ -0,0 +1,58 @@
+/*!
+ * @file
+ *
+ * @brief Host stand-in for the AVR EEPROM library
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * EEPROM is emulated by the host_eeprom array, addressed the same way
+ * as on the device (pointers are EEPROM addresses). Host tools load a
+ * dump or waypoint image into it before running firmware code.
+ *
+ * Writes take no time unless a tool on virtual time sets
+ * host_eeprom_write_us. Then a byte write keeps the EEPROM busy for
+ * that long, eeprom_is_ready() is false meanwhile, and a write while
+ * busy first waits, moving host_time_us forward. Every byte write is
+ * counted in host_eeprom_writes, for wear.
+ */
+
+#ifndef HOST_AVR_EEPROM_H
+#define HOST_AVR_EEPROM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define E2END 0x3FF  /*!< Last EEPROM address of the ATmega32u4 */
+
+extern uint8_t host_eeprom[E2END + 1];
+extern unsigned long host_eeprom_writes[E2END + 1];  /*!< Byte writes to each address */
+extern unsigned long host_eeprom_write_us;           /*!< Time a byte write takes, in us */
+
+int host_eeprom_is_ready(void);
+void host_eeprom_busy_wait(void);
+
+#define eeprom_is_ready() host_eeprom_is_ready()
+#define eeprom_busy_wait() host_eeprom_busy_wait()
+
+uint8_t eeprom_read_byte(const uint8_t *address);
+uint16_t eeprom_read_word(const uint16_t *address);
+uint32_t eeprom_read_dword(const uint32_t *address);
+float eeprom_read_float(const float *address);
+void eeprom_read_block(void *destination, const void *source, size_t length);
+
+void eeprom_write_byte(uint8_t *address, uint8_t value);
+void eeprom_write_word(uint16_t *address, uint16_t value);
+void eeprom_write_dword(uint32_t *address, uint32_t value);
+void eeprom_write_float(float *address, float value);
+void eeprom_write_block(const void *source, void *destination, size_t length);
+
+void eeprom_update_byte(uint8_t *address, uint8_t value);
+void eeprom_update_word(uint16_t *address, uint16_t value);
+void eeprom_update_dword(uint32_t *address, uint32_t value);
+void eeprom_update_float(float *address, float value);
+void eeprom_update_block(const void *source, void *destination, size_t length);
+
+#endif
@@ -0,0 +1,26 @@
+/*!
+ * @file
+ *
+ * @brief Host stand-in for the AVR sleep library
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * The host never sleeps; the sleep calls do nothing.
+ */
+
+#ifndef HOST_AVR_SLEEP_H
+#define HOST_AVR_SLEEP_H
+
+#define SLEEP_MODE_IDLE 0
+#define SLEEP_MODE_PWR_DOWN 2
+
+#define set_sleep_mode(mode) do {} while (0)
+#define sleep_enable() do {} while (0)
+#define sleep_disable() do {} while (0)
+#define sleep_cpu() do {} while (0)
+#define sleep_mode() do {} while (0)
+
+#endif
@@ -0,0 +1,42 @@
+/*!
+ * @file
+ *
+ * @brief Host stand-in for the AVR watchdog timer library
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * The host has no watchdog. Firmware enables it only to reset the
+ * AVR, so a host tool playing the reset sets host_watchdog_reset,
+ * which wdt_enable() calls once the timeout has passed, with WDRF set
+ * in MCUSR as the reset leaves it. The tool's reset must not return.
+ */
+
+#ifndef HOST_AVR_WDT_H
+#define HOST_AVR_WDT_H
+
+#include <stdint.h>
+
+#define WDTO_15MS 0
+#define WDTO_30MS 1
+#define WDTO_60MS 2
+#define WDTO_120MS 3
+#define WDTO_250MS 4
+#define WDTO_500MS 5
+#define WDTO_1S 6
+#define WDTO_2S 7
+#define WDTO_4S 8
+#define WDTO_8S 9
+
+#define WDRF 3  /*!< Watchdog reset flag of MCUSR */
+
+extern uint8_t MCUSR;                        /*!< MCU status register */
+extern void (*host_watchdog_reset)(void);    /*!< Reset played by a host tool */
+
+void wdt_enable(uint8_t timeout);
+void wdt_disable(void);
+void wdt_reset(void);
+
+#endif
@@ -0,0 +1,54 @@
+/*!
+ * @file
+ *
+ * @brief nRFgo Studio services with a tracking state broadcast pipe, for host tools
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file adds to the generated services.h the TX_BROADCAST pipe
+ * the firmware broadcasts the tracking state on, as nRFgo Studio
+ * would number it after the existing pipes, so the broadcast code
+ * can run against the nRF8001 model. Force include it in every
+ * source file with -include.
+ *
+ * Only the pipe numbers and the pipe type mapping change. The setup
+ * messages are still those of services.h, which the model does not
+ * check against the pipes, so this is no substitute for adding the
+ * pipe to the setup in nRFgo Studio.
+ */
+
+#ifndef BROADCAST_SERVICES_H
+#define BROADCAST_SERVICES_H
+
+#include <services.h>
+
+#define PIPE_GPS_WATCH_TRACKING_STATE_TX_BROADCAST          16
+#define PIPE_GPS_WATCH_TRACKING_STATE_TX_BROADCAST_MAX_SIZE 20
+
+#undef NUMBER_OF_PIPES
+#define NUMBER_OF_PIPES 16
+
+#undef SERVICES_PIPE_TYPE_MAPPING_CONTENT
+#define SERVICES_PIPE_TYPE_MAPPING_CONTENT {\
+  {ACI_STORE_LOCAL, ACI_SET},   \
+  {ACI_STORE_LOCAL, ACI_TX_ACK},   \
+  {ACI_STORE_LOCAL, ACI_SET},   \
+  {ACI_STORE_LOCAL, ACI_SET},   \
+  {ACI_STORE_LOCAL, ACI_SET},   \
+  {ACI_STORE_LOCAL, ACI_SET},   \
+  {ACI_STORE_LOCAL, ACI_SET},   \
+  {ACI_STORE_LOCAL, ACI_RX},   \
+  {ACI_STORE_LOCAL, ACI_TX},   \
+  {ACI_STORE_LOCAL, ACI_RX_ACK_AUTO},   \
+  {ACI_STORE_LOCAL, ACI_RX},   \
+  {ACI_STORE_LOCAL, ACI_TX},   \
+  {ACI_STORE_LOCAL, ACI_TX},   \
+  {ACI_STORE_LOCAL, ACI_RX},   \
+  {ACI_STORE_LOCAL, ACI_SET},   \
+  {ACI_STORE_LOCAL, ACI_TX_BROADCAST},   \
+}
+
+#endif
@@ -0,0 +1,233 @@
+/*!
+ * @file
+ *
+ * @brief Host implementations of the Arduino and AVR stand-ins
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file implements the functions declared by the host stand-in
+ * headers. Link it into any host tool built from firmware sources.
+ */
+
+#include <time.h>
+
+#include "Arduino.h"
+#include "SPI.h"
+#include "avr/eeprom.h"
+#include "avr/wdt.h"
+#include "EEPROM.h"
+
+HardwareSerial Serial;
+HardwareSerial Serial1;
+SPIClass SPI;
+EEPROMClass EEPROM;
+
+uint8_t host_pins[HOST_PINS];
+void (*host_interrupts[HOST_INTERRUPTS])(void);
+void (*host_io_hook)(void);
+uint8_t (*host_spi_transfer)(uint8_t data);
+unsigned long host_spi_blocks;
+unsigned long host_spi_block_bytes;
+
+bool host_virtual_time;
+unsigned long long host_time_us;
+
+uint8_t host_eeprom[E2END + 1];
+unsigned long host_eeprom_writes[E2END + 1];
+unsigned long host_eeprom_write_us;
+static unsigned long long eeprom_ready_at;
+
+uint8_t MCUSR;
+void (*host_watchdog_reset)(void);
+
+/*!
+ * @brief Returns microseconds on a monotonic clock, or virtual time
+ */
+static unsigned long long monotonic_us(void)
+{
+    if (host_virtual_time) {
+        return host_time_us;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec*1000000ULL + now.tv_nsec/1000;
+}
+
+unsigned long millis(void)
+{
+    return monotonic_us()/1000;
+}
+
+unsigned long micros(void)
+{
+    return monotonic_us();
+}
+
+void delay(unsigned long ms)
+{
+    if (host_virtual_time) {
+        host_time_us += ms*1000ULL;
+    } else {
+        struct timespec duration = {(time_t)(ms/1000), (long)(ms % 1000)*1000000};
+        nanosleep(&duration, NULL);
+    }
+    if (host_io_hook) host_io_hook();
+}
+
+void noInterrupts(void) {}
+void interrupts(void) {}
+
+void wdt_enable(uint8_t timeout)
+{
+    if (!host_watchdog_reset) {
+        fprintf(stderr, "watchdog reset without a host_watchdog_reset\n");
+        exit(1);
+    }
+    delay(15UL << timeout);
+    MCUSR |= 1 << WDRF;
+    host_watchdog_reset();
+}
+
+void wdt_disable(void) {}
+void wdt_reset(void) {}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    if (mode == INPUT_PULLUP) {
+        host_pins[pin % HOST_PINS] = HIGH;
+    }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    host_pins[pin % HOST_PINS] = value ? HIGH : LOW;
+    if (host_io_hook) host_io_hook();
+}
+
+int digitalRead(uint8_t pin)
+{
+    return host_pins[pin % HOST_PINS];
+}
+
+void attachInterrupt(uint8_t interrupt, void (*handler)(void), int)
+{
+    host_interrupts[interrupt % HOST_INTERRUPTS] = handler;
+    if (host_io_hook) host_io_hook();
+}
+
+void detachInterrupt(uint8_t interrupt)
+{
+    host_interrupts[interrupt % HOST_INTERRUPTS] = NULL;
+}
+
+/*!
+ * @brief Converts an EEPROM pointer into an index of host_eeprom
+ */
+static size_t index_of(const void *address)
+{
+    return (size_t)address & E2END;
+}
+
+void eeprom_read_block(void *destination, const void *source, size_t length)
+{
+    for (size_t i = 0; i < length; i++) {
+        ((uint8_t*)destination)[i] = host_eeprom[index_of((const uint8_t*)source + i)];
+    }
+}
+
+int host_eeprom_is_ready(void)
+{
+    return !host_virtual_time || host_time_us >= eeprom_ready_at;
+}
+
+void host_eeprom_busy_wait(void)
+{
+    if (!host_eeprom_is_ready()) {
+        host_time_us = eeprom_ready_at;
+    }
+}
+
+void eeprom_write_block(const void *source, void *destination, size_t length)
+{
+    for (size_t i = 0; i < length; i++) {
+        eeprom_write_byte((uint8_t*)destination + i, ((const uint8_t*)source)[i]);
+    }
+}
+
+void eeprom_update_block(const void *source, void *destination, size_t length)
+{
+    eeprom_write_block(source, destination, length);
+}
+
+uint8_t eeprom_read_byte(const uint8_t *address)
+{
+    return host_eeprom[index_of(address)];
+}
+
+uint16_t eeprom_read_word(const uint16_t *address)
+{
+    uint16_t value;
+    eeprom_read_block(&value, address, sizeof(value));
+    return value;
+}
+
+uint32_t eeprom_read_dword(const uint32_t *address)
+{
+    uint32_t value;
+    eeprom_read_block(&value, address, sizeof(value));
+    return value;
+}
+
+float eeprom_read_float(const float *address)
+{
+    float value;
+    eeprom_read_block(&value, address, sizeof(value));
+    return value;
+}
+
+void eeprom_write_byte(uint8_t *address, uint8_t value)
+{
+    host_eeprom_busy_wait();
+    host_eeprom[index_of(address)] = value;
+    host_eeprom_writes[index_of(address)]++;
+    eeprom_ready_at = host_time_us + host_eeprom_write_us;
+}
+
+void eeprom_write_word(uint16_t *address, uint16_t value)
+{
+    eeprom_write_block(&value, address, sizeof(value));
+}
+
+void eeprom_write_dword(uint32_t *address, uint32_t value)
+{
+    eeprom_write_block(&value, address, sizeof(value));
+}
+
+void eeprom_write_float(float *address, float value)
+{
+    eeprom_write_block(&value, address, sizeof(value));
+}
+
+void eeprom_update_byte(uint8_t *address, uint8_t value)
+{
+    eeprom_write_byte(address, value);
+}
+
+void eeprom_update_word(uint16_t *address, uint16_t value)
+{
+    eeprom_write_word(address, value);
+}
+
+void eeprom_update_dword(uint32_t *address, uint32_t value)
+{
+    eeprom_write_dword(address, value);
+}
+
+void eeprom_update_float(float *address, float value)
+{
+    eeprom_write_float(address, value);
+}
@@ -0,0 +1,264 @@
+/*!
+ * @file
+ *
+ * @brief Interface for reading NMEA captures in host tools
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains the function definitions used to walk the
+ * sentences of a memory mapped NMEA capture.
+ *
+ * The byte search and XOR routines come in AVX2, SSE2 and scalar
+ * versions. The AVX2 versions are compiled with a target attribute,
+ * so the tools build without -mavx2 and pick the best version at run
+ * time.
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+#include "nmea_corpus.h"
+
+/*!
+ * @brief Finds a byte in a range
+ *
+ * @param[in]  p    Start of the range
+ * @param[in]  end  End of the range
+ * @param[in]  c    Byte to find
+ *
+ * @returns    Pointer to the first match, or end if there is none
+ *
+ */
+static const char *find_byte_scalar(const char *p, const char *end, char c)
+{
+    while (p < end && *p != c) p++;
+    return p;
+}
+
+/*!
+ * @brief XORs the bytes of a range together
+ *
+ * @param[in]  p    Start of the range
+ * @param[in]  end  End of the range
+ *
+ * @returns    XOR of all bytes in the range
+ *
+ */
+static uint8_t xor_bytes_scalar(const char *p, const char *end)
+{
+    uint8_t checksum = 0;
+    while (p < end) checksum ^= *p++;
+    return checksum;
+}
+
+/*!
+ * @brief Folds 64 bits of XOR accumulator down to a byte
+ */
+static uint8_t fold64(uint64_t x)
+{
+    x ^= x >> 32;
+    x ^= x >> 16;
+    x ^= x >> 8;
+    return x;
+}
+
+#ifdef HAVE_X86_SIMD
+
+static const char *find_byte_sse2(const char *p, const char *end, char c)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+    while (end - p >= 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)p);
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+        if (mask) return p + __builtin_ctz(mask);
+        p += 16;
+    }
+    return find_byte_scalar(p, end, c);
+}
+
+static uint8_t xor_bytes_sse2(const char *p, const char *end)
+{
+    __m128i acc = _mm_setzero_si128();
+    while (end - p >= 16) {
+        acc = _mm_xor_si128(acc, _mm_loadu_si128((const __m128i*)p));
+        p += 16;
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    return fold64(lanes[0] ^ lanes[1]) ^ xor_bytes_scalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char *find_byte_avx2(const char *p, const char *end, char c)
+{
+    const __m256i needle = _mm256_set1_epi8(c);
+    while (end - p >= 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i*)p);
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle));
+        if (mask) return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return find_byte_sse2(p, end, c);
+}
+
+__attribute__((target("avx2")))
+static uint8_t xor_bytes_avx2(const char *p, const char *end)
+{
+    __m256i acc = _mm256_setzero_si256();
+    while (end - p >= 32) {
+        acc = _mm256_xor_si256(acc, _mm256_loadu_si256((const __m256i*)p));
+        p += 32;
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+    return fold64(lanes[0] ^ lanes[1] ^ lanes[2] ^ lanes[3]) ^ xor_bytes_sse2(p, end);
+}
+
+#endif
+
+/*!
+ * @brief struct holding the scanning routines chosen for this host
+ */
+struct scanner_t {
+    const char *(*find_byte)(const char *p, const char *end, char c);
+    uint8_t (*xor_bytes)(const char *p, const char *end);
+    const char *isa;
+};
+
+/*!
+ * @brief Picks the fastest scanning routines the host supports
+ *
+ * @returns    The chosen routines
+ *
+ */
+static scanner_t pick_scanner(void)
+{
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return (scanner_t){find_byte_avx2, xor_bytes_avx2, "avx2"};
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return (scanner_t){find_byte_sse2, xor_bytes_sse2, "sse2"};
+    }
+#endif
+    return (scanner_t){find_byte_scalar, xor_bytes_scalar, "scalar"};
+}
+
+/*!
+ * @brief Returns the scanning routines, choosing them on first use
+ */
+static const scanner_t &scanner(void)
+{
+    static const scanner_t chosen = pick_scanner();
+    return chosen;
+}
+
+/*!
+ * @brief Parses single hex character into decimal
+ *
+ * @param[in]  c    Hexadecimal character (0-9, A-F)
+ *
+ * @returns    Decimal equivalent, or -1 if c is not a hex digit
+ *
+ */
+static int parse_hex(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool nmea_corpus_open(nmea_corpus_t *corpus, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return false;
+    }
+
+    corpus->data = NULL;
+    corpus->size = st.st_size;
+    if (corpus->size > 0) {
+        void *mapping = mmap(NULL, corpus->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        madvise(mapping, corpus->size, MADV_SEQUENTIAL);
+        corpus->data = (const char*)mapping;
+    }
+    close(fd);
+
+    corpus->next = corpus->data;
+    return true;
+}
+
+void nmea_corpus_close(nmea_corpus_t *corpus)
+{
+    if (corpus->data != NULL) {
+        munmap((void*)corpus->data, corpus->size);
+    }
+    corpus->data = NULL;
+    corpus->next = NULL;
+    corpus->size = 0;
+}
+
+bool nmea_corpus_next(nmea_corpus_t *corpus, nmea_sentence_t *sentence)
+{
+    const scanner_t &scan = scanner();
+    const char *end = corpus->data + corpus->size;
+
+    while (corpus->next < end) {
+        const char *line = corpus->next;
+        const char *eol = scan.find_byte(line, end, '\n');
+        corpus->next = eol < end ? eol + 1 : end;
+
+        if (eol > line && eol[-1] == '\r') eol--;
+        if (eol == line || *line != '$') continue;
+
+        /* checksum is the xor of all bytes between $ and * */
+        const char *star = scan.find_byte(line + 1, eol, '*');
+        bool ok = false;
+        if (eol - star >= 3) {
+            int high = parse_hex(star[1]);
+            int low = parse_hex(star[2]);
+            ok = high >= 0 && low >= 0
+                && scan.xor_bytes(line + 1, star) == high*16 + low;
+        }
+
+        sentence->text = line;
+        sentence->length = eol - line;
+        sentence->checksum_ok = ok;
+        return true;
+    }
+    return false;
+}
+
+void nmea_sentence_to_gps(const nmea_sentence_t *sentence, gps_t *gps)
+{
+    size_t length = sentence->length < NMEA_LINE_LENGTH
+        ? sentence->length : NMEA_LINE_LENGTH;
+    memcpy(gps->nmea, sentence->text, length);
+    gps->nmea[length] = '\0';
+    gps->index = 0;
+}
+
+const char *nmea_corpus_isa(void)
+{
+    return scanner().isa;
+}
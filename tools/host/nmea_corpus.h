@@ -0,0 +1,106 @@
+/*!
+ * @file
+ *
+ * @brief Header file for reading NMEA captures in host tools
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains the data structures and function prototypes
+ * used to walk the sentences of a memory mapped NMEA capture.
+ * Sentences are returned as views into the mapping, with the checksum
+ * already verified, so nothing is copied until a sentence is handed
+ * to the firmware's gps parsing code.
+ *
+ * Line splitting and the checksum XOR use AVX2 or SSE2 when the host
+ * supports them and fall back to scalar code otherwise.
+ */
+
+#ifndef NMEA_CORPUS_H
+#define NMEA_CORPUS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gps.h"
+
+/*!
+ * @brief struct holding a memory mapped capture and the read position
+ */
+struct nmea_corpus_t {
+    const char *data;  /*!< Start of the mapping */
+    size_t size;       /*!< Size of the mapping */
+    const char *next;  /*!< Start of the next line to read */
+};
+
+/*!
+ * @brief struct holding a view of a single sentence
+ *
+ * The view covers the sentence from '$' up to (not including) the
+ * line ending.
+ */
+struct nmea_sentence_t {
+    const char *text;  /*!< Start of the sentence, at '$' */
+    size_t length;     /*!< Length of the sentence */
+    bool checksum_ok;  /*!< Flag indicating the checksum matched */
+};
+
+/*!
+ * @brief Maps a capture into memory
+ *
+ * @param[out] corpus  Pointer to corpus struct to initialize
+ * @param[in]  path    Path of the capture
+ *
+ * @returns    True on success, false with errno set otherwise
+ *
+ */
+bool nmea_corpus_open(nmea_corpus_t *corpus, const char *path);
+
+/*!
+ * @brief Unmaps a capture
+ *
+ * @param[in,out] corpus  Pointer to corpus struct
+ *
+ * @returns    Nothing.
+ *
+ */
+void nmea_corpus_close(nmea_corpus_t *corpus);
+
+/*!
+ * @brief Gets the next sentence of a capture
+ *
+ * Lines not starting with '$' are skipped.
+ *
+ * @param[in,out] corpus    Pointer to corpus struct
+ * @param[out]    sentence  Pointer to sentence view to fill
+ *
+ * @returns    True if a sentence was found, false at the end of the capture
+ *
+ */
+bool nmea_corpus_next(nmea_corpus_t *corpus, nmea_sentence_t *sentence);
+
+/*!
+ * @brief Copies a sentence into a gps struct
+ *
+ * The sentence is copied the way gps_available() fills the buffer on
+ * the device, truncated to NMEA_LINE_LENGTH characters.
+ *
+ * @param[in]  sentence  Pointer to sentence view
+ * @param[out] gps       Pointer to gps struct to fill
+ *
+ * @returns    Nothing.
+ *
+ */
+void nmea_sentence_to_gps(const nmea_sentence_t *sentence, gps_t *gps);
+
+/*!
+ * @brief Returns the name of the instruction set used for scanning
+ *
+ * @returns    "avx2", "sse2" or "scalar"
+ *
+ */
+const char *nmea_corpus_isa(void);
+
+#endif
@@ -0,0 +1,141 @@
+/*!
+ * @file
+ *
+ * @brief Interface for the mock nRF8001 used by host tools
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains the function definitions of the stand-in
+ * nRF8001 on the host SPI bus and pins.
+ */
+
+#include <string.h>
+
+#include "Arduino.h"
+#include "SPI.h"
+#include "aci_cmds.h"
+#include "aci_evts.h"
+#include "nrf8001_mock.h"
+
+nrf8001_mock_t nrf8001_mock;
+
+/*!
+ * @brief Plays the nRF8001's side of an SPI transfer, one byte at a time
+ *
+ * The first byte is the debug byte, then the event length and the
+ * event. The driver sends the command length and the command.
+ */
+static uint8_t transfer_byte(uint8_t data)
+{
+    nrf8001_mock_t *mock = &nrf8001_mock;
+    mock->bytes++;
+    if (host_virtual_time) {
+        host_time_us += NRF8001_MOCK_BYTE_US;
+    }
+
+    if (mock->index >= sizeof(mock->transfer)) {
+        return 0;
+    }
+    mock->command[mock->index] = data;
+    return mock->transfer[mock->index++];
+}
+
+void nrf8001_mock_begin(uint8_t rdyn_pin, uint8_t reqn_pin, uint8_t reset_pin,
+                        uint8_t interrupt)
+{
+    memset(&nrf8001_mock, 0, sizeof(nrf8001_mock));
+    nrf8001_mock.rdyn_pin = rdyn_pin;
+    nrf8001_mock.reqn_pin = reqn_pin;
+    nrf8001_mock.reset_pin = reset_pin;
+    nrf8001_mock.interrupt = interrupt;
+    nrf8001_mock.capacity = NRF8001_MOCK_EVENTS;
+    nrf8001_mock.reset_level = HIGH;
+
+    host_pins[rdyn_pin] = HIGH;
+    host_pins[reqn_pin] = HIGH;
+    host_pins[reset_pin] = HIGH;
+    host_spi_transfer = transfer_byte;
+    host_io_hook = nrf8001_mock_service;
+}
+
+bool nrf8001_mock_send(const uint8_t *event, uint8_t length)
+{
+    nrf8001_mock_t *mock = &nrf8001_mock;
+    if (mock->count >= mock->capacity || length > HAL_ACI_MAX_LENGTH) {
+        return false;
+    }
+
+    hal_aci_data_t *slot = &mock->events[(mock->head + mock->count++) % NRF8001_MOCK_EVENTS];
+    slot->status_byte = 0;
+    slot->buffer[0] = length;
+    memcpy(&slot->buffer[1], event, length);
+    return true;
+}
+
+uint8_t nrf8001_mock_room(void)
+{
+    return nrf8001_mock.capacity - nrf8001_mock.count;
+}
+
+void nrf8001_mock_service(void)
+{
+    nrf8001_mock_t *mock = &nrf8001_mock;
+
+    /* a rising edge on RESET restarts the chip */
+    if (mock->reset_level == LOW && host_pins[mock->reset_pin] == HIGH) {
+        static const uint8_t started[] = {ACI_EVT_DEVICE_STARTED, ACI_DEVICE_STANDBY, 0, 2};
+        mock->count = 0;
+        if (mock->reset_handler) {
+            mock->reset_handler();
+        } else {
+            nrf8001_mock_send(started, sizeof(started));
+        }
+    }
+    mock->reset_level = host_pins[mock->reset_pin];
+
+    while (!mock->in_transfer && host_interrupts[mock->interrupt] != NULL
+           && (mock->count > 0 || host_pins[mock->reqn_pin] == LOW)) {
+        memset(mock->transfer, 0, sizeof(mock->transfer));
+        memset(mock->command, 0, sizeof(mock->command));
+        bool sending = mock->count > 0;
+        if (sending) {
+            const hal_aci_data_t *event = &mock->events[mock->head];
+            mock->transfer[0] = 0x01;  /* debug byte */
+            memcpy(&mock->transfer[1], event->buffer, event->buffer[0] + 1);
+        }
+        mock->index = 0;
+        if (host_virtual_time) {
+            host_time_us += NRF8001_MOCK_TRANSFER_US;
+        }
+
+        mock->in_transfer = true;
+        host_pins[mock->rdyn_pin] = LOW;
+        host_interrupts[mock->interrupt]();
+        mock->in_transfer = false;
+
+        /* the driver clocks nothing while it holds the chip off */
+        if (mock->index == 0) {
+            break;
+        }
+        host_pins[mock->rdyn_pin] = HIGH;
+        mock->transfers++;
+
+        if (sending) {
+            mock->head = (mock->head + 1) % NRF8001_MOCK_EVENTS;
+            mock->count--;
+            mock->events_sent++;
+        }
+        if (mock->command[0] > 0) {
+            mock->commands++;
+            if (mock->command_handler) mock->command_handler(mock->command);
+        }
+    }
+
+    /* the chip asks for a transfer for as long as it has an event */
+    if (!mock->in_transfer) {
+        host_pins[mock->rdyn_pin] = mock->count > 0 ? LOW : HIGH;
+    }
+}
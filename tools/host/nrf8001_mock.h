@@ -0,0 +1,117 @@
+/*!
+ * @file
+ *
+ * @brief Header file for the mock nRF8001 used by host tools
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains the data structures and function prototypes of
+ * a stand-in nRF8001 on the host SPI bus and pins, for running the
+ * Nordic driver and the Bluetooth module on the host.
+ *
+ * The mock holds events to send. While it has one, or the driver
+ * pulls REQN low, it pulls RDYN low and runs the attached RDYN
+ * interrupt handler, playing its side of the SPI transfer. RDYN stays
+ * low while an event waits and the interrupt is detached. A pin reset
+ * empties the mock and calls reset_handler or, without one, queues an
+ * ACI Device Started event in standby. Commands clocked in by the
+ * driver are counted and handed to command_handler, if set. The
+ * nrf8001_model module sets both handlers to play a whole nRF8001.
+ *
+ * Under host_virtual_time each transfer takes time: a fixed interrupt
+ * overhead plus the bytes clocked at the driver's 2 MHz SPI clock.
+ */
+
+#ifndef NRF8001_MOCK_H
+#define NRF8001_MOCK_H
+
+#include <stdint.h>
+
+#include "hal_aci_tl.h"
+
+#define NRF8001_MOCK_EVENTS 16         /*!< Most events the mock can hold */
+#define NRF8001_MOCK_BYTE_US 4         /*!< Time to clock a byte at 2 MHz, in us */
+#define NRF8001_MOCK_TRANSFER_US 20    /*!< Interrupt and pin overhead of a transfer, in us */
+
+/*!
+ * @brief struct holding the state of the mock nRF8001
+ */
+struct nrf8001_mock_t {
+    uint8_t rdyn_pin;                          /*!< Pin the mock drives as RDYN */
+    uint8_t reqn_pin;                          /*!< Pin the driver drives as REQN */
+    uint8_t reset_pin;                         /*!< Pin the driver drives as RESET */
+    uint8_t interrupt;                         /*!< Interrupt attached to RDYN */
+    uint8_t capacity;                          /*!< Events the mock can hold, at most NRF8001_MOCK_EVENTS */
+
+    hal_aci_data_t events[NRF8001_MOCK_EVENTS];  /*!< Events waiting to be sent */
+    uint8_t head;                              /*!< Index of the next event to send */
+    uint8_t count;                             /*!< Number of events waiting */
+
+    uint8_t transfer[HAL_ACI_MAX_LENGTH + 2];  /*!< Bytes the mock sends in the current transfer */
+    uint8_t command[HAL_ACI_MAX_LENGTH + 2];   /*!< Bytes the driver sent in the current transfer */
+    uint8_t index;                             /*!< Next byte of the current transfer */
+    uint8_t reset_level;                       /*!< Last level seen on the reset pin */
+    bool in_transfer;                          /*!< Flag set while the interrupt runs */
+
+    /*! Called with each command, its length byte first */
+    void (*command_handler)(const uint8_t *command);
+    /*! Called on a pin reset instead of queueing Device Started in standby */
+    void (*reset_handler)(void);
+
+    unsigned long transfers;                   /*!< Number of transfers */
+    unsigned long commands;                    /*!< Number of commands received */
+    unsigned long events_sent;                 /*!< Number of events sent */
+    unsigned long bytes;                       /*!< Number of bytes clocked */
+};
+
+extern nrf8001_mock_t nrf8001_mock;
+
+/*!
+ * @brief Puts the mock on the host pins and SPI bus
+ *
+ * Sets host_spi_transfer and host_io_hook, and leaves RDYN and RESET
+ * high.
+ *
+ * @param[in]  rdyn_pin   Pin of RDYN
+ * @param[in]  reqn_pin   Pin of REQN
+ * @param[in]  reset_pin  Pin of RESET
+ * @param[in]  interrupt  Interrupt attached to RDYN
+ *
+ * @returns    Nothing.
+ *
+ */
+void nrf8001_mock_begin(uint8_t rdyn_pin, uint8_t reqn_pin, uint8_t reset_pin,
+                        uint8_t interrupt);
+
+/*!
+ * @brief Queues an event for the mock to send
+ *
+ * @param[in]  event   Event, opcode first, without the length byte
+ * @param[in]  length  Length of the event
+ *
+ * @returns    True if queued, false if the mock is full
+ *
+ */
+bool nrf8001_mock_send(const uint8_t *event, uint8_t length);
+
+/*!
+ * @brief Returns the number of events the mock has room for
+ */
+uint8_t nrf8001_mock_room(void);
+
+/*!
+ * @brief Runs transfers while the mock has an event or REQN is low
+ *
+ * This is the host_io_hook. Tools call it after queueing events.
+ * Nothing happens while the RDYN interrupt is detached or a transfer
+ * is already running.
+ *
+ * @returns    Nothing.
+ *
+ */
+void nrf8001_mock_service(void);
+
+#endif
@@ -0,0 +1,468 @@
+/*!
+ * @file
+ *
+ * @brief Interface for the nRF8001 device model used by host tools
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains the function definitions of the behavioral
+ * model of the nRF8001.
+ */
+
+#include <string.h>
+
+#include "Arduino.h"
+#include "aci_cmds.h"
+#include "aci_evts.h"
+#include "nrf8001_model.h"
+
+#define SETUP_CRC_TARGET 0xF0      /* target byte of the setup message carrying the CRC */
+#define BTLE_REMOTE_TERMINATED 0x13
+#define BTLE_LOCAL_TERMINATED 0x16
+
+nrf8001_model_t nrf8001_model;
+
+/*!
+ * @brief Charges the time the nRF8001 takes for something, under virtual time
+ */
+static void charge(unsigned long us)
+{
+    if (host_virtual_time) {
+        host_time_us += us;
+    }
+}
+
+/*!
+ * @brief Updates a CRC-16-CCITT, as the setup CRC is computed, with a byte
+ */
+static uint16_t crc_update(uint16_t crc, uint8_t data)
+{
+    crc ^= (uint16_t)data << 8;
+    for (uint8_t i = 0; i < 8; i++) {
+        crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+/*!
+ * @brief Hands an event to the mock, counting it if there is no room
+ */
+static void send_event(aci_evt_t *evt)
+{
+    if (!nrf8001_mock_send((const uint8_t*)&evt->evt_opcode, evt->len)) {
+        nrf8001_model.lost++;
+    }
+}
+
+/*!
+ * @brief Sends a Command Response event
+ */
+static void send_response(uint8_t opcode, uint8_t status, const void *params, uint8_t length)
+{
+    aci_evt_t evt;
+    evt.len = 3 + length;
+    evt.evt_opcode = ACI_EVT_CMD_RSP;
+    evt.params.cmd_rsp.cmd_opcode = (aci_cmd_opcode_t)opcode;
+    evt.params.cmd_rsp.cmd_status = (aci_status_code_t)status;
+    if (length > 0) {
+        memcpy(&evt.params.cmd_rsp.params, params, length);
+    }
+    send_event(&evt);
+
+    if (status >= ACI_STATUS_ERROR_UNKNOWN) {
+        nrf8001_model.errors++;
+    }
+}
+
+/*!
+ * @brief Sends a Device Started event
+ */
+static void send_started(aci_device_operation_mode_t mode)
+{
+    aci_evt_t evt;
+    evt.len = 4;
+    evt.evt_opcode = ACI_EVT_DEVICE_STARTED;
+    evt.params.device_started.device_mode = mode;
+    evt.params.device_started.hw_error = ACI_HW_ERROR_NONE;
+    evt.params.device_started.credit_available = NRF8001_MODEL_CREDITS;
+    send_event(&evt);
+}
+
+/*!
+ * @brief Sends a Pipe Error event
+ */
+static void send_pipe_error(uint8_t pipe, uint8_t error)
+{
+    aci_evt_t evt;
+    evt.len = 3;
+    evt.evt_opcode = ACI_EVT_PIPE_ERROR;
+    evt.params.pipe_error.pipe_number = pipe;
+    evt.params.pipe_error.error_code = error;
+    send_event(&evt);
+    nrf8001_model.errors++;
+}
+
+/*!
+ * @brief Ends the link, sending a Disconnected event
+ */
+static void end_link(uint8_t aci_status, uint8_t btle_status)
+{
+    nrf8001_model_t *model = &nrf8001_model;
+    model->mode = NRF8001_MODEL_STANDBY;
+    model->credits = NRF8001_MODEL_CREDITS;
+    model->credits_used = 0;
+    memset(model->pipes_open, 0, sizeof(model->pipes_open));
+
+    aci_evt_t evt;
+    evt.len = 3;
+    evt.evt_opcode = ACI_EVT_DISCONNECTED;
+    evt.params.disconnected.aci_status = (aci_status_code_t)aci_status;
+    evt.params.disconnected.btle_status = btle_status;
+    send_event(&evt);
+}
+
+/*!
+ * @brief Stores a setup message, checking the CRC in the last one
+ */
+static void handle_setup(const uint8_t *command)
+{
+    nrf8001_model_t *model = &nrf8001_model;
+    const uint8_t length = command[0];
+    const bool last = (length >= 5 && SETUP_CRC_TARGET == command[2]);
+
+    /* the CRC covers every setup byte before its own */
+    for (uint8_t i = 0; i <= (last ? length - 2 : length); i++) {
+        model->setup_crc = crc_update(model->setup_crc, command[i]);
+    }
+    model->setup_messages++;
+
+    if (!last) {
+        send_response(ACI_CMD_SETUP, ACI_STATUS_TRANSACTION_CONTINUE, NULL, 0);
+        return;
+    }
+
+    if (model->setup_crc != (uint16_t)((command[length - 1] << 8) | command[length])) {
+        model->setup_crc = 0xFFFF;
+        model->setup_messages = 0;
+        send_response(ACI_CMD_SETUP, ACI_STATUS_ERROR_CRC_MISMATCH, NULL, 0);
+        return;
+    }
+    model->setup_id = model->setup_crc;
+    model->mode = NRF8001_MODEL_STANDBY;
+    send_response(ACI_CMD_SETUP, ACI_STATUS_TRANSACTION_COMPLETE, NULL, 0);
+    send_started(ACI_DEVICE_STANDBY);
+}
+
+/*!
+ * @brief Sends data to the phone, using a credit
+ */
+static void handle_send_data(const uint8_t *command)
+{
+    nrf8001_model_t *model = &nrf8001_model;
+    const uint8_t pipe = command[2];
+
+    if (NRF8001_MODEL_CONNECTED != model->mode
+        || !(model->pipes_open[pipe/8] & (1 << (pipe % 8)))) {
+        send_pipe_error(pipe, ACI_STATUS_ERROR_PIPE_STATE_INVALID);
+        return;
+    }
+    if (0 == model->credits) {
+        send_pipe_error(pipe, ACI_STATUS_ERROR_CREDIT_NOT_AVAILABLE);
+        return;
+    }
+
+    model->credits--;
+    model->credits_used++;
+    model->packets++;
+    if (model->data_handler) {
+        model->data_handler(pipe, &command[3], command[0] - 2);
+    }
+}
+
+/*!
+ * @brief Answers a command as the nRF8001 does in its current mode
+ *
+ * This is the mock's command_handler.
+ */
+static void handle_command(const uint8_t *command)
+{
+    nrf8001_model_t *model = &nrf8001_model;
+    const uint8_t length = command[0];
+    const uint8_t opcode = command[1];
+    const uint8_t *params = &command[2];
+    const bool active = (NRF8001_MODEL_SETUP != model->mode && NRF8001_MODEL_SLEEP != model->mode);
+    bool valid;
+
+    charge(ACI_CMD_SETUP == opcode ? model->setup_us : model->command_us);
+
+    switch (opcode) {
+    case ACI_CMD_SETUP:
+        if ((valid = (NRF8001_MODEL_SETUP == model->mode))) {
+            handle_setup(command);
+        }
+        break;
+
+    case ACI_CMD_SLEEP:
+        /* sleep is not answered */
+        if ((valid = (NRF8001_MODEL_STANDBY == model->mode))) {
+            model->mode = NRF8001_MODEL_SLEEP;
+        }
+        break;
+
+    case ACI_CMD_WAKEUP:
+        if ((valid = (NRF8001_MODEL_SLEEP == model->mode))) {
+            model->mode = NRF8001_MODEL_STANDBY;
+            send_response(opcode, ACI_STATUS_SUCCESS, NULL, 0);
+        }
+        break;
+
+    case ACI_CMD_ECHO:
+        if ((valid = active)) {
+            aci_evt_t evt;
+            evt.len = length;
+            evt.evt_opcode = ACI_EVT_ECHO;
+            memcpy(evt.params.echo.echo_data, params, length - 1);
+            send_event(&evt);
+        }
+        break;
+
+    case ACI_CMD_GET_DEVICE_VERSION:
+        if ((valid = active)) {
+            aci_evt_cmd_rsp_params_get_device_version_t version;
+            version.configuration_id = 0x0105;
+            version.aci_version = 0x02;
+            version.setup_format = 0x03;
+            version.setup_id = model->setup_id;
+            version.setup_status = (0 != model->setup_id);
+            send_response(opcode, ACI_STATUS_SUCCESS, &version, sizeof(version));
+        }
+        break;
+
+    case ACI_CMD_SET_LOCAL_DATA:
+        if ((valid = active)) {
+            const uint8_t pipe = params[0];
+            if (pipe >= NRF8001_MODEL_PIPES || length - 2 > ACI_PIPE_TX_DATA_MAX_LEN) {
+                send_response(opcode, ACI_STATUS_ERROR_PIPE_INVALID, NULL, 0);
+                break;
+            }
+            model->local_length[pipe] = length - 2;
+            memcpy(model->local_data[pipe], &params[1], length - 2);
+            send_response(opcode, ACI_STATUS_SUCCESS, NULL, 0);
+        }
+        break;
+
+    case ACI_CMD_RADIO_RESET:
+        if ((valid = active)) {
+            send_response(opcode, ACI_STATUS_SUCCESS, NULL, 0);
+            if (NRF8001_MODEL_CONNECTED == model->mode) {
+                end_link(ACI_STATUS_EXTENDED, BTLE_LOCAL_TERMINATED);
+            }
+            model->mode = NRF8001_MODEL_STANDBY;
+        }
+        break;
+
+    case ACI_CMD_CONNECT:
+        if ((valid = (NRF8001_MODEL_STANDBY == model->mode))) {
+            memcpy(&model->adv_interval, &params[2], sizeof(model->adv_interval));
+            model->mode = NRF8001_MODEL_ADVERTISING;
+            send_response(opcode, ACI_STATUS_SUCCESS, NULL, 0);
+        }
+        break;
+
+    case ACI_CMD_OPEN_ADV_PIPE:
+        if ((valid = active)) {
+            memcpy(model->adv_pipes, params, sizeof(model->adv_pipes));
+            send_response(opcode, ACI_STATUS_SUCCESS, NULL, 0);
+        }
+        break;
+
+    case ACI_CMD_BROADCAST:
+        if ((valid = (NRF8001_MODEL_STANDBY == model->mode))) {
+            memcpy(&model->adv_interval, &params[2], sizeof(model->adv_interval));
+            model->mode = NRF8001_MODEL_BROADCASTING;
+            send_response(opcode, ACI_STATUS_SUCCESS, NULL, 0);
+        }
+        break;
+
+    case ACI_CMD_DISCONNECT:
+        if ((valid = (NRF8001_MODEL_CONNECTED == model->mode))) {
+            send_response(opcode, ACI_STATUS_SUCCESS, NULL, 0);
+            end_link(ACI_STATUS_EXTENDED, BTLE_LOCAL_TERMINATED);
+        }
+        break;
+
+    case ACI_CMD_CHANGE_TIMING:
+        if ((valid = (NRF8001_MODEL_CONNECTED == model->mode))) {
+            /* without parameters the GAP preferred connection parameters are asked for */
+            model->interval = NRF8001_MODEL_PPCP_INTERVAL;
+            if (length > 1) {
+                memcpy(&model->interval, params, sizeof(model->interval));
+            }
+            send_response(opcode, ACI_STATUS_SUCCESS, NULL, 0);
+
+            aci_evt_t evt;
+            evt.len = 7;
+            evt.evt_opcode = ACI_EVT_TIMING;
+            evt.params.timing.conn_rf_interval = model->interval;
+            evt.params.timing.conn_slave_rf_latency = 0;
+            evt.params.timing.conn_rf_timeout = 500;
+            send_event(&evt);
+        }
+        break;
+
+    case ACI_CMD_SEND_DATA:
+        valid = true;
+        handle_send_data(command);
+        break;
+
+    default:
+        valid = true;
+        send_response(opcode, ACI_STATUS_ERROR_CMD_UNKNOWN, NULL, 0);
+        break;
+    }
+
+    if (!valid) {
+        send_response(opcode, ACI_STATUS_ERROR_DEVICE_STATE_INVALID, NULL, 0);
+    }
+}
+
+/*!
+ * @brief Restarts the model in setup mode, losing the setup
+ *
+ * This is the mock's reset_handler.
+ */
+static void handle_reset(void)
+{
+    nrf8001_model_t *model = &nrf8001_model;
+    model->mode = NRF8001_MODEL_SETUP;
+    model->setup_crc = 0xFFFF;
+    model->setup_id = 0;
+    model->setup_messages = 0;
+    model->credits = NRF8001_MODEL_CREDITS;
+    model->credits_used = 0;
+    memset(model->pipes_open, 0, sizeof(model->pipes_open));
+    memset(model->adv_pipes, 0, sizeof(model->adv_pipes));
+    send_started(ACI_DEVICE_SETUP);
+}
+
+void nrf8001_model_begin(uint8_t rdyn_pin, uint8_t reqn_pin, uint8_t reset_pin,
+                         uint8_t interrupt)
+{
+    memset(&nrf8001_model, 0, sizeof(nrf8001_model));
+    nrf8001_model.mode = NRF8001_MODEL_SETUP;
+    nrf8001_model.interval = 0x18;    /* 30 ms, a phone's usual first interval */
+    nrf8001_model.command_us = 100;
+    nrf8001_model.setup_us = 300;
+
+    nrf8001_mock_begin(rdyn_pin, reqn_pin, reset_pin, interrupt);
+    nrf8001_mock.command_handler = handle_command;
+    nrf8001_mock.reset_handler = handle_reset;
+}
+
+void nrf8001_model_power_cycle(void)
+{
+    nrf8001_mock.count = 0;
+    handle_reset();
+}
+
+bool nrf8001_model_connect(void)
+{
+    nrf8001_model_t *model = &nrf8001_model;
+    if (NRF8001_MODEL_ADVERTISING != model->mode) {
+        return false;
+    }
+    model->mode = NRF8001_MODEL_CONNECTED;
+    model->credits = NRF8001_MODEL_CREDITS;
+    model->credits_used = 0;
+
+    aci_evt_t evt;
+    memset(&evt, 0, sizeof(evt));
+    evt.len = 15;
+    evt.evt_opcode = ACI_EVT_CONNECTED;
+    evt.params.connected.dev_addr_type = ACI_BD_ADDR_TYPE_RANDOM_STATIC;
+    evt.params.connected.conn_rf_interval = model->interval;
+    evt.params.connected.conn_slave_rf_latency = 0;
+    evt.params.connected.conn_rf_timeout = 500;
+    evt.params.connected.master_clock_accuracy = ACI_CLOCK_ACCURACY_50_PPM;
+    send_event(&evt);
+    nrf8001_mock_service();
+    return true;
+}
+
+bool nrf8001_model_open_pipe(uint8_t pipe)
+{
+    nrf8001_model_t *model = &nrf8001_model;
+    if (NRF8001_MODEL_CONNECTED != model->mode || pipe >= 64) {
+        return false;
+    }
+    model->pipes_open[pipe/8] |= 1 << (pipe % 8);
+
+    aci_evt_t evt;
+    memset(&evt, 0, sizeof(evt));
+    evt.len = 17;
+    evt.evt_opcode = ACI_EVT_PIPE_STATUS;
+    memcpy(evt.params.pipe_status.pipes_open_bitmap, model->pipes_open, sizeof(model->pipes_open));
+    send_event(&evt);
+    nrf8001_mock_service();
+    return true;
+}
+
+bool nrf8001_model_write(uint8_t pipe, const uint8_t *data, uint8_t length)
+{
+    if (NRF8001_MODEL_CONNECTED != nrf8001_model.mode || length > ACI_PIPE_RX_DATA_MAX_LEN
+        || 0 == nrf8001_mock_room()) {
+        return false;
+    }
+
+    aci_evt_t evt;
+    evt.len = 2 + length;
+    evt.evt_opcode = ACI_EVT_DATA_RECEIVED;
+    evt.params.data_received.rx_data.pipe_number = pipe;
+    memcpy(evt.params.data_received.rx_data.aci_data, data, length);
+    send_event(&evt);
+    nrf8001_mock_service();
+    return true;
+}
+
+uint8_t nrf8001_model_connection_event(void)
+{
+    nrf8001_model_t *model = &nrf8001_model;
+    uint8_t sent = model->credits_used;
+    if (NRF8001_MODEL_CONNECTED != model->mode || 0 == sent) {
+        return 0;
+    }
+    model->credits += sent;
+    model->credits_used = 0;
+
+    aci_evt_t evt;
+    evt.len = 2;
+    evt.evt_opcode = ACI_EVT_DATA_CREDIT;
+    evt.params.data_credit.credit = sent;
+    send_event(&evt);
+    nrf8001_mock_service();
+    return sent;
+}
+
+bool nrf8001_model_disconnect(void)
+{
+    if (NRF8001_MODEL_CONNECTED != nrf8001_model.mode) {
+        return false;
+    }
+    end_link(ACI_STATUS_EXTENDED, BTLE_REMOTE_TERMINATED);
+    nrf8001_mock_service();
+    return true;
+}
+
+uint8_t nrf8001_model_scan(uint8_t pipe, uint8_t *data)
+{
+    nrf8001_model_t *model = &nrf8001_model;
+    if (NRF8001_MODEL_BROADCASTING != model->mode || pipe >= NRF8001_MODEL_PIPES
+        || !(model->adv_pipes[pipe/8] & (1 << (pipe % 8)))) {
+        return 0;
+    }
+    memcpy(data, model->local_data[pipe], model->local_length[pipe]);
+    return model->local_length[pipe];
+}
@@ -0,0 +1,191 @@
+/*!
+ * @file
+ *
+ * @brief Header file for the nRF8001 device model used by host tools
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains the data structures and function prototypes of
+ * a behavioral model of the nRF8001, built on the mock nRF8001, so the
+ * Nordic driver, aci_setup and the Bluetooth module run unchanged on
+ * the host.
+ *
+ * The model answers the driver's commands as the nRF8001 does in each
+ * operating mode:
+ *
+ *    setup        After a pin reset the model starts in setup mode.
+ *                 Setup messages are answered with Transaction
+ *                 Continue, and the last, which carries the CRC of
+ *                 the setup, with Transaction Complete and Device
+ *                 Started in standby, or CRC Mismatch.
+ *    standby      Connect starts advertising, Broadcast starts
+ *                 broadcasting, Sleep sleeps, Radio Reset, Get Device
+ *                 Version, Set Local Data, Open Adv Pipe and Echo are
+ *                 answered.
+ *    sleep        Wakeup returns to standby. The setup is kept
+ *                 while asleep, only a pin reset or a power cycle
+ *                 loses it.
+ *    advertising  The phone can connect.
+ *    broadcasting The local data of the pipes opened for advertising
+ *                 goes out in the advertising packets, for any phone
+ *                 to scan. Radio Reset returns to standby.
+ *    connected    Send Data takes a data credit and goes to the phone,
+ *                 Change Timing answers with a Timing event and
+ *                 Disconnect ends the link.
+ *
+ * Commands in the wrong mode are answered with Device State Invalid.
+ * The phone's side is played by the tool through the functions below:
+ * connecting, opening pipes, writing to pipes, running connection
+ * events, which return the credits used, disconnecting and scanning
+ * broadcasts.
+ *
+ * Events are sent as soon as a command is handled. Under
+ * host_virtual_time the model charges the time the nRF8001 takes to
+ * handle each command, so the driver's busy waits see it. The times
+ * are assumptions and can be changed in nrf8001_model.
+ */
+
+#ifndef NRF8001_MODEL_H
+#define NRF8001_MODEL_H
+
+#include <stdint.h>
+
+#include "nrf8001_mock.h"
+
+#define NRF8001_MODEL_CREDITS 2             /*!< Data credits given in Device Started */
+#define NRF8001_MODEL_PIPES 63              /*!< Pipe numbers the model keeps local data for */
+#define NRF8001_MODEL_PPCP_INTERVAL 0x10    /*!< Interval Change Timing asks for without one, in 1.25 ms */
+
+/*!
+ * @brief enum holding the operating modes of the nRF8001
+ */
+enum nrf8001_model_mode_t {NRF8001_MODEL_SETUP, NRF8001_MODEL_STANDBY, NRF8001_MODEL_SLEEP,
+                           NRF8001_MODEL_ADVERTISING, NRF8001_MODEL_CONNECTED,
+                           NRF8001_MODEL_BROADCASTING};
+
+/*!
+ * @brief struct holding the state of the nRF8001 model
+ */
+struct nrf8001_model_t {
+    nrf8001_model_mode_t mode;                 /*!< Operating mode */
+
+    uint16_t setup_crc;                        /*!< CRC of the setup messages received so far */
+    uint16_t setup_id;                         /*!< CRC of the accepted setup, 0 without one */
+    uint8_t setup_messages;                    /*!< Setup messages received since the reset */
+
+    uint8_t credits;                           /*!< Data credits the driver has */
+    uint8_t credits_used;                      /*!< Credits used since the last connection event */
+    uint16_t adv_interval;                     /*!< Advertising interval, in 0.625 ms */
+    uint16_t interval;                         /*!< Connection interval, in 1.25 ms */
+    uint8_t pipes_open[8];                     /*!< Bitmap of the open pipes */
+    uint8_t adv_pipes[8];                      /*!< Bitmap of the pipes opened for advertising */
+
+    uint8_t local_data[NRF8001_MODEL_PIPES][ACI_PIPE_TX_DATA_MAX_LEN];  /*!< Set Local Data by pipe */
+    uint8_t local_length[NRF8001_MODEL_PIPES]; /*!< Length of the local data by pipe */
+
+    /*! Called with the data of each Send Data command */
+    void (*data_handler)(uint8_t pipe, const uint8_t *data, uint8_t length);
+
+    unsigned long command_us;                  /*!< Time to handle a command, in us */
+    unsigned long setup_us;                    /*!< Time to store a setup message, in us */
+
+    unsigned long packets;                     /*!< Number of data packets sent to the phone */
+    unsigned long errors;                      /*!< Number of commands answered with an error */
+    unsigned long lost;                        /*!< Number of events the mock had no room for */
+};
+
+extern nrf8001_model_t nrf8001_model;
+
+/*!
+ * @brief Puts the model on the host pins and SPI bus
+ *
+ * Starts the mock nRF8001 with the model's handlers. The model stays
+ * powered off until the driver's pin reset.
+ *
+ * @param[in]  rdyn_pin   Pin of RDYN
+ * @param[in]  reqn_pin   Pin of REQN
+ * @param[in]  reset_pin  Pin of RESET
+ * @param[in]  interrupt  Interrupt attached to RDYN
+ *
+ * @returns    Nothing.
+ *
+ */
+void nrf8001_model_begin(uint8_t rdyn_pin, uint8_t reqn_pin, uint8_t reset_pin,
+                         uint8_t interrupt);
+
+/*!
+ * @brief Cuts and restores the nRF8001's power
+ *
+ * The model loses its setup and any events it held, as on a pin
+ * reset, and sends Device Started in setup mode.
+ *
+ * @returns    Nothing.
+ *
+ */
+void nrf8001_model_power_cycle(void);
+
+/*!
+ * @brief Connects the phone to the advertising nRF8001
+ *
+ * @returns    True if connected, false if the model was not advertising
+ *
+ */
+bool nrf8001_model_connect(void);
+
+/*!
+ * @brief Opens a pipe, as the phone does by enabling notifications
+ *
+ * @param[in]  pipe  Pipe to open
+ *
+ * @returns    True if opened, false if not connected
+ *
+ */
+bool nrf8001_model_open_pipe(uint8_t pipe);
+
+/*!
+ * @brief Writes data from the phone to a pipe
+ *
+ * @param[in]  pipe    Pipe written to
+ * @param[in]  data    Data written
+ * @param[in]  length  Length of the data
+ *
+ * @returns    True if sent to the driver, false if not connected or
+ *             the nRF8001 has no room, as link layer flow control
+ *             would hold the write back
+ *
+ */
+bool nrf8001_model_write(uint8_t pipe, const uint8_t *data, uint8_t length);
+
+/*!
+ * @brief Runs a connection event, returning the credits used since the last
+ *
+ * @returns    Number of packets sent to the phone, whose credits are
+ *             returned in a Data Credit event
+ *
+ */
+uint8_t nrf8001_model_connection_event(void);
+
+/*!
+ * @brief Disconnects the phone
+ *
+ * @returns    True if disconnected, false if not connected
+ *
+ */
+bool nrf8001_model_disconnect(void);
+
+/*!
+ * @brief Scans the broadcast data of a pipe, as a phone in range sees it
+ *
+ * @param[in]  pipe  Pipe whose service data is read
+ * @param[out] data  Buffer for the data, ACI_PIPE_TX_DATA_MAX_LEN bytes
+ *
+ * @returns    Length of the data, 0 if not broadcasting or the pipe is
+ *             not opened for advertising
+ *
+ */
+uint8_t nrf8001_model_scan(uint8_t pipe, uint8_t *data);
+
+#endif
@@ -0,0 +1,670 @@
+/*!
+ * @file
+ *
+ * @brief Host fuzzing and differential testing harness for the GPS parser
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains a harness which feeds arbitrary bytes to the
+ * firmware's gps_available(), gps_valid() and gps_parse(), checking
+ * after every epoch that the receive state stays inside its buffer and
+ * that decoded positions are on the globe.
+ *
+ * Every RMC and GGA line is also checked against a reference parser,
+ * written independently and strictly from the NMEA format. The line is
+ * sent on its own, followed by a datastring with a later time which
+ * closes its epoch. Lines with a bad checksum, or of types the firmware
+ * does not handle, must not produce an epoch. Lines the reference finds well formed must
+ * produce exactly the fields it expects. Other lines with a good
+ * checksum are only held to the safety checks.
+ *
+ * Without libFuzzer, the harness generates well formed lines, mutates
+ * half of them (byte flips, insertions, deletions, truncation, overlong
+ * fields, with the checksum fixed up half the time so that the field
+ * parsers are reached) and sends them one by one and as a stream mixed
+ * with MTK binary packets. It then reports parser throughput on clean
+ * RMC, GGA and GSA output, and with -m fails if it is slower than a
+ * given time per line, so that parser changes can be checked for
+ * safety and speed together.
+ *
+ * Build and run with sanitizers
+ *    g++ -O1 -g -fsanitize=address,undefined -Ihost -I../src -o nmea_fuzz \
+ *        nmea_fuzz.cpp host/host.cpp ../src/gps.cpp
+ *    ./nmea_fuzz [-n cases] [-s seed] [-m max_ns_per_line]
+ *
+ * or as a libFuzzer target
+ *    clang++ -O1 -g -fsanitize=fuzzer,address,undefined -DLIBFUZZER -Ihost \
+ *        -I../src -o nmea_fuzz nmea_fuzz.cpp host/host.cpp ../src/gps.cpp
+ *    ./nmea_fuzz corpus/
+ *
+ * Throughput is only meaningful in a build without sanitizers.
+ */
+
+#include <math.h>
+#include <string>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "gps.h"
+
+/* Datastrings closing the epoch of a line. A line is followed by one of
+   another type, or the epoch would be replaced by the newer one */
+#define FLUSH_RMC "$GPRMC,235959.999,V,,,,,,,181015,,,N"
+#define FLUSH_GGA "$GPGGA,235959.999,,,,,0,00,,,M,,M,,"
+#define FLUSH_CLOCK 86399999UL  /*!< Time of day of the flush lines, in ms */
+#define COORDINATE_TOLERANCE 3e-5  /*!< Float precision at 180 degrees, in degrees */
+#define MAX_REPORTS 10          /*!< Failures printed before going quiet */
+
+/*!
+ * @brief struct holding the fields the reference parser expects
+ */
+struct reference_t {
+    bool accepted;       /*!< Checksum good and a handled type (RMC, GGA, GSA, VTG) */
+    bool well_formed;    /*!< Every field is strictly valid */
+    bool rmc;            /*!< Flag set for RMC, clear for GGA */
+    long clock;          /*!< Milliseconds since midnight, or -1 */
+    gps_data_t data;     /*!< Expected fields, 0 where missing */
+    bool valid;          /*!< Expected valid flag */
+};
+
+/* Number of failures found */
+static long failures = 0;
+
+/* Number of lines compared field by field with the reference */
+static long compared = 0;
+
+/*!
+ * @brief Reports a failure
+ *
+ * @param[in]  what  Description of the failure
+ * @param[in]  line  Line being tested, or NULL
+ *
+ * @returns    Nothing.
+ *
+ */
+static void fail(const char *what, const char *line)
+{
+    if (failures++ < MAX_REPORTS) {
+        fprintf(stderr, "FAIL %s: %s\n", what, line ? line : "(stream)");
+    }
+}
+
+/*!
+ * @brief Checks the receive state and the latest epoch of a GPS struct
+ *
+ * @param[in]  gps   Pointer to GPS struct after gps_available returned 1
+ * @param[in]  line  Line being tested, or NULL
+ *
+ * @returns    Nothing.
+ *
+ */
+static void check_safety(gps_t *gps, const char *line)
+{
+    if (gps->index < 0 || gps->index > NMEA_LINE_LENGTH) fail("index out of buffer", line);
+    if (gps->binary_step > 5) fail("binary step out of range", line);
+
+    gps_data_t data;
+    gps_valid(gps);
+    gps_parse(gps, &data);
+    if (!(fabs(data.location.latitude) <= 90) || !(fabs(data.location.longitude) <= 180)) {
+        fail("location off the globe", line);
+    }
+}
+
+/*!
+ * @brief Splits a line into its comma separated fields
+ */
+static int split(const std::string &body, std::string *fields, int max)
+{
+    int count = 0;
+    size_t start = 0;
+    while (count < max) {
+        size_t comma = body.find(',', start);
+        fields[count++] = body.substr(start, comma == std::string::npos ? std::string::npos
+                                                                      : comma - start);
+        if (comma == std::string::npos) break;
+        start = comma + 1;
+    }
+    return count;
+}
+
+/*!
+ * @brief Checks that a field is all digits, optionally with one decimal point
+ */
+static bool is_number(const std::string &field, bool sign, bool decimals)
+{
+    size_t i = sign && !field.empty() && field[0] == '-' ? 1 : 0;
+    size_t digits = 0, dot = std::string::npos;
+    for (; i < field.size(); i++) {
+        if (field[i] >= '0' && field[i] <= '9') {
+            digits++;
+        } else if (field[i] == '.' && decimals && dot == std::string::npos) {
+            dot = i;
+        } else {
+            return false;
+        }
+    }
+    return digits > 0 && (dot == std::string::npos || dot + 1 < field.size());
+}
+
+/*!
+ * @brief Parses a strict hhmmss(.s) time of day
+ *
+ * @returns    Milliseconds since midnight, or -1 if invalid
+ */
+static long reference_clock(const std::string &field)
+{
+    if (field.size() < 6 || !is_number(field, false, true) || field.find('.') < 6
+            || (field.size() > 6 && field[6] != '.')) {
+        return -1;
+    }
+    int hours = atoi(field.substr(0, 2).c_str());
+    int minutes = atoi(field.substr(2, 2).c_str());
+    int seconds = atoi(field.substr(4, 2).c_str());
+    if (hours > 23 || minutes > 59 || seconds > 59) return -1;
+
+    /* digits past milliseconds are dropped, not rounded */
+    long milliseconds = 0;
+    long scale = 100;
+    for (size_t i = 7; i < field.size() && scale; i++, scale /= 10) {
+        milliseconds += (field[i] - '0')*scale;
+    }
+    return ((hours*60L + minutes)*60 + seconds)*1000 + milliseconds;
+}
+
+/*!
+ * @brief Parses a strict ddmmyy date
+ *
+ * @returns    Days since 1 January 2000, or -1 if invalid
+ */
+static long reference_days(const std::string &field)
+{
+    if (field.size() != 6 || !is_number(field, false, false)) return -1;
+    int day = atoi(field.substr(0, 2).c_str());
+    int month = atoi(field.substr(2, 2).c_str());
+    int year = atoi(field.substr(4, 2).c_str());
+    if (day < 1 || day > 31 || month < 1 || month > 12) return -1;
+
+    /* counted day by day, unlike the firmware */
+    static const int month_days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    long days = 0;
+    for (int y = 0; y < year; y++) days += y % 4 == 0 ? 366 : 365;
+    for (int m = 1; m < month; m++) days += month_days[m - 1] + (m == 2 && year % 4 == 0);
+    return days + day - 1;
+}
+
+/*!
+ * @brief Parses a strict ddmm.mmmm or dddmm.mmmm coordinate and hemisphere
+ *
+ * @returns    True if valid
+ */
+static bool reference_coordinate(const std::string &field, const std::string &hemisphere,
+                                 int degree_digits, double max, char negative,
+                                 char positive, double *coordinate)
+{
+    if (field.size() < (size_t)degree_digits + 4 || field[degree_digits + 2] != '.'
+            || !is_number(field, false, true) || hemisphere.size() != 1
+            || (hemisphere[0] != negative && hemisphere[0] != positive)) {
+        return false;
+    }
+    double degrees = atoi(field.substr(0, degree_digits).c_str());
+    double minutes = atof(field.substr(degree_digits).c_str());
+    if (minutes >= 60) return false;
+    *coordinate = degrees + minutes/60;
+    if (*coordinate > max) return false;
+    if (hemisphere[0] == negative) *coordinate = -*coordinate;
+    return true;
+}
+
+/*!
+ * @brief Parses an RMC or GGA line the way the NMEA format defines it
+ *
+ * The line is cut to the firmware's buffer length first, as the GPS
+ * struct would be. GGA fields after the first empty one are not
+ * expected, as the firmware stops there.
+ *
+ * @param[in]  text  Line without its line ending
+ *
+ * @returns    Expected results of the line
+ *
+ */
+static reference_t reference_parse(std::string text)
+{
+    reference_t result = {};
+    result.clock = -1;
+    text = text.substr(0, NMEA_LINE_LENGTH);
+
+    /* $<body>*<two hex digits> */
+    size_t star = text.find('*');
+    if (text.size() < 7 || text[0] != '$' || star == std::string::npos
+            || star + 2 >= text.size() || !isxdigit((uint8_t)text[star + 1])
+            || !isxdigit((uint8_t)text[star + 2])) {
+        return result;
+    }
+    uint8_t checksum = 0;
+    for (size_t i = 1; i < star; i++) checksum ^= (uint8_t)text[i];
+    if (checksum != strtol(text.substr(star + 1, 2).c_str(), NULL, 16)) return result;
+
+    std::string body = text.substr(1, star - 1);
+    if (body.size() < 6 || body[5] != ',') return result;
+    std::string id = body.substr(2, 3);
+    if (id != "RMC" && id != "GGA" && id != "GSA" && id != "VTG") return result;
+    result.accepted = true;
+    result.rmc = id == "RMC";
+    if (id == "GSA" || id == "VTG") return result;
+
+    std::string talker = body.substr(0, 2);
+    if (talker != "GP" && talker != "GN") return result;
+
+    std::string f[20];
+    int count = split(body, f, 20);
+    gps_data_t *data = &result.data;
+    bool ok = true;
+
+    if (!f[1].empty()) {
+        result.clock = reference_clock(f[1]);
+        ok = ok && result.clock >= 0;
+    }
+
+    /* location fields are both present or both empty */
+    int lat = result.rmc ? 3 : 2;
+    if (count < lat + 4) return result;
+    if (!f[lat].empty() && !f[lat + 2].empty()) {
+        double latitude = 0, longitude = 0;
+        ok = ok && reference_coordinate(f[lat], f[lat + 1], 2, 90, 'S', 'N', &latitude)
+                && reference_coordinate(f[lat + 2], f[lat + 3], 3, 180, 'W', 'E', &longitude);
+        data->location.latitude = latitude;
+        data->location.longitude = longitude;
+    } else {
+        ok = ok && f[lat].empty() && f[lat + 1].empty() && f[lat + 2].empty()
+                && f[lat + 3].empty();
+    }
+
+    if (result.rmc) {
+        if (count < 10) return result;
+        ok = ok && (f[2] == "A" || f[2] == "V");
+        result.valid = f[2] == "A";
+        if (!f[7].empty()) {
+            ok = ok && is_number(f[7], false, true);
+            data->speed = atof(f[7].c_str())*1.150779;
+        }
+        if (!f[8].empty()) {
+            ok = ok && is_number(f[8], false, true);
+            data->course = atof(f[8].c_str());
+        }
+        long days = -1;
+        if (!f[9].empty()) {
+            days = reference_days(f[9]);
+            ok = ok && days >= 0;
+        }
+        if (days >= 0 && result.clock >= 0) {
+            data->time = days*86400UL + result.clock/1000;
+            data->milliseconds = result.clock % 1000;
+        }
+    } else {
+        if (count < 10) return result;
+        /* quality, satellites, hdop, altitude */
+        for (int i = 6; i <= 9 && !f[i].empty(); i++) {
+            bool decimals = i >= 8;
+            ok = ok && is_number(f[i], i == 9, decimals) && (decimals || f[i].size() <= 2);
+            switch (i) {
+            case 6: data->fix_quality = atoi(f[i].c_str()); break;
+            case 7: data->satellites = atoi(f[i].c_str()); break;
+            case 8: data->hdop = atof(f[i].c_str()); break;
+            case 9: data->altitude = atof(f[i].c_str()); break;
+            }
+        }
+    }
+
+    result.well_formed = ok;
+    return result;
+}
+
+/*!
+ * @brief Checks that two values agree within a tolerance
+ */
+static bool close_to(double a, double b, double tolerance)
+{
+    return fabs(a - b) <= tolerance*fmax(1.0, fabs(b));
+}
+
+/*!
+ * @brief Sends one line through the firmware and checks it against the reference
+ *
+ * @param[in]  text  Line without its line ending
+ *
+ * @returns    Nothing.
+ *
+ */
+static void check_line(const std::string &text)
+{
+    /* line endings, NULs and binary preambles would split the line */
+    for (size_t i = 0; i < text.size(); i++) {
+        uint8_t c = text[i];
+        if (c == '\r' || c == '\n' || c == '\0' || c == 0xD1) return;
+    }
+
+    reference_t expected = reference_parse(text);
+    if (expected.clock == (long)FLUSH_CLOCK) return;
+
+    const char *flush = expected.rmc ? FLUSH_GGA : FLUSH_RMC;
+    uint8_t checksum = 0;
+    for (const char *c = flush + 1; *c; c++) checksum ^= *c;
+    char flush_line[64];
+    snprintf(flush_line, sizeof(flush_line), "%s*%02X\r\n", flush, checksum);
+    std::string stream = text + "\r\n" + flush_line;
+
+    gps_t gps;
+    gps_reset_epoch(&gps);
+    Serial1.receive((const uint8_t*)stream.data(), stream.size());
+
+    int epochs = 0;
+    gps_data_t data = {};
+    boolean valid = false;
+    while (gps_available(&gps)) {
+        check_safety(&gps, text.c_str());
+        valid = gps_valid(&gps);
+        gps_parse(&gps, &data);
+        epochs++;
+    }
+
+    if (!expected.accepted) {
+        if (epochs != 0) fail("rejected line produced an epoch", text.c_str());
+        return;
+    }
+    if (epochs != 1) {
+        fail("accepted line did not produce one epoch", text.c_str());
+        return;
+    }
+    if (!expected.well_formed) return;
+
+    compared++;
+    const gps_data_t *want = &expected.data;
+    bool same = close_to(data.location.latitude, want->location.latitude, COORDINATE_TOLERANCE)
+        && close_to(data.location.longitude, want->location.longitude, COORDINATE_TOLERANCE)
+        && close_to(data.speed, want->speed, 1e-5)
+        && close_to(data.course, want->course, 1e-5)
+        && data.time == want->time
+        && data.milliseconds == want->milliseconds
+        && data.fix_quality == want->fix_quality
+        && data.satellites == want->satellites
+        && close_to(data.hdop, want->hdop, 1e-5)
+        && close_to(data.altitude, want->altitude, 1e-5)
+        && (bool)valid == (expected.rmc && expected.valid);
+    if (!same) {
+        fail("fields differ from the reference", text.c_str());
+        if (failures <= MAX_REPORTS) {
+            fprintf(stderr, "  got  %.6f %.6f %.3f %.2f %u.%03u q%u s%u %.2f %.1f %d\n"
+                    "  want %.6f %.6f %.3f %.2f %u.%03u q%u s%u %.2f %.1f %d\n",
+                    data.location.latitude, data.location.longitude, data.speed,
+                    data.course, data.time, data.milliseconds, data.fix_quality,
+                    data.satellites, data.hdop, data.altitude, valid,
+                    want->location.latitude, want->location.longitude, want->speed,
+                    want->course, want->time, want->milliseconds, want->fix_quality,
+                    want->satellites, want->hdop, want->altitude,
+                    expected.rmc && expected.valid);
+        }
+    }
+}
+
+/*!
+ * @brief Sends a byte stream through the firmware, checking every epoch
+ *
+ * @param[in]  data  Bytes received from the GPS
+ * @param[in]  size  Number of bytes
+ *
+ * @returns    Number of epochs
+ *
+ */
+static long check_stream(const uint8_t *data, size_t size)
+{
+    gps_t gps;
+    gps_reset_epoch(&gps);
+    Serial1.receive(data, size);
+
+    long epochs = 0;
+    while (gps_available(&gps)) {
+        check_safety(&gps, NULL);
+        epochs++;
+    }
+    if (gps.index < 0 || gps.index > NMEA_LINE_LENGTH) fail("index out of buffer", NULL);
+    return epochs;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    check_stream(data, size);
+
+    /* and each line on its own */
+    std::string input((const char*)data, size);
+    size_t start = 0;
+    for (int lines = 0; start < input.size() && lines < 64; lines++) {
+        size_t end = input.find('\n', start);
+        if (end == std::string::npos) end = input.size();
+        std::string line = input.substr(start, end - start);
+        if (!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+        check_line(line);
+        start = end + 1;
+    }
+
+    if (failures) abort();
+    return 0;
+}
+
+#ifndef LIBFUZZER
+
+/*!
+ * @brief Appends the checksum to a line body
+ */
+static std::string with_checksum(const std::string &body)
+{
+    uint8_t checksum = 0;
+    for (size_t i = 0; i < body.size(); i++) checksum ^= (uint8_t)body[i];
+    char tail[4];
+    snprintf(tail, sizeof(tail), "*%02X", checksum);
+    return "$" + body + tail;
+}
+
+/*!
+ * @brief Draws a random number below a bound
+ */
+static long below(long bound)
+{
+    return random() % bound;
+}
+
+/*!
+ * @brief Generates the body of a well formed RMC, GGA or GSA datastring
+ *
+ * @param[in]  type   0 RMC, 1 GGA, 2 GSA
+ * @param[in]  clock  Time of day, in ms
+ *
+ * @returns    Body between '$' and '*'
+ *
+ */
+static std::string generate(int type, long clock)
+{
+    /* room for any value the formats can take, though the fields
+       generated keep the datastrings within NMEA_LINE_LENGTH */
+    char time[32], location[64], body[2*NMEA_LINE_LENGTH];
+    snprintf(time, sizeof(time), "%02ld%02ld%02ld.%03ld", clock/3600000, clock/60000 % 60,
+             clock/1000 % 60, clock % 1000);
+
+    bool fix = below(8) != 0;
+    if (fix) {
+        snprintf(location, sizeof(location), "%02ld%02ld.%04ld,%c,%03ld%02ld.%04ld,%c",
+                 below(90), below(60), below(10000), below(2) ? 'N' : 'S',
+                 below(180), below(60), below(10000), below(2) ? 'E' : 'W');
+    } else {
+        snprintf(location, sizeof(location), ",,,");
+    }
+
+    switch (type) {
+    case 0:
+        snprintf(body, sizeof(body), "GPRMC,%s,%c,%s,%ld.%02ld,%ld.%02ld,%02ld%02ld%02ld,,,%c",
+                 time, fix ? 'A' : 'V', location, below(100), below(100), below(360),
+                 below(100), below(31) + 1, below(12) + 1, below(100), fix ? 'A' : 'N');
+        break;
+    case 1:
+        snprintf(body, sizeof(body), "GPGGA,%s,%s,%d,%02ld,%ld.%02ld,%ld.%ld,M,-19.6,M,,",
+                 time, location, fix ? 1 : 0, below(13), below(20), below(100),
+                 below(3000) - 400, below(10));
+        break;
+    default:
+        snprintf(body, sizeof(body), "GPGSA,A,%d,29,21,26,15,18,09,06,10,,,,,2.32,0.95,2.11",
+                 fix ? 3 : 1);
+        break;
+    }
+    return body;
+}
+
+/*!
+ * @brief Mutates a line
+ *
+ * The checksum is fixed up half the time, so that mutations reach the
+ * field parsers.
+ *
+ * @param[in]  line  Line with its checksum
+ *
+ * @returns    Mutated line
+ *
+ */
+static std::string mutate(std::string line)
+{
+    static const char interesting[] = ",.*$-09AFafNSEWV\r\n";
+    int mutations = 1 + below(4);
+    for (int i = 0; i < mutations && !line.empty(); i++) {
+        size_t at = below(line.size());
+        switch (below(7)) {
+        case 0: line[at] ^= 1 << below(8); break;
+        case 1: line.insert(at, 1, interesting[below(sizeof(interesting) - 1)]); break;
+        case 2: line.insert(at, 1, (char)below(256)); break;
+        case 3: line.erase(at, 1); break;
+        case 4: line.erase(at); break;
+        case 5: line.insert(at, std::string(1 + below(120), '0' + below(10))); break;
+        case 6: line[at] = interesting[below(sizeof(interesting) - 1)]; break;
+        }
+    }
+
+    size_t star = line.rfind('*');
+    if (below(2) && line.size() > 1 && line[0] == '$' && star != std::string::npos) {
+        line = with_checksum(line.substr(1, star - 1));
+    }
+    return line;
+}
+
+/*!
+ * @brief Appends an MTK binary packet with a random payload
+ */
+static void put_binary(std::string *stream)
+{
+    uint8_t checksum_a = GPS_BINARY_PAYLOAD_LENGTH, checksum_b = GPS_BINARY_PAYLOAD_LENGTH;
+    *stream += (char)0xD1;
+    *stream += (char)0xDD;
+    *stream += (char)GPS_BINARY_PAYLOAD_LENGTH;
+    for (int i = 0; i < GPS_BINARY_PAYLOAD_LENGTH; i++) {
+        uint8_t c = below(256);
+        *stream += (char)c;
+        checksum_a += c;
+        checksum_b += checksum_a;
+    }
+    /* most packets are sent intact, the rest cut short or corrupted */
+    if (below(4) == 0) stream->erase(stream->size() - below(20));
+    *stream += (char)(below(8) ? checksum_a : below(256));
+    *stream += (char)checksum_b;
+}
+
+/*!
+ * @brief Measures the parser on clean output
+ *
+ * @param[in]  epochs  Number of RMC, GGA and GSA epochs to parse
+ *
+ * @returns    Time per line, in ns
+ *
+ */
+static double measure(long epochs)
+{
+    std::string stream;
+    for (long i = 0; i < epochs; i++) {
+        long clock = i*200 % 86000000;
+        for (int type = 0; type < 3; type++) {
+            stream += with_checksum(generate(type, clock)) + "\r\n";
+        }
+    }
+
+    const int repeats = 5;
+    long found = 0;
+    struct timespec start, done;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < repeats; r++) {
+        gps_t gps;
+        gps_reset_epoch(&gps);
+        Serial1.receive((const uint8_t*)stream.data(), stream.size());
+        while (gps_available(&gps)) found++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &done);
+
+    double ns = (done.tv_sec - start.tv_sec)*1e9 + (done.tv_nsec - start.tv_nsec);
+    double lines = 3.0*epochs*repeats;
+    fprintf(stderr, "%.1f MB/s, %.0f ns per line, %ld/%ld epochs\n",
+            stream.size()*repeats/ns*1e3, ns/lines, found/repeats, epochs);
+    return ns/lines;
+}
+
+int main(int argc, char **argv)
+{
+    long cases = 200000;
+    unsigned seed = 1;
+    double max_ns = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:m:")) != -1) {
+        switch (opt) {
+        case 'n': cases = strtol(optarg, NULL, 10); break;
+        case 's': seed = strtoul(optarg, NULL, 10); break;
+        case 'm': max_ns = atof(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-n cases] [-s seed] [-m max_ns_per_line]\n", argv[0]);
+            return 1;
+        }
+    }
+    srandom(seed);
+
+    long mutated = 0, epochs = 0;
+    std::string stream;
+    for (long i = 0; i < cases; i++) {
+        std::string line = with_checksum(generate(below(3), below(86000000)));
+        if (below(2)) {
+            line = mutate(line);
+            mutated++;
+        }
+        check_line(line);
+
+        stream += line + "\r\n";
+        if (below(8) == 0) put_binary(&stream);
+        if (stream.size() > 65536) {
+            epochs += check_stream((const uint8_t*)stream.data(), stream.size());
+            stream.clear();
+        }
+    }
+    epochs += check_stream((const uint8_t*)stream.data(), stream.size());
+
+    fprintf(stderr, "%ld lines (%ld mutated, %ld compared with the reference), "
+            "%ld stream epochs, %ld failures\n", cases, mutated, compared, epochs, failures);
+
+    double ns = measure(100000);
+    if (max_ns > 0 && ns > max_ns) {
+        fprintf(stderr, "FAIL %.0f ns per line, limit %.0f\n", ns, max_ns);
+        return 1;
+    }
+    return failures ? 1 : 0;
+}
+
+#endif
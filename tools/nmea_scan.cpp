@@ -0,0 +1,181 @@
+/*!
+ * @file
+ *
+ * @brief Host tool verifying NMEA captures
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains a command line tool which walks NMEA captures
+ * with the corpus loader, counting sentences and checksum failures,
+ * and reports the scanning throughput. It can also write a synthetic
+ * capture of a given size to measure throughput on large inputs.
+ *
+ * With -m the synthetic capture holds the mixed GGA, GSA, GSV, RMC and
+ * VTG output of a receiver with all sentences enabled. With -a every
+ * sentence is also fed to the firmware's epoch assembly (gps_assemble()),
+ * reporting epochs found and the assembly cost per epoch.
+ *
+ * Build and run with
+ *    g++ -O2 -Ihost -I../src -o nmea_scan nmea_scan.cpp host/nmea_corpus.cpp \
+ *        host/host.cpp ../src/gps.cpp
+ *    ./nmea_scan -m -g 1000000000 mixed.nmea
+ *    ./nmea_scan -a mixed.nmea
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nmea_corpus.h"
+
+/*!
+ * @brief Writes a sentence with its checksum
+ *
+ * @param[in]  file     Capture to write to
+ * @param[in]  body     Sentence between '$' and '*'
+ * @param[in]  corrupt  Flag to write a wrong checksum
+ *
+ * @returns    Number of bytes written
+ *
+ */
+static int put_sentence(FILE *file, const char *body, bool corrupt)
+{
+    uint8_t checksum = 0;
+    for (const char *c = body; *c; c++) checksum ^= *c;
+    if (corrupt) checksum ^= 0x5A;
+
+    return fprintf(file, "$%s*%02X\r\n", body, checksum);
+}
+
+/*!
+ * @brief Writes a synthetic capture of RMC or mixed sentences
+ *
+ * Every 1000th sentence has a corrupted checksum.
+ *
+ * @param[in]  path   Path of the capture to write
+ * @param[in]  size   Approximate size of the capture in bytes
+ * @param[in]  mixed  Flag to write GGA, GSA, GSV, RMC and VTG epochs
+ *
+ * @returns    True on success
+ *
+ */
+static bool generate(const char *path, unsigned long long size, bool mixed)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) return false;
+
+    static char buffer[1 << 20];
+    setvbuf(file, buffer, _IOFBF, sizeof(buffer));
+
+    unsigned long long written = 0;
+    unsigned long count = 0;
+    for (unsigned long i = 0; written < size; i++) {
+        char time[16], latitude[16], longitude[16], body[NMEA_LINE_LENGTH];
+        double knots = (double)(i % 2000)/100;
+        snprintf(time, sizeof(time), "%02lu%02lu%02lu.000", i/3600 % 24, i/60 % 60, i % 60);
+        snprintf(latitude, sizeof(latitude), "4530.%04lu,N", i % 10000);
+        snprintf(longitude, sizeof(longitude), "12236.%04lu,W", (i*3) % 10000);
+
+        if (mixed) {
+            snprintf(body, sizeof(body), "GPGGA,%s,%s,%s,1,09,0.92,%.1f,M,-19.6,M,,",
+                     time, latitude, longitude, 30 + (double)(i % 500)/10);
+            written += put_sentence(file, body, ++count % 1000 == 0);
+            written += put_sentence(file,
+                "GPGSA,A,3,10,07,05,02,29,04,08,13,09,,,,1.72,0.92,1.46",
+                ++count % 1000 == 0);
+            if (i % 5 == 0) {
+                written += put_sentence(file,
+                    "GPGSV,3,1,12,10,63,137,17,07,61,098,15,05,59,290,20,08,54,157,30",
+                    ++count % 1000 == 0);
+            }
+        }
+
+        snprintf(body, sizeof(body), "GPRMC,%s,A,%s,%s,%04.2f,165.48,181015,,,A",
+                 time, latitude, longitude, knots);
+        written += put_sentence(file, body, ++count % 1000 == 0);
+
+        if (mixed) {
+            snprintf(body, sizeof(body), "GPVTG,165.48,T,,M,%04.2f,N,%.2f,K,A",
+                     knots, knots*1.852);
+            written += put_sentence(file, body, ++count % 1000 == 0);
+        }
+    }
+
+    return fclose(file) == 0;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long long generate_size = 0;
+    bool mixed = false, assemble = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "g:ma")) != -1) {
+        switch (opt) {
+        case 'g': generate_size = strtoull(optarg, NULL, 10); break;
+        case 'm': mixed = true; break;
+        case 'a': assemble = true; break;
+        default:
+            fprintf(stderr, "usage: %s [-m] [-g bytes] [-a] capture...\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "usage: %s [-m] [-g bytes] [-a] capture...\n", argv[0]);
+        return 1;
+    }
+
+    if (generate_size) {
+        if (!generate(argv[optind], generate_size, mixed)) {
+            perror(argv[optind]);
+            return 1;
+        }
+        return 0;
+    }
+
+    unsigned long long bytes = 0, sentences = 0, bad = 0, epochs = 0;
+    struct timespec start, done;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int i = optind; i < argc; i++) {
+        nmea_corpus_t corpus;
+        if (!nmea_corpus_open(&corpus, argv[i])) {
+            perror(argv[i]);
+            return 1;
+        }
+
+        gps_t gps;
+        gps_reset_epoch(&gps);
+
+        nmea_sentence_t sentence;
+        while (nmea_corpus_next(&corpus, &sentence)) {
+            sentences++;
+            bad += !sentence.checksum_ok;
+            if (assemble) {
+                nmea_sentence_to_gps(&sentence, &gps);
+                epochs += gps_assemble(&gps);
+            }
+        }
+        bytes += corpus.size;
+        nmea_corpus_close(&corpus);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &done);
+    double seconds = (done.tv_sec - start.tv_sec) + (done.tv_nsec - start.tv_nsec)/1e9;
+
+    printf("%llu sentences, %llu bad checksums\n", sentences, bad);
+    if (assemble) {
+        printf("%llu epochs\n", epochs);
+        fprintf(stderr, "%.0f ns per epoch, %.2f sentences per epoch\n",
+                epochs ? seconds/epochs*1e9 : 0.0,
+                epochs ? (double)sentences/epochs : 0.0);
+    }
+    fprintf(stderr, "%.2f GB in %.3f s (%.2f GB/s, %s)\n", bytes/1e9, seconds,
+            seconds > 0 ? bytes/seconds/1e9 : 0.0, nmea_corpus_isa());
+
+    return 0;
+}
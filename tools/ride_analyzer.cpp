@@ -0,0 +1,325 @@
+/*!
+ * @file
+ *
+ * @brief Host tool computing ride statistics from NMEA logs
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains a command line tool which replays recorded NMEA
+ * logs through the firmware's own tracking code (gps_assemble(),
+ * gps_valid(), gps_parse(), distance_between(), update_tracking_data() and
+ * update_waypoint()) and prints the distance, elapsed time, average
+ * speed and waypoint completion the device would have shown at the
+ * end of each ride.
+ *
+ * Logs are memory mapped (see nmea_corpus) and processed in parallel by a work stealing
+ * thread pool: files are dealt out to per-thread queues up front, and
+ * a thread which runs out of work takes files from the front of
+ * another thread's queue.
+ *
+ * Build and run with
+ *    g++ -O2 -pthread -Ihost -I../src -o ride_analyzer ride_analyzer.cpp \
+ *        host/host.cpp host/nmea_corpus.cpp ../src/gps.cpp ../src/haversine.cpp \
+ *        ../src/fix_filter.cpp ../src/kalman_filter.cpp ../src/tracking.cpp \
+ *        ../src/waypoint_reader.cpp
+ *    ./ride_analyzer -r route.bin logs/ride_*.nmea
+ *
+ * The optional route image is the waypoint path as produced by
+ * route_compiler. With -d n every nth sentence is dropped, to check
+ * that elapsed time and average speed, which come from the GPS time of
+ * each fix, do not depend on every packet arriving. With -s the logs are analyzed once per thread count
+ * (1, 2, 4, ... up to -j) to report how throughput scales with cores.
+ *
+ * The time spent in gps_assemble() and tracking_update() is also measured, giving the
+ * parsing load per fix and the share of a 100 ms epoch it would take
+ * with 10 Hz updates. This is host time: the device runs the same code
+ * far slower, so use it to compare changes, not as a device budget.
+ */
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <time.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "avr/eeprom.h"
+#include "gps.h"
+#include "nmea_corpus.h"
+#include "tracking.h"
+
+/*!
+ * @brief struct holding the statistics of a single ride
+ */
+struct ride_t {
+    bool ok;                   /*!< Flag indicating the log could be read */
+    size_t bytes;              /*!< Size of the log */
+    long fixes;                /*!< Number of valid gps packets */
+    double update_seconds;     /*!< Time spent in gps_assemble() and tracking_update() */
+    tracking_data_t data;      /*!< Tracking data at the end of the ride */
+    uint32_t waypoints_passed; /*!< Number of waypoints reached */
+};
+
+/* Drop every nth sentence of each log, 0 to keep all */
+static unsigned long drop_every = 0;
+
+/*!
+ * @brief Work queue of one thread in the pool
+ */
+struct worker_queue_t {
+    std::mutex mutex;
+    std::deque<size_t> files;
+};
+
+/*!
+ * @brief Counts the waypoints reached in a tracking session
+ *
+ * @param[in]  tracking  Pointer to tracking struct at the end of the ride
+ *
+ * @returns    Number of waypoints reached
+ *
+ */
+static uint32_t waypoints_passed(tracking_t *tracking)
+{
+    uint32_t count = waypoint_reader_count(&tracking->waypoint_reader);
+    if (count == 0) return 0;
+    if (tracking->data.waypoint_done) return count;
+
+    /* the reader has moved one past each waypoint reached, plus the current one */
+    uint32_t read = ((uintptr_t)tracking->waypoint_reader.ptr - 0x4)/8;
+    return read - 1;
+}
+
+/*!
+ * @brief Replays a log through the tracking code
+ *
+ * Sentences are copied into a gps_t buffer the way gps_available()
+ * fills it, skipping every drop_every-th sentence.
+ *
+ * @param[in]  path  Path of the log
+ *
+ * @returns    Statistics of the ride
+ *
+ */
+static ride_t analyze(const char *path)
+{
+    ride_t ride = {};
+
+    nmea_corpus_t corpus;
+    if (!nmea_corpus_open(&corpus, path)) return ride;
+
+    tracking_t tracking;
+    tracking_initialize(&tracking);
+    gps_t gps;
+    gps_reset_epoch(&gps);
+    nmea_sentence_t sentence;
+    unsigned long count = 0;
+
+    while (nmea_corpus_next(&corpus, &sentence)) {
+        if (drop_every && ++count % drop_every == 0) {
+            continue;
+        }
+
+        /* a bad checksum makes gps_assemble() drop the line, so skip the copy */
+        if (sentence.checksum_ok) {
+            nmea_sentence_to_gps(&sentence, &gps);
+
+            struct timespec start, done;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            boolean valid = gps_assemble(&gps) && tracking_update(&tracking, &gps);
+            clock_gettime(CLOCK_MONOTONIC, &done);
+
+            ride.update_seconds += (done.tv_sec - start.tv_sec)
+                                 + (done.tv_nsec - start.tv_nsec)/1e9;
+            if (valid) {
+                ride.fixes++;
+            }
+        }
+    }
+
+    ride.ok = true;
+    ride.bytes = corpus.size;
+    ride.data = tracking.data;
+    ride.waypoints_passed = waypoints_passed(&tracking);
+
+    nmea_corpus_close(&corpus);
+    return ride;
+}
+
+/*!
+ * @brief Takes the next file for a thread, stealing if its queue is empty
+ *
+ * @param[in]  queues  Queues of all threads
+ * @param[in]  self    Index of the calling thread
+ * @param[out] file    Index of the file to analyze
+ *
+ * @returns    True if a file was found, false when all work is done
+ *
+ */
+static bool next_file(std::vector<worker_queue_t> &queues, size_t self, size_t *file)
+{
+    {
+        std::lock_guard<std::mutex> lock(queues[self].mutex);
+        if (!queues[self].files.empty()) {
+            *file = queues[self].files.back();
+            queues[self].files.pop_back();
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < queues.size(); i++) {
+        worker_queue_t &victim = queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.files.empty()) {
+            *file = victim.files.front();
+            victim.files.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+/*!
+ * @brief Analyzes all logs with a pool of threads
+ *
+ * @param[in]  paths    Paths of the logs
+ * @param[in]  threads  Number of threads in the pool
+ * @param[out] rides    Statistics of each ride, in the order of paths
+ *
+ * @returns    Wall clock time taken, in seconds
+ *
+ */
+static double analyze_all(const std::vector<const char*> &paths, unsigned threads,
+                          std::vector<ride_t> *rides)
+{
+    std::vector<worker_queue_t> queues(threads);
+    for (size_t i = 0; i < paths.size(); i++) {
+        queues[i % threads].files.push_back(i);
+    }
+    rides->assign(paths.size(), ride_t());
+
+    struct timespec start, done;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+        workers.emplace_back([&, t] {
+            size_t file;
+            while (next_file(queues, t, &file)) {
+                (*rides)[file] = analyze(paths[file]);
+            }
+        });
+    }
+    for (size_t t = 0; t < workers.size(); t++) {
+        workers[t].join();
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &done);
+    return (done.tv_sec - start.tv_sec) + (done.tv_nsec - start.tv_nsec)/1e9;
+}
+
+/*!
+ * @brief Loads a waypoint image into the emulated EEPROM
+ *
+ * @param[in]  path  Path of the image
+ *
+ * @returns    True on success
+ *
+ */
+static bool load_route(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return false;
+    fread(host_eeprom, 1, sizeof(host_eeprom), file);
+    fclose(file);
+    return true;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-r route.bin] [-j threads] [-d n] [-s] log...\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned threads = std::thread::hardware_concurrency();
+    bool scaling = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:j:d:s")) != -1) {
+        switch (opt) {
+        case 'r':
+            if (!load_route(optarg)) {
+                perror(optarg);
+                return 1;
+            }
+            break;
+        case 'j': threads = strtoul(optarg, NULL, 10); break;
+        case 'd': drop_every = strtoul(optarg, NULL, 10); break;
+        case 's': scaling = true; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (threads == 0) threads = 1;
+
+    std::vector<const char*> paths(argv + optind, argv + argc);
+    std::vector<ride_t> rides;
+
+    if (scaling) {
+        for (unsigned t = 1; ; t = t*2 < threads ? t*2 : threads) {
+            double seconds = analyze_all(paths, t, &rides);
+            fprintf(stderr, "%2u threads: %8.1f files/s\n", t,
+                    seconds > 0 ? paths.size()/seconds : 0.0);
+            if (t == threads) break;
+        }
+        return 0;
+    }
+
+    double seconds = analyze_all(paths, threads, &rides);
+
+    uint32_t waypoint_count = host_eeprom[0] ? host_eeprom[1] : 0;
+    size_t bytes = 0;
+    long fixes = 0;
+    double update_seconds = 0;
+    int status = 0;
+
+    printf("file\tfixes\telapsed_s\tdistance_m\taverage_mph\twaypoints\n");
+    for (size_t i = 0; i < paths.size(); i++) {
+        const ride_t &ride = rides[i];
+        if (!ride.ok) {
+            perror(paths[i]);
+            status = 1;
+            continue;
+        }
+        bytes += ride.bytes;
+        fixes += ride.fixes;
+        update_seconds += ride.update_seconds;
+        printf("%s\t%ld\t%d\t%.0f\t%.1f\t%u/%u\n", paths[i], ride.fixes,
+               ride.data.time_elapsed, ride.data.total_distance,
+               ride.data.average_speed, ride.waypoints_passed, waypoint_count);
+    }
+
+    fprintf(stderr, "%zu files, %.1f MB in %.3f s with %u threads "
+            "(%.1f files/s, %.1f MB/s)\n",
+            paths.size(), bytes/1e6, seconds, threads,
+            seconds > 0 ? paths.size()/seconds : 0.0,
+            seconds > 0 ? bytes/seconds/1e6 : 0.0);
+
+    if (fixes > 0) {
+        double per_fix = update_seconds/fixes;
+        fprintf(stderr, "%.2f us per fix in gps_assemble() and tracking_update(), "
+                "%.4f%% of a 100 ms epoch at 10 Hz\n",
+                per_fix*1e6, per_fix/0.1*100);
+    }
+
+    return status;
+}
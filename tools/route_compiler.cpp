@@ -0,0 +1,608 @@
+/*!
+ * @file
+ *
+ * @brief Host tool compiling a GPX/KML route into a waypoint image
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains a command line tool which reads a route from a
+ * GPX (trkpt/rtept) or KML (coordinates) file, reduces it to the
+ * number of waypoints the device can hold, and writes the waypoint
+ * path exactly as waypoint_reader_initialize() expects to find it in
+ * EEPROM.
+ *
+ * The input is read by a separate thread in large chunks and parsed
+ * as a stream, so files of any size can be compiled without loading
+ * them whole. Points closer together than the waypoint spacing are
+ * dropped, then the route is simplified (Douglas-Peucker, most
+ * significant point first) down to the waypoint budget. Deviation
+ * scans over long segments are split across threads.
+ *
+ * Build and run with
+ *    g++ -O2 -pthread -o route_compiler route_compiler.cpp
+ *    ./route_compiler -o route.bin ride.gpx
+ *
+ * Flash the image without touching the rest of EEPROM with
+ *    avrdude -p m32u4 -c avr109 -P /dev/ttyACM0 -U eeprom:w:route.bin:r
+ *
+ * See waypoint writer for details on waypoint path layout in memory
+ */
+
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_WAYPOINTS 50             /*!< Waypoints held by the device (waypoint_writer.cpp) */
+#define WAYPOINT_SPACING 100         /*!< Waypoint distance threshold on the device, in metres */
+#define WAYPOINT_BASE_ADDRESS 0x4    /*!< EEPROM address of the first waypoint */
+#define VALID 1                      /*!< Waypoints valid flag */
+
+#define CHUNK_SIZE (1 << 20)         /*!< Size of a chunk read from the input */
+#define CHUNK_QUEUE_DEPTH 4          /*!< Chunks read ahead of the parser */
+#define PARALLEL_SCAN_MIN (1 << 16)  /*!< Shortest segment scanned with several threads */
+
+#define MEAN_EARTH_RADIUS 6371e3     /*!< Mean radius of Earth */
+
+/*!
+ * @brief struct holding a route point, in degrees
+ */
+struct route_point_t {
+    double latitude;
+    double longitude;
+};
+
+/*!
+ * @brief Bounded queue of chunks passed from the reader thread to the parser
+ *
+ * An empty chunk marks the end of the input.
+ */
+struct chunk_queue_t {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::queue<std::string> chunks;
+};
+
+/*!
+ * @brief Reads the input file in chunks and queues them for parsing
+ *
+ * @param[in]  file   Input file
+ * @param[in]  queue  Queue to fill
+ *
+ * @returns    Nothing.
+ *
+ */
+static void read_chunks(FILE *file, chunk_queue_t *queue)
+{
+    while (1) {
+        std::string chunk(CHUNK_SIZE, '\0');
+        chunk.resize(fread(&chunk[0], 1, CHUNK_SIZE, file));
+        bool end = chunk.empty();
+
+        std::unique_lock<std::mutex> lock(queue->mutex);
+        queue->changed.wait(lock, [queue] {
+            return queue->chunks.size() < CHUNK_QUEUE_DEPTH;
+        });
+        queue->chunks.push(std::move(chunk));
+        queue->changed.notify_all();
+
+        if (end) return;
+    }
+}
+
+/*!
+ * @brief Streaming parser for GPX and KML routes
+ *
+ * Input is fed in arbitrary chunks. Tags and coordinate tuples split
+ * across chunks are carried over to the next chunk.
+ */
+struct route_parser_t {
+    std::string carry;                  /*!< Unparsed input from the previous chunk */
+    bool in_coordinates;                /*!< Inside a KML coordinates element */
+    std::vector<route_point_t> *points; /*!< Parsed points */
+};
+
+/*!
+ * @brief Finds the value of an attribute in a tag
+ *
+ * @param[in]  tag     Start of the tag contents (after '<')
+ * @param[in]  end     End of the tag contents (at '>')
+ * @param[in]  name    Attribute name including the '=' sign
+ * @param[out] value   Parsed value
+ *
+ * @returns    True if the attribute was found
+ *
+ */
+static bool attribute(const char *tag, const char *end, const char *name,
+                      double *value)
+{
+    size_t length = strlen(name);
+    for (const char *p = tag; p + length < end; p++) {
+        /* match whole attribute names only, so lat= doesn't match in plat= */
+        if ((p == tag || p[-1] == ' ' || p[-1] == '\t' || p[-1] == '\n'
+             || p[-1] == '\r') && memcmp(p, name, length) == 0) {
+            p += length;
+            if (*p == '"' || *p == '\'') p++;
+            *value = strtod(p, NULL);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*!
+ * @brief Handles a complete tag
+ *
+ * @param[in,out] parser  Pointer to parser struct
+ * @param[in]     tag     Start of the tag contents (after '<')
+ * @param[in]     end     End of the tag contents (at '>')
+ *
+ * @returns    Nothing.
+ *
+ */
+static void parse_tag(route_parser_t *parser, const char *tag, const char *end)
+{
+    if (*tag == '/' || *tag == '?' || *tag == '!') return;
+
+    /* tag name without namespace prefix */
+    const char *name = tag;
+    const char *name_end = tag;
+    while (name_end < end && *name_end != ' ' && *name_end != '/'
+           && *name_end != '\t' && *name_end != '\n' && *name_end != '\r') {
+        if (*name_end == ':') name = name_end + 1;
+        name_end++;
+    }
+    std::string element(name, name_end);
+
+    if (element == "trkpt" || element == "rtept") {
+        route_point_t point;
+        if (attribute(name_end, end, "lat=", &point.latitude)
+            && attribute(name_end, end, "lon=", &point.longitude)) {
+            parser->points->push_back(point);
+        }
+    } else if (element == "coordinates" && end[-1] != '/') {
+        parser->in_coordinates = true;
+    }
+}
+
+/*!
+ * @brief Parses KML coordinate tuples (lon,lat[,alt]) separated by whitespace
+ *
+ * @param[in,out] parser  Pointer to parser struct
+ * @param[in]     text    Start of the text
+ * @param[in]     end     End of the text, which must fall between tuples
+ *
+ * @returns    Nothing.
+ *
+ */
+static void parse_coordinates(route_parser_t *parser, const char *text,
+                              const char *end)
+{
+    const char *p = text;
+    while (p < end) {
+        while (p < end && isspace((unsigned char)*p)) p++;
+        if (p >= end) break;
+
+        const char *tuple_end = p;
+        while (tuple_end < end && !isspace((unsigned char)*tuple_end)) tuple_end++;
+
+        char *next;
+        route_point_t point;
+        point.longitude = strtod(p, &next);
+        if (next < tuple_end && *next == ',') {
+            point.latitude = strtod(next + 1, NULL);
+            parser->points->push_back(point);
+        }
+        p = tuple_end;
+    }
+}
+
+/*!
+ * @brief Feeds a chunk of input to the parser
+ *
+ * @param[in,out] parser  Pointer to parser struct
+ * @param[in]     chunk   Next chunk of input
+ *
+ * @returns    Nothing.
+ *
+ */
+static void parse_chunk(route_parser_t *parser, const std::string &chunk)
+{
+    parser->carry.append(chunk);
+
+    const char *data = parser->carry.data();
+    size_t size = parser->carry.size();
+    size_t pos = 0;
+
+    while (pos < size) {
+        const char *lt = (const char*)memchr(data + pos, '<', size - pos);
+
+        if (parser->in_coordinates) {
+            if (lt == NULL) {
+                /* only parse up to the last complete tuple */
+                size_t last = size;
+                while (last > pos && !isspace((unsigned char)data[last - 1])) last--;
+                parse_coordinates(parser, data + pos, data + last);
+                pos = last;
+                break;
+            }
+            parse_coordinates(parser, data + pos, lt);
+            parser->in_coordinates = false;
+        }
+
+        if (lt == NULL) {
+            pos = size;
+            break;
+        }
+
+        const char *gt = (const char*)memchr(lt, '>', data + size - lt);
+        if (gt == NULL) {
+            pos = lt - data;
+            break;
+        }
+
+        parse_tag(parser, lt + 1, gt);
+        pos = gt + 1 - data;
+    }
+
+    parser->carry.erase(0, pos);
+}
+
+/*!
+ * @brief Projects a point onto a flat plane around a reference latitude
+ *
+ * @param[in]  point   Point to project
+ * @param[in]  scale   Cosine of the reference latitude
+ * @param[out] x       Distance east, in metres
+ * @param[out] y       Distance north, in metres
+ *
+ * @returns    Nothing.
+ *
+ */
+static void project(route_point_t point, double scale, double *x, double *y)
+{
+    *x = point.longitude*M_PI/180.0*MEAN_EARTH_RADIUS*scale;
+    *y = point.latitude*M_PI/180.0*MEAN_EARTH_RADIUS;
+}
+
+/*!
+ * @brief Distance between two points using the haversine formula
+ *
+ * @param[in]  a  A point in degrees
+ * @param[in]  b  A point in degrees
+ *
+ * @returns    Distance in metres
+ *
+ */
+static double distance_between(route_point_t a, route_point_t b)
+{
+    double lat_a = a.latitude*M_PI/180.0, lat_b = b.latitude*M_PI/180.0;
+    double del_lat = lat_b - lat_a;
+    double del_lng = (b.longitude - a.longitude)*M_PI/180.0;
+    double h = sin(del_lat/2)*sin(del_lat/2)
+        + cos(lat_a)*cos(lat_b)*sin(del_lng/2)*sin(del_lng/2);
+    return 2*asin(sqrt(h))*MEAN_EARTH_RADIUS;
+}
+
+/*!
+ * @brief Drops points closer than the spacing to the last kept point
+ *
+ * The device moves on to the next waypoint within the spacing anyway,
+ * so closer points only use up the budget. The last point is kept.
+ *
+ * @param[in]  points   Route points
+ * @param[in]  spacing  Minimum spacing in metres
+ *
+ * @returns    Resampled route points
+ *
+ */
+static std::vector<route_point_t> resample(const std::vector<route_point_t> &points,
+                                           double spacing)
+{
+    std::vector<route_point_t> result;
+    for (size_t i = 0; i < points.size(); i++) {
+        if (result.empty() || i + 1 == points.size()
+            || distance_between(result.back(), points[i]) >= spacing) {
+            result.push_back(points[i]);
+        }
+    }
+    return result;
+}
+
+/*!
+ * @brief struct holding the farthest point of a segment from its chord
+ */
+struct deviation_t {
+    double distance;  /*!< Distance from the chord, in metres */
+    size_t index;     /*!< Index of the farthest point */
+};
+
+/*!
+ * @brief Finds the point farthest from the chord between two points
+ *
+ * @param[in]  points  Route points
+ * @param[in]  first   Index of the start of the segment
+ * @param[in]  last    Index of the end of the segment
+ * @param[in]  from    First index to scan
+ * @param[in]  to      One past the last index to scan
+ *
+ * @returns    The farthest point and its distance
+ *
+ */
+static deviation_t scan_deviation(const std::vector<route_point_t> &points,
+                                  size_t first, size_t last,
+                                  size_t from, size_t to)
+{
+    double scale = cos(points[first].latitude*M_PI/180.0);
+    double ax, ay, bx, by;
+    project(points[first], scale, &ax, &ay);
+    project(points[last], scale, &bx, &by);
+    double dx = bx - ax, dy = by - ay;
+    double length2 = dx*dx + dy*dy;
+
+    deviation_t best = {-1.0, from};
+    for (size_t i = from; i < to; i++) {
+        double px, py;
+        project(points[i], scale, &px, &py);
+        double t = length2 > 0 ? ((px - ax)*dx + (py - ay)*dy)/length2 : 0;
+        if (t < 0) t = 0;
+        if (t > 1) t = 1;
+        double ex = ax + t*dx - px, ey = ay + t*dy - py;
+        double distance = sqrt(ex*ex + ey*ey);
+        if (distance > best.distance) {
+            best.distance = distance;
+            best.index = i;
+        }
+    }
+    return best;
+}
+
+/*!
+ * @brief Finds the point farthest from the chord of a segment
+ *
+ * Long segments are split across threads.
+ *
+ * @param[in]  points   Route points
+ * @param[in]  first    Index of the start of the segment
+ * @param[in]  last     Index of the end of the segment
+ * @param[in]  threads  Number of threads to use
+ *
+ * @returns    The farthest interior point and its distance
+ *
+ */
+static deviation_t max_deviation(const std::vector<route_point_t> &points,
+                                 size_t first, size_t last, unsigned threads)
+{
+    size_t count = last - first - 1;
+    if (count < PARALLEL_SCAN_MIN || threads < 2) {
+        return scan_deviation(points, first, last, first + 1, last);
+    }
+
+    std::vector<deviation_t> results(threads);
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++) {
+        size_t from = first + 1 + count*t/threads;
+        size_t to = first + 1 + count*(t + 1)/threads;
+        workers.emplace_back([&, t, from, to] {
+            results[t] = scan_deviation(points, first, last, from, to);
+        });
+    }
+
+    deviation_t best = {-1.0, first + 1};
+    for (unsigned t = 0; t < threads; t++) {
+        workers[t].join();
+        if (results[t].distance > best.distance) best = results[t];
+    }
+    return best;
+}
+
+/*!
+ * @brief struct holding a segment waiting to be split
+ */
+struct segment_t {
+    size_t first;          /*!< Index of the start of the segment */
+    size_t last;           /*!< Index of the end of the segment */
+    deviation_t farthest;  /*!< Farthest interior point */
+
+    bool operator<(const segment_t &other) const {
+        return farthest.distance < other.farthest.distance;
+    }
+};
+
+/*!
+ * @brief Simplifies a route down to a number of points
+ *
+ * Starting from the end points, repeatedly keeps the point farthest
+ * from the simplified route until the budget is used up.
+ *
+ * @param[in]  points   Route points
+ * @param[in]  budget   Maximum number of points to keep
+ * @param[in]  threads  Number of threads to use
+ *
+ * @returns    Simplified route points
+ *
+ */
+static std::vector<route_point_t> simplify(const std::vector<route_point_t> &points,
+                                           size_t budget, unsigned threads)
+{
+    if (points.size() <= budget) return points;
+
+    std::vector<bool> keep(points.size(), false);
+    keep.front() = true;
+    keep.back() = true;
+    size_t kept = 2;
+
+    std::priority_queue<segment_t> segments;
+    if (points.size() > 2) {
+        segments.push({0, points.size() - 1,
+                       max_deviation(points, 0, points.size() - 1, threads)});
+    }
+
+    while (kept < budget && !segments.empty()) {
+        segment_t segment = segments.top();
+        segments.pop();
+
+        size_t split = segment.farthest.index;
+        keep[split] = true;
+        kept++;
+
+        if (split - segment.first > 1) {
+            segments.push({segment.first, split,
+                           max_deviation(points, segment.first, split, threads)});
+        }
+        if (segment.last - split > 1) {
+            segments.push({split, segment.last,
+                           max_deviation(points, split, segment.last, threads)});
+        }
+    }
+
+    std::vector<route_point_t> result;
+    for (size_t i = 0; i < points.size(); i++) {
+        if (keep[i]) result.push_back(points[i]);
+    }
+    return result;
+}
+
+/*!
+ * @brief Appends a float to the image as the AVR stores it (little endian IEEE 754)
+ *
+ * @param[in,out] image  Image to append to
+ * @param[in]     value  Value to append
+ *
+ * @returns    Nothing.
+ *
+ */
+static void put_float(std::vector<uint8_t> *image, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    for (int i = 0; i < 4; i++) {
+        image->push_back(bits >> (8*i));
+    }
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-n waypoints] [-s spacing] [-j threads] [-v] "
+            "-o image.bin route.gpx|route.kml\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    size_t budget = MAX_WAYPOINTS;
+    double spacing = WAYPOINT_SPACING;
+    unsigned threads = std::thread::hardware_concurrency();
+    const char *output = NULL;
+    bool verbose = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:j:o:v")) != -1) {
+        switch (opt) {
+        case 'n': budget = strtoul(optarg, NULL, 10); break;
+        case 's': spacing = strtod(optarg, NULL); break;
+        case 'j': threads = strtoul(optarg, NULL, 10); break;
+        case 'o': output = optarg; break;
+        case 'v': verbose = true; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind + 1 != argc || output == NULL) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (budget < 2 || budget > MAX_WAYPOINTS) {
+        fprintf(stderr, "waypoints must be between 2 and %d\n", MAX_WAYPOINTS);
+        return 1;
+    }
+    if (threads == 0) threads = 1;
+
+    FILE *file = fopen(argv[optind], "rb");
+    if (file == NULL) {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    struct timespec start, parsed, done;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    /* read on one thread while parsing on this one */
+    std::vector<route_point_t> points;
+    route_parser_t parser = {std::string(), false, &points};
+    chunk_queue_t queue;
+    std::thread reader(read_chunks, file, &queue);
+    size_t bytes = 0;
+
+    while (1) {
+        std::string chunk;
+        {
+            std::unique_lock<std::mutex> lock(queue.mutex);
+            queue.changed.wait(lock, [&queue] { return !queue.chunks.empty(); });
+            chunk = std::move(queue.chunks.front());
+            queue.chunks.pop();
+            queue.changed.notify_all();
+        }
+        if (chunk.empty()) break;
+        bytes += chunk.size();
+        parse_chunk(&parser, chunk);
+    }
+    reader.join();
+    fclose(file);
+
+    clock_gettime(CLOCK_MONOTONIC, &parsed);
+
+    if (points.empty()) {
+        fprintf(stderr, "%s: no route points found\n", argv[optind]);
+        return 1;
+    }
+
+    std::vector<route_point_t> route = simplify(resample(points, spacing),
+                                                budget, threads);
+
+    clock_gettime(CLOCK_MONOTONIC, &done);
+
+    /* layout expected by waypoint_reader_initialize() */
+    std::vector<uint8_t> image;
+    image.push_back(VALID);
+    image.push_back(route.size());
+    while (image.size() < WAYPOINT_BASE_ADDRESS) image.push_back(0);
+    for (size_t i = 0; i < route.size(); i++) {
+        put_float(&image, route[i].latitude);
+        put_float(&image, route[i].longitude);
+    }
+
+    FILE *out = fopen(output, "wb");
+    if (out == NULL || fwrite(image.data(), 1, image.size(), out) != image.size()) {
+        perror(output);
+        return 1;
+    }
+    fclose(out);
+
+    if (verbose) {
+        double parse_time = (parsed.tv_sec - start.tv_sec)
+            + (parsed.tv_nsec - start.tv_nsec)/1e9;
+        double simplify_time = (done.tv_sec - parsed.tv_sec)
+            + (done.tv_nsec - parsed.tv_nsec)/1e9;
+        fprintf(stderr, "parsed %zu points from %zu bytes in %.3f s (%.1f MB/s)\n",
+                points.size(), bytes, parse_time,
+                parse_time > 0 ? bytes/parse_time/1e6 : 0.0);
+        fprintf(stderr, "simplified to %zu waypoints in %.3f s using %u threads\n",
+                route.size(), simplify_time, threads);
+    }
+
+    return 0;
+}
@@ -0,0 +1,240 @@
+/*!
+ * @file
+ *
+ * @brief Host benchmark of live telemetry against the nRF8001 model
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains a command line tool which runs the tracking
+ * loop's telemetry calls, the firmware's Bluetooth module and the
+ * Nordic driver against the nRF8001 model on virtual time, and
+ * measures how much longer they make the loop.
+ *
+ * The loop runs as run_tracking() does with BLE_TELEMETRY set:
+ * telemetry_poll() on every pass, and telemetry_update() after each
+ * fix. Each pass also does a set amount of other work. Fixes arrive
+ * at the GPS update rate, and the phone's connection events come at
+ * the connection interval, returning the data credits used. Halfway
+ * through, the phone disconnects for a while and connects again.
+ *
+ * The phone decodes every snapshot it receives and checks it against
+ * the one encoded for its sequence number, and that sequence numbers
+ * only go up. It counts the gaps, which are the fixes coalesced while
+ * out of credits or disconnected.
+ *
+ * It prints the device time the telemetry calls add to a pass, on
+ * average and at most, for passes with and without a fix, along with
+ * the snapshots sent, coalesced and received. The device times count
+ * the SPI transfers and the nRF8001's command handling as the model
+ * assumes them, not the AVR's own instructions.
+ *
+ * Build and run with
+ *    g++ -O2 -D__AVR__ -Ihost -I../libraries/nordic_bluetooth_driver -I../src \
+ *        -include Arduino.h -o telemetry_bench telemetry_bench.cpp host/host.cpp \
+ *        host/nrf8001_mock.cpp host/nrf8001_model.cpp ../src/bluetooth.cpp \
+ *        ../src/telemetry.cpp \
+ *        ../libraries/nordic_bluetooth_driver/{aci_queue,aci_setup,acilib,hal_aci_tl,lib_aci,bootloader_setup}.cpp
+ *    ./telemetry_bench [-n fixes] [-r rate_hz] [-c interval_ms] [-l loop_us] [-g gap_s]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "lib_aci.h"
+#include "services.h"
+#include "bluetooth.h"
+#include "telemetry.h"
+#include "nrf8001_model.h"
+
+/* pins as wired in bluetooth.cpp */
+#define RDY 7
+#define REQ 9
+#define RST 10
+#define RDY_INTERRUPT_NUMBER 4
+
+/*!
+ * @brief struct holding the simulation parameters
+ */
+struct parameters_t {
+    long fixes;               /*!< Number of fixes */
+    unsigned long period;     /*!< Time between fixes, in us */
+    unsigned long interval;   /*!< Connection interval, in us */
+    unsigned long loop;       /*!< Other work in each pass of the loop, in us */
+    unsigned long gap;        /*!< Time the phone stays disconnected, in us */
+};
+
+static parameters_t parameters = {3000, 200000, 20000, 500, 2000000};
+
+/*!
+ * @brief struct holding the time the telemetry calls add to passes
+ */
+struct added_t {
+    unsigned long long total;  /*!< Sum over the passes, in us */
+    unsigned long long most;   /*!< Most for one pass, in us */
+    long passes;               /*!< Number of passes */
+};
+
+static added_t with_fix, without_fix;
+
+static uint8_t expected[256][TELEMETRY_SIZE];  /* snapshot encoded for each sequence number */
+static bool have_last;
+static uint8_t last_sequence;
+static long received, gaps, errors;
+
+/*!
+ * @brief Decodes and checks each snapshot the phone receives
+ */
+static void phone_received(uint8_t pipe, const uint8_t *data, uint8_t length)
+{
+    if (PIPE_UART_OVER_BTLE_UART_TX_TX != pipe || TELEMETRY_SIZE != length
+        || TELEMETRY_TAG != data[TELEMETRY_TAG_OFFSET]) {
+        errors++;
+        return;
+    }
+
+    uint8_t sequence = data[TELEMETRY_SEQUENCE_OFFSET];
+    if (memcmp(data, expected[sequence], TELEMETRY_SIZE) != 0) {
+        errors++;
+    }
+    if (have_last) {
+        uint8_t step = sequence - last_sequence;
+        if (0 == step || step > 128) {
+            errors++;
+        } else {
+            gaps += step - 1;
+        }
+    }
+    have_last = true;
+    last_sequence = sequence;
+    received++;
+}
+
+/*!
+ * @brief Adds the time of one pass's telemetry calls
+ */
+static void account(added_t *added, unsigned long long us)
+{
+    added->total += us;
+    if (us > added->most) added->most = us;
+    added->passes++;
+}
+
+/*!
+ * @brief Makes up the tracking data of a fix
+ */
+static void make_data(tracking_data_t *data, long fix)
+{
+    data->instant_speed = 12 + (fix % 50)*0.1;
+    data->time_elapsed = fix/5;
+    data->average_speed = 14.5;
+    data->total_distance = fix*1.2;
+    data->waypoint_distance = 5000 - (fix % 5000);
+    data->waypoint_done = (fix % 1000) == 999;
+    data->heading = (fix*7) % 360;
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:c:l:g:")) != -1) {
+        switch (opt) {
+        case 'n': parameters.fixes = strtol(optarg, NULL, 10); break;
+        case 'r': parameters.period = atof(optarg) > 0 ? 1e6/atof(optarg) : 0; break;
+        case 'c': parameters.interval = atof(optarg)*1000; break;
+        case 'l': parameters.loop = strtoul(optarg, NULL, 10); break;
+        case 'g': parameters.gap = atof(optarg)*1e6; break;
+        default:
+            fprintf(stderr, "usage: %s [-n fixes] [-r rate_hz] [-c interval_ms] [-l loop_us]"
+                            " [-g gap_s]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (parameters.fixes <= 0 || parameters.period == 0 || parameters.interval == 0
+        || parameters.loop == 0) {
+        fprintf(stderr, "%s: bad parameters\n", argv[0]);
+        return 1;
+    }
+
+    host_virtual_time = true;
+    nrf8001_model_begin(RDY, REQ, RST, RDY_INTERRUPT_NUMBER);
+    nrf8001_model.data_handler = phone_received;
+
+    /* run_tracking() wakes the nRF8001 and advertises before the loop */
+    bluetooth_t bluetooth;
+    bluetooth_setup(&bluetooth);
+    bluetooth_advertise(&bluetooth);
+
+    telemetry_t telemetry;
+    telemetry_initialize(&telemetry);
+
+    unsigned long long next_fix = host_time_us;
+    unsigned long long next_event = host_time_us;
+    unsigned long long reconnect_at = 0;
+    unsigned long long connected_us = 0;
+    long fix = 0;
+    bool dropped = false;
+
+    while (fix < parameters.fixes) {
+
+        /* the phone */
+        if (NRF8001_MODEL_ADVERTISING == nrf8001_model.mode && host_time_us >= reconnect_at) {
+            nrf8001_model_connect();
+            nrf8001_model_open_pipe(PIPE_UART_OVER_BTLE_UART_TX_TX);
+        }
+        if (host_time_us >= next_event) {
+            nrf8001_model_connection_event();
+            next_event += parameters.interval;
+            if (NRF8001_MODEL_CONNECTED == nrf8001_model.mode) {
+                connected_us += parameters.interval;
+            }
+        }
+        if (!dropped && fix >= parameters.fixes/2 && nrf8001_model_disconnect()) {
+            dropped = true;
+            reconnect_at = host_time_us + parameters.gap;
+        }
+
+        /* a pass of the loop */
+        unsigned long long start = host_time_us;
+        telemetry_poll(&telemetry, &bluetooth);
+        if (host_time_us >= next_fix) {
+            tracking_data_t data;
+            make_data(&data, fix++);
+            telemetry_update(&telemetry, &data);
+            memcpy(expected[telemetry.sequence], telemetry.snapshot, TELEMETRY_SIZE);
+            next_fix += parameters.period;
+            account(&with_fix, host_time_us - start);
+        } else {
+            account(&without_fix, host_time_us - start);
+        }
+        host_time_us += parameters.loop;
+    }
+
+    /* let the last snapshot go */
+    for (int i = 0; i < 100 && telemetry.pending; i++) {
+        nrf8001_model_connection_event();
+        telemetry_poll(&telemetry, &bluetooth);
+        host_time_us += parameters.loop;
+    }
+    if (telemetry.pending || !have_last || last_sequence != telemetry.sequence) {
+        errors++;
+    }
+
+    printf("pass\tpasses\tmean_us\tmax_us\n");
+    printf("fix\t%ld\t%.1f\t%llu\n", with_fix.passes,
+           (double)with_fix.total/(with_fix.passes ? with_fix.passes : 1), with_fix.most);
+    printf("no_fix\t%ld\t%.1f\t%llu\n", without_fix.passes,
+           (double)without_fix.total/(without_fix.passes ? without_fix.passes : 1), without_fix.most);
+    printf("%ld fixes at %.1f Hz, %.0f ms connection interval, connected %.0f%% of the time;"
+           " %u sent, %u coalesced, %ld received, %ld gaps; %ld errors\n",
+           parameters.fixes, 1e6/parameters.period, parameters.interval/1000.0,
+           100.0*connected_us/(host_time_us ? host_time_us : 1), telemetry.sent,
+           telemetry.coalesced, received, gaps, errors);
+
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,298 @@
+/*!
+ * @file
+ *
+ * @brief Host benchmark of the track recorder
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains a command line tool which replays NMEA logs
+ * through the firmware's tracking code and records every valid fix
+ * with track_recorder_append(), as run_tracking() does, against the
+ * emulated EEPROM on virtual time.
+ *
+ * Fixes arrive once every GPS update interval, and track_recorder_poll()
+ * is called once per pass of the tracking loop in between. Each byte
+ * written keeps the EEPROM busy for the ATmega32u4's write time, so
+ * pages are copied in the background as on the device.
+ *
+ * It prints the bytes of log used per fix, the time a fix waits in
+ * track_recorder_append() (which should be 0), the time from closing
+ * a page until it is fully written, the time track_recorder_finish()
+ * blocks, and the writes to the page length bytes against the other
+ * bytes of the pages, for wear. The host time per append is for
+ * comparing changes only.
+ *
+ * With -o the EEPROM is written out, to be decoded with track_to_gpx.
+ *
+ * Build and run with
+ *    g++ -O2 -Ihost -I../src -o track_bench track_bench.cpp host/host.cpp \
+ *        host/nmea_corpus.cpp ../src/gps.cpp ../src/haversine.cpp \
+ *        ../src/fix_filter.cpp ../src/kalman_filter.cpp ../src/tracking.cpp \
+ *        ../src/waypoint_reader.cpp ../src/track_recorder.cpp
+ *    ./track_bench [-i interval_ms] [-l loop_us] [-w write_us] [-o eeprom.bin] log...
+ *
+ * See track format for details on the track log layout in memory
+ */
+
+#include <time.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "avr/eeprom.h"
+#include "gps.h"
+#include "nmea_corpus.h"
+#include "tracking.h"
+#include "track_recorder.h"
+
+#define EEPROM_WRITE_US 3400  /*!< Byte write time of the ATmega32u4 EEPROM, in us */
+
+/*!
+ * @brief struct holding the simulation parameters
+ */
+struct parameters_t {
+    unsigned long interval_ms;  /*!< GPS update interval */
+    unsigned long loop_us;      /*!< Tracking loop pass between polls */
+};
+
+static parameters_t parameters = {1000, 1000};
+
+/*!
+ * @brief struct holding the least, greatest and total of some times
+ */
+struct spread_t {
+    unsigned long count;
+    unsigned long long least;
+    unsigned long long most;
+    unsigned long long total;
+};
+
+/*!
+ * @brief Adds a time to a spread
+ */
+static void add(spread_t *spread, unsigned long long time)
+{
+    if (spread->count == 0 || time < spread->least) spread->least = time;
+    if (time > spread->most) spread->most = time;
+    spread->total += time;
+    spread->count++;
+}
+
+/*!
+ * @brief Prints a spread of times, in us
+ */
+static void print_spread(const char *what, const spread_t *spread)
+{
+    if (spread->count == 0) {
+        printf("%-24s      0\n", what);
+        return;
+    }
+    printf("%-24s %6lu %9llu %9.0f %9llu\n", what, spread->count, spread->least,
+           (double)spread->total/spread->count, spread->most);
+}
+
+/*!
+ * @brief struct holding the results of all logs
+ */
+struct results_t {
+    long fixes;                /*!< Fixes recorded */
+    long bytes;                /*!< Bytes of the pages used, headers included */
+    long pages;                /*!< Pages closed */
+    double append_seconds;     /*!< Host time spent in track_recorder_append() */
+    spread_t append_wait;      /*!< Virtual time spent in track_recorder_append() */
+    spread_t page_flush;       /*!< Time from closing a page until it is written */
+    spread_t finish;           /*!< Time track_recorder_finish() blocked */
+};
+
+/*!
+ * @brief Returns the host's monotonic clock, in seconds
+ */
+static double host_seconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec/1e9;
+}
+
+/*!
+ * @brief Polls the recorder once per loop pass until a time
+ *
+ * A closed page is written once the write of its length, started in
+ * the first pass finding the length stored, is done.
+ *
+ * @param[in,out] recorder   Pointer to recorder struct
+ * @param[in]     until      Time to run to, in us
+ * @param[in,out] closed_at  Time the page before was closed, 0 once written
+ * @param[in,out] results    Pointer to results struct
+ *
+ * @returns    Nothing.
+ *
+ */
+static void run_loop(track_recorder_t *recorder, unsigned long long until,
+                     unsigned long long *closed_at, results_t *results)
+{
+    while (host_time_us < until) {
+        track_recorder_poll(recorder);
+        if (*closed_at && recorder->pages[!recorder->current].committed) {
+            add(&results->page_flush, host_time_us + host_eeprom_write_us - *closed_at);
+            *closed_at = 0;
+        }
+        host_time_us += parameters.loop_us;
+    }
+}
+
+/*!
+ * @brief Replays a log, recording every valid fix
+ *
+ * Each log is a tracking session of its own, as if tracking mode was
+ * entered once per ride.
+ *
+ * @param[in]     path     Path of the log
+ * @param[in,out] results  Pointer to results struct
+ *
+ * @returns    True on success, false if the log could not be read
+ *
+ */
+static bool replay(const char *path, results_t *results)
+{
+    nmea_corpus_t corpus;
+    if (!nmea_corpus_open(&corpus, path)) return false;
+
+    tracking_t tracking;
+    tracking_initialize(&tracking);
+    gps_t gps;
+    gps_reset_epoch(&gps);
+    track_recorder_t recorder;
+    track_recorder_initialize(&recorder);
+
+    nmea_sentence_t sentence;
+    unsigned long long next_fix = host_time_us;
+    unsigned long long closed_at = 0;
+
+    while (nmea_corpus_next(&corpus, &sentence)) {
+        if (!sentence.checksum_ok) continue;
+        nmea_sentence_to_gps(&sentence, &gps);
+        if (!gps_assemble(&gps)) continue;
+
+        /* the loop runs until the epoch arrives */
+        next_fix += parameters.interval_ms*1000ULL;
+        run_loop(&recorder, next_fix, &closed_at, results);
+
+        if (!tracking_update(&tracking, &gps)) continue;
+
+        uint8_t current = recorder.current;
+        unsigned long long start = host_time_us;
+        double host_start = host_seconds();
+        track_recorder_append(&recorder, tracking.gps_data.time, &tracking.gps_data);
+        results->append_seconds += host_seconds() - host_start;
+        add(&results->append_wait, host_time_us - start);
+        results->fixes++;
+
+        if (recorder.current != current) {
+            results->bytes += recorder.pages[current].length;
+            results->pages++;
+            closed_at = host_time_us;
+        }
+    }
+
+    if (recorder.pages[recorder.current].length > TRACK_HEADER_SIZE) {
+        results->bytes += recorder.pages[recorder.current].length;
+    }
+
+    unsigned long long start = host_time_us;
+    track_recorder_finish(&recorder);
+    add(&results->finish, host_time_us - start);
+
+    nmea_corpus_close(&corpus);
+    return true;
+}
+
+/*!
+ * @brief Returns the most writes to any page length byte, or to any
+ *        other byte of the pages
+ *
+ * @param[in]  length_bytes  True for the length bytes, false for the others
+ *
+ * @returns    Most writes to one byte
+ *
+ */
+static unsigned long most_writes(bool length_bytes)
+{
+    unsigned long most = 0;
+    for (int i = 0; i < TRACK_PAGE_COUNT*TRACK_PAGE_SIZE; i++) {
+        if ((i % TRACK_PAGE_SIZE == TRACK_LENGTH_OFFSET) != length_bytes) continue;
+        if (host_eeprom_writes[TRACK_BASE_ADDRESS + i] > most) {
+            most = host_eeprom_writes[TRACK_BASE_ADDRESS + i];
+        }
+    }
+    return most;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-i interval_ms] [-l loop_us] [-w write_us] "
+            "[-o eeprom.bin] log...\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    const char *output = NULL;
+    int opt;
+
+    host_eeprom_write_us = EEPROM_WRITE_US;
+
+    while ((opt = getopt(argc, argv, "i:l:w:o:")) != -1) {
+        switch (opt) {
+        case 'i': parameters.interval_ms = strtoul(optarg, NULL, 10); break;
+        case 'l': parameters.loop_us = strtoul(optarg, NULL, 10); break;
+        case 'w': host_eeprom_write_us = strtoul(optarg, NULL, 10); break;
+        case 'o': output = optarg; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind >= argc || parameters.interval_ms == 0 || parameters.loop_us == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* an erased EEPROM, with no waypoints */
+    memset(host_eeprom, 0xFF, sizeof(host_eeprom));
+    host_eeprom[0] = 0;
+    host_virtual_time = true;
+
+    results_t results = {};
+    int status = 0;
+    for (int i = optind; i < argc; i++) {
+        if (!replay(argv[i], &results)) {
+            perror(argv[i]);
+            status = 1;
+        }
+    }
+
+    printf("%ld fixes in %ld bytes, %.2f bytes/fix, %ld pages closed\n",
+           results.fixes, results.bytes,
+           results.fixes ? (double)results.bytes/results.fixes : 0.0, results.pages);
+    printf("%-24s %6s %9s %9s %9s\n", "time in us", "count", "least", "mean", "most");
+    print_spread("fix waits in append", &results.append_wait);
+    print_spread("page closed to written", &results.page_flush);
+    print_spread("finish blocks", &results.finish);
+    printf("most writes to a byte: %lu to a length byte, %lu to another\n",
+           most_writes(true), most_writes(false));
+    if (results.fixes > 0) {
+        printf("%.0f ns per track_recorder_append() on the host\n",
+               results.append_seconds/results.fixes*1e9);
+    }
+
+    if (output) {
+        FILE *file = fopen(output, "wb");
+        if (file == NULL || fwrite(host_eeprom, 1, sizeof(host_eeprom), file) != sizeof(host_eeprom)) {
+            perror(output);
+            return 1;
+        }
+        fclose(file);
+    }
+
+    return status;
+}
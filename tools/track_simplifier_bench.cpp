@@ -0,0 +1,299 @@
+/*!
+ * @file
+ *
+ * @brief Host benchmark of the track simplifier on recorded rides
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains a command line tool which replays NMEA logs
+ * through the firmware's tracking code and passes every valid fix
+ * through the track simplifier, as run_tracking() does before the
+ * track recorder.
+ *
+ * For each ride and tolerance it prints the fixes, the points kept,
+ * the compression ratio, and the largest distance of any fix from the
+ * simplified track, which is the segment between the kept points
+ * before and after it. Only the first fix of each second is measured,
+ * as the simplifier drops the others unseen. Fixes further than the
+ * tolerance are counted, and any makes the exit status 1. The host
+ * time per track_simplifier_add() is for comparing changes only.
+ *
+ * The rides are simplified with each tolerance given with -t, or with
+ * the firmware's and a tighter one by default.
+ *
+ * Build and run with
+ *    g++ -O2 -Ihost -I../src -o track_simplifier_bench track_simplifier_bench.cpp \
+ *        host/host.cpp host/nmea_corpus.cpp ../src/gps.cpp ../src/haversine.cpp \
+ *        ../src/fix_filter.cpp ../src/kalman_filter.cpp ../src/tracking.cpp \
+ *        ../src/waypoint_reader.cpp ../src/track_simplifier.cpp
+ *    ./track_simplifier_bench [-t tolerance_m]... [-r repeats] log...
+ *
+ * Logs written by fix_filter_bench -w will do if no rides are at hand.
+ */
+
+#include <vector>
+
+#include <time.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "avr/eeprom.h"
+#include "gps.h"
+#include "nmea_corpus.h"
+#include "tracking.h"
+#include "track_simplifier.h"
+
+#define TRACK_TOLERANCE 5          /*!< Tolerance used by the firmware, in metres */
+#define TIGHT_TOLERANCE 2          /*!< Tighter tolerance also run by default, in metres */
+#define METRES_PER_DEGREE 111194.9 /*!< Length of a degree of latitude, in metres */
+
+/*!
+ * @brief struct holding a fix passed to the simplifier
+ */
+struct fix_t {
+    uint32_t time;
+    gps_data_t data;
+};
+
+/*!
+ * @brief struct holding the results of a ride
+ */
+struct ride_t {
+    size_t fixes;            /*!< Fixes passed to the simplifier */
+    size_t kept;             /*!< Points kept */
+    double max_deviation;    /*!< Largest distance of a fix from the track, in metres */
+    size_t outside;          /*!< Fixes further than the tolerance from the track */
+    double add_seconds;      /*!< Host time spent in track_simplifier_add() */
+};
+
+/*!
+ * @brief Reads the valid fixes of a log
+ *
+ * @param[in]  path   Path of the log
+ * @param[out] fixes  Valid fixes, in order
+ *
+ * @returns    True on success, false if the log could not be read
+ *
+ */
+static bool read_fixes(const char *path, std::vector<fix_t> *fixes)
+{
+    nmea_corpus_t corpus;
+    if (!nmea_corpus_open(&corpus, path)) return false;
+
+    tracking_t tracking;
+    tracking_initialize(&tracking);
+    gps_t gps;
+    gps_reset_epoch(&gps);
+    nmea_sentence_t sentence;
+
+    while (nmea_corpus_next(&corpus, &sentence)) {
+        if (!sentence.checksum_ok) continue;
+        nmea_sentence_to_gps(&sentence, &gps);
+        if (gps_assemble(&gps) && tracking_update(&tracking, &gps)) {
+            fix_t fix = {tracking.gps_data.time, tracking.gps_data};
+            fixes->push_back(fix);
+        }
+    }
+
+    nmea_corpus_close(&corpus);
+    return true;
+}
+
+/*!
+ * @brief Finds the fix a kept point came from
+ *
+ * The simplifier only takes the first fix of each second, so the kept
+ * point is the first fix with its time at or before the given index.
+ *
+ * @param[in]  fixes  Fixes of the ride
+ * @param[in]  index  Index of the last fix passed to the simplifier
+ * @param[in]  time   Time of the kept point
+ *
+ * @returns    Index in fixes of the kept point
+ *
+ */
+static size_t kept_index(const std::vector<fix_t> &fixes, size_t index, uint32_t time)
+{
+    while (index > 0 && fixes[index].time != time) index--;
+    while (index > 0 && fixes[index - 1].time == time) index--;
+    return index;
+}
+
+/*!
+ * @brief Runs the fixes of a ride through the simplifier
+ *
+ * @param[in]  fixes      Fixes of the ride
+ * @param[in]  tolerance  Tolerance of the simplifier, in metres
+ * @param[out] kept       Indices in fixes of the points kept
+ *
+ * @returns    Nothing.
+ *
+ */
+static void simplify(const std::vector<fix_t> &fixes, float tolerance,
+                     std::vector<size_t> *kept)
+{
+    track_simplifier_t simplifier;
+    track_simplifier_initialize(&simplifier, tolerance);
+    uint32_t kept_time;
+    gps_data_t kept_data;
+
+    kept->clear();
+    for (size_t i = 0; i < fixes.size(); i++) {
+        gps_data_t data = fixes[i].data;
+        if (track_simplifier_add(&simplifier, fixes[i].time, &data, &kept_time, &kept_data)) {
+            kept->push_back(kept_index(fixes, i, kept_time));
+        }
+    }
+    if (track_simplifier_finish(&simplifier, &kept_time, &kept_data)) {
+        kept->push_back(kept_index(fixes, fixes.size() - 1, kept_time));
+    }
+}
+
+/*!
+ * @brief Returns the distance of a point from a segment, in metres
+ *
+ * The points are projected onto a flat plane around the start of the
+ * segment, which is close enough over the length of a segment.
+ *
+ * @param[in]  point  The point
+ * @param[in]  start  Start of the segment
+ * @param[in]  end    End of the segment
+ *
+ * @returns    Distance of the point from the nearest point of the segment
+ *
+ */
+static double segment_distance(point_t point, point_t start, point_t end)
+{
+    double scale = METRES_PER_DEGREE*cos(start.latitude*M_PI/180.0);
+    double px = (point.longitude - start.longitude)*scale;
+    double py = (point.latitude - start.latitude)*METRES_PER_DEGREE;
+    double ex = (end.longitude - start.longitude)*scale;
+    double ey = (end.latitude - start.latitude)*METRES_PER_DEGREE;
+
+    double length = ex*ex + ey*ey;
+    double t = length > 0 ? (px*ex + py*ey)/length : 0;
+    t = t < 0 ? 0 : t > 1 ? 1 : t;
+    return hypot(px - t*ex, py - t*ey);
+}
+
+/*!
+ * @brief Simplifies a ride and measures the result
+ *
+ * @param[in]  fixes      Fixes of the ride
+ * @param[in]  tolerance  Tolerance of the simplifier, in metres
+ * @param[in]  repeats    Times the ride is simplified for timing
+ *
+ * @returns    Results of the ride
+ *
+ */
+static ride_t measure(const std::vector<fix_t> &fixes, float tolerance, int repeats)
+{
+    ride_t ride = {};
+    std::vector<size_t> kept;
+
+    struct timespec start, done;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int r = 0; r < repeats; r++) {
+        simplify(fixes, tolerance, &kept);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &done);
+    ride.add_seconds = ((done.tv_sec - start.tv_sec) + (done.tv_nsec - start.tv_nsec)/1e9)/repeats;
+
+    ride.fixes = fixes.size();
+    ride.kept = kept.size();
+
+    /* every fix added lies between two kept points, or is one */
+    for (size_t k = 0; k + 1 < kept.size(); k++) {
+        point_t from = fixes[kept[k]].data.location;
+        point_t to = fixes[kept[k + 1]].data.location;
+        for (size_t i = kept[k] + 1; i < kept[k + 1]; i++) {
+            if (fixes[i].time == fixes[i - 1].time) continue;
+            double deviation = segment_distance(fixes[i].data.location, from, to);
+            if (deviation > ride.max_deviation) ride.max_deviation = deviation;
+            if (deviation > tolerance) ride.outside++;
+        }
+    }
+
+    return ride;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-t tolerance_m]... [-r repeats] log...\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<float> tolerances;
+    int repeats = 10;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:r:")) != -1) {
+        switch (opt) {
+        case 't': tolerances.push_back(strtod(optarg, NULL)); break;
+        case 'r': repeats = atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (tolerances.empty()) {
+        tolerances.push_back(TRACK_TOLERANCE);
+        tolerances.push_back(TIGHT_TOLERANCE);
+    }
+    if (optind >= argc || repeats <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    for (size_t t = 0; t < tolerances.size(); t++) {
+        if (tolerances[t] <= 0) {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<std::vector<fix_t> > rides(argc - optind);
+    int status = 0;
+
+    for (int i = optind; i < argc; i++) {
+        if (!read_fixes(argv[i], &rides[i - optind])) {
+            perror(argv[i]);
+            status = 1;
+        }
+    }
+
+    printf("file\ttolerance_m\tfixes\tkept\tratio\tmax_deviation_m\toutside\n");
+    for (size_t t = 0; t < tolerances.size(); t++) {
+        float tolerance = tolerances[t];
+        ride_t total = {};
+
+        for (int i = optind; i < argc; i++) {
+            const std::vector<fix_t> &fixes = rides[i - optind];
+            ride_t ride = measure(fixes, tolerance, repeats);
+            printf("%s\t%.1f\t%zu\t%zu\t%.1f\t%.2f\t%zu\n", argv[i], tolerance, ride.fixes,
+                   ride.kept, ride.kept ? (double)ride.fixes/ride.kept : 0.0,
+                   ride.max_deviation, ride.outside);
+
+            total.fixes += ride.fixes;
+            total.kept += ride.kept;
+            total.outside += ride.outside;
+            total.add_seconds += ride.add_seconds;
+            if (ride.max_deviation > total.max_deviation) total.max_deviation = ride.max_deviation;
+        }
+
+        fprintf(stderr, "%zu fixes, %zu kept (%.1f:1) with a %.1f m tolerance, "
+                "max deviation %.2f m, %zu fixes outside\n",
+                total.fixes, total.kept, total.kept ? (double)total.fixes/total.kept : 0.0,
+                tolerance, total.max_deviation, total.outside);
+        if (total.fixes > 0) {
+            fprintf(stderr, "%.0f ns per track_simplifier_add() on the host\n",
+                    total.add_seconds/total.fixes*1e9);
+        }
+        if (total.outside > 0) {
+            status = 1;
+        }
+    }
+
+    return status;
+}
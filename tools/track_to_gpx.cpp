@@ -0,0 +1,237 @@
+/*!
+ * @file
+ *
+ * @brief Host tool converting a track log to GPX
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains a command line tool which decodes the track log
+ * from a raw dump of the device EEPROM and writes it out as GPX, one
+ * track per tracking session. The number of bytes used per recorded
+ * fix is reported on stderr.
+ *
+ * Dump the EEPROM with
+ *    avrdude -p m32u4 -c avr109 -P /dev/ttyACM0 -U eeprom:r:eeprom.bin:r
+ *
+ * Build and run with
+ *    g++ -O2 -o track_to_gpx track_to_gpx.cpp
+ *    ./track_to_gpx eeprom.bin > track.gpx
+ *
+ * See track format for details on the track log layout in memory
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../src/track_format.h"
+
+#define EEPROM_SIZE 1024  /*!< Size of the ATmega32u4 EEPROM */
+
+/*!
+ * @brief struct holding the decoding position in a page
+ */
+struct reader_t {
+    const uint8_t *data;  /*!< Page being decoded */
+    int index;            /*!< Index of the next byte to decode */
+    int length;           /*!< Number of valid bytes in the page */
+};
+
+/*!
+ * @brief Decodes a little endian 32 bit value
+ *
+ * @param[in,out] reader  Pointer to reader struct
+ * @param[out]    value   Decoded value
+ *
+ * @returns    1 on success, 0 if the page ended early
+ *
+ */
+static int get_u32(reader_t *reader, uint32_t *value)
+{
+    if (reader->index + 4 > reader->length) return 0;
+    const uint8_t *p = reader->data + reader->index;
+    *value = p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+    reader->index += 4;
+    return 1;
+}
+
+/*!
+ * @brief Decodes a zigzag varint
+ *
+ * @param[in,out] reader  Pointer to reader struct
+ * @param[out]    value   Decoded value
+ *
+ * @returns    1 on success, 0 if the page ended early
+ *
+ */
+static int get_varint(reader_t *reader, int32_t *value)
+{
+    uint32_t zigzag = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (reader->index >= reader->length) return 0;
+        uint8_t c = reader->data[reader->index++];
+        zigzag |= (uint32_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) {
+            *value = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*!
+ * @brief Writes a single GPX track point
+ *
+ * Timestamps are converted from the device's epoch (1 January 2000)
+ * to UTC dates and times.
+ *
+ * @param[in]  time       Timestamp in seconds
+ * @param[in]  latitude   Latitude in fixed point
+ * @param[in]  longitude  Longitude in fixed point
+ * @param[in]  speed      Speed in fixed point
+ *
+ * @returns    Nothing.
+ *
+ */
+static void print_point(uint32_t time, int32_t latitude, int32_t longitude,
+                        uint8_t speed)
+{
+    char stamp[32];
+    time_t seconds = TRACK_EPOCH + (time_t)time;
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&seconds));
+
+    printf("      <trkpt lat=\"%.5f\" lon=\"%.5f\">"
+           "<time>%s</time><speed>%.2f</speed></trkpt>\n",
+           (double)latitude/TRACK_DEGREE_SCALE,
+           (double)longitude/TRACK_DEGREE_SCALE,
+           stamp,
+           /* GPX speed is in metres per second */
+           (double)speed/TRACK_SPEED_SCALE*0.44704);
+}
+
+/*!
+ * @brief Decodes and prints all records of a page
+ *
+ * @param[in]  page  Pointer to the page in the EEPROM dump
+ *
+ * @returns    Number of points decoded
+ *
+ */
+static int decode_page(const uint8_t *page)
+{
+    reader_t reader = {page, TRACK_HEADER_SIZE, page[TRACK_LENGTH_OFFSET]};
+    uint32_t time = 0;
+    int32_t latitude = 0, longitude = 0;
+    int points = 0;
+
+    if (reader.length > TRACK_PAGE_SIZE) {
+        reader.length = TRACK_PAGE_SIZE;
+    }
+
+    while (reader.index < reader.length) {
+        uint8_t tag = page[reader.index++];
+        if (tag == TRACK_KEYFRAME) {
+            uint32_t lat, lng;
+            if (!get_u32(&reader, &time) || !get_u32(&reader, &lat)
+                || !get_u32(&reader, &lng)) break;
+            latitude = lat;
+            longitude = lng;
+        } else {
+            int32_t dlat, dlng;
+            /* a delta before any keyframe means the page is corrupt */
+            if (points == 0) break;
+            if (!get_varint(&reader, &dlat) || !get_varint(&reader, &dlng)) break;
+            time += tag;
+            latitude += dlat;
+            longitude += dlng;
+        }
+        if (reader.index >= reader.length) break;
+        print_point(time, latitude, longitude, page[reader.index++]);
+        points++;
+    }
+
+    return points;
+}
+
+/*!
+ * @brief Returns the sequence number following another
+ *
+ * @param[in]  sequence  A sequence number
+ *
+ * @returns    The next sequence number
+ *
+ */
+static uint8_t next_sequence(uint8_t sequence)
+{
+    return sequence + 1 == TRACK_ERASED ? 0 : sequence + 1;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t eeprom[EEPROM_SIZE];
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s eeprom.bin\n", argv[0]);
+        return 1;
+    }
+
+    FILE *file = fopen(argv[1], "rb");
+    if (file == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+    size_t size = fread(eeprom, 1, sizeof(eeprom), file);
+    fclose(file);
+
+    if (size < TRACK_BASE_ADDRESS + TRACK_PAGE_COUNT*TRACK_PAGE_SIZE) {
+        fprintf(stderr, "%s: dump too small\n", argv[1]);
+        return 1;
+    }
+
+    const uint8_t *pages = eeprom + TRACK_BASE_ADDRESS;
+
+    /* the oldest page follows the newest page, which is the written
+       page not followed by its successor */
+    int oldest = 0;
+    for (int i = 0; i < TRACK_PAGE_COUNT; i++) {
+        uint8_t sequence = pages[i*TRACK_PAGE_SIZE + TRACK_SEQUENCE_OFFSET];
+        uint8_t following = pages[((i + 1) % TRACK_PAGE_COUNT)*TRACK_PAGE_SIZE
+                                  + TRACK_SEQUENCE_OFFSET];
+        if (sequence != TRACK_ERASED && following != next_sequence(sequence)) {
+            oldest = (i + 1) % TRACK_PAGE_COUNT;
+            break;
+        }
+    }
+
+    printf("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+           "<gpx version=\"1.0\" creator=\"track_to_gpx\" "
+           "xmlns=\"http://www.topografix.com/GPX/1/0\">\n");
+
+    int session = -1;
+    int points = 0;
+    int bytes = 0;
+    for (int i = 0; i < TRACK_PAGE_COUNT; i++) {
+        const uint8_t *page = pages + ((oldest + i) % TRACK_PAGE_COUNT)*TRACK_PAGE_SIZE;
+        if (page[TRACK_SEQUENCE_OFFSET] == TRACK_ERASED) continue;
+
+        /* start a new track for every session */
+        if (page[TRACK_SESSION_OFFSET] != session) {
+            if (session >= 0) printf("    </trkseg>\n  </trk>\n");
+            session = page[TRACK_SESSION_OFFSET];
+            printf("  <trk>\n    <name>Session %d</name>\n    <trkseg>\n", session);
+        }
+
+        points += decode_page(page);
+        bytes += page[TRACK_LENGTH_OFFSET];
+    }
+    if (session >= 0) printf("    </trkseg>\n  </trk>\n");
+    printf("</gpx>\n");
+
+    fprintf(stderr, "%d points in %d bytes (%.2f bytes/fix)\n",
+            points, bytes, points ? (double)bytes/points : 0.0);
+
+    return 0;
+}
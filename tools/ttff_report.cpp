@@ -0,0 +1,151 @@
+/*!
+ * @file
+ *
+ * @brief Host tool reporting the time to first fix of recent rides
+ *
+ * @author Andrew Hayford
+ * @author Sebastian Luy
+ *
+ * @date 12 December, 2015
+ *
+ * This file contains a command line tool which reads the last fix and
+ * the time to first fix (TTFF) log from a raw dump of the device
+ * EEPROM. It prints the TTFF of each logged ride, oldest first, and
+ * the median TTFF of rides with and without GPS aiding.
+ *
+ * Dump the EEPROM with
+ *    avrdude -p m32u4 -c avr109 -P /dev/ttyACM0 -U eeprom:r:eeprom.bin:r
+ *
+ * Build and run with
+ *    g++ -O2 -o ttff_report ttff_report.cpp
+ *    ./ttff_report eeprom.bin
+ *
+ * See last fix format for details on the layout in memory
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/last_fix_format.h"
+#include "../src/track_format.h"
+
+#define EEPROM_SIZE 1024  /*!< Size of the ATmega32u4 EEPROM */
+
+/*!
+ * @brief Decodes a little endian 32 bit value
+ */
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/*!
+ * @brief Decodes a little endian float
+ */
+static float get_float(const uint8_t *p)
+{
+    uint32_t bits = get_u32(p);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/*!
+ * @brief Compares two TTFFs for qsort
+ */
+static int compare(const void *a, const void *b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/*!
+ * @brief Prints the median of a set of TTFFs
+ *
+ * @param[in]  label  Name of the set
+ * @param[in]  ttffs  TTFFs in seconds, sorted in place
+ * @param[in]  count  Number of TTFFs
+ *
+ * @returns    Nothing.
+ *
+ */
+static void print_median(const char *label, double *ttffs, int count)
+{
+    if (count == 0) {
+        printf("%s: no rides\n", label);
+        return;
+    }
+    qsort(ttffs, count, sizeof(double), compare);
+    double median = count % 2 ? ttffs[count/2]
+                              : (ttffs[count/2 - 1] + ttffs[count/2])/2;
+    printf("%s: median %.1f s over %d rides\n", label, median, count);
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t eeprom[EEPROM_SIZE];
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s eeprom.bin\n", argv[0]);
+        return 1;
+    }
+
+    FILE *file = fopen(argv[1], "rb");
+    if (file == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+    size_t size = fread(eeprom, 1, sizeof(eeprom), file);
+    fclose(file);
+
+    if (size < LAST_FIX_TTFF_ADDRESS + 2*LAST_FIX_TTFF_COUNT) {
+        fprintf(stderr, "%s: dump too small\n", argv[1]);
+        return 1;
+    }
+
+    if (eeprom[LAST_FIX_VALID_ADDRESS] == LAST_FIX_VALID) {
+        time_t time = get_u32(eeprom + LAST_FIX_TIME_ADDRESS) + TRACK_EPOCH;
+        char stamp[32];
+        strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&time));
+        printf("last fix %.5f %.5f %.0f m at %s\n",
+               get_float(eeprom + LAST_FIX_LATITUDE_ADDRESS),
+               get_float(eeprom + LAST_FIX_LONGITUDE_ADDRESS),
+               get_float(eeprom + LAST_FIX_ALTITUDE_ADDRESS), stamp);
+    } else {
+        printf("no last fix\n");
+    }
+
+    /* the oldest entry is the one to be overwritten next */
+    int next = eeprom[LAST_FIX_TTFF_INDEX_ADDRESS];
+    if (next >= LAST_FIX_TTFF_COUNT) next = 0;
+
+    double aided[LAST_FIX_TTFF_COUNT], unaided[LAST_FIX_TTFF_COUNT];
+    int aided_count = 0, unaided_count = 0;
+
+    printf("ride\tttff_s\taided\n");
+    for (int i = 0; i < LAST_FIX_TTFF_COUNT; i++) {
+        const uint8_t *p = eeprom + LAST_FIX_TTFF_ADDRESS
+                         + 2*((next + i) % LAST_FIX_TTFF_COUNT);
+        uint16_t entry = p[0] | p[1] << 8;
+        if (entry == LAST_FIX_TTFF_UNUSED) continue;
+
+        bool was_aided = entry & LAST_FIX_TTFF_AIDED;
+        double ttff = (double)(entry & ~LAST_FIX_TTFF_AIDED)/LAST_FIX_TTFF_SCALE;
+        printf("%d\t%.1f\t%s\n", aided_count + unaided_count + 1, ttff,
+               was_aided ? "yes" : "no");
+
+        if (was_aided) {
+            aided[aided_count++] = ttff;
+        } else {
+            unaided[unaided_count++] = ttff;
+        }
+    }
+
+    print_median("aided", aided, aided_count);
+    print_median("unaided", unaided, unaided_count);
+
+    return 0;
+}